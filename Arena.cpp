@@ -0,0 +1,89 @@
+#include "gb-include.h"
+
+#include "Arena.h"
+#include "Mem.h"
+
+// each chunk starts with one of these
+class ArenaChunk {
+ public:
+	char    *m_next;
+	int32_t  m_size;
+};
+
+// the room in chunk "c" starts here. mmalloc() does not align to
+// ARENA_ALIGN because of its UNDERPAD so align the address itself.
+static char *getRoom ( char *c ) {
+	PTRTYPE p = (PTRTYPE)(c + sizeof(ArenaChunk));
+	p = ( p + ARENA_ALIGN - 1 ) & ~((PTRTYPE)ARENA_ALIGN - 1);
+	return (char *)p;
+}
+
+Arena::Arena ( ) {
+	m_chunk     = NULL;
+	m_ptr       = NULL;
+	m_end       = NULL;
+	m_numChunks = 0;
+	m_alloced   = 0;
+}
+
+Arena::~Arena ( ) {
+	reset();
+}
+
+void Arena::reset ( ) {
+	char *c = m_chunk;
+	while ( c ) {
+		ArenaChunk *h = (ArenaChunk *)c;
+		char *next = h->m_next;
+		mfree ( c , h->m_size , "Arena" );
+		c = next;
+	}
+	m_chunk     = NULL;
+	m_ptr       = NULL;
+	m_end       = NULL;
+	m_numChunks = 0;
+	m_alloced   = 0;
+}
+
+// . mmalloc a chunk with "room" bytes after the header and take "size"
+//   bytes of it
+// . returns a ptr to those, NULL with g_errno set on error
+char *Arena::newChunk ( int32_t room , int32_t size ) {
+	int32_t need = sizeof(ArenaChunk) + ARENA_ALIGN - 1 + room;
+	char *c = (char *)mmalloc ( need , "Arena" );
+	if ( ! c ) return NULL;
+	ArenaChunk *h = (ArenaChunk *)c;
+	h->m_size = need;
+	m_numChunks++;
+	m_alloced += need;
+	char *p = getRoom ( c );
+	// a big one gets linked in behind the current chunk so we keep
+	// bumping in what is left of that
+	if ( m_chunk && room == size ) {
+		ArenaChunk *cur = (ArenaChunk *)m_chunk;
+		h->m_next    = cur->m_next;
+		cur->m_next  = c;
+		return p;
+	}
+	h->m_next = m_chunk;
+	m_chunk   = c;
+	m_ptr     = p + size;
+	m_end     = p + room;
+	return p;
+}
+
+char *Arena::alloc ( int32_t size ) {
+	// sanity check
+	if ( size < 0 ) { char *xx=NULL;*xx=0; }
+	// keep the next one aligned
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	// fits in the current chunk?
+	if ( m_ptr && size <= m_end - m_ptr ) {
+		char *p = m_ptr;
+		m_ptr += size;
+		return p;
+	}
+	// a big one gets a chunk to itself
+	if ( size > ARENA_CHUNK_SIZE / 2 ) return newChunk ( size , size );
+	return newChunk ( ARENA_CHUNK_SIZE , size );
+}
@@ -0,0 +1,50 @@
+// . a bump allocator for the buffers an XmlDoc needs while it is parsed
+//   and hashed, like the Xml nodes, the Words and Phrases arrays, the
+//   Sections and the posdb term table
+// . it gets memory from mmalloc() in big chunks and hands it out in order.
+//   nothing is freed until reset() frees all the chunks at once, so Mem's
+//   leak table sees one entry per chunk and not one per buffer.
+// . a class given an arena allocates from it and never frees what it got.
+//   set its m_arena before its first set() and leave it.
+// . a HashTableX that grows leaves its old slots in the arena, so its
+//   slots can take up to twice the memory until the reset
+// . not thread safe, but only one thread at a time works on an XmlDoc
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+// most docs fit in one of these
+#define ARENA_CHUNK_SIZE (256*1024)
+// what alloc() returns is aligned to this
+#define ARENA_ALIGN      16
+
+class Arena {
+
+ public:
+
+	Arena();
+	~Arena();
+
+	// frees all the chunks, everything alloc() returned is gone
+	void reset();
+
+	// returns NULL and sets g_errno on error
+	char *alloc ( int32_t size ) ;
+
+	int32_t getNumChunks ( ) { return m_numChunks; };
+	int64_t getAlloced   ( ) { return m_alloced; };
+
+ private:
+
+	char *newChunk ( int32_t room , int32_t size ) ;
+
+	// the chunk we bump in. the chunks are linked through their headers.
+	char    *m_chunk;
+	// where the next alloc() goes in m_chunk, and its end
+	char    *m_ptr;
+	char    *m_end;
+	int32_t  m_numChunks;
+	int64_t  m_alloced;
+};
+
+#endif
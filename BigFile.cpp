@@ -9,11 +9,13 @@
 #include "Threads.h"
 #include "Stats.h"
 #include "Statsdb.h"
-//#include "DiskPageCache.h"
+#include "DiskPageCache.h"
+#include "IoUring.h"
 
 #ifdef ASYNCIO
 #include <aio.h>
 #endif
+#include <sys/mman.h>
 
 // main.cpp will wait for this to be zero before exiting so all unlink/renames
 // can complete
@@ -24,6 +26,7 @@ int64_t g_lastDiskReadCompleted = 0LL;
 bool      g_diskIsStuck = false;
 
 static void  doneWrapper        ( void *state , ThreadEntry *t ) ;
+static void  ringDoneWrapper    ( FileState *fstate , int32_t err ) ;
 static bool  readwrite_r        ( FileState *fstate , ThreadEntry *t ) ;
 
 BigFile::~BigFile () {
@@ -40,8 +43,9 @@ BigFile::BigFile () {
 	//for ( int32_t i = 0 ; i < MAX_PART_FILES ; i++ ) m_files[i] = NULL;
 	m_maxParts = 0;
 	m_numParts = 0;
-	//m_pc  = NULL;
+	m_pc  = NULL;
 	m_vfd = -1;
+	m_mmapReads = false;
 	//m_vfdAllowed = false;
 	m_fileSize = -1;
 	m_lastModified = -1;
@@ -288,7 +292,7 @@ bool BigFile::open ( int flags ,
 		     int permissions ) {
 
         m_flags       = flags;
-	//m_pc          = pc;
+	if ( pc ) m_pc = (DiskPageCache *)pc;
 	//m_permissions = permissions;
 	m_isClosing   = false;
 	// this is true except when parsing big warc files
@@ -541,42 +545,45 @@ bool BigFile::readwrite ( void         *buf      ,
 	// reset this
 	fstate->m_errno = 0;
 	fstate->m_inPageCache = false;
-	// . try to get as much as we can from page cache first
-	// . the vfd of the big file will be the vfd of its last File class
-	/*
-	if ( ! doWrite && m_pc && allowPageCache ) {
-		//int32_t oldOff  = offset;
-		// we have to set these so RdbScan doesn't freak out if we
-		// have it all cached and return without hitting disk
-		fstate->m_bytesDone = size;
-		fstate->m_bytesToGo = size;
-		// sanity
-		if ( m_vfd == -1 ) { char *xx=NULL;*xx=0; }
-		//log("getting pages off=%"INT64" size=%"INT32"",offset,size);
-		// now we pass in a ptr to the buf ptr, because if buf is NULL
-		// this will allocate one for us if it has some pages in the
-		// cache that we can use.
-		char *readBuf = m_pc->getPages ( m_vfd, offset, size );
-		//log("got     pages off=%"INT64" size=%"INT32"",offset,size);
-		//bufOff = offset - oldOff;
-		// comment out for test
-		if ( readBuf ) {
+	// . the page cache for reads, if allowed
+	// . this re-inits the cache if its max mem parm changed
+	DiskPageCache *pc = NULL;
+	if ( m_pc && allowPageCache && ! doWrite && m_vfd != -1 )
+		pc = getBigFilePageCache ( m_pc->m_rdbId );
+	// . try to get it all from the page cache first
+	// . only alloc the buf if it is all there
+	if ( pc && pc->getPages ( m_vfd , offset , size , NULL ) ) {
+		char *readBuf = (char *)buf;
+		int32_t need = size + allocOff;
+		if ( ! readBuf ) {
+			allocBuf = (char *)mmalloc ( need , "PageCacheBuf" );
+			if ( allocBuf ) readBuf = allocBuf + allocOff;
+		}
+		// a page might have been evicted since we checked
+		if ( readBuf && pc->getPages ( m_vfd,offset,size,readBuf ) ) {
 			// let caller/RdbScan know about the newly alloc'd buf
-			fstate->m_buf         = (char *)readBuf;
-			fstate->m_allocBuf    = readBuf;
-			fstate->m_allocSize   = size;
-			fstate->m_allocOff    = 0;
+			fstate->m_buf         = readBuf;
+			fstate->m_allocBuf    = allocBuf;
+			fstate->m_allocSize   = need;
+			fstate->m_allocOff    = allocOff;
+			fstate->m_bytesDone   = size;
+			fstate->m_bytesToGo   = size;
+			fstate->m_offset      = offset;
+			fstate->m_doWrite     = doWrite;
 			fstate->m_inPageCache = true;
 			return true;
 		}
-		// check
-		//if ( m_pc->m_isOverriden && size < 0 ) {
-		//	fstate->m_bytesDone += size;
-		//	fstate->m_bytesToGo += size;
-		//	return true;
-		//}
+		if ( allocBuf ) mfree ( allocBuf , need , "PageCacheBuf" );
+		allocBuf = NULL;
 	}
-	*/
+	// . if the kernel has all the pages of the read in memory just
+	//   copy them out of our mmap of the part file, no thread needed
+	// . only for files RdbBase says will not be written to any more
+	if ( m_mmapReads && ! doWrite && g_conf.m_mmapRdbFiles &&
+	     mmapRead ( buf , size , offset , fstate , allocOff ) )
+		return true;
+	// do not leave stale pages in the cache for what we write
+	if ( doWrite && m_pc ) m_pc->rmPages ( m_vfd , offset , size );
 	// sanity check. if you set hitDisk to false, you must allow
 	// us to check the page cache! silly bean!
 	if ( ! allowPageCache && ! hitDisk ) { char*xx=NULL;*xx=0; }
@@ -669,9 +676,10 @@ bool BigFile::readwrite ( void         *buf      ,
 	fstate->m_errno       = 0;
 	fstate->m_errno2      = 0;
 	fstate->m_startTime   = gettimeofdayInMilliseconds();
-	//fstate->m_pc          = NULL;//m_pc;
-	// if ( ! allowPageCache )
-	// 	fstate->m_pc = NULL;
+	// . where to add the pages we read when done
+	// . for writes we drop the written pages again when done
+	fstate->m_pc          = pc;
+	if ( doWrite ) fstate->m_pc = m_pc;
 	fstate->m_vfd         = m_vfd;
 	// if hitDisk was false we only check the page cache!
 	if ( ! hitDisk ) return true;
@@ -690,6 +698,11 @@ bool BigFile::readwrite ( void         *buf      ,
 	if ( g_threads.m_disabled ) goto skipThread;
 	if ( ! g_conf.m_useThreads ) goto skipThread;
 
+	// . put it on the io_uring instead of using a thread if we can
+	// . Loop::doPoll() submits it and calls doneWrapper() when done
+	if ( g_conf.m_useIoUring && g_ioUring.submit(fstate,ringDoneWrapper) )
+		return false;
+
 
 #ifdef ASYNCIO
 	goto skipThread;
@@ -910,13 +923,15 @@ bool BigFile::readwrite ( void         *buf      ,
 	//		    now,
 	//		    fstate->m_bytesDone);
 
-	// store read/written pages into page cache
-	// if ( ! g_errno && fstate->m_pc )
-	// 	fstate->m_pc->addPages ( fstate->m_vfd       ,
-	// 				 fstate->m_offset    ,
-	// 				 fstate->m_bytesDone ,
-	// 				 fstate->m_buf       ,
-	// 				 fstate->m_niceness  );
+	// store read pages into page cache
+	if ( ! g_errno && fstate->m_pc && ! doWrite )
+		fstate->m_pc->addPages ( fstate->m_vfd       ,
+					 fstate->m_offset    ,
+					 fstate->m_bytesDone ,
+					 fstate->m_buf       ,
+					 fstate->m_niceness  );
+	if ( fstate->m_pc && doWrite )
+		fstate->m_pc->rmPages ( fstate->m_vfd , offset , size );
 	// now log our stuff here
 	if ( g_errno && g_errno != EBADENGINEER ) 
 		log("disk: readwrite: %s", mstrerror(g_errno));
@@ -951,6 +966,15 @@ bool BigFile::readwrite ( void         *buf      ,
 	return true;
 }
 
+// . called by g_ioUring when a read/write it did for us is done
+// . make it look like a disk thread exited
+static void ringDoneWrapper ( FileState *fstate , int32_t err ) {
+	ThreadEntry t;
+	t.m_exitTime = gettimeofdayInMilliseconds();
+	t.m_errno    = err;
+	doneWrapper ( fstate , &t );
+}
+
 // . this should be called from the main process after getting our call OUR callback here
 void doneWrapper ( void *state , ThreadEntry *t ) {
 
@@ -996,12 +1020,17 @@ void doneWrapper ( void *state , ThreadEntry *t ) {
 	if ( ! g_errno ) g_errno = fstate->m_errno2;
 	// fstate has his own m_pc in case BigFile got deleted, we cannot
 	// reference it...
-	// if ( ! g_errno && fstate->m_pc )
-	// 	fstate->m_pc->addPages ( fstate->m_vfd       ,
-	// 				 fstate->m_offset    ,
-	// 				 fstate->m_bytesDone ,
-	// 				 fstate->m_buf       ,
-	// 				 fstate->m_niceness  );
+	if ( ! g_errno && fstate->m_pc && ! fstate->m_doWrite )
+		fstate->m_pc->addPages ( fstate->m_vfd       ,
+					 fstate->m_offset    ,
+					 fstate->m_bytesDone ,
+					 fstate->m_buf       ,
+					 fstate->m_niceness  );
+	// drop any pages read while we were writing
+	if ( fstate->m_pc && fstate->m_doWrite )
+		fstate->m_pc->rmPages ( fstate->m_vfd       ,
+					fstate->m_offset    ,
+					fstate->m_bytesDone );
 
 	// add the stat
 	if ( ! g_errno ) {
@@ -1524,6 +1553,9 @@ bool BigFile::unlinkRename ( // non-NULL for renames, NULL for unlinks
 		log("disk: Unlink/rename threads are in progress.");
 		return true;
 	}
+	// . do not keep the part files mapped if unlinking or renaming them
+	// . getPartMap() will map them again if we read from them
+	unmapParts();
 	// . is this a rename?
 	// . hack off any directory in newBaseFilename
 	if ( newBaseFilename ) {
@@ -1690,8 +1722,7 @@ bool BigFile::unlinkRename ( // non-NULL for renames, NULL for unlinks
 	if ( m_isUnlink && part == -1 ) {
 		// release it first, cuz the removeThreads() below
 		// may call QUICKPOLL() and we end up reading from same file!
-		// this is no longer needed since we use rdbcache basically now
-		//if ( m_pc ) m_pc->rmVfd ( m_vfd );
+		if ( m_pc ) m_pc->rmVfd ( m_vfd );
 		// remove all queued threads that point to us that have not
 		// yet been launched
 		g_threads.m_threadQueues[DISK_THREAD].removeThreads(this);
@@ -1937,6 +1968,123 @@ void doneUnlinkWrapper ( void *state , ThreadEntry *t ) {
 	if ( THIS->m_callback ) THIS->m_callback ( THIS->m_state );
 }
 
+// do not memcpy more than this in the main thread
+#define MMAP_MAX_READ (2*1024*1024)
+
+// . returns NULL if we could not map part file #n
+// . maps the whole part file the first time it is called for it
+char *BigFile::getPartMap ( int32_t n , int64_t *mapSize ) {
+	// grow our array of maps if we need to, the new ones are zeroed
+	int32_t need  = (n+1) * sizeof(BigFileMap);
+	int32_t delta = need - m_mapsBuf.getLength();
+	if ( delta > 0 ) {
+		if ( ! m_mapsBuf.reserve ( delta , "bfmaps" , true ) )
+			return NULL;
+		m_mapsBuf.setLength ( m_mapsBuf.getCapacity() );
+	}
+	BigFileMap *bm = &((BigFileMap *)m_mapsBuf.getBufStart())[n];
+	if ( bm->m_ptr ) { *mapSize = bm->m_size; return bm->m_ptr; }
+	// mmap() failed before, do not keep trying
+	if ( bm->m_size < 0 ) return NULL;
+	File *f = getFile2 ( n );
+	if ( ! f ) return NULL;
+	int64_t fs = f->getFileSize();
+	if ( fs <= 0 ) return NULL;
+	int32_t saved = g_errno;
+	int fd = getfd ( n , true );
+	g_errno = saved;
+	if ( fd < 0 ) return NULL;
+	// the map stays valid after the fd is closed
+	void *p = mmap ( NULL , fs , PROT_READ , MAP_SHARED , fd , 0 );
+	if ( p == MAP_FAILED ) {
+		log("disk: mmap of %s failed: %s. Using disk threads.",
+		    f->getFilename(),mstrerror(errno));
+		bm->m_size = -1;
+		return NULL;
+	}
+	bm->m_ptr  = (char *)p;
+	bm->m_size = fs;
+	*mapSize   = fs;
+	return bm->m_ptr;
+}
+
+void BigFile::unmapParts ( ) {
+	BigFileMap *maps = (BigFileMap *)m_mapsBuf.getBufStart();
+	int32_t n = m_mapsBuf.getLength() / sizeof(BigFileMap);
+	for ( int32_t i = 0 ; i < n ; i++ ) {
+		if ( maps[i].m_ptr ) munmap ( maps[i].m_ptr , maps[i].m_size );
+		maps[i].m_ptr  = NULL;
+		maps[i].m_size = 0;
+	}
+}
+
+// . returns true if we copied the read out of our mmaps of the part files
+// . returns false if any page of the read is not in memory, in which case
+//   the caller reads it with a disk thread like before
+// . a page could get evicted after we call mincore() in which case the
+//   memcpy blocks on the page fault, but that should be rare
+bool BigFile::mmapRead ( void *buf , int32_t size , int64_t offset ,
+			 FileState *fstate , int32_t allocOff ) {
+	if ( size <= 0 || size > MMAP_MAX_READ ) return false;
+	if ( ! m_usePartFiles ) return false;
+	static int64_t s_osPageSize = 0;
+	if ( s_osPageSize <= 0 ) s_osPageSize = sysconf ( _SC_PAGESIZE );
+	// a read spans at most 2 part files since it is < MAX_PART_SIZE
+	char    *src  [2];
+	int32_t  len  [2];
+	int32_t  numParts = 0;
+	int64_t  off  = offset;
+	int32_t  left = size;
+	unsigned char vec [ MMAP_MAX_READ / 4096 + 2 ];
+	while ( left > 0 ) {
+		int32_t n = off / MAX_PART_SIZE;
+		int64_t mapSize;
+		char *map = getPartMap ( n , &mapSize );
+		if ( ! map ) return false;
+		int64_t start = off - (int64_t)n * MAX_PART_SIZE;
+		int64_t end   = start + left;
+		if ( end > MAX_PART_SIZE ) end = MAX_PART_SIZE;
+		// file might have grown since we mapped it
+		if ( end > mapSize ) return false;
+		// mincore() needs a page aligned address
+		int64_t a  = start & ~(s_osPageSize - 1);
+		int32_t np = (end - a + s_osPageSize - 1) / s_osPageSize;
+		if ( mincore ( map + a , end - a , vec ) ) return false;
+		for ( int32_t i = 0 ; i < np ; i++ )
+			if ( ! ( vec[i] & 0x01 ) ) return false;
+		src[numParts] = map + start;
+		len[numParts] = end - start;
+		numParts++;
+		off  += end - start;
+		left -= end - start;
+	}
+	// allocate the buf if caller did not, like for a page cache hit
+	char *allocBuf = NULL;
+	int32_t need   = size + allocOff;
+	char *dst      = (char *)buf;
+	if ( ! dst ) {
+		allocBuf = (char *)mmalloc ( need , "MmapReadBuf" );
+		if ( ! allocBuf ) { g_errno = 0; return false; }
+		dst = allocBuf + allocOff;
+	}
+	char *p = dst;
+	for ( int32_t i = 0 ; i < numParts ; i++ ) {
+		gbmemcpy ( p , src[i] , len[i] );
+		p += len[i];
+	}
+	// let caller/RdbScan know about the newly alloc'd buf
+	fstate->m_buf         = dst;
+	fstate->m_allocBuf    = allocBuf;
+	fstate->m_allocSize   = need;
+	fstate->m_allocOff    = allocOff;
+	fstate->m_bytesDone   = size;
+	fstate->m_bytesToGo   = size;
+	fstate->m_offset      = offset;
+	fstate->m_doWrite     = false;
+	fstate->m_inPageCache = true;
+	return true;
+}
+
 void BigFile::removePart ( int32_t i ) {
 	//File *f = getFile2(i);
 	File **filePtrs = (File **)m_filePtrsBuf.getBufStart();
@@ -1980,6 +2128,7 @@ bool BigFile::close ( ) {
 	// this end up being called again through a sequence of like 20
 	// subroutines, so put a stop to that circle
 	m_isClosing = true;
+	unmapParts();
 	File **filePtrs = (File **)m_filePtrsBuf.getBufStart();
 	for ( int32_t i = 0 ; i < m_maxParts ; i++ ) {
 		File *f = filePtrs[i];
@@ -2006,15 +2155,14 @@ bool BigFile::close ( ) {
 	// the done wrapper, sending back an error reply, shutting down the 
 	// udp server, calling main.cpp::resetAll(), which resets the Rdb and
 	// free this big file
-	//DiskPageCache *pc  = m_pc;
-	//int32_t           vfd = m_vfd;
+	DiskPageCache *pc  = m_pc;
+	int32_t           vfd = m_vfd;
 
 	// remove all queued threads that point to us that have not
 	// yet been launched
 	g_threads.m_threadQueues[DISK_THREAD].removeThreads(this);
 	// release our pages from the DiskPageCache
-	//if ( m_pc ) m_pc->rmVfd ( m_vfd );
-	//if ( pc ) pc->rmVfd ( vfd );
+	if ( pc ) pc->rmVfd ( vfd );
 	return true;
 }
 
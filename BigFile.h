@@ -81,8 +81,8 @@ public:
 	int64_t       m_doneTime;
 	char m_usePartFiles;
 	// this is used for calling DiskPageCache::addPages() when done 
-	// with the read/write
-	//class DiskPageCache *m_pc;
+	// with the read/write. NULL if not allowed to use the page cache.
+	class DiskPageCache *m_pc;
 	// this is just used for accessing the DiskPageCache, m_pc, it is
 	// a "virtual fd" for this whole file
 	int64_t            m_vfd;
@@ -115,6 +115,13 @@ public:
 };
 
 
+// an mmap of a part file, see BigFile::mmapRead()
+class BigFileMap {
+ public:
+	char    *m_ptr;
+	int64_t  m_size;
+};
+
 class BigFile {
 
  public:
@@ -248,9 +255,20 @@ class BigFile {
 
 	//int64_t m_currentOffset;
 
-	//DiskPageCache *getDiskPageCache ( ) { return m_pc;  };
+	class DiskPageCache *getDiskPageCache ( ) { return m_pc;  };
+	// RdbBase sets this on all of its files, even the ones being dumped
+	// or merged into, which get opened without one
+	void setDiskPageCache ( class DiskPageCache *pc ) { m_pc = pc; };
 	int32_t       getVfd       ( ) { return m_vfd; };
 
+	// . RdbBase turns this on for files that will never be written to
+	//   again, like a finished merge, so reads of pages the kernel
+	//   already has in memory are just a memcpy from an mmap of the
+	//   part file instead of a disk thread
+	// . see mmapRead()
+	void setMmapReads ( bool on ) { m_mmapReads = on; };
+	void unmapParts   ( );
+
 	// WARNING: some may have been unlinked from call to chopHead()
 	int32_t getNumParts ( ) { return m_numParts; };
 
@@ -281,6 +299,11 @@ class BigFile {
 	// to hold the array of Files
 	SafeBuf m_filePtrsBuf;
 
+	// . our mmaps of the part files, a BigFileMap for each part
+	// . only used if m_mmapReads is true
+	SafeBuf m_mapsBuf;
+	bool    m_mmapReads;
+
 	// enough mem for our first File so we can avoid a malloc
 	char m_littleBuf[LITTLEBUFSIZE];
 
@@ -313,6 +336,13 @@ class BigFile {
 			    void *state                       ,
 			    char *newBaseFilenameDir = NULL   ) ;
 
+	// . copy the read from our mmap of the part file(s) if all the pages
+	//   are resident, so we never block the main thread on a page fault
+	// . returns true if it did the read
+	bool mmapRead ( void *buf , int32_t size , int64_t offset ,
+			FileState *fstate , int32_t allocOff );
+	char *getPartMap ( int32_t n , int64_t *mapSize );
+
 	// . add all parts from this directory
 	// . called by set() above for normal dir as well as stripe dir
 	bool addParts ( char *dirname ) ;
@@ -361,7 +391,7 @@ class BigFile {
 	// maximum part #
 	int32_t      m_maxParts;
 
-	//class DiskPageCache *m_pc;
+	class DiskPageCache *m_pc;
 	int32_t             m_vfd;
 	//bool             m_vfdAllowed;
 
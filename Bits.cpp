@@ -5,10 +5,12 @@
 #include "fctypes.h"
 #include "Abbreviations.h"
 #include "Mem.h"
+#include "Arena.h"
 
 Bits::Bits() {
 	m_bits = NULL;
 	m_swbits = NULL;
+	m_arena = NULL;
 }
 
 Bits::~Bits() {
@@ -48,6 +50,8 @@ bool Bits::set ( Words *words , char titleRecVersion , int32_t niceness ,
 	if ( need < BITS_LOCALBUFSIZE ) m_bits = (wbit_t *)m_localBuf;
 	// use provided buf?
 	else if ( need < bufSize ) m_bits = (wbit_t *)buf;
+	// or the arena
+	else if ( m_arena ) m_bits = (wbit_t *)m_arena->alloc ( need );
 	// i guess need to malloc
 	else {
 		m_bitsSize = need;
@@ -466,6 +470,8 @@ bool Bits::setForSummary ( Words *words , char *buf , int32_t bufSize ) {
 	if ( need < BITS_LOCALBUFSIZE ) m_swbits = (swbit_t *)m_localBuf;
 	// use provided buf?
 	else if ( need < bufSize ) m_swbits = (swbit_t *)buf;
+	// or the arena
+	else if ( m_arena ) m_swbits = (swbit_t *)m_arena->alloc ( need );
 	// i guess need to malloc
 	else {
 		m_swbitsSize = need;
@@ -165,6 +165,9 @@ class Bits {
 	swbit_t *m_swbits;
 	int32_t     m_swbitsSize;
 
+	// XmlDoc's arena, alloc from it and do not free
+	class Arena *m_arena;
+
  private:
 
 	Words        *m_words;
@@ -213,6 +213,7 @@ bool Collectiondb::cleanTrees ( ) {
 	r = g_posdb.getRdb();
 	//r->m_tree.cleanTree    ();//(char **)r->m_bases);
 	r->m_buckets.cleanBuckets();
+	if ( r->m_doubleBuffer ) r->m_sealedBuckets.cleanBuckets();
 	//r = g_datedb.getRdb();
 	//r->m_tree.cleanTree    ((char **)r->m_bases);
 
@@ -246,6 +246,14 @@ class Conf {
 
 	int32_t  m_maxCpuThreads;
 	int32_t  m_maxCpuMergeThreads;
+	// run merge and intersect threads in the work stealing pool
+	bool  m_useThreadPool;
+	// workers in that pool, 0 for one per core
+	int32_t  m_threadPoolThreads;
+	// parse and hash docs being indexed in that pool
+	bool  m_useIndexThreads;
+	// how many docid range splits Msg39 may intersect at the same time
+	int32_t  m_maxParallelDocIdSplits;
 
 	int32_t  m_deadHostTimeout;
 	int32_t  m_sendEmailTimeout;
@@ -579,6 +587,46 @@ class Conf {
 
 	bool   m_useSHM;
 	bool   m_useQuickpoll;
+	// use epoll_wait() instead of select() in Loop::doPoll()
+	bool   m_useEpoll;
+	// use io_uring instead of DISK_THREADs in BigFile::readwrite()
+	bool   m_useIoUring;
+	// mmap the rdb map files instead of reading them into memory
+	bool   m_mmapRdbMaps;
+	// memcpy reads of merged rdb files from an mmap if in memory
+	bool   m_mmapRdbFiles;
+	// compress titlerecs with zstd and trained dictionaries
+	bool   m_useZstdTitleRecs;
+	int32_t m_zstdTitleRecLevel;
+	// read and merge the next list while RdbMerge dumps the last one
+	bool   m_mergeReadAhead;
+	// MERGE_POLICY_* from RdbBase.h and its tuning knobs
+	int32_t m_mergePolicy;
+	int32_t m_mergeSizeRatio;
+	int32_t m_mergeTierMinFiles;
+	// read and send dgrams with recvmmsg()/sendmmsg()
+	bool   m_udpBatchIo;
+	// per host congestion window and rtt based resends for udp sends
+	bool   m_udpCongestionControl;
+	// cache Msg39 replies for this many seconds, 0 to disable
+	int32_t m_msg39CacheMaxAge;
+	int32_t m_msg39CacheMem;
+	// send a shard's msg4 adds once the oldest waited this many ms
+	int32_t m_msg4MaxLatency;
+	bool   m_compressMsg4;
+	// stop launching spiders while a shard's tree is this full
+	int32_t m_spiderBackoffTreePercent;
+	// keep posdb's in memory keys in a concurrent skiplist
+	bool   m_useSkipListMemtable;
+	// seal full posdb buckets and dump them while new ones take adds
+	bool   m_doubleBufferMemtables;
+	// bloom filter bits per key for new titledb, clusterdb, tagdb and
+	// spiderdb files, 0 for none
+	int32_t m_bloomBitsPerKey;
+	// write new linkdb and spiderdb files as compressed blocks
+	bool    m_useBlockCompression;
+	// use RdbStripedCache instead of RdbCache for Msg3's list caches
+	bool    m_useStripedListCache;
 
 	int64_t m_posdbFileCacheSize;
 	int64_t m_tagdbFileCacheSize;
@@ -586,6 +634,12 @@ class Conf {
 	int64_t m_titledbFileCacheSize;
 	int64_t m_spiderdbFileCacheSize;
 
+	// max mem for the DiskPageCache under BigFile for each rdb
+	int64_t m_posdbPageCacheSize;
+	int64_t m_titledbPageCacheSize;
+	int64_t m_clusterdbPageCacheSize;
+	int64_t m_tagdbPageCacheSize;
+
 	//bool   m_quickpollCoreOnError;
 	bool   m_useShotgun;
 	bool   m_testMem;
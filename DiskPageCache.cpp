@@ -1,18 +1,29 @@
 #include "gb-include.h"
 
 #include "DiskPageCache.h"
-#include "RdbCache.h"
-
-// key = 24 bytes = 192 bits
-// vvvvvvvv vvvvvvvv vvvvvvvv vvvvvvvv v = vfd = unique file handle
-// vvvvvvvv vvvvvvvv vvvvvvvv vvvvvvvv
-// ffffffff ffffffff ffffffff ffffffff f = file read offset
-// ffffffff ffffffff ffffffff ffffffff
-// bbbbbbbb bbbbbbbb bbbbbbbb bbbbbbbb b = bytes to read
-// bbbbbbbb bbbbbbbb bbbbbbbb bbbbbbbb
+#include "Rdb.h"
+#include "Conf.h"
+#include "Mem.h"
+#include "hash.h"
 
+// a page is in exactly one set of one shard. the shard is picked by the
+// hash of the vfd and page number and then the set within that shard.
 
 DiskPageCache::DiskPageCache () {
+	memset ( m_shards , 0 , sizeof(m_shards) );
+	for ( int32_t i = 0 ; i < DPC_SHARDS ; i++ )
+		pthread_mutex_init ( &m_shards[i].m_lock , NULL );
+	m_enabled      = false;
+	m_pageSize     = DPC_PAGE_SIZE;
+	m_rdbId        = -1;
+	m_dbname[0]    = '\0';
+	m_maxMem       = -1;
+	m_numHits      = 0;
+	m_numMisses    = 0;
+	m_numAdds      = 0;
+	m_numDrops     = 0;
+	m_numPagesUsed = 0;
+	m_memAlloced   = 0;
 }
 
 DiskPageCache::~DiskPageCache() {
@@ -20,7 +31,19 @@ DiskPageCache::~DiskPageCache() {
 }
 
 void DiskPageCache::reset() {
-	m_rc.reset();
+	for ( int32_t i = 0 ; i < DPC_SHARDS ; i++ ) {
+		DiskPageShard *s = &m_shards[i];
+		if ( s->m_allocSize )
+			mfree ( s->m_pages , s->m_allocSize , m_dbname );
+		s->m_pages     = NULL;
+		s->m_data      = NULL;
+		s->m_hands     = NULL;
+		s->m_numSets   = 0;
+		s->m_allocSize = 0;
+	}
+	m_numPagesUsed = 0;
+	m_memAlloced   = 0;
+	m_maxMem       = -1;
 }
 
 bool DiskPageCache::init ( const char *dbname ,
@@ -31,80 +54,295 @@ bool DiskPageCache::init ( const char *dbname ,
 
 	snprintf(m_dbname,62,"pg-%s",dbname );
 	m_pageSize = pageSize;
-	m_rdbId = rdbId;
-	m_enabled = true;
+	m_rdbId    = rdbId;
+	m_enabled  = true;
+	m_maxMem   = maxMem;
+
+	// how many sets in each shard?
+	int64_t setSize = (int64_t)DPC_WAYS * m_pageSize;
+	int64_t numSets = maxMem / DPC_SHARDS / setSize;
+	// mmalloc() takes an int, so keep each shard under 1GB
+	int64_t maxSets = 1000000000LL / (setSize + DPC_WAYS*sizeof(DiskPage));
+	if ( numSets > maxSets ) numSets = maxSets;
+	// too small to cache anything?
+	if ( numSets <= 0 ) return true;
+
+	int32_t numPages = numSets * DPC_WAYS;
+	int64_t need =
+		(int64_t)numPages * sizeof(DiskPage) +
+		(int64_t)numPages * m_pageSize       +
+		numSets;
 
-	// disable for now
+	for ( int32_t i = 0 ; i < DPC_SHARDS ; i++ ) {
+		DiskPageShard *s = &m_shards[i];
+		char *p = (char *)mmalloc ( need , m_dbname );
+		if ( ! p ) {
+			log("db: Failed to allocate %"INT64" bytes for %s.",
+			    need,m_dbname);
+			reset();
+			return false;
+		}
+		s->m_pages     = (DiskPage *)p;
+		p += numPages * sizeof(DiskPage);
+		s->m_data      = p;
+		p += (int64_t)numPages * m_pageSize;
+		s->m_hands     = (unsigned char *)p;
+		s->m_numSets   = numSets;
+		s->m_allocSize = need;
+		// all empty
+		for ( int32_t j = 0 ; j < numPages ; j++ ) {
+			s->m_pages[j].m_vfd     = -1;
+			s->m_pages[j].m_pageNum = -1;
+			s->m_pages[j].m_version = 0;
+			s->m_pages[j].m_ref     = 0;
+		}
+		memset ( s->m_hands , 0 , numSets );
+		m_memAlloced += need;
+	}
 	return true;
+}
 
-	return m_rc.init( maxMem ,
-			  -1 , // fixedDataSize (-1->variable)
-			  false , // supportlists?
-			  // see RdbMap.h *PAGE_SIZE. it can be 1k or 32k so
-			  // we pick 4k to be in the middle
-			  maxMem / m_pageSize , // maxCacheNodes
-			  false , // usehalfkeys?
-			  m_dbname ,
-			  false , // loadfromdisk?
-			  24 , // 24 byte key
-			  12 , // data key size?
-			  -1 ); // num ptrs max
+// . returns the page if in the cache, NULL otherwise
+// . sets *shard and *set to where the page is or would be
+DiskPage *DiskPageCache::getPage ( int64_t vfd , int64_t pageNum ,
+				   DiskPageShard **shard , int32_t *set ) {
+	uint64_t h = hash64h ( vfd , pageNum );
+	DiskPageShard *s = &m_shards[h % DPC_SHARDS];
+	*shard = s;
+	*set   = -1;
+	if ( s->m_numSets <= 0 ) return NULL;
+	int32_t n = (h / DPC_SHARDS) % (uint64_t)s->m_numSets;
+	*set = n;
+	DiskPage *pg = &s->m_pages[n * DPC_WAYS];
+	for ( int32_t i = 0 ; i < DPC_WAYS ; i++ , pg++ )
+		if ( pg->m_vfd == vfd && pg->m_pageNum == pageNum )
+			return pg;
+	return NULL;
+}
 
+// . copy [offset,offset+size) of the file into "buf" from the cache
+// . if buf is NULL just see if it is all there
+// . returns false if any of it is not in the cache
+bool DiskPageCache::copyPages ( int64_t vfd , int64_t offset , int64_t size ,
+				char *buf ) {
+	int64_t end = offset + size;
+	int64_t pn  = offset / m_pageSize;
+	for ( ; pn * m_pageSize < end ; pn++ ) {
+		// the bytes we need from this page
+		int64_t pageStart = pn * m_pageSize;
+		int32_t a = 0;
+		int32_t b = m_pageSize;
+		if ( offset > pageStart ) a = offset - pageStart;
+		if ( end < pageStart + m_pageSize ) b = end - pageStart;
+		DiskPageShard *s;
+		int32_t set;
+		DiskPage *pg = getPage ( vfd , pn , &s , &set );
+		if ( ! pg ) return false;
+		// being written to?
+		int32_t v = pg->m_version;
+		__sync_synchronize();
+		if ( v & 0x01 ) return false;
+		if ( pg->m_lo > a || pg->m_hi < b ) return false;
+		if ( buf ) {
+			char *src = s->m_data + (pg - s->m_pages) * m_pageSize;
+			memcpy ( buf + (pageStart + a - offset) , src + a , b-a);
+		}
+		__sync_synchronize();
+		// if it changed from under us what we copied is bad
+		if ( pg->m_version != v ) return false;
+		if ( pg->m_vfd != vfd || pg->m_pageNum != pn ) return false;
+		// for CLOCK
+		pg->m_ref = 1;
+	}
+	return true;
 }
 
-key192_t makePCKey ( int64_t vfd ,
-		     int64_t offset ,
-		     int64_t readSize ) {
-	key192_t k;
-	k.n2 = vfd;
-	k.n1 = readSize;
-	k.n0 = offset;
-	return k;
+bool DiskPageCache::getPages ( int64_t vfd ,
+			       int64_t offset ,
+			       int64_t readSize ,
+			       char   *buf ) {
+	if ( ! m_enabled ) return false;
+	if ( readSize <= 0 ) return false;
+	if ( copyPages ( vfd , offset , readSize , buf ) ) {
+		// do not count the probe as a hit, the copy will count it
+		if ( buf ) __sync_fetch_and_add ( &m_numHits , 1 );
+		return true;
+	}
+	__sync_fetch_and_add ( &m_numMisses , 1 );
+	return false;
 }
 
-char *DiskPageCache::getPages ( int64_t vfd , 
-				int64_t offset , 
-				int64_t readSize ) {
-	if ( ! m_enabled ) return NULL;
-	// disable for now
-	return NULL;
-	// make the key
-	key192_t k = makePCKey ( vfd , offset , readSize );
-	char *rec = NULL;
-	int32_t recSize;
-	bool found = m_rc.getRecord ( (collnum_t)0 , // collnum
-				      (char *)&k ,
-				      &rec ,
-				      &recSize ,
-				      true , // doCopy? for now, yes
-				      -1 , // maxAge, none, permanent vfd
-				      true , // incCounts - stats hits/misses
-				      NULL , // cachedTimeptr
-				      true ); // promote rec?
-	if ( ! found ) return NULL;
-	// sanity
-	if ( recSize != readSize ) { char *xx=NULL;*xx=0; }
-	return rec;
+// . copy src[lo,hi) into the page, dst[lo,hi)
+// . caller must have the shard lock
+void DiskPageCache::addPage ( int64_t vfd , int64_t pageNum ,
+			      int32_t lo , int32_t hi , char *src ) {
+	DiskPageShard *s;
+	int32_t set;
+	DiskPage *pg = getPage ( vfd , pageNum , &s , &set );
+	if ( set < 0 ) return;
+	// if we already have it, extend the valid bytes if we can
+	if ( pg ) {
+		// already have these bytes?
+		if ( pg->m_lo <= lo && pg->m_hi >= hi ) return;
+		// . if not touching we can only keep one range
+		// . keep the bigger one
+		if ( ( hi < pg->m_lo || lo > pg->m_hi ) &&
+		     hi - lo <= pg->m_hi - pg->m_lo )
+			return;
+		char *dst = s->m_data + (pg - s->m_pages) * m_pageSize;
+		pg->m_version++;
+		__sync_synchronize();
+		memcpy ( dst + lo , src , hi - lo );
+		if ( hi < pg->m_lo || lo > pg->m_hi ) {
+			pg->m_lo = lo;
+			pg->m_hi = hi;
+		}
+		else {
+			if ( lo < pg->m_lo ) pg->m_lo = lo;
+			if ( hi > pg->m_hi ) pg->m_hi = hi;
+		}
+		__sync_synchronize();
+		pg->m_version++;
+		return;
+	}
+	// . use CLOCK to find a page in this set to replace
+	// . take an empty one or the first one whose ref bit is not set,
+	//   clearing the ref bits as we go
+	DiskPage *pages = &s->m_pages[set * DPC_WAYS];
+	unsigned char hand = s->m_hands[set];
+	for ( ; ; hand = ( hand + 1 ) % DPC_WAYS ) {
+		pg = &pages[hand];
+		if ( pg->m_vfd == -1 ) break;
+		if ( ! pg->m_ref ) break;
+		pg->m_ref = 0;
+	}
+	s->m_hands[set] = ( hand + 1 ) % DPC_WAYS;
+	if ( pg->m_vfd == -1 ) __sync_fetch_and_add ( &m_numPagesUsed , 1 );
+	else                   __sync_fetch_and_add ( &m_numDrops     , 1 );
+	char *dst = s->m_data + (pg - s->m_pages) * m_pageSize;
+	pg->m_version++;
+	__sync_synchronize();
+	pg->m_vfd     = vfd;
+	pg->m_pageNum = pageNum;
+	pg->m_lo      = lo;
+	pg->m_hi      = hi;
+	pg->m_ref     = 0;
+	memcpy ( dst + lo , src , hi - lo );
+	__sync_synchronize();
+	pg->m_version++;
 }
 
 // returns true if successfully added to the cache, false otherwise
-bool DiskPageCache::addPages ( int64_t vfd , 
-			       int64_t offset , 
+bool DiskPageCache::addPages ( int64_t vfd ,
+			       int64_t offset ,
 			       int64_t readSize ,
 			       char   *buf ,
 			       char    niceness ) {
 	if ( ! m_enabled ) return false;
-	// disable for now
+	if ( readSize <= 0 || ! buf ) return false;
+	if ( m_memAlloced <= 0 ) return false;
+	// . do not let one huge read, like a merge or a big posdb termlist,
+	//   flush out everything else
+	// . this is what 2Q does with its probationary queue, just cheaper
+	if ( readSize > m_memAlloced / 8 ) return false;
+	__sync_fetch_and_add ( &m_numAdds , 1 );
+	int64_t end = offset + readSize;
+	int64_t pn  = offset / m_pageSize;
+	for ( ; pn * m_pageSize < end ; pn++ ) {
+		int64_t pageStart = pn * m_pageSize;
+		int32_t a = 0;
+		int32_t b = m_pageSize;
+		if ( offset > pageStart ) a = offset - pageStart;
+		if ( end < pageStart + m_pageSize ) b = end - pageStart;
+		uint64_t h = hash64h ( vfd , pn );
+		DiskPageShard *s = &m_shards[h % DPC_SHARDS];
+		pthread_mutex_lock ( &s->m_lock );
+		addPage ( vfd , pn , a , b , buf + (pageStart + a - offset) );
+		pthread_mutex_unlock ( &s->m_lock );
+	}
 	return true;
-	// make the key
-	key192_t k = makePCKey ( vfd , offset , readSize );
-	time_t now = getTimeLocal();
-	return m_rc.addRecord ( (collnum_t)0 , // collnum
-				(char *)&k ,
-				buf , 
-				readSize ,
-				NULL , // rec2
-				0 , // recsize2
-				now , //timestamp
-				NULL ); // return rec ptr
+}
+
+// caller must have the shard lock
+void DiskPageCache::dropPage ( DiskPage *pg ) {
+	pg->m_version++;
+	__sync_synchronize();
+	pg->m_vfd     = -1;
+	pg->m_pageNum = -1;
+	pg->m_ref     = 0;
+	__sync_synchronize();
+	pg->m_version++;
+	__sync_fetch_and_add ( &m_numPagesUsed , -1 );
+}
+
+void DiskPageCache::rmPages ( int64_t vfd , int64_t offset , int64_t size ) {
+	if ( m_memAlloced <= 0 ) return;
+	int64_t end = offset + size;
+	int64_t pn  = offset / m_pageSize;
+	for ( ; pn * m_pageSize < end ; pn++ ) {
+		DiskPageShard *s;
+		int32_t set;
+		uint64_t h = hash64h ( vfd , pn );
+		pthread_mutex_lock ( &m_shards[h % DPC_SHARDS].m_lock );
+		DiskPage *pg = getPage ( vfd , pn , &s , &set );
+		if ( pg ) dropPage ( pg );
+		pthread_mutex_unlock ( &s->m_lock );
+	}
+}
+
+void DiskPageCache::rmVfd ( int64_t vfd ) {
+	for ( int32_t i = 0 ; i < DPC_SHARDS ; i++ ) {
+		DiskPageShard *s = &m_shards[i];
+		pthread_mutex_lock ( &s->m_lock );
+		int32_t numPages = s->m_numSets * DPC_WAYS;
+		for ( int32_t j = 0 ; j < numPages ; j++ )
+			if ( s->m_pages[j].m_vfd == vfd )
+				dropPage ( &s->m_pages[j] );
+		pthread_mutex_unlock ( &s->m_lock );
+	}
+}
+
+static DiskPageCache s_pageCaches[4];
+
+DiskPageCache *getBigFilePageCache ( char rdbId ) {
+
+	DiskPageCache *pc = NULL;
+	int64_t maxMem;
+	char *dbname;
+	if ( rdbId == RDB_POSDB ) {
+		pc = &s_pageCaches[0];
+		maxMem = g_conf.m_posdbPageCacheSize;
+		dbname = "posdb";
+	}
+	if ( rdbId == RDB_TITLEDB ) {
+		pc = &s_pageCaches[1];
+		maxMem = g_conf.m_titledbPageCacheSize;
+		dbname = "titledb";
+	}
+	if ( rdbId == RDB_CLUSTERDB ) {
+		pc = &s_pageCaches[2];
+		maxMem = g_conf.m_clusterdbPageCacheSize;
+		dbname = "clusterdb";
+	}
+	if ( rdbId == RDB_TAGDB ) {
+		pc = &s_pageCaches[3];
+		maxMem = g_conf.m_tagdbPageCacheSize;
+		dbname = "tagdb";
+	}
+
+	if ( ! pc ) return NULL;
+
+	if ( maxMem < 0 ) maxMem = 0;
+
+	// did size change? if not, return it
+	if ( pc->m_maxMem == maxMem ) return pc;
+
+	// . re-init or init for the first time here
+	// . if this fails it is just an empty cache
+	if ( ! pc->init ( dbname , rdbId , maxMem ) )
+		log("db: page cache init for %s failed: %s",
+		    dbname,mstrerror(g_errno));
+	// do not keep retrying the alloc
+	pc->m_maxMem = maxMem;
+	return pc;
 }
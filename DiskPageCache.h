@@ -1,13 +1,55 @@
 // Matt Wells, Copyright Jan 2004-2015
 
-// . now we just use RdbCache
+// . a shared cache of file pages that sits under BigFile::readwrite()
 // . when a BigFile is first opened we assign it a unique 'vfd' (virtual fd)
-// . to make the rdbcache key we hash this vfd with the read offset and size
+// . a page is identified by its vfd and page number in the file. the page
+//   may be only partially filled, we store which bytes are valid.
+// . the pages are split into DPC_SHARDS shards, each shard is a set
+//   associative cache of DPC_WAYS pages per set. we evict using the CLOCK
+//   algorithm over the ways of a set.
+// . lookups take no locks. each page has a version which is odd while the
+//   page is being written, so a reader copies the page and then makes sure
+//   the version did not change while copying. any change is a miss.
+// . adds/removes take the shard lock, but they are only done by the main
+//   thread right now anyway.
+// . init() and reset() must only be called by the main thread when no
+//   disk thread is reading from the cache
 
 #ifndef PAGECACHE_H
 #define PAGECACHE_H
 
-#include "RdbCache.h"
+#include <pthread.h>
+
+#define DPC_PAGE_SIZE  (16*1024)
+#define DPC_WAYS       8
+#define DPC_SHARDS     16
+
+class DiskPage {
+ public:
+	// -1 if page slot is empty
+	int64_t  m_vfd;
+	int64_t  m_pageNum;
+	// odd while being written to
+	volatile int32_t m_version;
+	// the valid bytes in the page are [m_lo,m_hi)
+	int32_t  m_lo;
+	int32_t  m_hi;
+	// CLOCK reference bit, set when the page is used
+	volatile char m_ref;
+};
+
+class DiskPageShard {
+ public:
+	// the page headers, m_numSets * DPC_WAYS of them
+	DiskPage      *m_pages;
+	// the page data, DPC_PAGE_SIZE bytes for each DiskPage
+	char          *m_data;
+	// the CLOCK hand for each set
+	unsigned char *m_hands;
+	int32_t        m_numSets;
+	int64_t        m_allocSize;
+	pthread_mutex_t m_lock;
+};
 
 class DiskPageCache {
 
@@ -19,24 +61,35 @@ class DiskPageCache {
 
 	// returns false and sets g_errno if unable to alloc the memory,
 	// true otherwise
-	bool init ( const char *dbname , 
-		    char    rdbId , 
+	bool init ( const char *dbname ,
+		    char    rdbId ,
 		    int64_t maxMem ,
-		    int32_t pageSize );
-
-	// . this returns true iff the entire read was copied into
-	//   "buf" from the page cache
-	// . it will move the used pages to the head of the linked list
-	char *getPages ( int64_t  vfd , 
-			 int64_t  offset , 
-			 int64_t  readSize );
-
-	// after you read/write from/to disk, copy into the page cache
-	bool addPages  ( int64_t  vfd , 
-			 int64_t  offset , 
-			 int64_t  readSize ,
-			 char    *buf , 
-			 char     niceness );
+		    int32_t pageSize = DPC_PAGE_SIZE );
+
+	// . returns true iff the entire read was copied into "buf" from the
+	//   page cache
+	// . if "buf" is NULL we just see if all the pages are in the cache,
+	//   but a later getPages() can still miss if a page gets evicted
+	// . safe to call from a disk thread
+	bool getPages ( int64_t  vfd ,
+			int64_t  offset ,
+			int64_t  readSize ,
+			char    *buf );
+
+	// after you read from disk, copy into the page cache
+	bool addPages ( int64_t  vfd ,
+			int64_t  offset ,
+			int64_t  readSize ,
+			char    *buf ,
+			char     niceness );
+
+	// after you write to disk, drop any pages we have for those bytes
+	void rmPages  ( int64_t  vfd ,
+			int64_t  offset ,
+			int64_t  size );
+
+	// when a file is unlinked drop all its pages
+	void rmVfd    ( int64_t vfd );
 
 	void enableCache () { m_enabled = true ; };
 	void disableCache() { m_enabled = false; };
@@ -45,13 +98,38 @@ class DiskPageCache {
 	int32_t m_pageSize;
 	char m_rdbId;
 	char m_dbname[64];
+	int64_t m_maxMem;
+
+	DiskPageShard m_shards[DPC_SHARDS];
 
-	RdbCache m_rc;
+	// stats for PageStats.cpp, updated atomically
+	int64_t m_numHits;
+	int64_t m_numMisses;
+	int64_t m_numAdds;
+	int64_t m_numDrops;
+	int64_t m_numPagesUsed;
+	int64_t m_memAlloced;
 
-	int64_t getNumHits   () { return m_rc.getNumHits(); }
-	int64_t getNumMisses () { return m_rc.getNumMisses(); }
-	int64_t getMemUsed   () { return m_rc.getMemOccupied(); } 
-	int64_t getMemAlloced() { return m_rc.getMemAlloced(); } 
+	int64_t getNumHits   () { return m_numHits; }
+	int64_t getNumMisses () { return m_numMisses; }
+	int64_t getMemUsed   () { return m_numPagesUsed * m_pageSize; }
+	int64_t getMemAlloced() { return m_memAlloced; }
+
+ private:
+
+	DiskPage *getPage ( int64_t vfd , int64_t pageNum ,
+			    DiskPageShard **shard , int32_t *set );
+	bool      copyPages ( int64_t vfd , int64_t offset , int64_t size ,
+			      char *buf );
+	void      addPage ( int64_t vfd , int64_t pageNum ,
+			    int32_t lo , int32_t hi , char *src );
+	void      dropPage ( DiskPage *pg );
 };
 
+// . get the page cache BigFile uses for the files of this rdb
+// . returns NULL if the rdb does not use a page cache
+// . re-inits the cache if its max mem parm changed
+// . only call this from the main thread
+DiskPageCache *getBigFilePageCache ( char rdbId );
+
 #endif
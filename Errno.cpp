@@ -3,7 +3,7 @@
 #include "Errno.h"
 
 // use our own errno so threads don't fuck with it
-int g_errno;
+__thread int g_errno;
 
 char *mstrerror ( int errnum ) {
 	return mstrerrno ( errnum );
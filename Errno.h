@@ -6,8 +6,10 @@
 #ifndef _MYERRNO_H_
 #define _MYERRNO_H_
 
-// use our own errno so threads don't fuck with it
-extern int g_errno;
+// . use our own errno so threads don't fuck with it
+// . each thread has its own so a thread running XmlDoc code can set and
+//   clear it without the main thread seeing it
+extern __thread int g_errno;
 
 char *mstrerrno ( int errnum ) ;
 char *mstrerror ( int errnum ) ;
@@ -7,12 +7,14 @@
 #include "SafeBuf.h"
 #include "Threads.h"
 #include "Mem.h"     // for mcalloc and mmalloc
+#include "Arena.h"
 
 
 void HashTableX::constructor() {
 	m_buf   = NULL;
 	m_allocName = NULL;
 	m_doFree = false;
+	m_arena = NULL;
 	m_isWritable = true;
 	m_txtBuf = NULL;
 	m_useKeyMagic = false;
@@ -30,6 +32,7 @@ HashTableX::HashTableX () {
 	m_buf   = NULL;
 	m_allocName = NULL;
 	m_doFree = false;
+	m_arena = NULL;
 	m_isWritable = true;
 	m_txtBuf = NULL;
 	m_useKeyMagic = false;
@@ -352,6 +355,12 @@ bool HashTableX::setTableSize ( int32_t oldn , char *buf , int32_t bufSize ) {
 	// use what they gave us if we can
 	m_buf    = buf;
 	m_doFree = false;
+	// from the arena if we have one. m_doFree stays false.
+	if ( ! m_buf && m_arena ) {
+		m_buf     = m_arena->alloc ( need );
+		m_bufSize = need;
+		if ( ! m_buf ) return false;
+	}
 	// alloc if we should
 	if ( ! m_buf ) {
 		m_buf     = (char *)mmalloc ( need , m_allocName);
@@ -491,6 +491,10 @@ class HashTableX {
 	char *m_buf;
 	int32_t  m_bufSize;
 
+	// . XmlDoc's arena, get the slots from it if no buf is given
+	// . they are not freed and growing leaves the old ones in it
+	class Arena *m_arena;
+
 	char m_useKeyMagic;
 
 	int32_t m_ks;
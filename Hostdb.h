@@ -301,6 +301,20 @@ class Host {
 	int64_t      m_dgramsTo;
 	int64_t      m_dgramsFrom;
 
+	// . udp congestion control state for our sends to this host which
+	//   all UdpSlots sending to it share. see UdpSlot::getCcHost().
+	// . m_cwnd is how many dgrams we can have unacked to this host
+	// . m_srtt and m_rttVar are the smoothed round trip time and its
+	//   deviation in microseconds
+	float          m_cwnd;
+	float          m_ssthresh;
+	int32_t        m_inFlight;
+	int32_t        m_srtt;
+	int32_t        m_rttVar;
+	int64_t        m_nextSendTime;
+	int64_t        m_lastCwndCut;
+	int64_t        m_dgramsLost;
+
 	char           m_repairMode;
 
 	// for timing how long the msg39 takes from this host
@@ -0,0 +1,367 @@
+#include "gb-include.h"
+
+#include "IoUring.h"
+#include "BigFile.h"
+#include "Loop.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+// only if our kernel headers know about io_uring, otherwise init() fails
+// and BigFile just keeps using DISK_THREADs
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#define HAVE_IOURING
+#else
+struct io_uring_sqe;
+struct io_uring_cqe;
+#endif
+
+IoUring g_ioUring;
+
+static void gotCompletionsWrapper ( int fd , void *state ) ;
+
+IoUring::IoUring ( ) {
+	m_ringFd      = -1;
+	m_eventFd     = -1;
+	m_initFailed  = false;
+	m_sqRing      = NULL;
+	m_cqRing      = NULL;
+	m_sqes        = NULL;
+	m_numOut      = 0;
+	m_numToSubmit = 0;
+}
+
+IoUring::~IoUring ( ) {
+	reset();
+}
+
+void IoUring::reset ( ) {
+	if ( m_eventFd >= 0 ) {
+		g_loop.unregisterReadCallback ( m_eventFd , this ,
+						gotCompletionsWrapper , true );
+		close ( m_eventFd );
+	}
+	if ( m_sqes ) munmap ( m_sqes , m_sqesSize );
+	if ( m_cqRing && m_cqRing != m_sqRing ) munmap(m_cqRing,m_cqRingSize);
+	if ( m_sqRing ) munmap ( m_sqRing , m_sqRingSize );
+	if ( m_ringFd >= 0 ) close ( m_ringFd );
+	m_ringFd      = -1;
+	m_eventFd     = -1;
+	m_sqRing      = NULL;
+	m_cqRing      = NULL;
+	m_sqes        = NULL;
+	m_numOut      = 0;
+	m_numToSubmit = 0;
+}
+
+bool IoUring::init ( ) {
+	// already did it?
+	if ( m_ringFd >= 0 ) return true;
+	// do not keep trying
+	if ( m_initFailed ) return false;
+	m_initFailed = true;
+
+#ifndef HAVE_IOURING
+	log("disk: io_uring not supported by this build.");
+	g_errno = EBADENGINEER;
+	return false;
+#else
+	struct io_uring_params p;
+	memset ( &p , 0 , sizeof(p) );
+	m_ringFd = syscall ( __NR_io_uring_setup , IOURING_ENTRIES , &p );
+	if ( m_ringFd < 0 ) {
+		m_ringFd = -1;
+		g_errno = errno;
+		log("disk: io_uring_setup: %s. Using disk threads.",
+		    mstrerror(g_errno));
+		return false;
+	}
+
+	// map in the submission and completion queue rings
+	m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	m_cqRingSize = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+	bool single = ( p.features & IORING_FEAT_SINGLE_MMAP );
+	if ( single && m_cqRingSize > m_sqRingSize )
+		m_sqRingSize = m_cqRingSize;
+	void *sq = mmap ( NULL , m_sqRingSize , PROT_READ | PROT_WRITE ,
+			  MAP_SHARED | MAP_POPULATE , m_ringFd ,
+			  IORING_OFF_SQ_RING );
+	if ( sq == MAP_FAILED ) goto hadError;
+	m_sqRing = (char *)sq;
+	if ( single ) m_cqRing = m_sqRing;
+	else {
+		void *cq = mmap ( NULL , m_cqRingSize , PROT_READ|PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE , m_ringFd ,
+				  IORING_OFF_CQ_RING );
+		if ( cq == MAP_FAILED ) goto hadError;
+		m_cqRing = (char *)cq;
+	}
+	{
+	m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+	void *sqes = mmap ( NULL , m_sqesSize , PROT_READ | PROT_WRITE ,
+			    MAP_SHARED | MAP_POPULATE , m_ringFd ,
+			    IORING_OFF_SQES );
+	if ( sqes == MAP_FAILED ) goto hadError;
+	m_sqes = (io_uring_sqe *)sqes;
+	}
+
+	m_sqHead  = (unsigned *)(m_sqRing + p.sq_off.head);
+	m_sqTail  = (unsigned *)(m_sqRing + p.sq_off.tail);
+	m_sqMask  = (unsigned *)(m_sqRing + p.sq_off.ring_mask);
+	m_sqArray = (unsigned *)(m_sqRing + p.sq_off.array);
+	m_cqHead  = (unsigned *)(m_cqRing + p.cq_off.head);
+	m_cqTail  = (unsigned *)(m_cqRing + p.cq_off.tail);
+	m_cqMask  = (unsigned *)(m_cqRing + p.cq_off.ring_mask);
+	m_cqes    = (io_uring_cqe *)(m_cqRing + p.cq_off.cqes);
+
+	// the kernel bumps this eventfd on every completion
+	m_eventFd = eventfd ( 0 , EFD_NONBLOCK | EFD_CLOEXEC );
+	if ( m_eventFd < 0 ) goto hadError;
+	if ( syscall ( __NR_io_uring_register , m_ringFd ,
+		       IORING_REGISTER_EVENTFD , &m_eventFd , 1 ) < 0 )
+		goto hadError;
+	// . niceness 0 so query reads complete in a quickpoll too
+	// . we defer the niceness 1 callbacks if in a quickpoll
+	if ( ! g_loop.registerReadCallback ( m_eventFd , this ,
+					     gotCompletionsWrapper , 0 ) )
+		goto hadError;
+
+	// all reqs are free
+	for ( int32_t i = 0 ; i < IOURING_ENTRIES ; i++ )
+		m_reqs[i].m_next = i + 1;
+	m_reqs[IOURING_ENTRIES-1].m_next = -1;
+	m_freeHead = 0;
+	m_doneHead = -1;
+	m_doneTail = -1;
+	m_initFailed = false;
+	log(LOG_INIT,"disk: Using io_uring for disk reads and writes.");
+	return true;
+
+ hadError:
+	g_errno = errno;
+	log("disk: io_uring init: %s. Using disk threads.",
+	    mstrerror(g_errno));
+	reset();
+	return false;
+#endif
+}
+
+// . fill in an sqe for the next piece of the read/write of this req
+// . returns false if no room
+bool IoUring::queueSqe ( int32_t reqNum ) {
+#ifndef HAVE_IOURING
+	return false;
+#else
+	IoReq     *r  = &m_reqs[reqNum];
+	FileState *fs = r->m_fstate;
+	// is there room in the submission queue?
+	unsigned tail = *m_sqTail;
+	unsigned head = *(volatile unsigned *)m_sqHead;
+	if ( tail - head > *m_sqMask ) return false;
+
+	// . same part file logic as readwrite_r() in BigFile.cpp
+	// . a read/write spanning two part files takes two sqes, one
+	//   after the other
+	int64_t offset      = fs->m_offset + fs->m_bytesDone;
+	int32_t filenum     = offset / MAX_PART_SIZE;
+	int64_t localOffset = offset % MAX_PART_SIZE;
+	int64_t avail       = MAX_PART_SIZE - localOffset;
+	int64_t len         = fs->m_bytesToGo - fs->m_bytesDone;
+	if ( len > avail ) len = avail;
+	if ( ! fs->m_usePartFiles ) {
+		filenum     = 0;
+		localOffset = offset;
+		len         = fs->m_bytesToGo - fs->m_bytesDone;
+	}
+	int fd = -1;
+	if      ( filenum == fs->m_filenum1 ) fd = fs->m_fd1;
+	else if ( filenum == fs->m_filenum2 ) fd = fs->m_fd2;
+
+	r->m_len = len;
+
+	unsigned idx = tail & *m_sqMask;
+	io_uring_sqe *sqe = &m_sqes[idx];
+	memset ( sqe , 0 , sizeof(io_uring_sqe) );
+	sqe->opcode    = fs->m_doWrite ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd        = fd;
+	sqe->off       = localOffset;
+	sqe->addr      = (uint64_t)(fs->m_buf + fs->m_bytesDone);
+	sqe->len       = len;
+	sqe->user_data = reqNum;
+	m_sqArray[idx] = idx;
+	// make sure the kernel sees the sqe before the new tail
+	__sync_synchronize();
+	*m_sqTail = tail + 1;
+	m_numToSubmit++;
+	return true;
+#endif
+}
+
+bool IoUring::submit ( FileState *fstate ,
+		       void (* callback) ( FileState *fs , int32_t err ) ) {
+	if ( ! init() ) return false;
+	// all reqs in use?
+	if ( m_freeHead < 0 ) return false;
+
+	// the open count is how we detect our fd being closed and
+	// re-opened for another file. this is what the thread does right
+	// before it is launched in Threads.cpp.
+	BigFile *f = fstate->m_this;
+	bool forReading = ! fstate->m_doWrite;
+	if ( fstate->m_fd1 < 0 ) {
+		fstate->m_fd1 = f->getfd ( fstate->m_filenum1 , forReading );
+		fstate->m_fd2 = f->getfd ( fstate->m_filenum2 , forReading );
+		fstate->m_closeCount1 = getCloseCount_r ( fstate->m_fd1 );
+		fstate->m_closeCount2 = getCloseCount_r ( fstate->m_fd2 );
+	}
+	if ( fstate->m_fd1 < 0 || fstate->m_fd2 < 0 ) return false;
+
+	// allocate the read buffer here like Threads.cpp does
+	if ( forReading && ! fstate->m_buf && fstate->m_bytesToGo > 0 ) {
+		int32_t need = fstate->m_bytesToGo + fstate->m_allocOff;
+		char *p = (char *) mmalloc ( need , "ThreadReadBuf" );
+		if ( ! p ) return false;
+		fstate->m_buf       = p + fstate->m_allocOff;
+		fstate->m_allocBuf  = p;
+		fstate->m_allocSize = need;
+	}
+
+	int32_t reqNum = m_freeHead;
+	IoReq *r = &m_reqs[reqNum];
+	r->m_fstate   = fstate;
+	r->m_callback = callback;
+	r->m_errno    = 0;
+	fstate->m_bytesDone = 0;
+	if ( ! queueSqe ( reqNum ) ) return false;
+	m_freeHead = r->m_next;
+	r->m_next  = -1;
+	m_numOut++;
+	return true;
+}
+
+void IoUring::flush ( ) {
+	if ( m_ringFd < 0 ) return;
+	// submit all the sqes we queued since the last flush in one call
+	while ( m_numToSubmit > 0 ) {
+		int n = syscall ( __NR_io_uring_enter , m_ringFd ,
+				  m_numToSubmit , 0 , 0 , NULL , 0 );
+		if ( n < 0 && errno == EINTR ) continue;
+		// EAGAIN/EBUSY, kernel is out of resources, try again later
+		if ( n <= 0 ) break;
+		m_numToSubmit -= n;
+	}
+	// call callbacks we could not call in a quickpoll
+	if ( g_loop.m_inQuickPoll ) return;
+	while ( m_doneHead >= 0 ) {
+		int32_t reqNum = m_doneHead;
+		m_doneHead = m_reqs[reqNum].m_next;
+		if ( m_doneHead < 0 ) m_doneTail = -1;
+		callCallback ( reqNum );
+	}
+}
+
+static void gotCompletionsWrapper ( int fd , void *state ) {
+	IoUring *THIS = (IoUring *)state;
+	// reset the eventfd counter
+	uint64_t count;
+	while ( read ( fd , &count , sizeof(count) ) > 0 );
+	THIS->gotCompletions();
+}
+
+void IoUring::gotCompletions ( ) {
+#ifdef HAVE_IOURING
+	for ( ; ; ) {
+		// . re-read it each time, a quickpoll in a callback below
+		//   can call us again and take some cqes
+		unsigned head = *(volatile unsigned *)m_cqHead;
+		__sync_synchronize();
+		if ( head == *(volatile unsigned *)m_cqTail ) break;
+		io_uring_cqe *cqe = &m_cqes[head & *m_cqMask];
+		int32_t    reqNum = cqe->user_data;
+		int32_t    res    = cqe->res;
+		// . let the kernel have the cqe back before we call a
+		//   callback so a re-entered call does not see it again
+		//   and call it twice
+		__sync_synchronize();
+		*m_cqHead = head + 1;
+		IoReq     *r      = &m_reqs[reqNum];
+		FileState *fs     = r->m_fstate;
+		// try again if interrupted
+		if ( res == -EINTR || res == -EAGAIN ) {
+			if ( ! queueSqe ( reqNum ) ) {
+				r->m_errno = -res;
+				reqDone ( reqNum );
+			}
+			continue;
+		}
+		if ( res < 0 ) {
+			r->m_errno = -res;
+			reqDone ( reqNum );
+			continue;
+		}
+		// same as readwrite_r(), the fd was probably stolen from us
+		if ( res == 0 && r->m_len > 0 ) {
+			log("disk: io_uring read of %"INT32" bytes at offset "
+			    "%"INT64" failed because file is too short for "
+			    "that offset?",
+			    r->m_len,fs->m_offset+fs->m_bytesDone);
+			r->m_errno = EBADENGINEER;
+			reqDone ( reqNum );
+			continue;
+		}
+		fs->m_bytesDone += res;
+		// short read or spans two part files? do the rest.
+		if ( fs->m_bytesDone < fs->m_bytesToGo ) {
+			if ( ! queueSqe ( reqNum ) ) {
+				r->m_errno = EBADENGINEER;
+				reqDone ( reqNum );
+			}
+			continue;
+		}
+		reqDone ( reqNum );
+	}
+	// submit any sqes we re-queued above
+	flush();
+#endif
+}
+
+void IoUring::reqDone ( int32_t reqNum ) {
+	IoReq     *r  = &m_reqs[reqNum];
+	FileState *fs = r->m_fstate;
+	// just like readwriteWrapper_r(), if our fd got closed and re-opened
+	// for another file while we were reading, what we read is junk
+	if ( ! fs->m_doWrite &&
+	     ( getCloseCount_r ( fs->m_fd1 ) != fs->m_closeCount1 ||
+	       getCloseCount_r ( fs->m_fd2 ) != fs->m_closeCount2 ) )
+		r->m_errno = EFILECLOSED;
+	g_lastDiskReadCompleted = g_now;
+	// . do not call niceness 1 callbacks from a quickpoll, flush() will
+	//   call them when we are out of it
+	if ( g_loop.m_inQuickPoll && fs->m_niceness > 0 ) {
+		r->m_next = -1;
+		if ( m_doneTail >= 0 ) m_reqs[m_doneTail].m_next = reqNum;
+		else                   m_doneHead = reqNum;
+		m_doneTail = reqNum;
+		return;
+	}
+	callCallback ( reqNum );
+}
+
+void IoUring::callCallback ( int32_t reqNum ) {
+	IoReq *r = &m_reqs[reqNum];
+	FileState *fs = r->m_fstate;
+	void (* callback) ( FileState *, int32_t ) = r->m_callback;
+	int32_t err = r->m_errno;
+	// free it before calling the callback, which may submit another
+	r->m_fstate = NULL;
+	r->m_next   = m_freeHead;
+	m_freeHead  = reqNum;
+	m_numOut--;
+	// set the niceness like Threads.cpp does for thread callbacks
+	char saved = g_niceness;
+	if ( fs->m_niceness >= 1 ) g_niceness = 1;
+	else                       g_niceness = 0;
+	callback ( fs , err );
+	g_niceness = saved;
+}
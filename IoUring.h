@@ -0,0 +1,103 @@
+// Copyright Matt Wells
+
+// . an io_uring backend for BigFile reads and writes
+// . instead of handing each read/write to a DISK_THREAD that does a
+//   blocking pread()/pwrite(), we put it on the submission queue of an
+//   io_uring and the kernel does it
+// . all the reads/writes queued while Loop::doPoll() is calling callbacks
+//   are submitted in one io_uring_enter() call by flush()
+// . the kernel signals an eventfd when they complete, which g_loop polls
+//   like any other fd, so we get hundreds of outstanding reads without
+//   hundreds of thread stacks
+// . we do not use liburing, just the raw system calls
+
+#ifndef _IOURING_H_
+#define _IOURING_H_
+
+// max outstanding reads/writes. if full we fall back to DISK_THREADs.
+#define IOURING_ENTRIES 256
+
+class IoReq {
+ public:
+	class FileState *m_fstate;
+	// called when the whole read/write is done or had an error
+	void (* m_callback) ( class FileState *fstate , int32_t err );
+	// how many bytes the current sqe is reading/writing
+	int32_t m_len;
+	int32_t m_errno;
+	// next in free list or done list
+	int32_t m_next;
+};
+
+class IoUring {
+
+ public:
+
+	IoUring();
+	~IoUring();
+
+	// . set up the ring on first use
+	// . returns false and sets g_errno on error
+	bool init ( );
+	void reset ( );
+
+	// . queue a read/write of the whole fstate
+	// . fstate must be set up by BigFile::readwrite()
+	// . returns false if we could not, so caller should use a thread
+	bool submit ( class FileState *fstate ,
+		      void (* callback) ( class FileState *fs , int32_t err ));
+
+	// . submit the queued sqes to the kernel
+	// . and call the callbacks of reads/writes that completed while
+	//   we were in a quickpoll
+	// . called by Loop::doPoll()
+	void flush ( );
+
+	// read the completions off the completion queue
+	void gotCompletions ( );
+
+	bool isActive ( ) { return m_ringFd >= 0; };
+
+	int32_t m_numOut;
+
+ private:
+
+	bool queueSqe  ( int32_t reqNum );
+	void reqDone   ( int32_t reqNum );
+	void callCallback ( int32_t reqNum );
+
+	int  m_ringFd;
+	int  m_eventFd;
+	// do not keep trying to init if the kernel does not support it
+	bool m_initFailed;
+
+	// the mmap'd rings
+	char     *m_sqRing;
+	char     *m_cqRing;
+	int32_t   m_sqRingSize;
+	int32_t   m_cqRingSize;
+	struct io_uring_sqe *m_sqes;
+	int32_t   m_sqesSize;
+
+	unsigned *m_sqHead;
+	unsigned *m_sqTail;
+	unsigned *m_sqMask;
+	unsigned *m_sqArray;
+	unsigned *m_cqHead;
+	unsigned *m_cqTail;
+	unsigned *m_cqMask;
+	struct io_uring_cqe *m_cqes;
+
+	// sqes we filled in but did not give to io_uring_enter() yet
+	int32_t   m_numToSubmit;
+
+	IoReq     m_reqs[IOURING_ENTRIES];
+	int32_t   m_freeHead;
+	// done but we could not call their callbacks in a quickpoll
+	int32_t   m_doneHead;
+	int32_t   m_doneTail;
+};
+
+extern class IoUring g_ioUring;
+
+#endif
@@ -10,6 +10,8 @@
 #include "Threads.h"
 
 #include "Stats.h"
+#include "IoUring.h"
+#include <sys/epoll.h>
 // raised from 5000 to 10000 because we have more UdpSlots now and Multicast
 // will call g_loop.registerSleepCallback() if it fails to get a UdpSlot to
 // send on.
@@ -163,6 +165,25 @@ static int32_t s_numReadFds = 0;
 static int s_writeFds[MAX_NUM_FDS];
 static int32_t s_numWriteFds = 0;
 
+// . is the fd in s_readFds/s_writeFds? replaces FD_ISSET() on the select
+//   masks since those only go up to FD_SETSIZE
+static char s_inReadFds  [MAX_NUM_FDS];
+static char s_inWriteFds [MAX_NUM_FDS];
+
+// . the fds that select() or epoll_wait() said were ready in doPoll()
+// . the callbacks doPoll() calls can quickpoll which calls doPoll() again,
+//   so [1] is for the doPoll() inside a quickpoll and [0] for the rest
+static int s_readyRead  [2][MAX_NUM_FDS];
+static int32_t s_numReadyRead [2];
+static int s_readyWrite [2][MAX_NUM_FDS];
+static int32_t s_numReadyWrite[2];
+
+// . the epoll descriptor, -1 if using select()
+// . s_epollEvents[fd] is what we last told epoll_ctl() we want for fd
+static int s_epfd = -1;
+static uint32_t s_epollEvents [MAX_NUM_FDS];
+static struct epoll_event s_events [MAX_EPOLL_EVENTS];
+
 void Loop::unregisterCallback ( Slot **slots , int fd , void *state ,
 				void (* callback)(int fd,void *state) ,
 				bool silent , bool forReading ) {
@@ -202,8 +223,9 @@ void Loop::unregisterCallback ( Slot **slots , int fd , void *state ,
 				if ( s_readFds[i] != fd ) continue;
 				s_readFds[i] = s_readFds[s_numReadFds-1];
 				s_numReadFds--;
+				s_inReadFds[fd] = 0;
 				// remove from select mask too
-				FD_CLR(fd,&s_selectMaskRead );
+				if ( ! m_useEpoll ) FD_CLR(fd,&s_selectMaskRead );
 				if ( g_conf.m_logDebugLoop ||
 				     g_conf.m_logDebugTcp )
 					log("loop: unregistering read "
@@ -215,8 +237,9 @@ void Loop::unregisterCallback ( Slot **slots , int fd , void *state ,
 			 	if ( s_writeFds[i] != fd ) continue;
 			 	s_writeFds[i] = s_writeFds[s_numWriteFds-1];
 			 	s_numWriteFds--;
+				s_inWriteFds[fd] = 0;
 			 	// remove from select mask too
-			 	FD_CLR(fd,&s_selectMaskWrite);
+			 	if ( ! m_useEpoll ) FD_CLR(fd,&s_selectMaskWrite);
 				if ( g_conf.m_logDebugLoop ||
 				     g_conf.m_logDebugTcp )
 					log("loop: unregistering write "
@@ -242,6 +265,9 @@ void Loop::unregisterCallback ( Slot **slots , int fd , void *state ,
 		// advance to the next slot
 		s = next;
 	}	
+	// stop epoll from watching for events nobody is waiting on
+	if ( found && m_useEpoll && fd < MAX_NUM_FDS ) updateEpoll ( fd );
+
 	// set our new minTick if we were unregistering a sleep callback
 	if ( fd == MAX_NUM_FDS ) {
 		m_minTick = min;
@@ -313,6 +339,13 @@ bool Loop::addSlot ( bool forReading , int fd, void *state,
 		log("loop: bad fd of %"INT32"",(int32_t)fd);
 		char *xx=NULL;*xx=0; 
 	}
+	// select() can not watch fds past FD_SETSIZE
+	if ( fd < MAX_NUM_FDS && fd >= getMaxFd() ) {
+		g_errno = EBADENGINEER;
+		return log("loop: fd=%i is too big for select(). Turn on "
+			   "\"use epoll\" or lower 'ulimit -n' to %"INT32".",
+			   fd,getMaxFd());
+	}
 	// debug note
 	if (  forReading && (g_conf.m_logDebugLoop || g_conf.m_logDebugTcp) )
 		log("loop: registering read callback sd=%i",fd);
@@ -346,9 +379,10 @@ bool Loop::addSlot ( bool forReading , int fd, void *state,
 		next = m_readSlots [ fd ];
 		m_readSlots  [ fd ] = s;
 		// if not already registered, add to list
-		if ( fd<MAX_NUM_FDS && ! FD_ISSET ( fd,&s_selectMaskRead ) ) {
+		if ( fd<MAX_NUM_FDS && ! s_inReadFds[fd] ) {
 			s_readFds[s_numReadFds++] = fd;
-			FD_SET ( fd,&s_selectMaskRead  );
+			s_inReadFds[fd] = 1;
+			if ( ! m_useEpoll ) FD_SET ( fd,&s_selectMaskRead  );
 			// sanity
 			if ( s_numReadFds>MAX_NUM_FDS){char *xx=NULL;*xx=0;}
 		}
@@ -363,9 +397,10 @@ bool Loop::addSlot ( bool forReading , int fd, void *state,
 	 	m_writeSlots [ fd ] = s;
 	 	//FD_SET ( fd , &m_writefds );
 	 	// if not already registered, add to list
-	 	if ( fd<MAX_NUM_FDS && ! FD_ISSET ( fd,&s_selectMaskWrite ) ) {
+	 	if ( fd<MAX_NUM_FDS && ! s_inWriteFds[fd] ) {
 	 		s_writeFds[s_numWriteFds++] = fd;
-	 		FD_SET ( fd,&s_selectMaskWrite  );
+			s_inWriteFds[fd] = 1;
+	 		if ( ! m_useEpoll ) FD_SET ( fd,&s_selectMaskWrite  );
 	 		// sanity
 	 		if ( s_numWriteFds>MAX_NUM_FDS){char *xx=NULL;*xx=0;}
 	 	}
@@ -387,10 +422,56 @@ bool Loop::addSlot ( bool forReading , int fd, void *state,
 	if ( fd == MAX_NUM_FDS ) return true;
 	// watch out for big bogus fds used for thread exit callbacks
 	if ( fd >  MAX_NUM_FDS ) return true;
+	// tell epoll about the new interest
+	if ( m_useEpoll && ! updateEpoll ( fd ) ) return false;
 	// set fd non-blocking
 	return setNonBlocking ( fd , niceness ) ;
 }
 
+int32_t Loop::getMaxFd ( ) {
+	if ( m_useEpoll ) return MAX_NUM_FDS;
+	return FD_SETSIZE;
+}
+
+// . we are level-triggered, not edge-triggered, because the callbacks
+//   in TcpServer and UdpServer were written for select() and do not
+//   always drain the socket before returning
+// . returns false and sets g_errno on error
+bool Loop::updateEpoll ( int fd ) {
+	uint32_t want = 0;
+	if ( m_readSlots [fd] ) want |= EPOLLIN;
+	if ( m_writeSlots[fd] ) want |= EPOLLOUT;
+	uint32_t have = s_epollEvents[fd];
+	if ( want == have ) return true;
+	struct epoll_event ev;
+	memset ( &ev , 0 , sizeof(ev) );
+	ev.events  = want;
+	ev.data.fd = fd;
+	int op;
+	if      ( ! have ) op = EPOLL_CTL_ADD;
+	else if ( ! want ) op = EPOLL_CTL_DEL;
+	else               op = EPOLL_CTL_MOD;
+ retry:
+	if ( epoll_ctl ( s_epfd , op , fd , &ev ) == 0 ) {
+		s_epollEvents[fd] = want;
+		return true;
+	}
+	if ( errno == EINTR ) goto retry;
+	// . the kernel drops an fd from the epoll set when it is closed,
+	//   so the fd may have been closed and re-opened on us
+	if ( errno == ENOENT && op == EPOLL_CTL_MOD ) {
+		op = EPOLL_CTL_ADD; goto retry; }
+	if ( errno == EEXIST && op == EPOLL_CTL_ADD ) {
+		op = EPOLL_CTL_MOD; goto retry; }
+	// or it was already closed before being unregistered
+	if ( op == EPOLL_CTL_DEL && ( errno == ENOENT || errno == EBADF ) ) {
+		s_epollEvents[fd] = 0;
+		return true;
+	}
+	g_errno = errno;
+	return log("loop: epoll_ctl(fd=%i): %s.",fd,mstrerror(g_errno));
+}
+
 // . now make sure we're listening for an interrupt on this fd
 // . set it non-blocing and enable signal catching for it
 // . listen for an interrupt for this fd
@@ -602,6 +683,7 @@ Loop::Loop ( ) {
 	m_needsToQuickPoll = false;
 	m_canQuickPoll     = false;
 	m_isDoingLoop      = false;
+	m_useEpoll         = false;
 
 	// set all callbacks to NULL so we know they're empty
 	for ( int32_t i = 0 ; i < MAX_NUM_FDS+2 ; i++ ) {
@@ -761,6 +843,21 @@ bool Loop::init ( ) {
 	FD_ZERO(&s_selectMaskWrite);
 	FD_ZERO(&s_selectMaskExcept);
 
+	// . use epoll_wait() instead of select() in doPoll()?
+	// . this can only be changed on startup since all the fds are
+	//   registered with one or the other
+	m_useEpoll = false;
+	if ( g_conf.m_useEpoll && s_epfd < 0 ) s_epfd = epoll_create ( 1024 );
+	if ( g_conf.m_useEpoll && s_epfd < 0 )
+		log("loop: epoll_create: %s. Using select() instead.",
+		    mstrerror(errno));
+	if ( s_epfd >= 0 ) {
+		m_useEpoll = true;
+		// do not give our epoll fd to pdftohtml and friends
+		fcntl ( s_epfd , F_SETFD , FD_CLOEXEC );
+		log ( LOG_INIT , "loop: Using epoll for i/o." );
+	}
+
 	// redhat 9's NPTL doesn't like our async signals
 	if ( ! g_conf.m_allowAsyncSignals ) g_isHot = false;
 #ifdef _VALGRIND_
@@ -1879,6 +1976,77 @@ bool Loop::runLoop ( ) {
 // 	return;
 // }
 
+// . wait up to QUICKPOLL_INTERVAL ms (0 if in quickpoll) for fds to be ready
+// . fills in s_readyRead and s_readyWrite with the fds whose read or write
+//   callbacks we should call
+// . returns -1 and sets errno on error, like select()
+int32_t Loop::getReadyFds ( ) {
+	int32_t k = m_inQuickPoll ? 1 : 0;
+	int *readyRead  = s_readyRead [k];
+	int *readyWrite = s_readyWrite[k];
+	int32_t numReadyRead  = 0;
+	int32_t numReadyWrite = 0;
+	s_numReadyRead [k] = 0;
+	s_numReadyWrite[k] = 0;
+
+	// 10ms for sleepcallbacks so they can be called...
+	// and we need this to be the same as sigalrmhandler() since we
+	// keep track of cpu usage here too, since sigalrmhandler is "VT"
+	// based it only goes off when that much "cpu time" has elapsed.
+	int32_t ms = QUICKPOLL_INTERVAL;
+	if ( m_inQuickPoll ) ms = 0;
+
+	if ( m_useEpoll ) {
+		int n = epoll_wait ( s_epfd, s_events, MAX_EPOLL_EVENTS, ms );
+		if ( n < 0 ) return n;
+		for ( int32_t i = 0 ; i < n ; i++ ) {
+			int      fd = s_events[i].data.fd;
+			uint32_t ev = s_events[i].events;
+			// . select() says an fd is ready on an error or hangup
+			//   so the callback gets the error from read()/write()
+			// . if nobody is registered anymore we will have
+			//   removed it from the epoll set already
+			if ( (ev & (EPOLLIN|EPOLLERR|EPOLLHUP)) &&
+			     m_readSlots[fd] )
+				readyRead[numReadyRead++] = fd;
+			if ( (ev & (EPOLLOUT|EPOLLERR|EPOLLHUP)) &&
+			     m_writeSlots[fd] )
+				readyWrite[numReadyWrite++] = fd;
+		}
+		s_numReadyRead [k] = numReadyRead;
+		s_numReadyWrite[k] = numReadyWrite;
+		return n;
+	}
+
+	// gotta copy to our own since bits get cleared by select() function
+	fd_set readfds;
+	fd_set writefds;
+	gbmemcpy ( &readfds, &s_selectMaskRead , sizeof(fd_set) );
+	gbmemcpy ( &writefds, &s_selectMaskWrite , sizeof(fd_set) );
+
+	timeval v;
+	v.tv_sec  = 0;
+	v.tv_usec = ms * 1000;
+
+	int n = select ( FD_SETSIZE, &readfds, &writefds, NULL, &v );
+	if ( n <= 0 ) return n;
+
+	// now keep this fast, too. just check fds we need to.
+	for ( int32_t i = 0 ; i < s_numReadFds ; i++ ) {
+		int fd = s_readFds[i];
+		if ( FD_ISSET ( fd , &readfds ) )
+			readyRead[numReadyRead++] = fd;
+	}
+	for ( int32_t i = 0 ; i < s_numWriteFds ; i++ ) {
+		int fd = s_writeFds[i];
+		if ( FD_ISSET ( fd , &writefds ) )
+			readyWrite[numReadyWrite++] = fd;
+	}
+	s_numReadyRead [k] = numReadyRead;
+	s_numReadyWrite[k] = numReadyWrite;
+	return n;
+}
+
 //--- TODO: flush the signal queue after polling until done
 //--- are we getting stale signals resolved by flush so we get
 //--- read event on a socket that isnt in read mode???
@@ -1915,65 +2083,17 @@ void Loop::doPoll ( ) {
 
 	//bool processedOne;
 	int32_t n;
-	//	int32_t repeats = 0;
-	// skipLowerPriorities:
-	// descriptor bits for calling select()
-	// fd_set readfds;
-	// fd_set writefds;
-	// fd_set exceptfds;
-	// clear fds for select()
-	//FD_ZERO ( &readfds   );
-	//FD_ZERO ( &writefds  );
-	//FD_ZERO ( &exceptfds );
-	timeval v;
-	v.tv_sec  = 0;
-	if ( m_inQuickPoll ) v.tv_usec = 0;
-	// 10ms for sleepcallbacks so they can be called...
-	// and we need this to be the same as sigalrmhandler() since we
-	// keep track of cpu usage here too, since sigalrmhandler is "VT"
-	// based it only goes off when that much "cpu time" has elapsed.
-	else                 v.tv_usec = QUICKPOLL_INTERVAL * 1000;  
 
-	//int32_t count = v.tv_usec;
-
-	// set descriptors we should watch
-	// MDW: no longer necessary since we have s_selectMaskRead, etc.
-	// for ( int32_t i = 0 ; i < MAX_NUM_FDS ; i++ ) {
-	// 	if ( m_readSlots [i] ) {
-	// 		FD_SET ( i , &readfds   );
-	// 		FD_SET ( i , &exceptfds );
-	// 	}
-	// 	if ( m_writeSlots[i] ) {
-	// 		FD_SET ( i , &writefds );
-	// 		FD_SET ( i , &exceptfds );
-	// 	}
-	// }
-
-	// gotta copy to our own since bits get cleared by select() function
-	fd_set readfds;
-	fd_set writefds;
+	// submit disk reads queued since the last poll before we wait
+	g_ioUring.flush();
 
 	// only register write callbacks if TcpServer.cpp failed to write
 	// the # of bytes that it wanted to a socket descriptor. and it
 	// should unregister the writecallback as soon as it is able to
 	// write the bytes it wanted to write.
 
-	//FD_ZERO ( &writefds );
-
-	//int64_t startTime = gettimeofdatInMillisecondsLocal();
-
  again:
 
-	//fd_set exceptfds;
-	gbmemcpy ( &readfds, &s_selectMaskRead , sizeof(fd_set) );
-	gbmemcpy ( &writefds, &s_selectMaskWrite , sizeof(fd_set) );
-	//gbmemcpy ( &exceptfds, &s_selectMaskExcept , sizeof(fd_set) );
-
-	// what is the point of fds for writing... its for when we
-	// get a new socket via accept() it is read for writing...
-	//FD_ZERO ( &writefds );
-	//FD_ZERO ( &exceptfds );
-
 	if ( g_conf.m_logDebugLoop )
 		log("loop: in select");
 
@@ -1981,16 +2101,6 @@ void Loop::doPoll ( ) {
 	// sitting idle in select() or are actively doing something w/ the cpu
 	g_inWaitState = true;
 
-	// for ( int32_t i = 0 ; i < MAX_NUM_FDS ; i++ ) {	
-	// 	// continue if not set for reading
-	// 	if ( FD_ISSET ( i , &s_selectMaskRead ) ||
-	// 	     FD_ISSET ( i , &writefds ) ||
-	// 	     FD_ISSET ( i , &exceptfds ) )
-	// 	// debug
-	// 	log("loop: fd %"INT32" is set",i);
-	// 	// if niceness is not -1, handle it below
-	// }
-
 	// . poll the fd's searching for socket closes
 	// . the sigalrms and sigvtalrms and SIGCHLDs knock us out of this
 	//   select() with n < 0 and errno equal to EINTR.
@@ -1998,11 +2108,8 @@ void Loop::doPoll ( ) {
 	//   then when running disableTimer() above and we don't get
 	//   any EINTRs... can we mask those out here? it only seems to be
 	//   the SIGALRMs not the SIGVTALRMs that interrupt us.
-	n = select (MAX_NUM_FDS, 
-		    &readfds,
-		    &writefds,
-		    NULL,//&exceptfds,
-		    &v );
+	// . this fills in s_readyRead and s_readyWrite
+	n = getReadyFds ( );
 
 	g_inWaitState = false;
 
@@ -2010,33 +2117,21 @@ void Loop::doPoll ( ) {
 
 	if ( g_conf.m_logDebugLoop )
 		log("loop: out select n=%"INT32" errno=%"INT32" errnomsg=%s "
-		    "ms_wait=%i",
+		    "epoll=%i",
 		    (int32_t)n,(int32_t)errno,mstrerror(errno),
-		    (int)v.tv_sec*1000);
+		    (int)m_useEpoll);
 
 	if ( n < 0 ) { 
 		// valgrind
 		if ( errno == EINTR ) {
 			// got it. if we get a sig alarm or vt alarm or
 			// SIGCHLD (from Threads.cpp) we end up here.
-			//log("loop: got errno=%"INT32"",(int32_t)errno);
-			// if not linux we have to decrease this by 1ms
-			//count -= 1000; 
-			// and re-assign to wait less time. we are
-			// assuming SIGALRM goes off once per ms and if
-			// that is not what interrupted us we may end
-			// up exiting early
-			//if ( count <= 0 && m_shutdown ) return;
-			// wait less this time around
-			//v.tv_usec = count;
 			// if shutting down was it a sigterm ?
 			if ( m_shutdown ) goto again;
 			// handle returned threads for niceness 0
-			//if ( g_threads.m_needsCleanup )
 			g_threads.timedCleanUp(-3,0); // 3 ms
 			if ( m_inQuickPoll ) goto again;
 			// high niceness threads
-			//if ( g_threads.m_needsCleanup )
 			g_threads.timedCleanUp(-4,MAX_NICENESS); //3 ms
 
 			goto again;
@@ -2046,70 +2141,31 @@ void Loop::doPoll ( ) {
 		return;
 	}
 
-	// if we wait for 10ms with nothing happening, fix cpu usage here too
-	// if ( n == 0 ) {
-	// 	Host *h = g_hostdb.m_myHost;
-	// 	h->m_cpuUsage = .99 * h->m_cpuUsage + .01 * 000;
-	// }
-
 	// debug msg
 	if ( g_conf.m_logDebugLoop) 
 		logf(LOG_DEBUG,"loop: Got %"INT32" fds waiting.",n);
 
+	// the ready fds getReadyFds() got for us
+	int32_t k = m_inQuickPoll ? 1 : 0;
+	int     *readyRead     = s_readyRead    [k];
+	int32_t  numReadyRead  = s_numReadyRead [k];
+	int     *readyWrite    = s_readyWrite   [k];
+	int32_t  numReadyWrite = s_numReadyWrite[k];
+
 	for ( int32_t i = 0 ; 
-	      (g_conf.m_logDebugLoop || g_conf.m_logDebugTcp) && i<MAX_NUM_FDS;
-	      i++){
-	  	// continue if not set for reading
-		 if ( FD_ISSET ( i , &readfds ) )
-			 log("loop: fd=%"INT32" is on for read qp=%i",i,
-			     (int)m_inQuickPoll);
-	 	if ( FD_ISSET ( i , &writefds ) )
-			log("loop: fd=%"INT32" is on for write qp=%i",i,
-			    (int)m_inQuickPoll);
-	 	// if ( FD_ISSET ( i , &exceptfds ) )
-	 	// 	log("loop: fd %"INT32" is on for except",i);
-	  	// debug
-
-	 	// if niceness is not -1, handle it below
-	}
-
-	// . reset the need to poll flag if everything is caught up now
-	// . let's take this out for now ... won't this leave some
-	//   threads hanging, they do not always generate SIGIO's if 
-	//   the sigqueue is full!! LET'S SEE... mdw
-	//if ( n == 0 ) {
-	//	// deal with any threads before returning
-	//	g_threads.cleanUp ( NULL , 1000 /*max niceness*/ );
-	//	g_threads.launchThreads();
-	//	return;
-	//}
-	//processedOne = false;
+	      (g_conf.m_logDebugLoop || g_conf.m_logDebugTcp) && 
+		      i < numReadyRead ; i++ )
+		log("loop: fd=%"INT32" is on for read qp=%i",
+		    (int32_t)readyRead[i],(int)m_inQuickPoll);
+	for ( int32_t i = 0 ; 
+	      (g_conf.m_logDebugLoop || g_conf.m_logDebugTcp) && 
+		      i < numReadyWrite ; i++ )
+		log("loop: fd=%"INT32" is on for write qp=%i",
+		    (int32_t)readyWrite[i],(int)m_inQuickPoll);
 
 	// a Slot ptr
 	Slot *s;
 	g_now = gettimeofdayInMilliseconds();
-	/*
-	// call g_udpServer sig handlers for niceness -1 here
-	for ( int32_t i = 0 ; i < MAX_NUM_FDS ; i++ ) {	
-		// continue if not set for reading
-		if ( ! FD_ISSET ( i , &readfds ) ) continue;
-		// if niceness is not -1, handle it below
-		s = m_readSlots  [ i  ];
-		if ( s && s->m_niceness != -1 ) continue;
-		callCallbacks_ass (true,i, g_now); // for reading = true
-		processedOne = true;
-	}
-	for ( int32_t i = 0 ; i < MAX_NUM_FDS ; i++ ) {
-		if ( ! FD_ISSET ( i , &writefds ) ) continue;
-		// if niceness is not -1, handle it below
-		s = m_writeSlots  [ i ];
-		if ( s && s->m_niceness != -1 ) continue;
-		callCallbacks_ass (false,i, g_now); // for reading = false
-		processedOne = true;
-	}
-	*/
-	// handle returned threads for niceness -1
-	//g_threads.timedCleanUp(2/*ms*/);
 
 	// handle returned threads for niceness 0
 	g_threads.timedCleanUp(-3,0); // 3 ms
@@ -2117,29 +2173,26 @@ void Loop::doPoll ( ) {
 
 	bool calledOne = false;
 
-	// now keep this fast, too. just check fds we need to.
-	for ( int32_t i = 0 ; i < s_numReadFds ; i++ ) {
-		if ( n == 0 ) break;
-		int fd = s_readFds[i];
+	// now keep this fast, too. just check fds that are ready.
+	for ( int32_t i = 0 ; i < numReadyRead ; i++ ) {
+		int fd = readyRead[i];
 	 	s = m_readSlots  [ fd ];
+		// might have been unregistered by a callback we called
+		if ( ! s ) continue;
 	 	// if niceness is not 0, handle it below
-		if ( s && s->m_niceness > 0 ) continue;
-		// must be set
-		if ( ! FD_ISSET ( fd , &readfds ) ) continue;
+		if ( s->m_niceness > 0 ) continue;
 		if ( g_conf.m_logDebugLoop || g_conf.m_logDebugTcp )
 			log("loop: calling cback0 niceness=%"INT32" "
 			    "fd=%i", s->m_niceness , fd );
 		calledOne = true;
 		callCallbacks_ass (true,fd, g_now,0);//read?
 	}
-	for ( int32_t i = 0 ; i < s_numWriteFds ; i++ ) {
-		if ( n == 0 ) break;
-		int fd = s_writeFds[i];
+	for ( int32_t i = 0 ; i < numReadyWrite ; i++ ) {
+		int fd = readyWrite[i];
 	 	s = m_writeSlots  [ fd ];
+		if ( ! s ) continue;
 	 	// if niceness is not 0, handle it below
-		if ( s && s->m_niceness > 0 ) continue;
-		// fds are always ready for writing so take this out.
-		if ( ! FD_ISSET ( fd , &writefds ) ) continue;
+		if ( s->m_niceness > 0 ) continue;
 		if ( g_conf.m_logDebugLoop || g_conf.m_logDebugTcp )
 			log("loop: calling wcback0 niceness=%"INT32" fd=%i"
 			    , s->m_niceness , fd );
@@ -2156,14 +2209,12 @@ void Loop::doPoll ( ) {
 	if ( m_inQuickPoll ) return;
 
 	// now for lower priority fds
-	for ( int32_t i = 0 ; i < s_numReadFds ; i++ ) {
-		if ( n == 0 ) break;
-		int fd = s_readFds[i];
+	for ( int32_t i = 0 ; i < numReadyRead ; i++ ) {
+		int fd = readyRead[i];
 	 	s = m_readSlots  [ fd ];
+		if ( ! s ) continue;
 	  	// if niceness is <= 0 we did it above
-		if ( s && s->m_niceness <= 0 ) continue;
-		// must be set
-		if ( ! FD_ISSET ( fd , &readfds ) ) continue;
+		if ( s->m_niceness <= 0 ) continue;
 		if ( g_conf.m_logDebugLoop || g_conf.m_logDebugTcp )
 			log("loop: calling cback1 niceness=%"INT32" "
 			    "fd=%i", s->m_niceness , fd );
@@ -2171,14 +2222,12 @@ void Loop::doPoll ( ) {
 		callCallbacks_ass (true,fd, g_now,1);//read?
 	}
 
-	for ( int32_t i = 0 ; i < s_numWriteFds ; i++ ) {
-		if ( n == 0 ) break;
-	 	int fd = s_writeFds[i];
+	for ( int32_t i = 0 ; i < numReadyWrite ; i++ ) {
+	 	int fd = readyWrite[i];
 	  	s = m_writeSlots  [ fd ];
+		if ( ! s ) continue;
 	  	// if niceness is <= 0 we did it above
-	 	if ( s && s->m_niceness <= 0 ) continue;
-	 	// must be set
-	 	if ( ! FD_ISSET ( fd , &writefds ) ) continue;
+	 	if ( s->m_niceness <= 0 ) continue;
 		if ( g_conf.m_logDebugLoop || g_conf.m_logDebugTcp )
 			log("loop: calling wcback1 niceness=%"INT32" "
 			    "fd=%i", s->m_niceness , fd );
@@ -2261,6 +2310,8 @@ void Loop::doPoll ( ) {
 		// handle returned threads for all other nicenesses
 		g_threads.timedCleanUp(-4,MAX_NICENESS); // 4 ms
 	}
+	// submit all the disk reads the callbacks above queued in one call
+	g_ioUring.flush();
 	// debug msg
 	if ( g_conf.m_logDebugLoop ) log(LOG_DEBUG,"loop: Exited doPoll.");
 }
@@ -2523,8 +2574,11 @@ void Loop::quickPoll(int32_t niceness, const char* caller, int32_t lineno) {
 		//char *xx=NULL;*xx=0; }
 	}
 
-	// sanity -- temporary -- no quickpoll in a thread!!!
-	//if ( g_threads.amThread() ) { char *xx=NULL;*xx=0; }
+	// . no quickpoll in a thread!!! the handlers it calls are main
+	//   thread only
+	// . XmlDoc code running in a PARSE_THREAD still has its
+	//   QUICKPOLL()s
+	if ( g_threads.amThread() ) return;
 
 	// if we are niceness 1 and not in a handler, make it niceness 2
 	// so the handlers can be answered and we don't slow other
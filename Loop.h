@@ -53,8 +53,15 @@ class Slot {
 #define usleep(a) { char *xx=NULL;*xx=0; }
 //#define sleep(a) logf(LOG_INFO,"sleep: sleep"); 
 
-// linux 2.2 kernel has this limitation
-#define MAX_NUM_FDS 1024
+// . size of our fd->Slot tables. select() is still limited to FD_SETSIZE
+//   (1024) descriptors, but the epoll backend can use all of these.
+// . fd of MAX_NUM_FDS is used for sleep callbacks, so keep this in sync
+//   with 'ulimit -n' on the spider hosts
+#define MAX_NUM_FDS 65536
+
+// max # of ready fds we pull out of epoll_wait() per doPoll(). the rest
+// stay ready (we are level-triggered) and get picked up on the next call.
+#define MAX_EPOLL_EVENTS 4096
 
 
 // . niceness can only be 0, 1 or 2
@@ -200,8 +207,26 @@ class Loop {
 
 	// called when sigqueue overflows and we gotta do a select() or poll()
 	void doPoll ( );
+
+	// . are we using epoll_wait() instead of select() in doPoll()?
+	// . set in init() from g_conf.m_useEpoll, falls back to select() if
+	//   epoll_create() fails
+	bool m_useEpoll;
+
+	// . fds at or above this can not be registered. this is FD_SETSIZE
+	//   when using select() and MAX_NUM_FDS when using epoll.
+	int32_t getMaxFd ( ) ;
+
  private:
 
+	// . add, modify or remove the epoll interest for "fd" so it matches
+	//   what is in m_readSlots[fd] and m_writeSlots[fd]
+	// . returns false and sets g_errno on error
+	bool updateEpoll ( int fd ) ;
+
+	// fill s_readyRead/s_readyWrite from select() or epoll_wait()
+	int32_t getReadyFds ( ) ;
+
 
 	void unregisterCallback ( Slot **slots , int fd , void *state ,
 				  void (* callback)(int fd,void *state) ,
@@ -149,8 +149,70 @@ void mutexUnlock ( ) {
 //** Insure messages will be written to insra **
 //[mwells@lenny c]$ tca -X
 
-// the thread lock
-//static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+// . the thread lock for setting up the leak table
+// . recursive since a log() in addMem() or rmMem() might alloc
+static pthread_mutex_t s_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+// . the leak table is split into MEM_STRIPES runs of buckets. a ptr goes
+//   in the stripe its home bucket is in and its probe wraps inside that
+//   stripe, so an addMem() and the rmMem() of the same ptr always use the
+//   same stripe.
+// . each stripe has its own lock and its own counts, so threads
+//   allocating and freeing different ptrs rarely wait on each other
+// . getNumAllocated() and the other counts add the stripes up when called
+// . but the bytes in use are one atomic total, s_used, since the limit
+//   checks in operator new, gbmalloc() and gbrealloc() read it before
+//   every alloc and should not have to touch every stripe
+#define MEM_STRIPES      16
+// live allocs are also counted by the highest bit of their size
+#define MEM_SIZE_CLASSES 32
+
+class MemStripe {
+public:
+	pthread_mutex_t m_lock;
+	int64_t         m_numTotalAllocated;
+	int32_t         m_numAllocated;
+	int32_t         m_classAllocs[MEM_SIZE_CLASSES];
+} __attribute__((aligned(64)));
+
+// . set up before any constructor runs since operator new uses them
+// . recursive for the same reason as s_lock
+#define MS_INIT { PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP }
+static MemStripe s_stripes[MEM_STRIPES] = {
+	MS_INIT, MS_INIT, MS_INIT, MS_INIT,
+	MS_INIT, MS_INIT, MS_INIT, MS_INIT,
+	MS_INIT, MS_INIT, MS_INIT, MS_INIT,
+	MS_INIT, MS_INIT, MS_INIT, MS_INIT };
+
+// bytes alloced now, only changed with __sync_add_and_fetch()
+static int64_t s_used = 0;
+
+static inline int32_t getSizeClass ( int32_t size ) {
+	if ( size <= 0 ) return 0;
+	return 31 - __builtin_clz ( (uint32_t)size );
+}
+
+// . returns the stripe of "mem" and sets its home bucket in *h and the
+//   buckets of the stripe in [*a,*b)
+// . the last stripe gets the remainder of the table
+static MemStripe *getStripe ( void *mem , uint32_t tableSize ,
+			      uint32_t *h , uint32_t *a , uint32_t *b ) {
+	uint32_t u   = (PTRTYPE)mem * (PTRTYPE)0x4bf60ade;
+	uint32_t per = tableSize / MEM_STRIPES;
+	*h = u % tableSize;
+	int32_t s = *h / per;
+	if ( s >= MEM_STRIPES ) s = MEM_STRIPES - 1;
+	*a = s * per;
+	if ( s == MEM_STRIPES - 1 ) *b = tableSize;
+	else                        *b = *a + per;
+	return &s_stripes[s];
+}
+
+// the lock of the stripe "mem" is in
+static pthread_mutex_t *getMemLock ( void *mem ) {
+	uint32_t h , a , b;
+	return &getStripe ( mem , g_mem.m_memtablesize , &h , &a , &b )->m_lock;
+}
 
 // make it big for production machines
 //#define DMEMTABLESIZE (1024*602)
@@ -167,8 +229,7 @@ static void **s_mptrs ;
 static int32_t  *s_sizes ;
 static char  *s_labels;
 static char  *s_isnew;
-static int32_t   s_n = 0;
-static bool   s_initialized = 0;
+static volatile bool s_initialized = 0;
 
 // our own memory manager
 //static MemPoolVar s_pool;
@@ -256,7 +317,7 @@ void * operator new (size_t size) throw (std::bad_alloc) {
 	//if ( g_hostdb.m_hostId == 0 )  max += 2000000000;
 
 	// don't go over max
-	if ( g_mem.m_used + (int32_t)size >= max &&
+	if ( g_mem.getUsedMem() + (int32_t)size >= max &&
 	     g_conf.m_maxMem > 1000000 ) {
 		log("mem: new(%"UINT32"): Out of memory.", (uint32_t)size );
 		//if ( unlock ) mutexUnlock();
@@ -354,7 +415,7 @@ void * operator new [] (size_t size) throw (std::bad_alloc) {
 	//if ( g_hostdb.m_hostId == 0 )  max += 2000000000;
 
 	// don't go over max
-	if ( g_mem.m_used + (int32_t)size >= max &&
+	if ( g_mem.getUsedMem() + (int32_t)size >= max &&
 	     g_conf.m_maxMem > 1000000 ) {
 		log("mem: new(%"UINT32"): Out of memory.", (uint32_t)size );
 		throw std::bad_alloc();
@@ -429,11 +490,8 @@ newmemloop:
 
 
 Mem::Mem() {
-	m_used = 0;
 	// assume large max until this gets set for real
 	//m_maxMem  = 50000000;
-	m_numAllocated = 0;
-	m_numTotalAllocated = 0;
 	m_maxAlloc = 0;
 	m_maxAllocBy = "";
 	m_maxAlloced = 0;
@@ -572,14 +630,6 @@ void Mem::addMem ( void *mem , int32_t size , const char *note , char isnew ) {
 	}
 
 
-	if ( (int32_t)m_numAllocated + 100 >= (int32_t)m_memtablesize ) { 
-		bool s_printed = false;
-		if ( ! s_printed ) {
-			log("mem: using too many slots");
-			printMem();
-			s_printed = true;
-		}
-	}
 
 	// sanity check
 	if ( g_inSigHandler ) {
@@ -595,7 +645,7 @@ void Mem::addMem ( void *mem , int32_t size , const char *note , char isnew ) {
 	//}
 	if ( g_conf.m_logDebugMem )
 		log("mem: add %08"PTRFMT" %"INT32" bytes (%"INT64") (%s)",
-		    (PTRTYPE)mem,size,m_used,note);
+		    (PTRTYPE)mem,size,getUsedMem(),note);
 
 	//if ( strcmp(note,"RdbList") == 0 ) 
 	//	log("mem: freelist%08"XINT32" %"INT32"bytes (%s)",(int32_t)mem,size,note);
@@ -643,9 +693,9 @@ void Mem::addMem ( void *mem , int32_t size , const char *note , char isnew ) {
 			((char *)mem)[0+size+i] = MAGICCHAR;
 	}
 	// hey!
-	if ( s_pid == -1 && m_numTotalAllocated >1000 ) {
+	if ( s_pid == -1 && getNumTotalAllocated() >1000 ) {
 		log(LOG_WARN, "pid is %i and numAllocs is %i", (int)s_pid,  
-		    (int)m_numTotalAllocated);
+		    (int)getNumTotalAllocated());
         //char *xx=NULL;*xx=0;}
         //	if ( s_pid == -1 && m_numTotalAllocated >1000 ) { char *xx=NULL;*xx=0;}
     }
@@ -662,15 +712,16 @@ void Mem::addMem ( void *mem , int32_t size , const char *note , char isnew ) {
 	// if no label!
 	if ( ! note[0] ) log(LOG_LOGIC,"mem: addmem: NO note.");
 
-	// lock for threads
-	//pthread_mutex_lock ( &s_lock );
 	// return NULL if we'd go over our limit
 	//if ( getUsedMem() + size > s_maxMem ) {
 	//	log("Mem::addMem: max mem limit breeched");
 	//	sleep(50000); 
 	//	return;
 	//}
-	// clear mem ptrs if this is our first call
+	// clear mem ptrs if this is our first call. lock so two threads
+	// do not both do it.
+	bool locked = false;
+	if ( ! s_initialized ) { pthread_mutex_lock ( &s_lock ); locked=true; }
 	if ( ! s_initialized ) {
 
 		s_mptrs  = (void **)sysmalloc ( m_memtablesize*sizeof(void *));
@@ -684,24 +735,43 @@ void Mem::addMem ( void *mem , int32_t size , const char *note , char isnew ) {
 			if ( s_isnew  ) sysfree ( s_isnew );
 			log("mem: addMem: Init failed. Disabling checks.");
 			g_conf.m_detectMemLeaks = false;
+			pthread_mutex_unlock ( &s_lock );
 			return;
 		}
-		s_initialized = true;
 		memset ( s_mptrs , 0 , sizeof(char *) * m_memtablesize );
+		// other threads check it without the lock so the table
+		// must be cleared before they see it set
+		__sync_synchronize();
+		s_initialized = true;
 	}
+	if ( locked ) pthread_mutex_unlock ( &s_lock );
+	// hash into table
+	uint32_t h , a , b;
+	MemStripe *st = getStripe ( mem , m_memtablesize , &h , &a , &b );
+	// the total and the max so far
+	int64_t used , max;
+	// . each stripe gets its share of the table
+	// . this check is done without the lock, it is just a warning
+	if ( st->m_numAllocated + 100 >= (int32_t)(b - a) ) { 
+		static bool s_printed = false;
+		if ( ! s_printed ) {
+			s_printed = true;
+			log("mem: using too many slots");
+			printMem();
+		}
+	}
+	// lock for threads
+	pthread_mutex_lock ( &st->m_lock );
 	// try to add ptr/size/note to leak-detecting table
-	if ( (int32_t)s_n > (int32_t)m_memtablesize ) {
+	if ( st->m_numAllocated >= (int32_t)(b - a) ) {
+		// unlock for threads
+		pthread_mutex_unlock ( &st->m_lock );
 		log("mem: addMem: No room in table for %s size=%"INT32".",
 		    note,size);
-		// unlock for threads
-		//pthread_mutex_unlock ( &s_lock );
 		return;
 	}
-	// hash into table
-	uint32_t u = (PTRTYPE)mem * (PTRTYPE)0x4bf60ade;
-	uint32_t h = u % (uint32_t)m_memtablesize;
 	// chain to an empty bucket
-	int32_t count = (int32_t)m_memtablesize;
+	int32_t count = (int32_t)(b - a);
 	while ( s_mptrs[h] ) {
 		// if an occupied bucket as our same ptr then chances are
 		// we freed without calling rmMem() and a new addMem() got it
@@ -732,7 +802,7 @@ void Mem::addMem ( void *mem , int32_t size , const char *note , char isnew ) {
 			char *xx = NULL; *xx = 0; //sleep(50000);
 		}
 		h++;
-		if ( h == m_memtablesize ) h = 0;
+		if ( h == b ) h = a;
 		if ( --count == 0 ) {
 			log("mem: addMem: Mem table is full.");
 			printMem();
@@ -744,20 +814,20 @@ void Mem::addMem ( void *mem , int32_t size , const char *note , char isnew ) {
 	s_sizes  [ h ] = size;
 	s_isnew  [ h ] = isnew;
 	//log("adding %"INT32" size=%"INT32" to [%"INT32"] #%"INT32" (%s)",
-	//(int32_t)mem,size,h,s_n,note);
-	s_n++;
-	// debug
-	if ( (size > MINMEM && g_conf.m_logDebugMemUsage) || size>=100000000 )
-		log(LOG_INFO,"mem: addMem(%"INT32"): %s. ptr=0x%"PTRFMT" "
-		    "used=%"INT64"",
-		    size,note,(PTRTYPE)mem,m_used);
+	//(int32_t)mem,size,h,st->m_numAllocated,note);
 	// now update used mem
 	// we do this here now since we always call addMem() now
-	m_used += size;
-	m_numAllocated++;
-	m_numTotalAllocated++;
+	used = __sync_add_and_fetch ( &s_used , (int64_t)size );
+	// only a new max writes it, so this is rare
+	max = m_maxAlloced;
+	while ( used > max &&
+		! __sync_bool_compare_and_swap ( &m_maxAlloced , max , used ) )
+		max = m_maxAlloced;
+	st->m_numAllocated++;
+	st->m_numTotalAllocated++;
+	st->m_classAllocs[getSizeClass(size)]++;
+	// these are just stats, let threads race on them
 	if ( size > m_maxAlloc ) { m_maxAlloc = size; m_maxAllocBy = note; }
-	if ( m_used > m_maxAlloced ) m_maxAlloced = m_used;
 
 
  skipMe:
@@ -768,7 +838,13 @@ void Mem::addMem ( void *mem , int32_t size , const char *note , char isnew ) {
 	// make sure NULL terminated
 	here[len] = '\0';
 	// unlock for threads
-	//pthread_mutex_unlock ( &s_lock );
+	pthread_mutex_unlock ( &st->m_lock );
+	// . debug
+	// . log after the unlock since log() might alloc in another stripe
+	if ( (size > MINMEM && g_conf.m_logDebugMemUsage) || size>=100000000 )
+		log(LOG_INFO,"mem: addMem(%"INT32"): %s. ptr=0x%"PTRFMT" "
+		    "used=%"INT64"",
+		    size,note,(PTRTYPE)mem,getUsedMem());
 	//validate();
 }
 
@@ -812,7 +888,7 @@ bool Mem::printMemBreakdownTable ( SafeBuf* sb,
 		       "</tr>" ,
 		       TABLE_STYLE, darkblue , ss , darkblue );
 
-	int32_t n = m_numAllocated * 2;
+	int32_t n = getNumAllocated() * 2;
 	MemEntry *e = (MemEntry *)mcalloc ( sizeof(MemEntry) * n , "Mem" );
 	if ( ! e ) {
 		log("admin: Could not alloc %"INT32" bytes for mem table.",
@@ -938,8 +1014,9 @@ bool Mem::lblMem( void *mem, int32_t size, const char *note ) {
 	// 	return val;
 	// }
 
-	uint32_t u = (PTRTYPE)mem * (PTRTYPE)0x4bf60ade;
-	uint32_t h = u % (uint32_t)m_memtablesize;
+	uint32_t h , a , b;
+	MemStripe *st = getStripe ( mem , m_memtablesize , &h , &a , &b );
+	pthread_mutex_lock ( &st->m_lock );
 	// chain to bucket
 	while( s_mptrs[h] ) {
 		if( s_mptrs[h] == mem ) {
@@ -962,8 +1039,9 @@ bool Mem::lblMem( void *mem, int32_t size, const char *note ) {
 			break;
 		}
 		h++;
-		if ( h == m_memtablesize ) h = 0;
+		if ( h == b ) h = a;
 	}
+	pthread_mutex_unlock ( &st->m_lock );
 
 	if( !val ) log( "mem: lblMem: Mem addr (0x%08"PTRFMT") not found.", 
 			(PTRTYPE)mem );
@@ -997,9 +1075,9 @@ bool Mem::rmMem  ( void *mem , int32_t size , const char *note ) {
 	// don't free 0 bytes
 	if ( size == 0 ) return true;
 	// hey!
-	if ( s_pid == -1 && m_numTotalAllocated >1000 ) {
+	if ( s_pid == -1 && getNumTotalAllocated() >1000 ) {
 		log(LOG_WARN, "pid is %i and numAllocs is %i", 
-		    (int)s_pid,  (int)m_numTotalAllocated);
+		    (int)s_pid,  (int)getNumTotalAllocated());
         //char *xx=NULL;*xx=0;}
 	}
 	// threads can't be here!
@@ -1013,18 +1091,18 @@ bool Mem::rmMem  ( void *mem , int32_t size , const char *note ) {
 		//sigqueue ( s_pid, GB_SIGRTMIN+1 , svt ) ;
 		//return true;
 	}
-	// lock for threads
-	//pthread_mutex_lock ( &s_lock );
 	// . hash by first hashing "mem" to mix it up some
 	// . balance the mallocs/frees
 	// . hash into table
-	uint32_t u = (PTRTYPE)mem * (PTRTYPE)0x4bf60ade;
-	uint32_t h = u % (uint32_t)m_memtablesize;
+	uint32_t h , a , b;
+	MemStripe *st = getStripe ( mem , m_memtablesize , &h , &a , &b );
+	// lock for threads
+	pthread_mutex_lock ( &st->m_lock );
 	// . chain to an empty bucket
 	// . CAUTION: loops forever if no empty bucket
 	while ( s_mptrs[h] && s_mptrs[h] != mem ) {
 		h++;
-		if ( h == m_memtablesize ) h = 0;
+		if ( h == b ) h = a;
 	}
 	// if not found, bitch
 	if ( ! s_mptrs[h] ) {
@@ -1043,7 +1121,7 @@ bool Mem::rmMem  ( void *mem , int32_t size , const char *note ) {
 #endif
 		//sleep(50000);
 		// unlock for threads
-		//pthread_mutex_unlock ( &s_lock );
+		pthread_mutex_unlock ( &st->m_lock );
 		return false;
 	}
 	// are we from the "new" operator
@@ -1068,25 +1146,21 @@ bool Mem::rmMem  ( void *mem , int32_t size , const char *note ) {
 #endif
 		//sleep(50000);
 		// unlock for threads
-		//pthread_mutex_unlock ( &s_lock );
+		pthread_mutex_unlock ( &st->m_lock );
 		return false;
 	}
 
  keepgoing:
-	// debug
-	if ( (size > MINMEM && g_conf.m_logDebugMemUsage) || size>=100000000 )
-		log(LOG_INFO,"mem: rmMem (%"INT32"): "
-		    "ptr=0x%"PTRFMT" %s.",size,(PTRTYPE)mem,note);
-
 	//
 	// we do this here now since we always call rmMem() now
 	//
 	// decrement freed mem
-	m_used -= size;
+	__sync_sub_and_fetch ( &s_used , (int64_t)size );
 	// new/delete does not have padding because the "new"
 	// function can't support it right now
 	//if ( ! isnew ) m_used -= (UNDERPAD + OVERPAD);
-	m_numAllocated--;
+	st->m_numAllocated--;
+	st->m_classAllocs[getSizeClass(size)]--;
 
 	// check for breeches, if we don't do it here, we won't be able
 	// to check this guy for breeches later, cuz he's getting 
@@ -1094,12 +1168,10 @@ bool Mem::rmMem  ( void *mem , int32_t size , const char *note ) {
 	if ( ! isnew ) printBreech ( h , 1 );
 	// empty our bucket, and point to next bucket after us
 	s_mptrs[h++] = NULL;
-	// dec the count
-	s_n--;
 	// wrap if we need to
-	if ( h >= m_memtablesize ) h = 0;
+	if ( h >= b ) h = a;
 	// var decl.
-	uint32_t k;
+	uint32_t k , u;
 	// shit after us may has to be rehashed in case it chained over us
 	while ( s_mptrs[h] ) {
 		// get mem ptr in bucket #h
@@ -1108,14 +1180,14 @@ bool Mem::rmMem  ( void *mem , int32_t size , const char *note ) {
 		u = (PTRTYPE)mem * (PTRTYPE)0x4bf60ade;
 		k= u % (uint32_t)m_memtablesize;
 		// if it's in it, continue
-		if ( k == h ) { h++; continue; }
+		if ( k == h ) { if ( ++h >= b ) h = a; continue; }
 		// otherwise, move it back to fill the gap
 		s_mptrs[h] = NULL;
 		// dec count
 		//s_n--;
 		// if slot #k is full, chain
 		for ( ; s_mptrs[k] ; )
-			if ( ++k >= m_memtablesize ) k = 0;
+			if ( ++k >= b ) k = a;
 		// re-add it to table
 		s_mptrs[k] = (void *)mem;
 		s_sizes[k] = s_sizes[h];
@@ -1124,16 +1196,39 @@ bool Mem::rmMem  ( void *mem , int32_t size , const char *note ) {
 		// try next bucket now
 		h++;
 		// wrap if we need to
-		if ( h >= m_memtablesize ) h = 0;
+		if ( h >= b ) h = a;
 	}
 
 	//validate();
 
 	// unlock for threads
-	//pthread_mutex_unlock ( &s_lock );
+	pthread_mutex_unlock ( &st->m_lock );
+	// . debug
+	// . log after the unlock since log() might alloc in another stripe
+	if ( (size > MINMEM && g_conf.m_logDebugMemUsage) || size>=100000000 )
+		log(LOG_INFO,"mem: rmMem (%"INT32"): "
+		    "ptr=0x%"PTRFMT" %s.",size,(PTRTYPE)mem,note);
 	return true;
 }
 
+int64_t Mem::getUsedMem ( ) {
+	return *(volatile int64_t *)&s_used;
+}
+
+int32_t Mem::getNumAllocated ( ) {
+	int32_t n = 0;
+	for ( int32_t i = 0 ; i < MEM_STRIPES ; i++ )
+		n += s_stripes[i].m_numAllocated;
+	return n;
+}
+
+int64_t Mem::getNumTotalAllocated ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < MEM_STRIPES ; i++ )
+		n += s_stripes[i].m_numTotalAllocated;
+	return n;
+}
+
 int32_t Mem::validate ( ) {
 	if ( ! s_mptrs ) return 1;
 	// stock up "p" and compute total bytes alloced
@@ -1146,21 +1241,22 @@ int32_t Mem::validate ( ) {
 		count++;
 	}
 	// see if it matches
-	if ( total != m_used ) { char *xx=NULL;*xx=0; }
-	if ( count != m_numAllocated ) { char *xx=NULL;*xx=0; }
+	if ( total != getUsedMem() ) { char *xx=NULL;*xx=0; }
+	if ( count != getNumAllocated() ) { char *xx=NULL;*xx=0; }
 	return 1;
 }
 
 
+// . the caller must hold the stripe lock of "mem", see getMemLock()
 int32_t Mem::getMemSlot ( void *mem ) {
 	// hash into table
-	uint32_t u = (PTRTYPE)mem * (PTRTYPE)0x4bf60ade;
-	uint32_t h = u % (uint32_t)m_memtablesize;
+	uint32_t h , a , b;
+	getStripe ( mem , m_memtablesize , &h , &a , &b );
 	// . chain to an empty bucket
 	// . CAUTION: loops forever if no empty bucket
 	while ( s_mptrs[h] && s_mptrs[h] != mem ) {
 		h++;
-		if ( h == m_memtablesize ) h = 0;
+		if ( h == b ) h = a;
 	}
 	// if not found, return -1
 	if ( ! s_mptrs[h] ) return -1;
@@ -1379,7 +1475,16 @@ int Mem::printMem ( ) {
 	log(LOG_INFO,"mem: totalMem alloced now = %"INT64"", total );
 	//log("mem: max alloced at one time = %"INT32"", (int32_t)(m_maxAlloced));
 	log(LOG_INFO,"mem: Memory allocated now: %"INT64".\n", getUsedMem() );
-	log(LOG_INFO,"mem: Num allocs %"INT32".\n", m_numAllocated );
+	log(LOG_INFO,"mem: Num allocs %"INT32".\n", getNumAllocated() );
+	// the live allocs by size class, the highest bit of their size
+	for ( int32_t c = 0 ; c < MEM_SIZE_CLASSES ; c++ ) {
+		int32_t n = 0;
+		for ( int32_t i = 0 ; i < MEM_STRIPES ; i++ )
+			n += s_stripes[i].m_classAllocs[c];
+		if ( n == 0 ) continue;
+		log(LOG_INFO,"mem: %"INT32" allocs of %"INT64" to %"INT64" "
+		    "bytes",n,(int64_t)(1LL<<c),(int64_t)((2LL<<c)-1));
+	}
 	return 1;
 }
 
@@ -1405,9 +1510,10 @@ void *Mem::gbmalloc ( int size , const char *note ) {
 	//if ( g_hostdb.m_hostId == 0 )  max += 2000000000;
 
 	// don't go over max
-	if ( m_used + size + UNDERPAD + OVERPAD >= max ) {
+	if ( getUsedMem() + size + UNDERPAD + OVERPAD >= max ) {
 		// try to free temp mem. returns true if it freed some.
-		if ( freeCacheMem() ) goto retry;
+		// the caches are main thread only
+		if ( ! g_threads.amThread() && freeCacheMem() ) goto retry;
 		g_errno = ENOMEM;
 		log("mem: malloc(%i): Out of memory", size );
 		return NULL;
@@ -1482,13 +1588,14 @@ mallocmemloop:
 	if ( ! mem && size > 0 ) {
 		g_mem.m_outOfMems++;
 		// try to free temp mem. returns true if it freed some.
-		if ( freeCacheMem() ) goto retry;
+		// the caches are main thread only
+		if ( ! g_threads.amThread() && freeCacheMem() ) goto retry;
 		g_errno = errno;
 		static int64_t s_lastTime;
 		static int32_t s_missed = 0;
 		int64_t now = gettimeofdayInMillisecondsLocal();
 		int64_t avail = (int64_t)g_conf.m_maxMem - 
-			(int64_t)m_used;
+			(int64_t)getUsedMem();
 		if ( now - s_lastTime >= 1000LL ) {
 			log("mem: system malloc(%i,%s) availShouldBe=%"INT64": "
 			    "%s (%s) (ooms suppressed since "
@@ -1597,9 +1704,10 @@ void *Mem::gbrealloc ( void *ptr , int oldSize , int newSize ,
 	//if ( g_hostdb.m_hostId == 0 )  max += 2000000000;
 
 	// don't go over max
-	if ( m_used + newSize - oldSize >= max ) {
+	if ( getUsedMem() + newSize - oldSize >= max ) {
 		// try to free temp mem. returns true if it freed some.
-		if ( freeCacheMem() ) goto retry;
+		// the caches are main thread only
+		if ( ! g_threads.amThread() && freeCacheMem() ) goto retry;
 		g_errno = ENOMEM;
 		log("mem: realloc(%i,%i): Out of memory.",oldSize,newSize);
 		return NULL;
@@ -1715,7 +1823,13 @@ void Mem::gbfree ( void *ptr , int size , const char *note ) {
 	// . get how much it was from the mem table
 	// . this is used for alloc/free wrappers for zlib because it does
 	//   not give us a size to free when it calls our mfree(), so we use -1
+	// . a thread's rmMem() can move our slot while we look
+	pthread_mutex_t *lock = getMemLock ( ptr );
+	pthread_mutex_lock ( lock );
 	int32_t slot = g_mem.getMemSlot ( ptr );
+	bool isnew = false;
+	if ( slot >= 0 ) isnew = s_isnew[slot];
+	pthread_mutex_unlock ( lock );
 	if ( slot < 0 ) {
 		log(LOG_LOGIC,"mem: could not find slot (note=%s)",note);
 		//log(LOG_LOGIC,"mem: FIXME!!!");
@@ -1724,8 +1838,6 @@ void Mem::gbfree ( void *ptr , int size , const char *note ) {
 		//char *xx = NULL; *xx = 0;
 	}
 
-	bool isnew = s_isnew[slot];
-
 #ifdef EFENCE
 	// this does a delayed free so do not call rmMem() just yet
 	freeElecMem ((char *)ptr - UNDERPAD );
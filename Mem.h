@@ -19,7 +19,8 @@
 
 extern bool g_inMemFunction;
 
-// we share malloc between threads, so you need to get the lock
+// . threads can malloc and free. the leak table and the counts are split
+//   into stripes with a lock each, see MemStripe in Mem.cpp.
 //void mutexLock   ( );
 //void mutexUnlock ( );
 
@@ -108,7 +109,9 @@ class Mem {
 	//			const char *note);
 
 	// this one does not include new/delete mem, only *alloc()/free() mem
-	int64_t getUsedMem () { return m_used; };
+	// . one atomic total, cheap enough to call before every alloc
+	// . getNumAllocated() and getNumTotalAllocated() add up the stripes
+	int64_t getUsedMem () ;
 	int64_t getAvailMem() ;
 	// the max mem ever alloced
 	int64_t getMaxAlloced() { return m_maxAlloced; };
@@ -117,9 +120,9 @@ class Mem {
 	// the max mem we can use!
 	int64_t getMaxMem () ;
 
-	int32_t getNumAllocated() { return m_numAllocated; };
+	int32_t getNumAllocated() ;
 
-	int64_t getNumTotalAllocated() { return m_numTotalAllocated; };
+	int64_t getNumTotalAllocated() ;
 
 	// # of currently allocated chunks
 	int32_t getNumChunks(); 
@@ -168,14 +171,9 @@ class Mem {
 	// shared mem used
 	int64_t m_sharedUsed;
 
-	// currently used mem (estimate)
-	int64_t m_used;
-
 	// count how many allocs/news failed
 	int32_t m_outOfMems;
 
-	int32_t          m_numAllocated;
-	int64_t     m_numTotalAllocated;
 	uint32_t m_memtablesize;
 
  protected:
@@ -1440,6 +1440,7 @@ void gotListWrapper ( void *state , RdbList *listb , Msg5 *msg5xx ) {
 	// . TODO: dataSize may not equal list->getListMaxSize() so
 	//         Mem class may show an imblanace
 	// . now g_udpServer is responsible for freeing data/dataSize
+	// . the dgrams are sent right out of the list's memory, no copies
 	// . the "true" means to call doneSending_ass() from the signal handler
 	//   if need be
 	st0->m_us->sendReply_ass  ( data            ,
@@ -2,6 +2,8 @@
 
 #include "Msg3.h"
 #include "Rdb.h"
+#include "RdbBlocks.h"
+#include "RdbStripedCache.h"
 #include "Threads.h"
 #include "Stats.h"     // for timing and graphing merge time
 //#include "Sync.h"      // incremental syncing
@@ -50,54 +52,87 @@ key192_t makeCacheKey ( int64_t vfd ,
 }
 
 RdbCache g_rdbCaches[5];
+RdbStripedCache g_stripedCaches[5];
 
-class RdbCache *getDiskPageCache ( char rdbId ) {
-
-	RdbCache *rpc = NULL;
-	int64_t *maxSizePtr = NULL;
-	int64_t maxMem;
-	int64_t maxRecs;
-	char *dbname;
+// . which of the caches above is for "rdbId" and how big it should be
+// . returns -1 if the rdb has no list cache
+static int32_t getListCacheParms ( char rdbId , int64_t *maxMem ,
+				   int64_t *maxRecs , char **dbname ) {
+	int32_t i = -1;
 	if ( rdbId == RDB_POSDB ) {
-		rpc = &g_rdbCaches[0];
-		maxSizePtr = &g_conf.m_posdbFileCacheSize;
-		maxMem = *maxSizePtr;
-		maxRecs = maxMem / 5000;
-		dbname = "posdbcache";
+		i = 0;
+		*maxMem = g_conf.m_posdbFileCacheSize;
+		*maxRecs = *maxMem / 5000;
+		*dbname = "posdbcache";
 	}
 	if ( rdbId == RDB_TAGDB ) {
-		rpc = &g_rdbCaches[1];
-		maxSizePtr = &g_conf.m_tagdbFileCacheSize;
-		maxMem = *maxSizePtr;
-		maxRecs = maxMem / 200;
-		dbname = "tagdbcache";
+		i = 1;
+		*maxMem = g_conf.m_tagdbFileCacheSize;
+		*maxRecs = *maxMem / 200;
+		*dbname = "tagdbcache";
 	}
 	if ( rdbId == RDB_CLUSTERDB ) {
-		rpc = &g_rdbCaches[2];
-		maxSizePtr = &g_conf.m_clusterdbFileCacheSize;
-		maxMem = *maxSizePtr;
-		maxRecs = maxMem / 32;
-		dbname = "clustcache";
+		i = 2;
+		*maxMem = g_conf.m_clusterdbFileCacheSize;
+		*maxRecs = *maxMem / 32;
+		*dbname = "clustcache";
 	}
 	if ( rdbId == RDB_TITLEDB ) {
-		rpc = &g_rdbCaches[3];
-		maxSizePtr = &g_conf.m_titledbFileCacheSize;
-		maxMem = *maxSizePtr;
-		maxRecs = maxMem / 3000;
-		dbname = "titdbcache";
+		i = 3;
+		*maxMem = g_conf.m_titledbFileCacheSize;
+		*maxRecs = *maxMem / 3000;
+		*dbname = "titdbcache";
 	}
 	if ( rdbId == RDB_SPIDERDB ) {
-		rpc = &g_rdbCaches[4];
-		maxSizePtr = &g_conf.m_spiderdbFileCacheSize;
-		maxMem = *maxSizePtr;
-		maxRecs = maxMem / 3000;
-		dbname = "spdbcache";
+		i = 4;
+		*maxMem = g_conf.m_spiderdbFileCacheSize;
+		*maxRecs = *maxMem / 3000;
+		*dbname = "spdbcache";
 	}
+	if ( i >= 0 && *maxMem < 0 ) *maxMem = 0;
+	return i;
+}
 
-	if ( ! rpc )
+// . the thread safe version of the cache below, used instead of it if
+//   the "use striped list caches" parm is on
+// . returns NULL if off or the rdb has no list cache
+class RdbStripedCache *getStripedListCache ( char rdbId ) {
+	if ( ! g_conf.m_useStripedListCache ) return NULL;
+	int64_t maxMem;
+	int64_t maxRecs;
+	char *dbname;
+	int32_t i = getListCacheParms ( rdbId , &maxMem , &maxRecs , &dbname );
+	if ( i < 0 ) return NULL;
+	RdbStripedCache *spc = &g_stripedCaches[i];
+	// did size change? if not, return it
+	if ( spc->getMaxMem() == maxMem )
+		return spc;
+	// free the RdbCache we used before the parm was turned on
+	if ( g_rdbCaches[i].m_maxMem > 0 ) {
+		g_rdbCaches[i].reset();
+		g_rdbCaches[i].m_maxMem = 0;
+	}
+	if ( ! spc->init ( maxMem , maxRecs , dbname , sizeof(key192_t) ) )
+		return NULL;
+	return spc;
+}
+
+class RdbCache *getDiskPageCache ( char rdbId ) {
+
+	// the striped cache is used instead
+	if ( g_conf.m_useStripedListCache ) return NULL;
+
+	int64_t maxMem;
+	int64_t maxRecs;
+	char *dbname;
+	int32_t i = getListCacheParms ( rdbId , &maxMem , &maxRecs , &dbname );
+	if ( i < 0 )
 		return NULL;
+	RdbCache *rpc = &g_rdbCaches[i];
 
-	if ( maxMem < 0 ) maxMem = 0;
+	// free the striped cache we used before the parm was turned off
+	if ( g_stripedCaches[i].getMaxMem() > 0 )
+		g_stripedCaches[i].reset();
 
 	// did size change? if not, return it
 	if ( rpc->m_maxMem == maxMem )
@@ -395,6 +430,14 @@ bool Msg3::readList  ( char           rdbId         ,
 		     m_fileNums[i] <  base->m_mergeStartFileNum + 
 		                      base->m_numFilesToMerge      )
 			continue;
+		// . skip those whose bloom filter says they do not have the
+		//   docid, site or ip we are looking up
+		// . so a titlerec lookup only reads the file that has it
+		if ( m_fileNums[i] >= 0 &&
+		     m_fileNums[i] < base->getNumFiles() &&
+		     ! base->getMap(m_fileNums[i])->mayContain ( startKeyArg ,
+								 endKeyArg ) )
+			continue;
 		// otherwise, keep it
 		m_fileNums[n++] = m_fileNums[i];
 	}
@@ -655,9 +698,11 @@ bool Msg3::readList  ( char           rdbId         ,
 		char tmpKey    [16];
 		char lastTmpKey[16];
 		int32_t ccount = 0;
+		// . a big compressed block spans pages with the same key
 		if ( bytesToRead     > 10000000      && 
 		     bytesToRead / 2 > m_minRecSizes &&
-		     base->m_fixedDataSize >= 0        ) {
+		     base->m_fixedDataSize >= 0      &&
+		     ! maps[fn]->isBlockCompressed()   ) {
 			for ( int32_t pn = p1 ; pn <= p2 ; pn++ ) {
 				maps[fn]->getKey ( pn , tmpKey );
 				if ( KEYCMP(tmpKey,lastTmpKey,m_ks) == 0 ) 
@@ -690,7 +735,8 @@ bool Msg3::readList  ( char           rdbId         ,
 		////////
 		BigFile *ff = base->getFile(m_fileNums[i]);
 		RdbCache *rpc = getDiskPageCache ( m_rdbId );
-		if ( ! m_allowPageCache ) rpc = NULL;
+		RdbStripedCache *spc = getStripedListCache ( m_rdbId );
+		if ( ! m_allowPageCache ) { rpc = NULL; spc = NULL; }
 		// . vfd is unique 64 bit file id
 		// . if file is opened vfd is -1, only set in call to open()
 		int64_t vfd = ff->getVfd();
@@ -705,6 +751,12 @@ bool Msg3::readList  ( char           rdbId         ,
 						   true , // copy?
 						   -1 , // maxAge, none 
 						   true ); // inccounts?
+		if ( spc && vfd != -1 && ! m_validateCache )
+			inCache = spc->getRecord ( (collnum_t)0 , // collnum
+						   (char *)&ck ,
+						   &rec ,
+						   &recSize ,
+						   -1 ); // maxAge, none
 		m_scans[i].m_inPageCache = false;
 		if ( inCache ) {
 			m_scans[i].m_inPageCache = true;
@@ -1065,7 +1117,8 @@ bool Msg3::doneScanning ( ) {
 
 		// compute cache info
 		RdbCache *rpc = getDiskPageCache ( m_rdbId );
-		if ( ! m_allowPageCache ) rpc = NULL;
+		RdbStripedCache *spc = getStripedListCache ( m_rdbId );
+		if ( ! m_allowPageCache ) { rpc = NULL; spc = NULL; }
 		int64_t vfd ;
 		if ( ff ) vfd = ff->getVfd();
 		key192_t ck ;
@@ -1073,16 +1126,23 @@ bool Msg3::doneScanning ( ) {
 			ck = makeCacheKey ( vfd ,
 					    m_scans[i].m_offset ,
 					    m_scans[i].m_bytesToRead );
-		if ( m_validateCache && ff && rpc && vfd != -1 ) {
+		if ( m_validateCache && ff && (rpc || spc) && vfd != -1 ) {
 			bool inCache;
 			char *rec; int32_t recSize;
-			inCache = rpc->getRecord ( (collnum_t)0 , // collnum
-						   (char *)&ck , 
-						   &rec , 
-						   &recSize ,
-						   true , // copy?
-						   -1 , // maxAge, none 
-						   true ); // inccounts?
+			if ( spc )
+				inCache = spc->getRecord ( (collnum_t)0 ,
+							   (char *)&ck ,
+							   &rec ,
+							   &recSize ,
+							   -1 );
+			else
+				inCache = rpc->getRecord ( (collnum_t)0 ,
+							   (char *)&ck ,
+							   &rec ,
+							   &recSize ,
+							   true , // copy?
+							   -1 , // maxAge
+							   true ); // inccounts
 			if ( inCache && 
 			     // 1st byte is RdbScan::m_shifted
 			     ( m_lists[i].m_listSize != recSize-1 ||
@@ -1114,9 +1174,34 @@ bool Msg3::doneScanning ( ) {
 					 m_lists[i].getList() ,
 					 m_lists[i].getListSize() ,
 					 0 ); // timestamp. 0 = now
+		if ( m_retryNum<=0 && ff && spc && vfd != -1 &&
+		     ! m_scans[i].m_inPageCache )
+			spc->addRecord ( (collnum_t)0 , // collnum
+					 (char *)&ck ,
+					 &m_scans[i].m_shifted,
+					 1,
+					 m_lists[i].getList() ,
+					 m_lists[i].getListSize() ,
+					 0 ); // timestamp. 0 = now
 
 		QUICKPOLL(m_niceness);
 
+		// . files of compressed blocks are read a block at a time,
+		//   expand the blocks into a regular list. the page cache
+		//   keeps the compressed blocks.
+		// . the map only knows where the blocks are so no hint
+		if ( ff && base->getMap(m_fileNums[i])->isBlockCompressed() ) {
+			m_hintOffsets[i] = 0;
+			if ( ! uncompressBlockList ( &m_lists[i] ,
+						     base->m_fixedDataSize ,
+						     m_niceness ) ) {
+				log("net: Had error uncompressing list read "
+				    "from %s: %s.",filename,
+				    mstrerror(g_errno));
+				continue;
+			}
+		}
+
 		// if from our 'page' cache, no need to constrain
 		if ( ! m_lists[i].constrain ( m_startKey       ,
 					      m_constrainKey   , // m_endKey
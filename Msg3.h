@@ -7,6 +7,7 @@
 #define MSG3_H
 
 class RdbCache *getDiskPageCache ( char rdbId ) ;
+class RdbStripedCache *getStripedListCache ( char rdbId ) ;
 
 // . max # of rdb files an rdb can have w/o merging
 // . merge your files to keep the number of them low to cut down # of seeks
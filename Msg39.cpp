@@ -7,6 +7,7 @@
 #include "UdpServer.h"
 //#include "CollectionRec.h"
 #include "SearchInput.h"
+#include "RdbCache.h"
 
 // called to send back the reply
 static void  sendReply         ( UdpSlot *slot         ,
@@ -21,6 +22,33 @@ static void  sendReply         ( UdpSlot *slot         ,
 static void *addListsWrapper   ( void *state , ThreadEntry *t ) ;
 //static void  threadDoneWrapper ( void *state , ThreadEntry *t ) ;
 
+// . cache of the serialized Msg39Replies we send back so paging through
+//   the results, or the same query from another frontend, does not
+//   redo the intersection
+// . each rec is the m_docsToGet the reply was made for then the reply
+static RdbCache s_msg39Cache;
+
+void resetMsg39Cache ( ) {
+	s_msg39Cache.reset();
+}
+
+RdbCache *Msg39::getResultsCache ( ) { return &s_msg39Cache; }
+
+bool Msg39::initResultsCache ( ) {
+	int32_t maxMem = g_conf.m_msg39CacheMem;
+	// a reply for 10 docids with scoring info is a few KB
+	int32_t maxNodes = maxMem / 4096;
+	if ( ! s_msg39Cache.init ( maxMem    ,
+				   -1        , // fixedDataSize
+				   false     , // lists of recs?
+				   maxNodes  ,
+				   false     , // use half keys
+				   "msg39"   , // dbname
+				   false     ))// save to disk
+		return false;
+	return true;
+}
+
 bool Msg39::registerHandler ( ) {
 	// . register ourselves with the udp server
 	// . it calls our callback when it receives a msg of type 0x39
@@ -31,6 +59,9 @@ bool Msg39::registerHandler ( ) {
 
 Msg39::Msg39 () {
 	m_inUse = false;
+	m_numSplitWorkers = 0;
+	m_parent = NULL;
+	m_useCache = false;
 	reset();
 }
 
@@ -45,6 +76,15 @@ void Msg39::reset() {
 	m_tmpq.reset();
 	m_numTotalHits = 0;
 	m_gotClusterRecs = 0;
+	// free the docid split workers, if any
+	for ( int32_t i = 0 ; i < m_numSplitWorkers ; i++ ) {
+		mdelete ( m_splitWorkers[i] , sizeof(Msg39) , "Msg39split" );
+		delete ( m_splitWorkers[i] );
+	}
+	m_numSplitWorkers    = 0;
+	m_numSplitWorkersOut = 0;
+	m_splitErrno         = 0;
+	m_launchingSplits    = false;
 	reset2();
 }
 
@@ -105,6 +145,14 @@ void sendReply ( UdpSlot *slot , Msg39 *msg39 , char *reply , int32_t replyLen ,
 	// no longer in use. msg39 will be NULL if ENOMEM or something
 	if ( msg39 ) msg39->m_inUse = false;
 
+	// . if we are a docid split worker then hand our top tree back
+	//   to the msg39 that launched us, there is no udp reply to send
+	// . he might delete us, so do not touch "msg39" after this
+	if ( msg39 && msg39->m_parent ) {
+		msg39->m_parent->gotSplitDocIds ( msg39 );
+		return;
+	}
+
 	// . if we enter from a local call and not from handling a udp slot
 	//   then execute this logic here to return control to caller.
 	// . do not delete ourselves because we will be re-used probably and
@@ -259,6 +307,9 @@ void Msg39::getDocIds2 ( Msg39Request *req ) {
 		logf(LOG_DEBUG,"query: msg39: [%"PTRFMT"] Got request "
 		     "for q=%s", (PTRTYPE) this,m_tmpq.m_orig);
 
+	// a cached reply to the same query saves the whole intersection
+	if ( setCacheKey() && sendCachedReply() ) return;
+
 	// reset this
 	m_tt.reset();
 
@@ -296,6 +347,40 @@ void Msg39::getDocIds2 ( Msg39Request *req ) {
 
 	m_phase = 0;
 
+	// . intersect the docid range splits in parallel?
+	// . facet terms accumulate into QueryTerm::m_facetHashTable of
+	//   m_tmpq and gbdocid: restrictions only have one docid, so do
+	//   those the old way
+	int32_t numWorkers = g_conf.m_maxParallelDocIdSplits;
+	if ( numWorkers > m_r->m_numDocIdSplits ) 
+		numWorkers = m_r->m_numDocIdSplits;
+	if ( numWorkers > MAX_SPLIT_WORKERS ) 
+		numWorkers = MAX_SPLIT_WORKERS;
+	if ( m_r->m_forSectionStats     ) numWorkers = 1;
+	if ( m_r->m_seoDebug            ) numWorkers = 1;
+	if ( m_tmpq.m_docIdRestriction  ) numWorkers = 1;
+	for ( int32_t i = 0 ; i < m_tmpq.m_numTerms ; i++ ) {
+		QueryTerm *qt = &m_tmpq.m_qterms[i];
+		if ( qt->m_fieldCode == FIELD_GBFACETSTR   ||
+		     qt->m_fieldCode == FIELD_GBFACETINT   ||
+		     qt->m_fieldCode == FIELD_GBFACETFLOAT )
+			numWorkers = 1;
+	}
+	// make the workers
+	for ( int32_t i = 0 ; numWorkers >= 2 && i < numWorkers ; i++ ) {
+		Msg39 *w;
+		try { w = new ( Msg39 ); }
+		catch ( ... ) {
+			g_errno = ENOMEM;
+			log("msg39: new(%"INT32"): %s", 
+			    (int32_t)sizeof(Msg39),mstrerror(g_errno));
+			sendReply ( m_slot , this , NULL , 0 , 0 , true );
+			return;
+		}
+		mnew ( w , sizeof(Msg39) , "Msg39split" );
+		m_splitWorkers[m_numSplitWorkers++] = w;
+	}
+
 	// if ( m_r->m_docsToGet <= 0 ) {
 	// 	estimateHitsAndSendReply ( );
 	// 	return;
@@ -355,6 +440,21 @@ bool Msg39::controlLoop ( ) {
 		return true; 
 	}
 
+	// . if we have split workers, they do phases 0-2 for us
+	// . this returns false if blocked, and when the last worker is done
+	//   gotSplitDocIds() calls us again at phase 3
+	if ( m_phase == 0 && m_numSplitWorkers > 0 ) {
+		m_phase = 3;
+		if ( ! launchSplitWorkers() ) return false;
+	}
+
+	// merge the top trees of the split workers into m_tt
+	if ( m_phase == 3 && m_numSplitWorkers > 0 ) {
+		if ( m_splitErrno ) g_errno = m_splitErrno;
+		if ( ! g_errno ) mergeSplitWorkers();
+		if ( g_errno ) goto hadError;
+	}
+
 	if ( m_phase == 0 ) {
 		// next phase
 		m_phase++;
@@ -367,10 +467,11 @@ bool Msg39::controlLoop ( ) {
 		// ensure this is exclusive of ddd since it will be
 		// inclusive in the following iteration.
 		int64_t d1 = m_ddd;
-		// fix rounding errors
-		if ( d1 + 20LL > MAX_DOCID ) {
-			d1    = MAX_DOCID;
-			m_ddd = MAX_DOCID;
+		// fix rounding errors. m_dddEnd is MAX_DOCID unless we
+		// are a split worker doing just a piece of the docid space
+		if ( d1 + 20LL > m_dddEnd ) {
+			d1    = m_dddEnd;
+			m_ddd = m_dddEnd;
 		}
 		// fix it
 		m_r->m_minDocId = d0;
@@ -434,6 +535,14 @@ bool Msg39::controlLoop ( ) {
 		}
 	}
 
+	// . split workers are done at this point, our parent will merge
+	//   our top tree into his and get the cluster recs
+	// . this may delete us
+	if ( m_parent ) {
+		sendReply ( m_slot , this , NULL , 0 , 0 , false );
+		return true;
+	}
+
 	// ok, we are done, get cluster recs of the winning docids
 	if ( m_phase == 3 ) {
 		m_phase++;
@@ -456,6 +565,191 @@ bool Msg39::controlLoop ( ) {
 	return true;
 }
 
+// . called by a split worker's controlLoop() via sendReply() when
+//   it has intersected all the docid range splits we gave it
+// . g_errno is set if it had an error
+void Msg39::gotSplitDocIds ( Msg39 *worker ) {
+	// save the first error
+	if ( g_errno && ! m_splitErrno ) m_splitErrno = g_errno;
+	if ( g_errno )
+		log("query: msg39: split worker had error: %s",
+		    mstrerror(g_errno));
+	g_errno = 0;
+	// one less outstanding
+	m_numSplitWorkersOut--;
+	// sanity
+	if ( m_numSplitWorkersOut < 0 ) { char *xx=NULL;*xx=0; }
+	// launchSplitWorkers() will see if we are done
+	if ( m_launchingSplits ) return;
+	// wait for the others
+	if ( m_numSplitWorkersOut > 0 ) return;
+	// all done, merge the trees and get the cluster recs
+	controlLoop();
+}
+
+// . give each split worker a contiguous run of the docid range splits
+// . returns false if blocked, true otherwise
+bool Msg39::launchSplitWorkers ( ) {
+	int32_t numSplits  = m_r->m_numDocIdSplits;
+	int32_t numWorkers = m_numSplitWorkers;
+	// the docid range of one split, same as in controlLoop()
+	int64_t delta = MAX_DOCID / (int64_t)numSplits;
+	if ( m_debug )
+		log("msg39: intersecting %"INT32" docid splits with %"INT32" "
+		    "split workers", numSplits , numWorkers );
+	// do not call controlLoop() until we launched them all
+	m_launchingSplits = true;
+	m_numSplitWorkersOut = 0;
+	int32_t first = 0;
+	for ( int32_t i = 0 ; i < numWorkers ; i++ ) {
+		// worker #i does splits [first,last)
+		int32_t last = ((int64_t)numSplits * (i+1)) / numWorkers;
+		int64_t d0 = delta * (int64_t)first;
+		int64_t d1 = delta * (int64_t)last;
+		// last one gets the rounding error
+		if ( i == numWorkers - 1 ) d1 = MAX_DOCID;
+		first = last;
+		// count it before it can call gotSplitDocIds()
+		m_numSplitWorkersOut++;
+		// . this calls gotSplitDocIds() when done, even if it
+		//   does not block
+		m_splitWorkers[i]->getSplitDocIds ( this , d0 , d1 );
+	}
+	m_launchingSplits = false;
+	// did they all complete without blocking?
+	if ( m_numSplitWorkersOut == 0 ) return true;
+	m_blocked = true;
+	return false;
+}
+
+// . a split worker intersects the docid range [d0,d1] one split at a time
+//   just like the old sequential logic
+// . returns false if blocked, true otherwise
+// . calls m_parent->gotSplitDocIds() when done
+bool Msg39::getSplitDocIds ( Msg39 *parent , int64_t d0 , int64_t d1 ) {
+	m_inUse  = true;
+	m_parent = parent;
+	m_slot   = NULL;
+	m_errno  = 0;
+	m_debug  = parent->m_debug;
+	// . our own copy of the request since getLists() sets its
+	//   m_minDocId/m_maxDocId. the ptr_* members still reference
+	//   into the parent's request buffer
+	gbmemcpy ( &m_splitRequest , parent->m_r , sizeof(Msg39Request) );
+	m_r = &m_splitRequest;
+	// . our own Query too, since PosdbTable::init() sets the
+	//   QueryTerm::m_posdbListPtr to our lists
+	if ( ! m_tmpq.set2 ( m_r->ptr_query  , 
+			     m_r->m_language ,
+			     m_r->m_queryExpansion ,
+			     m_r->m_useQueryStopWords ,
+			     m_r->m_maxQueryTerms ) ) {
+		log("query: msg39: split setQuery: %s." , 
+		    mstrerror(g_errno) );
+		sendReply ( m_slot , this , NULL , 0 , 0 , true );
+		return true;
+	}
+	m_tt.reset();
+	m_ddd    = d0;
+	m_dddEnd = d1;
+	m_phase  = 0;
+	return controlLoop();
+}
+
+// . merge the top trees of the split workers into m_tt
+// . also merge their scoring info if they got it
+// . returns false and sets g_errno on error
+bool Msg39::mergeSplitWorkers ( ) {
+	// each worker tree was sized the same way by allocTopTree()
+	int32_t nn = 0;
+	// for the debug msg in estimateHitsAndSendReply()
+	m_posdbTable.m_addListsTime = 0;
+	for ( int32_t i = 0 ; i < m_numSplitWorkers ; i++ ) {
+		Msg39 *w = m_splitWorkers[i];
+		// accumulate total hits count over each docid split
+		m_numTotalHits += w->m_numTotalHits;
+		m_posdbTable.m_addListsTime += w->m_posdbTable.m_addListsTime;
+		if ( w->m_tt.m_numNodes <= 0 ) continue;
+		if ( w->m_tt.m_docsWanted > nn ) nn = w->m_tt.m_docsWanted;
+	}
+	// all termlists were empty?
+	if ( nn <= 0 ) return true;
+	if ( ! m_tt.setNumNodes ( nn , m_r->m_doSiteClustering ) ) {
+		log("query: msg39: error allocating merge tree: %s",
+		    mstrerror(g_errno));
+		return false;
+	}
+	m_allocedTree = true;
+	for ( int32_t i = 0 ; i < m_numSplitWorkers ; i++ ) {
+		TopTree *src = &m_splitWorkers[i]->m_tt;
+		if ( src->m_numNodes <= 0 ) continue;
+		// gbsortbyint: etc.
+		if ( src->m_useIntScores ) m_tt.m_useIntScores = true;
+		for ( int32_t ti = src->getHighNode() ; ti >= 0 ; 
+		      ti = src->getPrev(ti) ) {
+			// breathe
+			QUICKPOLL ( m_r->m_niceness );
+			TopNode *s  = &src->m_nodes[ti];
+			int32_t  tn = m_tt.getEmptyNode();
+			TopNode *t  = &m_tt.m_nodes[tn];
+			t->m_score    = s->m_score;
+			t->m_docId    = s->m_docId;
+			t->m_intScore = s->m_intScore;
+			// will not add if tree is full and score is too low
+			m_tt.addNode ( t , tn );
+		}
+	}
+
+	if ( ! m_r->m_getDocIdScoringInfo ) return true;
+
+	// . now copy the scoring info of the winners into m_posdbTable
+	//   so estimateHitsAndSendReply() can send it back
+	// . the workers' score bufs may have info for docids that got
+	//   kicked out of the tree, so only take the winners
+	HashTableX dt;
+	if ( ! dt.set ( 8,0,m_tt.m_numUsedNodes*2,NULL,0,false,
+			m_r->m_niceness,"msg39dt") )
+		return false;
+	for ( int32_t ti = m_tt.getHighNode() ; ti >= 0 ; 
+	      ti = m_tt.getPrev(ti) ) 
+		if ( ! dt.addKey ( &m_tt.m_nodes[ti].m_docId ) ) return false;
+
+	PosdbTable *pt = &m_posdbTable;
+	for ( int32_t i = 0 ; i < m_numSplitWorkers ; i++ ) {
+		PosdbTable *wt = &m_splitWorkers[i]->m_posdbTable;
+		char *p    = wt->m_scoreInfoBuf.getBufStart();
+		char *pend = p + wt->m_scoreInfoBuf.length();
+		for ( ; p < pend ; p += sizeof(DocIdScore) ) {
+			DocIdScore dcs;
+			gbmemcpy ( &dcs , p , sizeof(DocIdScore) );
+			if ( ! dt.isInTable ( &dcs.m_docId ) ) continue;
+			// only take one per docid
+			dt.removeKey ( &dcs.m_docId );
+			// rebase the offsets into our pair and single bufs
+			int32_t psize = dcs.m_numPairs * sizeof(PairScore);
+			int32_t ssize = dcs.m_numSingles * sizeof(SingleScore);
+			if ( dcs.m_pairsOffset >= 0 ) {
+				char *src = wt->m_pairScoreBuf.getBufStart();
+				src += dcs.m_pairsOffset;
+				dcs.m_pairsOffset = pt->m_pairScoreBuf.length();
+				if ( ! pt->m_pairScoreBuf.safeMemcpy(src,psize))
+					return false;
+			}
+			if ( dcs.m_singlesOffset >= 0 ) {
+				char *src = wt->m_singleScoreBuf.getBufStart();
+				src += dcs.m_singlesOffset;
+				dcs.m_singlesOffset=pt->m_singleScoreBuf.length();
+				if (!pt->m_singleScoreBuf.safeMemcpy(src,ssize))
+					return false;
+			}
+			if ( ! pt->m_scoreInfoBuf.safeMemcpy ( &dcs , 
+						       sizeof(DocIdScore) ) )
+				return false;
+		}
+	}
+	return true;
+}
+
 /*
 // . returns false if blocked, true if done
 // . only come here if m_numDocIdSplits > 1
@@ -1592,7 +1886,7 @@ void Msg39::estimateHitsAndSendReply ( ) {
 		topRecs      = (key_t     *) mr.ptr_clusterRecs;
 
 		// sanity
-		if ( nqt != m_msg2.m_numLists )
+		if ( nqt != m_msg2.m_numLists && m_numSplitWorkers == 0 )
 			log("query: nqt mismatch for q=%s",m_tmpq.m_orig);
 		int64_t *facetCounts=(int64_t*)mr.ptr_numDocsThatHaveFacetList;
 		for ( int32_t i = 0 ; i < nqt ; i++ ) {
@@ -1711,7 +2005,135 @@ void Msg39::estimateHitsAndSendReply ( ) {
 		return;
 	}
 
+	// . remember it for the next page of results
+	// . msg40 sets m_addToCache from the "wcache" cgi parm
+	if ( m_useCache && m_r->m_addToCache && ! m_errno &&
+	     ! s_msg39Cache.addRecord ( m_r->m_collnum                ,
+					(char *)&m_cacheKey           ,
+					(char *)&m_r->m_docsToGet     ,
+					4                             ,
+					reply                         ,
+					replySize                     ,
+					0                             ))
+		// the reply is still good
+		g_errno = 0;
+
 	// now send back the reply
 	sendReply(m_slot,this,reply,replySize,replySize,false);
 	return;
 }
+
+// . set m_cacheKey from everything in the request that changes the reply
+// . use the parsed query terms so whitespace, case and the order of the
+//   request's pointers do not matter
+// . returns false if this request should not use the results cache
+bool Msg39::setCacheKey ( ) {
+	m_useCache = false;
+	// not if seo.cpp is calling us locally and wants the posdbtable
+	if ( m_callback ) return false;
+	if ( g_conf.m_msg39CacheMaxAge <= 0 ) return false;
+	if ( ! m_r->m_makeReply ) return false;
+	if ( m_r->m_seoDebug || m_r->m_forSectionStats ) return false;
+	// the boolean expression is not in the terms we hash below
+	if ( m_tmpq.m_isBoolean ) return false;
+
+	char tmp[2048];
+	SafeBuf sb ( tmp , 2048 );
+
+	// . dumps and merges bump this so we never serve a reply made
+	//   from posdb files that are gone
+	// . recs added to the tree since are covered by the max age
+	sb.pushLong ( g_posdb.getRdb()->m_generation );
+
+	for ( int32_t i = 0 ; i < m_tmpq.m_numTerms ; i++ ) {
+		QueryTerm *qt = &m_tmpq.m_qterms[i];
+		// the query word # matters for the term proximity scores
+		int32_t qwn = -1;
+		if ( qt->m_qword ) qwn = qt->m_qword - m_tmpq.m_qwords;
+		int32_t syn = -1;
+		if ( qt->m_synonymOf ) syn = qt->m_synonymOf - m_tmpq.m_qterms;
+		sb.pushLongLong ( qt->m_termId     );
+		sb.pushLong     ( qwn              );
+		sb.pushLong     ( syn              );
+		sb.pushFloat    ( qt->m_userWeight );
+		sb.pushChar     ( qt->m_termSign   );
+		sb.pushChar     ( qt->m_userType   );
+		sb.pushChar     ( qt->m_fieldCode  );
+		sb.pushChar     ( qt->m_isPhrase   );
+		sb.pushChar     ( qt->m_ignored    );
+	}
+
+	// the ranking parms. not m_docsToGet, we check that on a hit.
+	Msg39Request *r = m_r;
+	sb.pushLong       ( r->m_maxFacets             );
+	sb.pushLong       ( r->m_numDocIdSplits        );
+	sb.pushFloat      ( r->m_sameLangWeight        );
+	sb.pushChar       ( r->m_language              );
+	sb.pushChar       ( r->m_doSiteClustering      );
+	sb.pushChar       ( r->m_hideAllClustered      );
+	sb.pushChar       ( r->m_doDupContentRemoval   );
+	sb.pushChar       ( r->m_restrictPosdbForQuery );
+	sb.pushChar       ( r->m_familyFilter          );
+	sb.pushChar       ( r->m_getDocIdScoringInfo   );
+	sb.pushChar       ( r->m_realMaxTop            );
+	sb.pushChar       ( r->m_doMaxScoreAlgo        );
+	sb.pushLongLong   ( r->m_minDocId              );
+	sb.pushLongLong   ( r->m_maxDocId              );
+	sb.pushDouble     ( r->m_maxSerpScore          );
+	sb.pushLongLong   ( r->m_minSerpDocId          );
+	// and the buffers msg3a sends along with the query
+	sb.pushLong       ( r->size_readSizes          );
+	sb.safeMemcpy     ( r->ptr_readSizes  , r->size_readSizes );
+	sb.pushLong       ( r->size_termFreqWeights    );
+	sb.safeMemcpy     ( r->ptr_termFreqWeights , 
+			    r->size_termFreqWeights    );
+	sb.pushLong       ( r->size_whiteList          );
+	sb.safeMemcpy     ( r->ptr_whiteList  , r->size_whiteList );
+
+	// out of memory? just do not cache then
+	if ( g_errno ) { g_errno = 0; return false; }
+
+	// collnum in the top so it is never KEYMAX
+	m_cacheKey.n1 = (uint32_t)r->m_collnum;
+	m_cacheKey.n0 = hash64 ( sb.getBufStart() , sb.length() );
+	m_useCache = true;
+	return true;
+}
+
+// . send back the reply we cached for this query if it has enough docids
+// . returns true if we sent it, and "this" is deleted
+bool Msg39::sendCachedReply ( ) {
+	// msg40 sets m_maxAge to 0 when the "rcache" cgi parm is off
+	if ( m_r->m_maxAge == 0 ) return false;
+	char    *rec;
+	int32_t  recSize;
+	if ( ! s_msg39Cache.getRecord ( m_r->m_collnum               ,
+					(char *)&m_cacheKey          ,
+					&rec                         ,
+					&recSize                     ,
+					false                        , // copy?
+					g_conf.m_msg39CacheMaxAge    ,
+					true                         ))// inc counts
+		return false;
+	// sanity
+	if ( recSize < 4 + (int32_t)sizeof(Msg39Reply) ) return false;
+	int32_t     docsToGet = *(int32_t *)rec;
+	Msg39Reply *mr        = (Msg39Reply *)(rec + 4);
+	// . a reply made for more docids is good for fewer, msg3a only
+	//   merges the top m_docsToGet of each shard
+	// . one made for fewer is only good if it had every docid that
+	//   matched
+	if ( docsToGet < m_r->m_docsToGet && 
+	     mr->m_estimatedHits > docsToGet ) 
+		return false;
+	int32_t replySize = recSize - 4;
+	// the udp server frees the reply once it is sent
+	char *reply = (char *)mdup ( rec + 4 , replySize , "Msg39cache" );
+	if ( ! reply ) { g_errno = 0; return false; }
+	if ( m_debug )
+		logf(LOG_DEBUG,"query: msg39: [%"PTRFMT"] Sending cached "
+		     "reply with %"INT32" docids for q=%s",
+		     (PTRTYPE)this,mr->m_numDocIds,m_tmpq.m_orig);
+	sendReply ( m_slot , this , reply , replySize , replySize , false );
+	return true;
+}
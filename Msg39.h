@@ -19,8 +19,13 @@
 
 #define MAX_MSG39_REQUEST_SIZE (500+MAX_QUERY_LEN)
 
+// max # of docid range splits we intersect at the same time
+#define MAX_SPLIT_WORKERS 32
+
 void  handleRequest39 ( UdpSlot *slot , int32_t netnice ) ;
 
+void resetMsg39Cache ( ) ;
+
 class Msg39Request {
 
  public:
@@ -221,6 +226,9 @@ class Msg39 {
 	void reset2();
 	// register our request handler for Msg39's
 	bool registerHandler ( );
+	// the per host cache of the replies we send back
+	static bool initResultsCache ( );
+	static class RdbCache *getResultsCache ( );
 	// called by handler when a request for docids arrives
 	void getDocIds ( UdpSlot *slot ) ;
 	// XmlDoc.cpp seo pipeline uses this call
@@ -265,6 +273,24 @@ class Msg39 {
 	int64_t m_dddEnd;
 	bool doDocIdSplitLoop();
 
+	// . for intersecting docid range splits in parallel
+	// . each worker is a Msg39 that does phases 0-2 of controlLoop()
+	//   over a contiguous run of the splits with its own Query, Msg2,
+	//   PosdbTable and TopTree. we merge their top trees into m_tt.
+	bool getSplitDocIds ( Msg39 *parent , int64_t d0 , int64_t d1 );
+	void gotSplitDocIds ( Msg39 *worker );
+	bool launchSplitWorkers ( );
+	bool mergeSplitWorkers ( );
+	Msg39     *m_splitWorkers[MAX_SPLIT_WORKERS];
+	int32_t    m_numSplitWorkers;
+	int32_t    m_numSplitWorkersOut;
+	int32_t    m_splitErrno;
+	bool       m_launchingSplits;
+	// non-NULL if we are a split worker of this msg39
+	Msg39     *m_parent;
+	// our copy of the parent's request, we set m_minDocId/m_maxDocId
+	Msg39Request m_splitRequest;
+
 	// . we hold our IndexLists here for passing to PosdbTable
 	// . one array for each of the tiers
 	//IndexList  m_lists [ MAX_QUERY_TERMS ];
@@ -302,6 +328,11 @@ class Msg39 {
 	Msg51       m_msg51;
 	bool        m_gotClusterRecs;
 	bool        controlLoop();
+	// results cache key and whether this request uses the cache
+	bool        setCacheKey ();
+	bool        sendCachedReply ();
+	key_t       m_cacheKey;
+	bool        m_useCache;
 	int32_t m_phase;
 	void        estimateHitsAndSendReply   ();
 	bool        setClusterRecs ();
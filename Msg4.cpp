@@ -15,6 +15,8 @@
 #include "Repair.h"
 #include "Multicast.h"
 #include "Syncdb.h"
+#include "Process.h"
+#include "XmlDoc.h"    // gbcompress()
 
 //////////////
 //
@@ -32,11 +34,18 @@
 
 // article1.html and article11.html are dups but they are being spidered
 // within 500ms of another
-#define MSG4_WAIT 100
+//#define MSG4_WAIT 100
+
+// . now we check the host bufs this often and send the ones whose oldest
+//   rec has waited g_conf.m_msg4MaxLatency ms
+// . a buf also goes out as soon as it reaches its shard's batch size
+#define MSG4_TICK 20
 
 
 // we have up to this many outstanding Multicasts to send add requests to hosts
 #define MAX_MCASTS 128
+// but do not let one slow shard tie them all up
+#define MAX_MCASTS_PER_SHARD 32
 Multicast  s_mcasts[MAX_MCASTS];
 Multicast *s_mcastHead = NULL;
 Multicast *s_mcastTail = NULL;
@@ -52,6 +61,32 @@ static int32_t  s_numHostBufs;
 // . buffer will be more than 32k if the record to add is larger than 32k
 #define MAXHOSTBUFSIZE (32*1024)
 
+// . a shard that is slow to reply gets bigger batches, up to this, so
+//   we send it fewer requests instead of stalling on the multicasts
+// . its batch size decays back to MAXHOSTBUFSIZE when it keeps up
+#define MAXHOSTBATCHSIZE (512*1024)
+
+// when the first rec went into each host buf
+static int64_t s_hostBufStartTime [MAX_HOSTS];
+// how big we let each host buf get before sending it
+static int32_t s_hostBatchSize    [MAX_HOSTS];
+// how many requests we have out to each host buf's shard
+static int32_t s_hostBufsOut      [MAX_HOSTS];
+// how full the shard said its fullest rdb was in its last reply
+static char    s_hostTreeFull     [MAX_HOSTS];
+static int64_t s_hostTreeFullTime [MAX_HOSTS];
+// the host buf each multicast is sending and when we sent it
+static int32_t s_mcastHostId      [MAX_MCASTS];
+static int64_t s_mcastSendTime    [MAX_MCASTS];
+
+// . a deflated request is used(4)|zid(8)|MSG4_DEFLATED|rawSize(4)|recs
+// . no real collnum is negative so handleRequest4() can tell them apart
+// . rawSize is the size of the recs after inflating
+#define MSG4_DEFLATED ((collnum_t)-2)
+#define MSG4_DEFLATED_HDR (12 + sizeof(collnum_t) + 4)
+// do not bother deflating small requests
+#define MSG4_MIN_DEFLATE 1024
+
 // the linked list of Msg4s waiting in line
 static Msg4 *s_msg4Head = NULL;
 static Msg4 *s_msg4Tail = NULL;
@@ -90,6 +125,13 @@ bool registerHandler4 ( ) {
 	s_numHostBufs = g_hostdb.getNumShards();
 	for ( int32_t i = 0 ; i < s_numHostBufs ; i++ )
 		s_hostBufs[i] = NULL;
+	for ( int32_t i = 0 ; i < MAX_HOSTS ; i++ ) {
+		s_hostBufStartTime [i] = 0;
+		s_hostBatchSize    [i] = MAXHOSTBUFSIZE;
+		s_hostBufsOut      [i] = 0;
+		s_hostTreeFull     [i] = 0;
+		s_hostTreeFullTime [i] = 0;
+	}
 
 	// init the linked list of multicasts
 	s_mcastHead = &s_mcasts[0];
@@ -121,29 +163,51 @@ bool registerHandler4 ( ) {
 	//   to speed up spidering so it would harvest outlinks
 	//   faster and be able to spider them right away.
 	// . returns false on failure
-	return g_loop.registerSleepCallback(MSG4_WAIT,NULL,sleepCallback4 );
+	return g_loop.registerSleepCallback(MSG4_TICK,NULL,sleepCallback4 );
 }
 
-static void flushLocal ( ) ;
+static void flushLocal ( bool force ) ;
 
 // scan all host bufs and try to send on them
 void sleepCallback4 ( int bogusfd , void    *state ) {
 	// wait for clock to be in sync
 	if ( ! isClockInSync() ) return;
-	// flush them buffers
-	flushLocal();
+	// flush them buffers that waited long enough
+	flushLocal ( false );
 }
 
-void flushLocal ( ) {
+// . send the host bufs whose oldest rec waited g_conf.m_msg4MaxLatency
+// . or all of them if "force" is true
+void flushLocal ( bool force ) {
 	g_errno = 0;
 	// put the line waiters into the buffers in case they are not there
 	//storeLineWaiters();
+	int64_t now = gettimeofdayInMillisecondsLocal();
 	// now try to send the buffers
-	for ( int32_t i = 0 ; i < s_numHostBufs ; i++ ) 
+	for ( int32_t i = 0 ; i < s_numHostBufs ; i++ ) {
+		if ( ! force &&
+		     now - s_hostBufStartTime[i] < g_conf.m_msg4MaxLatency )
+			continue;
 		sendBuffer ( i , MAX_NICENESS );
+	}
 	g_errno = 0;
 }
 
+bool isMsg4Backlogged ( ) {
+	// msg4s waiting in line for a multicast
+	if ( s_msg4Head ) return true;
+	int32_t max = g_conf.m_spiderBackoffTreePercent;
+	if ( max <= 0 ) return false;
+	// ignore what a shard told us a while ago, we might not have
+	// sent it anything since because we backed off
+	int64_t now = gettimeofdayInMillisecondsLocal();
+	for ( int32_t i = 0 ; i < s_numHostBufs ; i++ ) {
+		if ( now - s_hostTreeFullTime[i] > 5000 ) continue;
+		if ( s_hostTreeFull[i] >= max ) return true;
+	}
+	return false;
+}
+
 //static void (* s_flushCallback) ( void *state ) = NULL ;
 //static void  * s_flushState = NULL;
 
@@ -205,7 +269,7 @@ bool flushMsg4Buffers ( void *state , void (* callback) (void *) ) {
 
 	//if ( s_flushCallback ) { char *xx=NULL;*xx=0; }
 	// start it up
-	flushLocal();
+	flushLocal ( true );
 
 	// scan msg4 slots for maximum start time so we can only
 	// call the flush done callback when all msg4 slots in udpserver
@@ -763,8 +827,9 @@ bool storeRec ( collnum_t      collnum ,
 	char *buf = s_hostBufs[hostId];
 	// if NULL, try to allocate one
 	if ( ! buf  || s_hostBufSizes[hostId] < needForBuf ) {
-		// how big to make it
+		// how big to make it. a new buf is as big as the batch.
 		int32_t size = MAXHOSTBUFSIZE;
+		if ( ! buf ) size = s_hostBatchSize[hostId];
 		// must accomodate rec at all costs
 		if ( size < needForBuf ) size = needForBuf;
 		// make them all the same size
@@ -811,6 +876,9 @@ bool storeRec ( collnum_t      collnum ,
 		// now the buffer should be empty, try again
 		goto retry;
 	}
+	// the latency clock starts with the first rec
+	if ( used == 12 ) 
+		s_hostBufStartTime[hostId] = gettimeofdayInMillisecondsLocal();
 	// point to where to store the list
 	char *start = buf + used;
 	char *p     = start;
@@ -821,10 +889,88 @@ bool storeRec ( collnum_t      collnum ,
 	gbmemcpy ( p , rec , recSize ); p += recSize;
 	// update buffer used
 	*(int32_t *)buf = used + (p - start);
+	// . send it now if it reached its shard's batch size
+	// . if no multicast is available flushLocal() or the next
+	//   storeRec() will try again
+	if ( *(int32_t *)buf >= s_hostBatchSize[hostId] ) {
+		sendBuffer ( hostId , niceness );
+		g_errno = 0;
+	}
 	// all done, did not "block"
 	return true;
 }
 
+// . deflate the recs in a host buf into a new request
+// . returns NULL if that would not save enough to be worth the cpu
+static char *deflateBuffer ( char *buf , int32_t used , int32_t *allocSize ) {
+	char    *src    = buf  + 12;
+	uint32_t srcLen = used - 12;
+	// zlib's worst case is a little bigger than what we give it
+	uint32_t zlen = srcLen + srcLen / 1000 + 64;
+	int32_t  size = MSG4_DEFLATED_HDR + zlen;
+	char *zbuf = (char *)mmalloc ( size , "Msg4z" );
+	if ( ! zbuf ) { g_errno = 0; return NULL; }
+	int err = gbcompress ( (unsigned char *)zbuf + MSG4_DEFLATED_HDR ,
+			       &zlen ,
+			       (unsigned char *)src ,
+			       srcLen );
+	int32_t zused = MSG4_DEFLATED_HDR + zlen;
+	if ( err != Z_OK || zused > used - used / 8 ) {
+		mfree ( zbuf , size , "Msg4z" );
+		return NULL;
+	}
+	char *p = zbuf;
+	*(int32_t   *)p = zused         ; p += 4;
+	// the zid
+	*(uint64_t  *)p = *(uint64_t *)(buf + 4); p += 8;
+	*(collnum_t *)p = MSG4_DEFLATED ; p += sizeof(collnum_t);
+	*(int32_t   *)p = srcLen        ; p += 4;
+	*allocSize = size;
+	return zbuf;
+}
+
+// . inflate a request made by deflateBuffer() into a new buffer
+// . returns NULL and sets g_errno on error
+static char *inflateRequest ( char *req , int32_t reqSize ,
+			      int32_t *allocSize ) {
+	uint32_t rawLen = *(int32_t *)(req + 12 + sizeof(collnum_t));
+	int32_t  size   = 12 + rawLen;
+	if ( reqSize < (int32_t)MSG4_DEFLATED_HDR ||
+	     rawLen > 300000000 ) {
+		g_errno = ECORRUPTDATA;
+		return NULL;
+	}
+	char *buf = (char *)mmalloc ( size , "Msg4i" );
+	if ( ! buf ) return NULL;
+	uint32_t outLen = rawLen;
+	int err = gbuncompress ( (unsigned char *)buf + 12 ,
+				 &outLen ,
+				 (unsigned char *)req + MSG4_DEFLATED_HDR ,
+				 reqSize - MSG4_DEFLATED_HDR );
+	if ( err != Z_OK || outLen != rawLen ) {
+		mfree ( buf , size , "Msg4i" );
+		g_errno = ECORRUPTDATA;
+		return NULL;
+	}
+	*(int32_t  *)buf       = size;
+	*(uint64_t *)(buf + 4) = *(uint64_t *)(req + 4);
+	*allocSize = size;
+	return buf;
+}
+
+// how full the fullest of our rdbs is, 0 to 100
+static char getMaxPercentFull ( ) {
+	int32_t max = 0;
+	for ( int32_t i = 0 ; i < g_process.m_numRdbs ; i++ ) {
+		Rdb *rdb = g_process.m_rdbs[i];
+		if ( ! rdb || ! rdb->isInitialized() ) continue;
+		int32_t pct = rdb->getPercentFull();
+		if ( pct > max ) max = pct;
+	}
+	if ( max > 100 ) max = 100;
+	return (char)max;
+}
+
 // . returns false if we were UNable to get a multicast to launch the buffer, 
 //   true otherwise
 // . returns false and sets g_errno on error
@@ -840,6 +986,8 @@ bool sendBuffer ( int32_t hostId , int32_t niceness ) {
 	int32_t used = *(int32_t *)buf;
 	// if empty, bail
 	if ( used <= 12 ) return true;
+	// wait for some replies if the shard is that far behind
+	if ( s_hostBufsOut[hostId] >= MAX_MCASTS_PER_SHARD ) return false;
 	// grab a vehicle for sending the buffer
 	Multicast *mcast = getMulticast();
 	// if we could not get one, wait in line for one to become available
@@ -897,6 +1045,17 @@ bool sendBuffer ( int32_t hostId , int32_t niceness ) {
 	// this is the request
 	char *request     = buf;
 	int32_t  requestSize = used;
+	// . send the recs deflated if that makes them enough smaller
+	// . posdb keys of the same doc have a lot in common
+	char *zbuf = NULL;
+	int32_t  zbufAllocSize = 0;
+	if ( g_conf.m_compressMsg4 && used >= MSG4_MIN_DEFLATE )
+		zbuf = deflateBuffer ( buf , used , &zbufAllocSize );
+	if ( zbuf ) {
+		request     = zbuf;
+		requestSize = *(int32_t *)zbuf;
+		allocSize   = zbufAllocSize;
+	}
 	// . launch the request
 	// . we now have this multicast timeout if a host goes dead on it
 	//   and it fails to send its payload
@@ -931,9 +1090,16 @@ bool sendBuffer ( int32_t hostId , int32_t niceness ) {
 			   RDB_NONE   , // bogus rdbId
 			   -1         , // unknown minRecSizes read size
 			   true      )) { // sendToSelf?
+		// we sent the deflated copy, so done with the host buf
+		if ( zbuf ) mfree ( buf , s_hostBufSizes[hostId] , "Msg4b" );
 		// . let storeRec() do all the allocating...
 		// . only let the buffer go once multicast succeeds
 		s_hostBufs [ hostId ] = NULL;
+		// for adapting the batch size when the reply comes
+		int32_t mi = mcast - s_mcasts;
+		s_mcastHostId   [mi] = hostId;
+		s_mcastSendTime [mi] = gettimeofdayInMillisecondsLocal();
+		s_hostBufsOut   [hostId]++;
 		// success
 		return true;
 	}
@@ -942,6 +1108,8 @@ bool sendBuffer ( int32_t hostId , int32_t niceness ) {
 	log("net: Had error when sending request to add data to rdb shard "
 	    "#%"UINT32": %s.", shardNum,mstrerror(g_errno));
 
+	if ( zbuf ) mfree ( zbuf , zbufAllocSize , "Msg4z" );
+
 	returnMulticast ( mcast );
 
 	return false;
@@ -1000,6 +1168,27 @@ void gotReplyWrapper4 ( void *state , void *state2 ) {
 	UdpSlot *replyingSlot = mcast->m_slot;
 	if ( ! replyingSlot ) { char *xx=NULL;*xx=0; }
 
+	int32_t mi  = mcast - s_mcasts;
+	int32_t hid = s_mcastHostId[mi];
+	int64_t now = gettimeofdayInMillisecondsLocal();
+	s_hostBufsOut[hid]--;
+	// . a shard that is slow to reply, or has requests piling up,
+	//   gets bigger batches so we send it fewer requests
+	// . otherwise let the batch size decay back to MAXHOSTBUFSIZE
+	int32_t *bs = &s_hostBatchSize[hid];
+	if ( now - s_mcastSendTime[mi] > g_conf.m_msg4MaxLatency ||
+	     s_hostBufsOut[hid] > 0 )
+		*bs *= 2;
+	else
+		*bs -= *bs / 8;
+	if ( *bs > MAXHOSTBATCHSIZE ) *bs = MAXHOSTBATCHSIZE;
+	if ( *bs < MAXHOSTBUFSIZE   ) *bs = MAXHOSTBUFSIZE;
+	// the shard says how close its trees are to dumping
+	if ( replyingSlot->m_readBuf && replyingSlot->m_readBufSize >= 1 ) {
+		s_hostTreeFull    [hid] = *replyingSlot->m_readBuf;
+		s_hostTreeFullTime[hid] = now;
+	}
+
 	returnMulticast ( mcast );
 
 	storeLineWaiters ( ); // try to launch more msg4 requests in waiting
@@ -1069,7 +1258,7 @@ void gotReplyWrapper4 ( void *state , void *state2 ) {
 	// if not completely empty, wait!
 	if ( hasAddsInQueue () ) {
 		// flush away some more just in case
-		flushLocal();
+		flushLocal ( true );
 		// and wait
 		return;
 	}
@@ -1109,8 +1298,6 @@ void storeLineWaiters ( ) {
 	goto loop;
 }
 
-#include "Process.h"
-
 // . destroys the slot if false is returned
 // . this is registered in Msg4::set() to handle add rdb record msgs
 // . seems like we should always send back a reply so we don't leave the
@@ -1210,13 +1397,34 @@ void handleRequest4 ( UdpSlot *slot , int32_t netnice ) {
 	skipSyncdb = true;
 
 	if ( skipSyncdb ) {
+		// inflate it if the sender deflated it
+		char *raw = readBuf;
+		int32_t  rawAllocSize = 0;
+		if ( readBufSize >= (int32_t)MSG4_DEFLATED_HDR &&
+		     *(collnum_t *)(readBuf+12) == MSG4_DEFLATED )
+			raw = inflateRequest ( readBuf , readBufSize ,
+					       &rawAllocSize );
+		if ( ! raw ) {
+			// if we send back a g_errno then multicast retries
+			// forever so just absorb it!
+			log("msg4: could not inflate request from hostid "
+			    "%"INT32": %s", slot->m_host->m_hostId,
+			    mstrerror(g_errno));
+			g_errno = 0;
+			us->sendReply_ass ( NULL , 0 , NULL , 0 , slot ) ;
+			return;
+		}
 		// this returns false with g_errno set on error
-	        if ( ! addMetaList ( readBuf , slot ) ) {
+		bool status = addMetaList ( raw , slot );
+		if ( raw != readBuf ) mfree ( raw , rawAllocSize , "Msg4i" );
+		if ( ! status ) {
 		     us->sendErrorReply(slot,g_errno);
 		     return; 
 		}
-		// good to go
-		us->sendReply_ass ( NULL , 0 , NULL , 0 , slot ) ;
+		// good to go. tell the sender how full our trees are.
+		char *reply = slot->m_tmpBuf;
+		*reply = getMaxPercentFull();
+		us->sendReply_ass ( reply , 1 , reply , 1 , slot ) ;
 		return;
 	}
 
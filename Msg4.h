@@ -17,6 +17,9 @@ bool addMetaList ( char *p , class UdpSlot *slot = NULL ) ;
 
 bool isInMsg4LinkedList ( class Msg4 *msg4 ) ;
 
+// true if SpiderLoop should hold off launching more spiders
+bool isMsg4Backlogged ( ) ;
+
 #include "SafeBuf.h"
 
 class Msg4 {
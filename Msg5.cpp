@@ -612,8 +612,8 @@ bool Msg5::readList ( ) {
 			// debug msg
 		}
 		else {
-			RdbBuckets *buckets = &base->m_rdb->m_buckets;
-			if ( ! buckets->getList ( base->m_collnum    ,
+			// includes the sealed buckets if double buffering
+			if ( ! base->m_rdb->getBucketsList ( base->m_collnum ,
 						  m_fileStartKey       ,
 						  treeEndKey           ,
 						  m_newMinRecSizes     ,
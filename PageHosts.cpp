@@ -205,6 +205,8 @@ skipReplaceHost:
 			       "<td><a href=\"/admin/hosts?c=%s&sort=3\">"
 			       "<b>dgrams resent</b></a></td>"
 
+			       "<td><b>udp rtt / loss / cwnd</b></td>"
+
 			       /*
 
 				 MDW: take out for adding new stuff
@@ -300,6 +302,7 @@ skipReplaceHost:
 			h->m_pingInfo.m_etryagains   = 0;
 			h->m_dgramsTo     = 0;
 			h->m_dgramsFrom   = 0;
+			h->m_dgramsLost   = 0;
 			h->m_splitTimes = 0;
 			h->m_splitsDone = 0;
 			h->m_pingInfo.m_slowDiskReads =0;
@@ -687,6 +690,16 @@ skipReplaceHost:
 			sb.safePrintf("\t\t<resends>%"INT32"</resends>\n",
 				      h->m_pingInfo.m_totalResends);
 
+			sb.safePrintf("\t\t<udpRttUs>%"INT32"</udpRttUs>\n",
+				      h->m_srtt);
+			sb.safePrintf("\t\t<udpRttVarUs>%"INT32"</udpRttVarUs>\n",
+				      h->m_rttVar);
+			sb.safePrintf("\t\t<udpDgramsLost>%"INT64""
+				      "</udpDgramsLost>\n",
+				      h->m_dgramsLost);
+			sb.safePrintf("\t\t<udpCwnd>%.1f</udpCwnd>\n",
+				      h->m_cwnd);
+
 			/*
 			  MDW: take out for new stuff
 			sb.safePrintf("\t\t<errorReplies>%"INT32"</errorReplies>\n",
@@ -811,6 +824,15 @@ skipReplaceHost:
 			sb.safePrintf("\t\t\"resends\":%"INT32",\n",
 				      h->m_pingInfo.m_totalResends);
 
+			sb.safePrintf("\t\t\"udpRttUs\":%"INT32",\n",
+				      h->m_srtt);
+			sb.safePrintf("\t\t\"udpRttVarUs\":%"INT32",\n",
+				      h->m_rttVar);
+			sb.safePrintf("\t\t\"udpDgramsLost\":%"INT64",\n",
+				      h->m_dgramsLost);
+			sb.safePrintf("\t\t\"udpCwnd\":%.1f,\n",
+				      h->m_cwnd);
+
 			/*
 			sb.safePrintf("\t\t\"errorReplies\":%"INT32",\n",
 				      h->m_errorReplies);
@@ -928,6 +950,9 @@ skipReplaceHost:
 			  // etryagains
 			  "<td>%"INT32"</td>"
 
+			  // udp rtt / loss / cwnd
+			  "<td><nobr>%.2fms / %.2f%% / %.0f</nobr></td>"
+
 			  // # dgrams sent to
 			  //"<td>%"INT64"</td>"
 			  // # dgrams recvd from
@@ -997,6 +1022,12 @@ skipReplaceHost:
 
 			  // h->m_errorReplies,
 			  h->m_pingInfo.m_etryagains,
+
+			  (float)h->m_srtt / 1000.0,
+			  h->m_dgramsTo ?
+			  100.0 * (float)h->m_dgramsLost / (float)h->m_dgramsTo
+			  : 0.0,
+			  h->m_cwnd,
 			  // h->m_dgramsTo,
 			  // h->m_dgramsFrom,
 
@@ -1327,6 +1358,17 @@ skipReplaceHost:
 		  "</td>"
 		  "</tr>\n"
 
+		  "<tr class=poo>"
+		  "<td>udp rtt / loss / cwnd</td>"
+		  "<td>The smoothed round trip time of datagrams we sent to "
+		  "this host and when their ACKs came back, the percent of "
+		  "datagrams we sent it that we think were lost, and how many "
+		  "unACKed datagrams we allow to it at once. Only measured "
+		  "when <i>udp congestion control</i> is enabled in the "
+		  "master controls."
+		  "</td>"
+		  "</tr>\n"
+
 		  /*
 		  "<tr class=poo>"
 		  "<td>errors recvd</td>"
@@ -31,6 +31,8 @@
 //#include "Msg0.h" // g_termlistCache
 #include "Msg13.h"
 #include "Msg3.h"
+#include "DiskPageCache.h"
+#include "RdbStripedCache.h"
 
 bool printNumAbbr ( SafeBuf &p, int64_t vvv ) {
 	float val = (float)vvv;
@@ -590,6 +592,7 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	caches[3] = g_dns.getCacheLocal();
 	caches[4] = resultsCache;
 	caches[5] = &g_spiderLoop.m_winnerListCache;
+	caches[6] = Msg39::getResultsCache();
 	//caches[5] = &g_termListCache;
 	//caches[6] = &g_genericCache[SEORESULTS_CACHEID];
 	//caches[5] = &g_qtable;
@@ -600,7 +603,7 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	//caches[6] = &g_forcedCache;
 	//caches[9] = &g_msg20Cache;
 	//caches[10] = &g_tagdb.m_listCache;
-	int32_t numCaches = 6;
+	int32_t numCaches = 7;
 
 	if ( format == FORMAT_HTML )
 		p.safePrintf (
@@ -676,6 +679,58 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 		p.safePrintf("\t},\n");
 	}
 
+	// the thread safe list caches
+	for ( int32_t i = 0 ; i < RdbStripedCache::getNumCaches() ; i++ ) {
+		RdbStripedCache *sc = RdbStripedCache::getCache(i);
+		int64_t a = sc->getNumHits();
+		int64_t b = sc->getNumMisses();
+		double r = 100.0 * (double)a / (double)(a+b);
+		if ( format == FORMAT_XML ) {
+			p.safePrintf("\t<cacheStats>\n");
+			p.safePrintf("\t\t<name>%s</name>\n",sc->getDbname());
+			p.safePrintf("\t\t<hitRatio>");
+			if ( a+b > 0 ) p.safePrintf("%.1f%%",r);
+			p.safePrintf("</hitRatio>\n");
+			p.safePrintf("\t\t<numHits>%"INT64"</numHits>\n",a);
+			p.safePrintf("\t\t<numMisses>%"INT64"</numMisses>\n",b);
+			p.safePrintf("\t\t<numTries>%"INT64"</numTries>\n",a+b);
+			p.safePrintf("\t\t<numUsedSlots>%"INT64"</numUsedSlots>\n",
+				     sc->getNumUsedNodes());
+			p.safePrintf("\t\t<numTotalSlots>%"INT64""
+				     "</numTotalSlots>\n",
+				     sc->getNumTotalNodes());
+			p.safePrintf("\t\t<bytesUsed>%"INT64"</bytesUsed>\n",
+				     sc->getMemOccupied());
+			p.safePrintf("\t\t<maxBytes>%"INT64"</maxBytes>\n",
+				     sc->getMaxMem());
+			p.safePrintf("\t\t<numRejected>%"INT64""
+				     "</numRejected>\n",
+				     sc->getNumRejects());
+			p.safePrintf("\t</cacheStats>\n");
+		}
+		if ( format == FORMAT_JSON ) {
+			p.safePrintf("\t\"cacheStats\":{\n");
+			p.safePrintf("\t\t\"name\":\"%s\",\n",sc->getDbname());
+			p.safePrintf("\t\t\"hitRatio\":\"");
+			if ( a+b > 0 ) p.safePrintf("%.1f%%",r);
+			p.safePrintf("\",\n");
+			p.safePrintf("\t\t\"numHits\":%"INT64",\n",a);
+			p.safePrintf("\t\t\"numMisses\":%"INT64",\n",b);
+			p.safePrintf("\t\t\"numTries\":%"INT64",\n",a+b);
+			p.safePrintf("\t\t\"numUsedSlots\":%"INT64",\n",
+				     sc->getNumUsedNodes());
+			p.safePrintf("\t\t\"numTotalSlots\":%"INT64",\n",
+				     sc->getNumTotalNodes());
+			p.safePrintf("\t\t\"bytesUsed\":%"INT64",\n",
+				     sc->getMemOccupied());
+			p.safePrintf("\t\t\"maxBytes\":%"INT64",\n",
+				     sc->getMaxMem());
+			p.safePrintf("\t\t\"numRejected\":%"INT64"\n",
+				     sc->getNumRejects());
+			p.safePrintf("\t},\n");
+		}
+	}
+
 
 	// do not print any more if xml or json
 	if ( format == FORMAT_XML || format == FORMAT_JSON )
@@ -761,6 +816,88 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	// end the table now
 	p.safePrintf ( "</tr>\n</table><br><br>" );
 
+	//
+	// print the striped list cache table, columns are the caches
+	//
+	if ( RdbStripedCache::getNumCaches() > 0 ) {
+		int32_t ns = RdbStripedCache::getNumCaches();
+		p.safePrintf (
+		  "<table %s>"
+		  "<tr class=hdrow>"
+		  "<td colspan=%"INT32">"
+		  "<center><b>Striped List Caches"
+		  "</b></td></tr>\n"
+		  "<tr class=poo><td>&nbsp;</td>",
+		  TABLE_STYLE,
+		  ns+1 );
+		for ( int32_t i = 0 ; i < ns ; i++ )
+			p.safePrintf("<td><b>%s</b></td>",
+				     RdbStripedCache::getCache(i)->getDbname());
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>hit ratio"
+			      "</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ ) {
+			RdbStripedCache *sc = RdbStripedCache::getCache(i);
+			int64_t a = sc->getNumHits();
+			int64_t b = sc->getNumMisses();
+			double r = 100.0 * (double)a / (double)(a+b);
+			if ( a+b > 0 ) p.safePrintf("<td>%.1f%%</td>",r);
+			else           p.safePrintf("<td>--</td>");
+		}
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>hits</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ )
+			p.safePrintf("<td>%"INT64"</td>",
+				     RdbStripedCache::getCache(i)->getNumHits());
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>tries</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ ) {
+			RdbStripedCache *sc = RdbStripedCache::getCache(i);
+			p.safePrintf("<td>%"INT64"</td>",
+				     sc->getNumHits() + sc->getNumMisses());
+		}
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>used slots"
+			      "</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ )
+			p.safePrintf("<td>%"INT64"</td>",
+			     RdbStripedCache::getCache(i)->getNumUsedNodes());
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>max slots"
+			      "</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ )
+			p.safePrintf("<td>%"INT64"</td>",
+			     RdbStripedCache::getCache(i)->getNumTotalNodes());
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>used bytes"
+			      "</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ )
+			p.safePrintf("<td>%"INT64"</td>",
+			     RdbStripedCache::getCache(i)->getMemOccupied());
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>max bytes"
+			      "</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ )
+			p.safePrintf("<td>%"INT64"</td>",
+			     RdbStripedCache::getCache(i)->getMaxMem());
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>added recs"
+			      "</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ )
+			p.safePrintf("<td>%"INT64"</td>",
+			     RdbStripedCache::getCache(i)->getNumAdds());
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>dropped recs"
+			      "</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ )
+			p.safePrintf("<td>%"INT64"</td>",
+			     RdbStripedCache::getCache(i)->getNumDrops());
+		// not admitted since the rec to evict was used more
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>rejected recs"
+			      "</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ )
+			p.safePrintf("<td>%"INT64"</td>",
+			     RdbStripedCache::getCache(i)->getNumRejects());
+		// recs that were used so they got moved back to the head
+		p.safePrintf ("</tr>\n<tr class=poo><td><b><nobr>second chances"
+			      "</td>" );
+		for ( int32_t i = 0 ; i < ns ; i++ )
+			p.safePrintf("<td>%"INT64"</td>",
+			     RdbStripedCache::getCache(i)->getNumMoves());
+		p.safePrintf ( "</tr>\n</table><br><br>" );
+	}
+
 
 
 	//
@@ -1234,8 +1371,24 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	//}
 
 
-	if ( format == FORMAT_HTML ) 
+	// dgrams moved per syscall, goes above 1.0 with batched udp io
+	if ( format == FORMAT_HTML ) {
+		UdpServer *us = &g_udpServer;
+		p.safePrintf ( "<tr class=poo><td><b>udp dgrams/syscalls in"
+			       "</b></td><td>%"INT64" / %"INT64" (%.02f)"
+			       "</td></tr>\n"
+			       "<tr class=poo><td><b>udp dgrams/syscalls out"
+			       "</b></td><td>%"INT64" / %"INT64" (%.02f)"
+			       "</td></tr>\n"
+			       , us->m_recvDgrams , us->m_recvCalls
+			       , us->m_recvCalls ?
+			       (float)us->m_recvDgrams/us->m_recvCalls : 0.0
+			       , us->m_sendDgrams , us->m_sendCalls
+			       , us->m_sendCalls ?
+			       (float)us->m_sendDgrams/us->m_sendCalls : 0.0
+			       );
 		p.safePrintf ( "</table><br><br>\n" );
+	}
 
 
 	if ( g_hostdb.m_myHost->m_isProxy ) {
@@ -2089,17 +2242,64 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	*/
 
 
+	// . bytes dumped from memory vs. bytes rewritten by merges
+	// . write amplification is how many bytes hit the disk for every
+	//   byte we dumped. see "merge policy" in the master controls.
+	p.safePrintf("<tr class=poo><td><b>bytes dumped</b></td>");
+	total = 0;
+	for ( int32_t i = 0 ; i < nr ; i++ ) {
+		int64_t val = rdbs[i]->m_bytesDumped;
+		total += val;
+		printNumAbbr ( p , val );
+	}
+	p.safePrintf("<td>%"UINT64"</td></tr>\n",total);
+
+	p.safePrintf("<tr class=poo><td><b>bytes merged</b></td>");
+	total = 0;
+	for ( int32_t i = 0 ; i < nr ; i++ ) {
+		int64_t val = rdbs[i]->m_bytesMerged;
+		total += val;
+		printNumAbbr ( p , val );
+	}
+	p.safePrintf("<td>%"UINT64"</td></tr>\n",total);
+
+	p.safePrintf("<tr class=poo><td><b>write amplification</b></td>");
+	int64_t totalDumped = 0;
+	int64_t totalMerged = 0;
+	for ( int32_t i = 0 ; i < nr ; i++ ) {
+		int64_t dumped = rdbs[i]->m_bytesDumped;
+		int64_t merged = rdbs[i]->m_bytesMerged;
+		totalDumped += dumped;
+		totalMerged += merged;
+		if ( dumped <= 0 ) {
+			p.safePrintf("<td>--</td>");
+			continue;
+		}
+		p.safePrintf("<td>%.2f</td>",
+			     (double)(dumped+merged)/(double)dumped);
+	}
+	if ( totalDumped > 0 )
+		p.safePrintf("<td>%.2f</td></tr>\n",
+			     (double)(totalDumped+totalMerged)/
+			     (double)totalDumped);
+	else
+		p.safePrintf("<td>--</td></tr>\n");
+
+
 	p.safePrintf("<tr class=poo><td><b>file cache hits %%</b></td>");
 	totalf = 0.0;
 	for ( int32_t i = 0 ; i < nr ; i++ ) {
 		Rdb *rdb = rdbs[i];
 		RdbCache *rpc = getDiskPageCache ( rdb->m_rdbId );
-		if ( ! rpc ) {
+		// or the striped one if used instead
+		RdbStripedCache *spc = getStripedListCache ( rdb->m_rdbId );
+		if ( ! rpc && ! spc ) {
 			p.safePrintf("<td>--</td>");
 			continue;
 		}
-		int64_t hits   = rpc->getNumHits();
-		int64_t misses = rpc->getNumMisses();
+		int64_t hits   = spc ? spc->getNumHits() : rpc->getNumHits();
+		int64_t misses = spc ? spc->getNumMisses() :
+			rpc->getNumMisses();
 		int64_t sum    = hits + misses;
 		float val = 0.0;
 		if ( sum > 0.0 ) val = ((float)hits * 100.0) / (float)sum;
@@ -2117,11 +2317,13 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	for ( int32_t i = 0 ; i < nr ; i++ ) {
 		Rdb *rdb = rdbs[i];
 		RdbCache *rpc = getDiskPageCache ( rdb->m_rdbId );
-		if ( ! rpc ) {
+		// or the striped one if used instead
+		RdbStripedCache *spc = getStripedListCache ( rdb->m_rdbId );
+		if ( ! rpc && ! spc ) {
 			p.safePrintf("<td>--</td>");
 			continue;
 		}
-		int64_t val = rpc->getNumHits();
+		int64_t val = spc ? spc->getNumHits() : rpc->getNumHits();
 		total += val;
 		p.safePrintf("<td>%"UINT64"</td>",val);
 	}
@@ -2133,11 +2335,13 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	for ( int32_t i = 0 ; i < nr ; i++ ) {
 		Rdb *rdb = rdbs[i];
 		RdbCache *rpc = getDiskPageCache ( rdb->m_rdbId );
-		if ( ! rpc ) {
+		// or the striped one if used instead
+		RdbStripedCache *spc = getStripedListCache ( rdb->m_rdbId );
+		if ( ! rpc && ! spc ) {
 			p.safePrintf("<td>--</td>");
 			continue;
 		}
-		int64_t val = rpc->getNumMisses();
+		int64_t val = spc ? spc->getNumMisses() : rpc->getNumMisses();
 		total += val;
 		p.safePrintf("<td>%"UINT64"</td>",val);
 	}
@@ -2149,12 +2353,15 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	for ( int32_t i = 0 ; i < nr ; i++ ) {
 		Rdb *rdb = rdbs[i];
 		RdbCache *rpc = getDiskPageCache ( rdb->m_rdbId );
-		if ( ! rpc ) {
+		// or the striped one if used instead
+		RdbStripedCache *spc = getStripedListCache ( rdb->m_rdbId );
+		if ( ! rpc && ! spc ) {
 			p.safePrintf("<td>--</td>");
 			continue;
 		}
-		int64_t hits   = rpc->getNumHits();
-		int64_t misses = rpc->getNumMisses();
+		int64_t hits   = spc ? spc->getNumHits() : rpc->getNumHits();
+		int64_t misses = spc ? spc->getNumMisses() :
+			rpc->getNumMisses();
 		int64_t val    = hits + misses;
 		total += val;
 		p.safePrintf("<td>%"UINT64"</td>",val);
@@ -2167,11 +2374,14 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	for ( int32_t i = 0 ; i < nr ; i++ ) {
 		Rdb *rdb = rdbs[i];
 		RdbCache *rpc = getDiskPageCache ( rdb->m_rdbId );
-		if ( ! rpc ) {
+		// or the striped one if used instead
+		RdbStripedCache *spc = getStripedListCache ( rdb->m_rdbId );
+		if ( ! rpc && ! spc ) {
 			p.safePrintf("<td>--</td>");
 			continue;
 		}
-		p.safePrintf("<td>%"UINT64"</td>",rpc->m_adds);
+		int64_t val = spc ? spc->getNumAdds() : rpc->m_adds;
+		p.safePrintf("<td>%"UINT64"</td>",val);
 	}
 	p.safePrintf("<td>%"UINT64"</td></tr>\n",total);
 
@@ -2181,11 +2391,14 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	for ( int32_t i = 0 ; i < nr ; i++ ) {
 		Rdb *rdb = rdbs[i];
 		RdbCache *rpc = getDiskPageCache ( rdb->m_rdbId );
-		if ( ! rpc ) {
+		// or the striped one if used instead
+		RdbStripedCache *spc = getStripedListCache ( rdb->m_rdbId );
+		if ( ! rpc && ! spc ) {
 			p.safePrintf("<td>--</td>");
 			continue;
 		}
-		p.safePrintf("<td>%"UINT64"</td>",rpc->m_deletes);
+		int64_t val = spc ? spc->getNumDrops() : rpc->m_deletes;
+		p.safePrintf("<td>%"UINT64"</td>",val);
 	}
 	p.safePrintf("<td>%"UINT64"</td></tr>\n",total);
 
@@ -2195,11 +2408,14 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	for ( int32_t i = 0 ; i < nr ; i++ ) {
 		Rdb *rdb = rdbs[i];
 		RdbCache *rpc = getDiskPageCache ( rdb->m_rdbId );
-		if ( ! rpc ) {
+		// or the striped one if used instead
+		RdbStripedCache *spc = getStripedListCache ( rdb->m_rdbId );
+		if ( ! rpc && ! spc ) {
 			p.safePrintf("<td>--</td>");
 			continue;
 		}
-		int64_t val = rpc->getMemOccupied();
+		int64_t val = spc ? spc->getMemOccupied() :
+			rpc->getMemOccupied();
 		total += val;
 		printNumAbbr ( p , val );
 	}
@@ -2211,17 +2427,118 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	for ( int32_t i = 0 ; i < nr ; i++ ) {
 		Rdb *rdb = rdbs[i];
 		RdbCache *rpc = getDiskPageCache ( rdb->m_rdbId );
-		if ( ! rpc ) {
+		// or the striped one if used instead
+		RdbStripedCache *spc = getStripedListCache ( rdb->m_rdbId );
+		if ( ! rpc && ! spc ) {
+			p.safePrintf("<td>--</td>");
+			continue;
+		}
+		int64_t val = spc ? spc->getMemAlloced() :
+			rpc->getMemAlloced();
+		total += val;
+		printNumAbbr ( p , val );
+	}
+	p.safePrintf("<td>%"UINT64"</td></tr>\n",total);
+
+
+
+
+	p.safePrintf("<tr class=poo><td><b>page cache hits %%</b></td>");
+	for ( int32_t i = 0 ; i < nr ; i++ ) {
+		Rdb *rdb = rdbs[i];
+		DiskPageCache *pc = getBigFilePageCache ( rdb->m_rdbId );
+		if ( ! pc ) {
+			p.safePrintf("<td>--</td>");
+			continue;
+		}
+		int64_t hits   = pc->getNumHits();
+		int64_t misses = pc->getNumMisses();
+		int64_t sum    = hits + misses;
+		float val = 0.0;
+		if ( sum > 0.0 ) val = ((float)hits * 100.0) / (float)sum;
+		p.safePrintf("<td>%.1f%%</td>",val);
+	}
+	p.safePrintf("<td>--</td></tr>\n");
+
+
+	p.safePrintf("<tr class=poo><td><b>page cache hits</b></td>");
+	total = 0;
+	for ( int32_t i = 0 ; i < nr ; i++ ) {
+		Rdb *rdb = rdbs[i];
+		DiskPageCache *pc = getBigFilePageCache ( rdb->m_rdbId );
+		if ( ! pc ) {
+			p.safePrintf("<td>--</td>");
+			continue;
+		}
+		int64_t val = pc->getNumHits();
+		total += val;
+		p.safePrintf("<td>%"UINT64"</td>",val);
+	}
+	p.safePrintf("<td>%"UINT64"</td></tr>\n",total);
+
+
+	p.safePrintf("<tr class=poo><td><b>page cache misses</b></td>");
+	total = 0;
+	for ( int32_t i = 0 ; i < nr ; i++ ) {
+		Rdb *rdb = rdbs[i];
+		DiskPageCache *pc = getBigFilePageCache ( rdb->m_rdbId );
+		if ( ! pc ) {
+			p.safePrintf("<td>--</td>");
+			continue;
+		}
+		int64_t val = pc->getNumMisses();
+		total += val;
+		p.safePrintf("<td>%"UINT64"</td>",val);
+	}
+	p.safePrintf("<td>%"UINT64"</td></tr>\n",total);
+
+
+	p.safePrintf("<tr class=poo><td><b>page cache drops</b></td>");
+	total = 0;
+	for ( int32_t i = 0 ; i < nr ; i++ ) {
+		Rdb *rdb = rdbs[i];
+		DiskPageCache *pc = getBigFilePageCache ( rdb->m_rdbId );
+		if ( ! pc ) {
 			p.safePrintf("<td>--</td>");
 			continue;
 		}
-		int64_t val = rpc->getMemAlloced();
+		int64_t val = pc->m_numDrops;
+		total += val;
+		p.safePrintf("<td>%"UINT64"</td>",val);
+	}
+	p.safePrintf("<td>%"UINT64"</td></tr>\n",total);
+
+
+	p.safePrintf("<tr class=poo><td><b>page cache used</b></td>");
+	total = 0;
+	for ( int32_t i = 0 ; i < nr ; i++ ) {
+		Rdb *rdb = rdbs[i];
+		DiskPageCache *pc = getBigFilePageCache ( rdb->m_rdbId );
+		if ( ! pc ) {
+			p.safePrintf("<td>--</td>");
+			continue;
+		}
+		int64_t val = pc->getMemUsed();
 		total += val;
 		printNumAbbr ( p , val );
 	}
 	p.safePrintf("<td>%"UINT64"</td></tr>\n",total);
 
 
+	p.safePrintf("<tr class=poo><td><b><nobr>page cache allocated</nobr></b></td>");
+	total = 0;
+	for ( int32_t i = 0 ; i < nr ; i++ ) {
+		Rdb *rdb = rdbs[i];
+		DiskPageCache *pc = getBigFilePageCache ( rdb->m_rdbId );
+		if ( ! pc ) {
+			p.safePrintf("<td>--</td>");
+			continue;
+		}
+		int64_t val = pc->getMemAlloced();
+		total += val;
+		printNumAbbr ( p , val );
+	}
+	p.safePrintf("<td>%"UINT64"</td></tr>\n",total);
 
 
 	p.safePrintf("<tr class=poo><td><b># disk seeks</b></td>");
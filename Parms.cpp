@@ -11415,6 +11415,353 @@ void Parms::init ( ) {
 	m->m_obj   = OBJ_CONF;
 	m++;
 
+	m->m_title = "use epoll";
+	m->m_desc  = "If enabled, Gigablast will use epoll instead of select "
+		"to wait on sockets. This lifts the 1024 file descriptor "
+		"limit of select and is much faster with thousands of "
+		"open sockets. Takes effect on restart.";
+	m->m_cgi   = "uepoll";
+	m->m_off   = (char *)&g_conf.m_useEpoll - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
+	m->m_title = "use io_uring";
+	m->m_desc  = "If enabled, Gigablast will do non-blocking disk reads "
+		"and writes with io_uring instead of disk threads, so it "
+		"can have hundreds of reads outstanding without a thread "
+		"for each. Needs Linux 5.6 or later, otherwise disk threads "
+		"are used.";
+	m->m_cgi   = "uiour";
+	m->m_off   = (char *)&g_conf.m_useIoUring - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "mmap rdb maps";
+	m->m_desc  = "If enabled, Gigablast will mmap the .map files of the "
+		"rdb files when it starts up instead of reading them into "
+		"memory, so startup is much faster and the maps share memory "
+		"with the kernel's page cache. A map is copied into memory "
+		"if it is ever added to. Takes effect on restart.";
+	m->m_cgi   = "mmrm";
+	m->m_off   = (char *)&g_conf.m_mmapRdbMaps - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "mmap rdb files";
+	m->m_desc  = "If enabled, Gigablast will mmap rdb files that are "
+		"done being merged and serve reads from the mmap, without "
+		"using a disk thread, when the kernel already has the pages "
+		"of the read in memory.";
+	m->m_cgi   = "mmrf";
+	m->m_off   = (char *)&g_conf.m_mmapRdbFiles - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "use zstd for titlerecs";
+	m->m_desc  = "If enabled, Gigablast will compress new titledb "
+		"records with zstd instead of zlib, using a dictionary "
+		"trained on the first few thousand titledb records of the "
+		"collection. That makes titledb smaller and summaries "
+		"faster to generate. Old records are still read. Needs gb "
+		"to be compiled with zstd.";
+	m->m_cgi   = "uztr";
+	m->m_off   = (char *)&g_conf.m_useZstdTitleRecs - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "titlerec zstd level";
+	m->m_desc  = "The zstd compression level to use for titledb "
+		"records, 1 to 19. Higher is smaller but slower to "
+		"compress. It does not change how fast they uncompress. "
+		"Takes effect on restart.";
+	m->m_cgi   = "ztrl";
+	m->m_off   = (char *)&g_conf.m_zstdTitleRecLevel - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "3";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "merge read ahead";
+	m->m_desc  = "If enabled, a merge will read and merge the next "
+		"list from the files being merged while the last list is "
+		"still being written to the merged file.";
+	m->m_cgi   = "mra";
+	m->m_off   = (char *)&g_conf.m_mergeReadAhead - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "merge policy";
+	m->m_desc  = "How to pick the files to merge. 0 = classic, merge "
+		"when a db has its min files to merge. 1 = size-tiered, "
+		"merge runs of similarly sized files, which writes the "
+		"least. 2 = leveled, keep every file merge size ratio times "
+		"bigger than all newer files combined, which keeps the "
+		"fewest files to read. The min files to merge settings "
+		"still force a merge in all of them.";
+	m->m_cgi   = "mpol";
+	m->m_off   = (char *)&g_conf.m_mergePolicy - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "merge size ratio";
+	m->m_desc  = "For the size-tiered merge policy, files whose sizes "
+		"are within this ratio are in the same tier. For the leveled "
+		"merge policy, how much bigger each file should be than all "
+		"the newer files combined.";
+	m->m_cgi   = "msr";
+	m->m_off   = (char *)&g_conf.m_mergeSizeRatio - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "4";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "merge tier min files";
+	m->m_desc  = "For the size-tiered merge policy, merge a tier once "
+		"it has this many files.";
+	m->m_cgi   = "mtmf";
+	m->m_off   = (char *)&g_conf.m_mergeTierMinFiles - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "4";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "batch udp io";
+	m->m_desc  = "If enabled, read and send up to 16 datagrams per system "
+		"call using recvmmsg() and sendmmsg(). The datagrams per "
+		"call are shown on the stats page. Takes effect when gb "
+		"is restarted.";
+	m->m_cgi   = "bui";
+	m->m_off   = (char *)&g_conf.m_udpBatchIo - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "udp congestion control";
+	m->m_desc  = "If enabled, limit the unacknowledged datagrams we send "
+		"to each host with a congestion window that grows as acks "
+		"come back and shrinks on loss, pace the sends over the "
+		"measured round trip time, and base resend times on it. "
+		"Otherwise use a fixed window of 4 datagrams per "
+		"transaction.";
+	m->m_cgi   = "ucc";
+	m->m_off   = (char *)&g_conf.m_udpCongestionControl - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "msg39 cache max age";
+	m->m_desc  = "Each host caches the docids it intersected for a query "
+		"so the next page of results, or the same query from another "
+		"frontend, does not redo the intersection. Cached replies are "
+		"dropped when posdb dumps or merges, but docs added to the "
+		"posdb tree are only seen after this many seconds. Use 0 to "
+		"disable the cache.";
+	m->m_cgi   = "mcma";
+	m->m_off   = (char *)&g_conf.m_msg39CacheMaxAge - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "60";
+	m->m_units = "seconds";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "msg39 cache mem";
+	m->m_desc  = "Bytes of memory to use for the msg39 cache. Takes "
+		"effect when gb is restarted.";
+	m->m_cgi   = "mcm";
+	m->m_off   = (char *)&g_conf.m_msg39CacheMem - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "20000000";
+	m->m_units = "bytes";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "msg4 max latency";
+	m->m_desc  = "Records added to the index are buffered per shard and "
+		"sent once the oldest has waited this long, or sooner if "
+		"the buffer reaches the shard's batch size. The batch size "
+		"grows for shards that are slow to reply.";
+	m->m_cgi   = "mml";
+	m->m_off   = (char *)&g_conf.m_msg4MaxLatency - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "50";
+	m->m_units = "milliseconds";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "compress msg4 requests";
+	m->m_desc  = "If enabled, deflate the buffered records before "
+		"sending them to a shard if that makes them at least 1/8 "
+		"smaller. Only enable this once all hosts are running a gb "
+		"that understands compressed requests.";
+	m->m_cgi   = "cm4";
+	m->m_off   = (char *)&g_conf.m_compressMsg4 - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "spider backoff tree percent";
+	m->m_desc  = "Do not launch more spiders while a shard says the "
+		"tree or memory of one of its rdbs is at least this "
+		"percent full, so it can finish dumping before the adds "
+		"from new spiders get ETRYAGAIN. Use 0 to disable.";
+	m->m_cgi   = "sbtp";
+	m->m_off   = (char *)&g_conf.m_spiderBackoffTreePercent - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "95";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "use skiplist memtable";
+	m->m_desc  = "If enabled, posdb keeps the keys it has not dumped yet "
+		"in a concurrent skiplist instead of in sorted buckets. Adds "
+		"and reads of it take no locks, so they do not have to be "
+		"done from the main loop. It saves in the same format as the "
+		"buckets so this can be switched back and forth. Takes "
+		"effect on restart.";
+	m->m_cgi   = "usm";
+	m->m_off   = (char *)&g_conf.m_useSkipListMemtable - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "double buffer memtables";
+	m->m_desc  = "If enabled, posdb splits its tree memory into two "
+		"halves. When one half fills up it is sealed and dumped to "
+		"disk while adds go into the other half, so adds do not have "
+		"to wait for the dump. Takes effect on restart.";
+	m->m_cgi   = "dbm";
+	m->m_off   = (char *)&g_conf.m_doubleBufferMemtables - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "bloom filter bits per key";
+	m->m_desc  = "Titledb, clusterdb, tagdb and spiderdb files made by "
+		"dumps and merges get a bloom filter of their docids, sites "
+		"or ips with this many bits per key. Lookups of one docid, "
+		"site or ip skip the files it says do not have it. 10 bits "
+		"gives about 1% false positives. Use 0 to make none.";
+	m->m_cgi   = "bfbpk";
+	m->m_off   = (char *)&g_conf.m_bloomBitsPerKey - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "10";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "use block compression";
+	m->m_desc  = "If enabled, linkdb and spiderdb files made by dumps and "
+		"merges store their records in blocks of about 16KB. Each "
+		"key only stores the bytes that differ from the key before "
+		"it and the block is then compressed with zstd or zlib. The "
+		"files take a fraction of the disk and reading them moves "
+		"far fewer bytes. Files already on disk are read either "
+		"way, so this can be turned off again.";
+	m->m_cgi   = "ubc";
+	m->m_off   = (char *)&g_conf.m_useBlockCompression - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "use striped list caches";
+	m->m_desc  = "If enabled, the caches of lists read from posdb, "
+		"tagdb, clusterdb, titledb and spiderdb files are split into "
+		"stripes with their own locks so threads can use them. A "
+		"list that was used again survives eviction and a new list "
+		"only gets in if it was asked for at least as often as the "
+		"one it would evict, so big scans do not flush out the hot "
+		"lists. The hit ratios are on the stats page.";
+	m->m_cgi   = "uslc";
+	m->m_off   = (char *)&g_conf.m_useStripedListCache - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
 // 	m->m_title = "quickpoll core on error";
 // 	m->m_desc  = "If enabled, quickpoll will terminate the process and "
 // 		"generate a core file when callbacks are called with the "
@@ -11531,6 +11878,65 @@ void Parms::init ( ) {
 	m->m_group = 0;
 	m++;
 
+	m->m_title = "posdb page cache size";
+	m->m_desc  = "How much memory in bytes to use for caching the pages "
+		"of the posdb files? Posdb is the index. Queries that read "
+		"parts of the same termlists hit these pages even when the "
+		"disk cache above, which caches whole lists, misses.";
+	m->m_cgi   = "pcsp";
+	m->m_off   = (char *)&g_conf.m_posdbPageCacheSize - g;
+	m->m_type  = TYPE_LONG_LONG;
+	m->m_def   = "30000000";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
+	m->m_title = "titledb page cache size";
+	m->m_desc  = "How much memory in bytes to use for caching the pages "
+		"of the titledb files? Titledb holds the cached web pages, "
+		"compressed. Summaries of popular search results read the "
+		"same title recs again and again.";
+	m->m_cgi   = "pcsx";
+	m->m_off   = (char *)&g_conf.m_titledbPageCacheSize - g;
+	m->m_type  = TYPE_LONG_LONG;
+	m->m_def   = "30000000";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "clusterdb page cache size";
+	m->m_desc  = "How much memory in bytes to use for caching the pages "
+		"of the clusterdb files? Site clustering reads a small "
+		"record for every docid of a result set, so a little "
+		"memory here saves a lot of seeks.";
+	m->m_cgi   = "pcsc";
+	m->m_off   = (char *)&g_conf.m_clusterdbPageCacheSize - g;
+	m->m_type  = TYPE_LONG_LONG;
+	m->m_def   = "30000000";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "tagdb page cache size";
+	m->m_desc  = "How much memory in bytes to use for caching the pages "
+		"of the tagdb files? Tagdb holds the siterank and ban info "
+		"of sites. The spider looks up the same few sites for most "
+		"of the urls it adds.";
+	m->m_cgi   = "pcst";
+	m->m_off   = (char *)&g_conf.m_tagdbPageCacheSize - g;
+	m->m_type  = TYPE_LONG_LONG;
+	m->m_def   = "30000000";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
 
 
 	/*
@@ -12362,6 +12768,24 @@ void Parms::init ( ) {
 	m->m_group = 0;
 	m++;
 
+	m->m_title = "max parallel docid splits";
+	m->m_desc  = "When a query is broken up into docid range splits to "
+		"save memory, intersect up to this many of those splits at "
+		"the same time, each with its own top tree, then merge the "
+		"winners. Each split in flight holds its own termlists in "
+		"memory. Use 1 to intersect the splits one at a time.";
+	m->m_cgi   = "mpds";
+	m->m_off   = (char *)&g_conf.m_maxParallelDocIdSplits - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "4";
+	m->m_units = "splits";
+	m->m_min   = 1;
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
 	m->m_title = "max cpu merge threads";
 	m->m_desc  = "Maximum number of threads to use per Gigablast process "
 		"for merging lists read from disk.";
@@ -12377,6 +12801,53 @@ void Parms::init ( ) {
 	m->m_group = 0;
 	m++;
 
+	m->m_title = "use thread pool";
+	m->m_desc  = "Run the threads that merge lists read from disk and "
+		"intersect docid lists in a pool of workers, one per core, "
+		"that steal work from each other and run niceness 0 work "
+		"first. Then the max cpu threads and max cpu merge threads "
+		"limits do not apply. Disk threads are not affected.";
+	m->m_cgi   = "utp";
+	m->m_off   = (char *)&g_conf.m_useThreadPool - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "thread pool threads";
+	m->m_desc  = "How many workers to start for the thread pool. Use 0 "
+		"for one per core. Takes effect when the pool is first used, "
+		"so changing it needs a restart.";
+	m->m_cgi   = "tpt";
+	m->m_off   = (char *)&g_conf.m_threadPoolThreads - g;
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "0";
+	m->m_units = "threads";
+	m->m_min   = 0;
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
+	m->m_title = "use threads for indexing";
+	m->m_desc  = "Parse the html of a doc being indexed and hash its "
+		"terms in the thread pool so the docs being spidered at the "
+		"same time use all the cores and do not hold up the main "
+		"loop. Needs use thread pool to be on.";
+	m->m_cgi   = "uith";
+	m->m_off   = (char *)&g_conf.m_useIndexThreads - g;
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = 0;
+	m++;
+
 	m->m_title = "max write threads";
 	m->m_desc  = "Maximum number of threads to use per Gigablast process "
 		"for writing data to the disk. "
@@ -1,10 +1,12 @@
 #include "gb-include.h"
 
 #include "Phrases.h"
+#include "Arena.h"
 #include "Mem.h"
 
 Phrases::Phrases ( ) {
 	m_buf = NULL;
+	m_arena = NULL;
 	//m_phraseScores = NULL;
 	m_phraseSpam   = NULL;
 	//m_phraseIds    = NULL;
@@ -15,7 +17,7 @@ Phrases::~Phrases ( ) {
 }
 
 void Phrases::reset() {
-	if ( m_buf && m_buf != m_localBuf )
+	if ( m_buf && m_buf != m_localBuf && ! m_arena )
 		mfree ( m_buf , m_bufSize , "Phrases" );
 	m_buf = NULL;
 	//m_phraseScores = NULL;
@@ -65,7 +67,9 @@ bool Phrases::set( Words    *words,
 	//if ( m_wordScores ) need += 4 * m_numPhrases;
 
 	// alloc if we need to
-	if ( need > PHRASE_BUF_SIZE ) 
+	if ( need > PHRASE_BUF_SIZE && m_arena )
+		m_buf = m_arena->alloc ( need );
+	else if ( need > PHRASE_BUF_SIZE ) 
 		m_buf = (char *)mmalloc ( need , "Phrases" );
 	else
 		m_buf = m_localBuf;
@@ -108,6 +108,9 @@ class Phrases {
 
 	char  m_localBuf [ PHRASE_BUF_SIZE ];
 
+	// XmlDoc's arena, alloc m_buf from it and do not free it
+	class Arena *m_arena;
+
 	char *m_buf;
 	int32_t  m_bufSize;
 
@@ -611,6 +611,11 @@ int64_t Posdb::getTermFreq ( collnum_t collnum, int64_t termId ) {
 						(char *)&startKey,
 						(char *)&endKey,
 						NULL,NULL);
+	if ( m_rdb.m_doubleBuffer )
+		numBytes += m_rdb.m_sealedBuckets.getListSize(collnum,
+							(char *)&startKey,
+							(char *)&endKey,
+							NULL,NULL);
 
 
 
@@ -4832,6 +4837,27 @@ bool PosdbTable::setQueryTermInfo ( ) {
 	// get max # of docids we got in an intersection from all the lists
 	if ( ! m_docIdVoteBuf.reserve ( need,"divbuf" ) ) return false;
 
+	// . block-max early termination only applies where 
+	//   intersectLists10_r() uses getMaxPossibleScore()
+	// . alloc here since we can not alloc in the intersection thread
+	m_useBlockMax = ( m_msg2 && 
+			  ! m_q->m_isBoolean && 
+			  m_r->m_doMaxScoreAlgo );
+	m_numBlocks = maxDocIds / BLOCKMAX_DOCIDS + 1;
+	m_numBlockSubLists = 0;
+	for ( int32_t i = 0 ; i < m_numQueryTermInfos ; i++ ) {
+		qip[i].m_blockSubListOffset = m_numBlockSubLists;
+		m_numBlockSubLists += qip[i].m_numSubLists;
+	}
+	int32_t bmNeed = m_numBlocks * m_numQueryTermInfos * sizeof(BlockMax);
+	int32_t bcNeed = m_numBlocks * m_numBlockSubLists * sizeof(char *);
+	// do not go crazy on memory
+	if ( bmNeed + bcNeed > 50000000 ) m_useBlockMax = false;
+	if ( m_useBlockMax && ! m_blockMaxBuf.reserve ( bmNeed , "bmbuf" ) )
+		return false;
+	if ( m_useBlockMax && ! m_blockCursorBuf.reserve ( bcNeed,"bcbuf") )
+		return false;
+
 	// i'm feeling if a boolean query put this in there too, the
 	// hashtable that maps each docid to its boolean bit vector
 	// where each bit stands for an operand so we can quickly evaluate
@@ -4868,6 +4894,54 @@ bool PosdbTable::setQueryTermInfo ( ) {
 	return true;
 }
 
+// . is the docid of the 12-byte posdb key "rec" less than the docid of
+//   the 6-byte docid vote buf entry "dp"?
+static inline bool isDocIdLess ( char *rec , char *dp ) {
+	if ( *(uint32_t *)(rec+8) < *(uint32_t *)(dp+1) ) return true;
+	if ( *(uint32_t *)(rec+8) > *(uint32_t *)(dp+1) ) return false;
+	return ( (*(unsigned char *)(rec+7) & 0xfc) < *(unsigned char *)dp );
+}
+
+// . back up from the 6-byte boundary "u" to the start of the 12-byte key
+//   at or before it, but do not go before "lo" which is a 12-byte key
+// . the alignment bit is set in every 6-byte word position key and in
+//   the low half of every 12-byte key, but it is clear in the docid half,
+//   see getWordPosList()
+static inline char *getDocIdKey ( char *u , char *lo ) {
+	for ( ; u > lo + 6 && ( u[1] & 0x02 ) ; u -= 6 );
+	return u - 6;
+}
+
+// . "rec" is a 12-byte key in a posdb sublist whose docid is less than
+//   the docid at "dp" in the docid vote buf
+// . gallop forward to the last 12-byte key whose docid is still less 
+//   than "dp" so the caller does not have to walk every key of a huge
+//   termlist when intersecting it with a small docid vote buf
+// . the caller then steps over the returned key like it always did
+static inline char *gallopToDocId ( char *rec , char *recEnd , char *dp ) {
+	char *lo = rec;
+	char *hi = recEnd;
+	// step is always a multiple of 6 bytes so we land on a key boundary
+	int32_t step = 6 * 16;
+	// exponential search for a key at or past "dp"
+	for ( ; step < hi - lo ; step <<= 1 ) {
+		char *k = getDocIdKey ( lo + step , lo );
+		if ( isDocIdLess ( k , dp ) ) { lo = k; continue; }
+		hi = k;
+		break;
+	}
+	// then binary search down to a handful of keys. the caller will
+	// scan the rest.
+	while ( hi - lo > 6 * 32 ) {
+		char *k = getDocIdKey ( lo + ((hi - lo) / 12) * 6 , lo );
+		// probably one doc with a ton of word positions
+		if ( k == lo ) break;
+		if ( isDocIdLess ( k , dp ) ) lo = k;
+		else                          hi = k;
+	}
+	return lo;
+}
+
 void PosdbTable::rmDocIdVotes ( QueryTermInfo *qti ) {
 	// int16_tcut
 	char *bufStart = m_docIdVoteBuf.getBufStart();
@@ -4876,6 +4950,7 @@ void PosdbTable::rmDocIdVotes ( QueryTermInfo *qti ) {
 	register char *dpEnd;
 	register char *recPtr     ;
 	char          *subListEnd ;
+	bool           gallop     ;
 
 	// just scan each sublist vs. the docid list
 	for ( int32_t i = 0 ; i < qti->m_numSubLists  ; i++ ) {
@@ -4885,6 +4960,8 @@ void PosdbTable::rmDocIdVotes ( QueryTermInfo *qti ) {
 		// reset docid list ptrs
 		dp    =      m_docIdVoteBuf.getBufStart();
 		dpEnd = dp + m_docIdVoteBuf.length();
+		// skip through the sublist if it is much bigger than us
+		gallop = ( subListEnd - recPtr > 32 * ( dpEnd - dp ) );
 		// loop it
 	subLoop:
 		// scan for his docids and inc the vote
@@ -4915,6 +4992,9 @@ void PosdbTable::rmDocIdVotes ( QueryTermInfo *qti ) {
 		}
 		// if we've exhausted this docid list go to next sublist
 		if ( dp >= dpEnd ) continue;
+		// jump over the docids we do not have
+		if ( gallop && isDocIdLess ( recPtr , dp ) )
+			recPtr = gallopToDocId ( recPtr , subListEnd , dp );
 		// skip that docid record in our termlist. it MUST have been
 		// 12 bytes, a docid heading record.
 		recPtr += 12;
@@ -5052,6 +5132,7 @@ void PosdbTable::addDocIdVotes ( QueryTermInfo *qti , int32_t   listGroupNum) {
 	register char *dpEnd;
 	register char *recPtr     ;
 	char          *subListEnd ;
+	bool           gallop     ;
 
 	// range terms tend to disappear if the docid's value falls outside
 	// of the specified range... gbmin:offerprice:190
@@ -5090,6 +5171,11 @@ void PosdbTable::addDocIdVotes ( QueryTermInfo *qti , int32_t   listGroupNum) {
 		// reset docid list ptrs
 		dp    =      m_docIdVoteBuf.getBufStart();
 		dpEnd = dp + m_docIdVoteBuf.length();
+		// . the docid vote buf came from the smallest group of
+		//   sublists, so if this sublist is much bigger, like for
+		//   a stopword-ish term, skip through it rather than walk
+		//   every key of it
+		gallop = ( subListEnd - recPtr > 32 * ( dpEnd - dp ) );
 		// loop it
 	subLoop:
 		// scan for his docids and inc the vote
@@ -5136,6 +5222,10 @@ void PosdbTable::addDocIdVotes ( QueryTermInfo *qti , int32_t   listGroupNum) {
 		// of the docids for each queryterm
 		if ( dp >= dpEnd ) continue;
 
+		// jump over the docids that are not in the intersection
+		if ( gallop && isDocIdLess ( recPtr , dp ) )
+			recPtr = gallopToDocId ( recPtr , subListEnd , dp );
+
 		// skip that docid record in our termlist. it MUST have been
 		// 12 bytes, a docid heading record.
 		recPtr += 12;
@@ -5331,11 +5421,43 @@ void PosdbTable::addDocIdVotes ( QueryTermInfo *qti , int32_t   listGroupNum) {
 	goto getMin;
 }
 
+// . record the upper bounds of the key at "p" into the block max "bm"
+// . works for the 6-byte part of 6 and 12 byte posdb keys
+static inline void addToBlockMax ( BlockMax *bm , char *p ) {
+	unsigned char hg = g_posdb.getHashGroup ( p );
+	if ( hg == HASHGROUP_INLINKTEXT ) bm->m_flags |= BMF_INLINKTEXT;
+	float hw = s_hashGroupWeights [ hg ];
+	if ( hw > bm->m_hashGroupWeight ) bm->m_hashGroupWeight = hw;
+	float dw = s_densityWeights [ g_posdb.getDensityRank ( p ) ];
+	if ( dw > bm->m_densityWeight ) bm->m_densityWeight = dw;
+}
+
 void PosdbTable::shrinkSubLists ( QueryTermInfo *qti ) {
 
 	// reset count of new sublists
 	qti->m_numNewSubLists = 0;
 
+	// . the block max info for this query term
+	// . it is the max over all of our sublists
+	BlockMax *bms     = NULL;
+	char    **bcs     = NULL;
+	int32_t   bstride = m_numBlockSubLists;
+	char     *dpStart = m_docIdVoteBuf.getBufStart();
+	if ( m_useBlockMax ) {
+		QueryTermInfo *qip = (QueryTermInfo *)m_qiBuf.getBufStart();
+		bms  = (BlockMax *)m_blockMaxBuf.getBufStart();
+		bms += qti - qip;
+		bcs  = (char **)m_blockCursorBuf.getBufStart();
+		bcs += qti->m_blockSubListOffset;
+		for ( int32_t b = 0 ; b < m_numBlocks ; b++ ) {
+			BlockMax *bm = &bms[b * m_numQueryTermInfos];
+			bm->m_hashGroupWeight = -1.0;
+			bm->m_densityWeight   = -1.0;
+			bm->m_siteRank        = 0;
+			bm->m_flags           = 0;
+		}
+	}
+
 	// scan each sublist vs. the docid list
 	for ( int32_t i = 0 ; i < qti->m_numSubLists ; i++ ) {
 
@@ -5351,6 +5473,17 @@ void PosdbTable::shrinkSubLists ( QueryTermInfo *qti ) {
 		// save it
 		char *savedDst = dst;
 
+		// . the block max block we are in and the cursors of this
+		//   new sublist for each block
+		// . the new sublist will be in slot m_numNewSubLists
+		int32_t   curBlock = 0;
+		BlockMax *bm       = NULL;
+		char    **bc       = NULL;
+		if ( bcs ) {
+			bc    = bcs + qti->m_numNewSubLists;
+			bc[0] = savedDst;
+		}
+
 
 	subLoop:
 		// scan the docid list for the current docid in this termlist
@@ -5374,6 +5507,24 @@ void PosdbTable::shrinkSubLists ( QueryTermInfo *qti ) {
 			if ( *(unsigned char *)(dp) <
 			     (*(unsigned char *)(recPtr+7) & 0xfc ) )
 				continue;
+			// record the block max info of this docid
+			if ( bcs ) {
+				int32_t nb = (dp - dpStart) / 
+					(6 * BLOCKMAX_DOCIDS);
+				// new sublist cursors for skipped blocks
+				for ( ; curBlock < nb ; ) 
+					bc[++curBlock * bstride] = dst;
+				bm = &bms[nb * m_numQueryTermInfos];
+				bm->m_flags |= BMF_HASDOCS;
+				unsigned char sr = g_posdb.getSiteRank(recPtr);
+				if ( sr > bm->m_siteRank ) bm->m_siteRank = sr;
+				char dl = g_posdb.getLangId ( recPtr );
+				if ( m_r->m_language == dl ||
+				     m_r->m_language == 0  ||
+				     dl == 0 )
+					bm->m_flags |= BMF_SAMELANG;
+				addToBlockMax ( bm , recPtr );
+			}
 			// copy over the 12 byte key
 			*(int64_t *)dst = *(int64_t *)recPtr;
 			*(int32_t *)(dst+8) = *(int32_t *)(recPtr+8);
@@ -5387,6 +5538,8 @@ void PosdbTable::shrinkSubLists ( QueryTermInfo *qti ) {
 					goto doneWithSubList;
 				// next docid willbe next 12 bytekey
 				if ( ! ( recPtr[0] & 0x04 ) ) break;
+				// max it in
+				if ( bm ) addToBlockMax ( bm , recPtr );
 				// otherwise it's 6 bytes
 				*(int32_t *)dst = *(int32_t *)recPtr;
 				*(int16_t *)(dst+4) = *(int16_t *)(recPtr+4);
@@ -5416,6 +5569,10 @@ void PosdbTable::shrinkSubLists ( QueryTermInfo *qti ) {
 
 	doneWithSubList:
 
+		// the remaining blocks start at the end of the new sublist
+		for ( ; bc && curBlock + 1 < m_numBlocks ; ) 
+			bc[++curBlock * bstride] = dst;
+
 		// set sublist end
 		int32_t x = qti->m_numNewSubLists;
 		qti->m_newSubListSize  [x] = dst - savedDst;
@@ -6008,6 +6165,7 @@ void PosdbTable::intersectLists10_r ( ) {
 	char *mptrEnd = mbuf + 299000;
 	char *mptr;
 	char *docIdPtr;
+	char *docIdStart = m_docIdVoteBuf.getBufStart();
 	char *docIdEnd = m_docIdVoteBuf.getBufStart()+m_docIdVoteBuf.length();
 	float minWinningScore = -1.0;
 	char *nwp     [MAX_SUBLISTS];
@@ -6139,6 +6297,51 @@ void PosdbTable::intersectLists10_r ( ) {
 	// is this right?
 	if ( docIdPtr >= docIdEnd ) goto done;
 
+	// . block-max: at the start of each block of docids, see if any
+	//   query term can not score high enough for any docid in the
+	//   block to beat the top tree's minimum winning score. then we
+	//   can skip the whole block without scoring any of its docids.
+	// . same constraints as the getMaxPossibleScore() filter below
+	if ( m_useBlockMax && nnn && ! secondPass && 
+	     minWinningScore >= 0.0 &&
+	     ( docIdPtr - docIdStart ) % ( 6 * BLOCKMAX_DOCIDS ) == 0 ) {
+		int32_t block = (docIdPtr - docIdStart) / (6 * BLOCKMAX_DOCIDS);
+		bool skip = false;
+		for ( int32_t i = 0 ; i < nnn ; i++ ) {
+			if ( qip[i].m_bigramFlags[0]&(BF_NEGATIVE|BF_FACET) ) 
+				continue;
+			float maxScore = getBlockMaxScore ( &qip[i], block );
+			// has inlink text, can not constrain it
+			if ( maxScore == -1.0 ) continue;
+			if ( maxScore > minWinningScore ) continue;
+			skip = true;
+			break;
+		}
+		// move all cursors to the start of the next block
+		if ( skip && block + 1 < m_numBlocks ) {
+			char **bcs = (char **)m_blockCursorBuf.getBufStart();
+			bcs += (block + 1) * m_numBlockSubLists;
+			for ( int32_t i = 0 ; i < m_numQueryTermInfos ; i++ ) {
+				QueryTermInfo *qti = &qip[i];
+				if ( qti->m_bigramFlags[0] & BF_NEGATIVE ) 
+					continue;
+				char **bc = bcs + qti->m_blockSubListOffset;
+				for ( int32_t j = 0 ; j<qti->m_numNewSubLists ; j++)
+					qti->m_cursor[j] = bc[j];
+			}
+			char *next = docIdPtr + 6 * BLOCKMAX_DOCIDS;
+			if ( next > docIdEnd ) next = docIdEnd;
+			fail0 += ( next - docIdPtr ) / 6;
+			docIdPtr = next;
+			goto docIdLoop;
+		}
+		// last block, just end it
+		if ( skip ) {
+			fail0 += ( docIdEnd - docIdPtr ) / 6;
+			goto done;
+		}
+	}
+
 	// assume all sublists exhausted for this query term
 	//docId = *(int64_t *)docIdPtr;
 
@@ -7959,6 +8162,35 @@ float PosdbTable::getMaxPossibleScore ( QueryTermInfo *qti ,
 	return score;
 }
 
+// . like getMaxPossibleScore() but for all the docids in a block of
+//   m_docIdVoteBuf using the BlockMax shrinkSubLists() made
+// . the score is >= getMaxPossibleScore() of every docid in the block
+// . returns -1.0 if a docid in the block has inlink text for this term
+float PosdbTable::getBlockMaxScore ( QueryTermInfo *qti , int32_t block ) {
+	QueryTermInfo *qip = (QueryTermInfo *)m_qiBuf.getBufStart();
+	BlockMax *bm = (BlockMax *)m_blockMaxBuf.getBufStart();
+	bm += block * m_numQueryTermInfos + ( qti - qip );
+	if ( bm->m_flags & BMF_INLINKTEXT ) return -1.0;
+	// no docids in this block have this term at all
+	if ( ! ( bm->m_flags & BMF_HASDOCS ) ) return 0.0;
+	float score = 100.0;
+	score *= bm->m_hashGroupWeight;
+	score *= bm->m_hashGroupWeight;
+	score *= bm->m_densityWeight;
+	score *= bm->m_densityWeight;
+	if ( qti->m_bigramFlags[0] & BF_HALFSTOPWIKIBIGRAM ) {
+		score *= WIKI_BIGRAM_WEIGHT;
+		score *= WIKI_BIGRAM_WEIGHT;
+	}
+	score *= (((float)bm->m_siteRank)*m_siteRankMultiplier+1.0);
+	if ( ( bm->m_flags & BMF_SAMELANG ) && m_r->m_sameLangWeight > 1.0 )
+		score *= m_r->m_sameLangWeight;
+	score *= qti->m_termFreqWeight;
+	if ( m_allInSameWikiPhrase )
+		score *= WIKI_WEIGHT;
+	return score;
+}
+
 void printTermList ( int32_t i, char *list, int32_t listSize ) {
 	// first key is 12 bytes
 	bool firstKey = true;
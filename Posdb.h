@@ -448,6 +448,30 @@ public:
 	int32_t      m_wikiPhraseId;
 	// phrase id term or bigram is in
 	int32_t      m_quotedStartId;
+	// where our sublist cursors start in each block of
+	// PosdbTable::m_blockCursorBuf
+	int32_t      m_blockSubListOffset;
+};
+
+// . how many docids of PosdbTable::m_docIdVoteBuf go into one block for
+//   the block-max early termination in intersectLists10_r()
+#define BLOCKMAX_DOCIDS 128
+
+// BlockMax::m_flags
+#define BMF_HASDOCS    0x01
+#define BMF_SAMELANG   0x02
+#define BMF_INLINKTEXT 0x04
+
+// . upper bounds of what one QueryTermInfo could score for any docid in
+//   a block of BLOCKMAX_DOCIDS docids, set by shrinkSubLists()
+// . getBlockMaxScore() turns these into a score just like 
+//   getMaxPossibleScore() does for a single docid
+class BlockMax {
+public:
+	float         m_hashGroupWeight;
+	float         m_densityWeight;
+	unsigned char m_siteRank;
+	char          m_flags;
 };
 
 
@@ -733,6 +757,20 @@ class PosdbTable {
 				    int32_t qdist ,
 				    class QueryTermInfo *qtm ) ;
 
+	// upper score bound for a whole block of docids
+	float getBlockMaxScore ( class QueryTermInfo *qti , int32_t block );
+
+	// . block-max early termination. shrinkSubLists() records the
+	//   BlockMax of each QueryTermInfo for every BLOCKMAX_DOCIDS docids
+	//   of m_docIdVoteBuf and where each new sublist starts for that
+	//   block so we can skip a whole block if it can not beat the
+	//   top tree's minimum score
+	bool     m_useBlockMax;
+	int32_t  m_numBlocks;
+	int32_t  m_numBlockSubLists;
+	SafeBuf  m_blockMaxBuf;
+	SafeBuf  m_blockCursorBuf;
+
 	// stuff set in setQueryTermInf() function:
 	SafeBuf              m_qiBuf;
 	int32_t                 m_numQueryTermInfos;
@@ -2197,6 +2197,7 @@ void Process::resetAll ( ) {
 	g_users.m_loginTable.reset();
 	resetAddressTables();
 	resetMsg13Caches();
+	resetMsg39Cache();
 	resetStopWordTables();
 	//resetSynonymTables();
 	resetDateTables();
@@ -2204,13 +2205,19 @@ void Process::resetAll ( ) {
 }
 
 #include "Msg3.h"
+#include "RdbStripedCache.h"
+#include "DiskPageCache.h"
 
 void Process::resetPageCaches ( ) {
 	log("gb: Resetting page caches.");
 	for ( int32_t i = 0 ; i < RDB_END ; i++ ) {
 		RdbCache *rpc = getDiskPageCache ( i ); // rdbid = i
-		if ( ! rpc ) continue;
-		rpc->reset();
+		if ( rpc ) rpc->reset();
+		RdbStripedCache *spc = getStripedListCache ( i );
+		if ( spc ) spc->reset();
+		// and the pages cached under BigFile
+		DiskPageCache *pc = getBigFilePageCache ( i );
+		if ( pc ) pc->reset();
 	}
 		
 	// g_posdb           .getDiskPageCache()->reset();
@@ -44,6 +44,10 @@ Rdb::Rdb ( ) {
 	m_collectionlessBase = NULL;
 	m_initialized = false;
 	m_numMergesOut = 0;
+	m_bytesDumped  = 0;
+	m_bytesMerged  = 0;
+	m_generation   = 0;
+	m_doubleBuffer = false;
 	//memset ( m_bases , 0 , sizeof(RdbBase *) * MAX_COLLS );
 	reset();
 }
@@ -72,6 +76,7 @@ void Rdb::reset ( ) {
 	// reset tree and cache
 	m_tree.reset();
 	m_buckets.reset();
+	m_sealedBuckets.reset();
 	m_mem.reset();
 	//m_cache.reset();
 	m_lastWrite = 0LL;
@@ -288,10 +293,24 @@ bool Rdb::init ( char          *dir                  ,
 				     false , // alowdups?
 				     m_rdbId );
 		}
+		// . double buffer if the parm is on, or if we have sealed
+		//   buckets saved on disk from when it was on, so we do not
+		//   lose them
+		sprintf(m_sealedName,"%s-sealed",m_dbname);
+		char sealedFile[256];
+		sprintf(sealedFile,"%s-buckets-saved.dat",m_sealedName);
+		BigFile sf;
+		sf.set ( getDir() , sealedFile , NULL );
+		m_doubleBuffer = g_conf.m_doubleBufferMemtables;
+		if ( sf.doesExist() > 0 && sf.getFileSize() > 0 )
+			m_doubleBuffer = true;
+		// each buffer gets half the mem
+		int32_t bucketsMem = maxTreeMem;
+		if ( m_doubleBuffer ) bucketsMem = maxTreeMem / 2;
 		// set this then
 		sprintf(m_treeName,"buckets-%s",m_dbname);
 		if( ! m_buckets.set ( fixedDataSize, 
-			      maxTreeMem,
+			      bucketsMem,
 			      false, //own data
 			      m_treeName, // allocName
 				      m_rdbId,
@@ -301,12 +320,24 @@ bool Rdb::init ( char          *dir                  ,
 			      false)) { //use protection
 			return false;
 		}
+		// it saves to and loads from <dbname>-sealed-buckets-saved.dat
+		if ( m_doubleBuffer &&
+		     ! m_sealedBuckets.set ( fixedDataSize ,
+					     bucketsMem ,
+					     false , // own data
+					     m_treeName , // allocName
+					     m_rdbId ,
+					     false , // data in ptrs
+					     m_sealedName ,
+					     m_ks ,
+					     false ) ) // use protection
+			return false;
 	}
 
 	// now get how much mem the tree is using (not including stored recs)
 	int32_t dataMem;
 	if(m_useTree) dataMem = maxTreeMem - m_tree.getTreeOverhead();
-	else          dataMem = maxTreeMem - m_buckets.getMemOccupied( );
+	else          dataMem = maxTreeMem - getTreeMemOccupied( );
 
 	sprintf(m_memName,"mem-%s",m_dbname);
 
@@ -444,6 +475,17 @@ bool Rdb::updateToRebuildFiles ( Rdb *rdb2 , char *coll ) {
 
 	log("repair: Moving saved %s: %s",structName, mstrerror(errno));
 
+	// and the sealed buckets, if we got any
+	if ( m_doubleBuffer ) {
+		sprintf ( cmd , "mv %s/%s-buckets-saved.dat %s/%s-buckets-"
+			  "saved.dat", g_hostdb.m_dir , m_sealedName ,
+			  dstDir , m_sealedName );
+		errno = 0;
+		if ( gbsystem ( cmd ) == -1 )
+			return log("repair: Moving saved sealed buckets had "
+				   "error: %s.", mstrerror(errno));
+	}
+
 	// now move our map and data files to the "trash" subdir, "dstDir"
 	logf(LOG_INFO,"repair: Moving old data and map files to trash.");
 	if ( ! base->moveToTrash(dstDir) )
@@ -467,6 +509,7 @@ bool Rdb::updateToRebuildFiles ( Rdb *rdb2 , char *coll ) {
 	// allow rdb2->reset() to succeed without dumping core
 	rdb2->m_tree.m_needsSave = false;
 	rdb2->m_buckets.setNeedsSave(false);
+	rdb2->m_sealedBuckets.setNeedsSave(false);
 	
 	// . make rdb2, the secondary rdb used for rebuilding, give up its mem
 	// . if we do another rebuild its ::init() will be called by PageRepair
@@ -475,6 +518,7 @@ bool Rdb::updateToRebuildFiles ( Rdb *rdb2 , char *coll ) {
 	// clean out tree, newly rebuilt rdb does not have any data in tree
 	if ( m_useTree ) m_tree.delColl ( collnum );
 	else             m_buckets.delColl( collnum );
+	if ( m_doubleBuffer ) m_sealedBuckets.delColl ( collnum );
 	// reset our cache
 	//m_cache.clear ( collnum );
 
@@ -603,6 +647,7 @@ bool Rdb::deleteAllRecs ( collnum_t collnum ) {
 	// remove from tree
 	if(m_useTree) m_tree.delColl    ( collnum );
 	else          m_buckets.delColl ( collnum );
+	if ( m_doubleBuffer ) m_sealedBuckets.delColl ( collnum );
 
 	// only for doledb now, because we unlink we do not move the files
 	// into the trash subdir and doledb is easily regenerated. i don't
@@ -666,6 +711,7 @@ bool Rdb::deleteColl ( collnum_t collnum , collnum_t newCollnum ) {
 	// remove these collnums from tree
 	if(m_useTree) m_tree.delColl    ( collnum );
 	else          m_buckets.delColl ( collnum );
+	if ( m_doubleBuffer ) m_sealedBuckets.delColl ( collnum );
 
 	// . close all files, set m_numFiles to 0 in RdbBase
 	// . TODO: what about outstanding merge or dump operations?
@@ -917,6 +963,14 @@ bool Rdb::close ( void *state , void (* callback)(void *state ), bool urgent ,
 			return false;
 	}
 	else {
+		// save the sealed buckets without a thread so we only
+		// get the one callback
+		if ( m_doubleBuffer &&
+		     ! m_sealedBuckets.fastSave ( getDir() ,
+						  false    , // use thread?
+						  NULL     ,
+						  NULL     ) )
+			return false;
 		if ( ! m_buckets.fastSave ( getDir()    ,
 					    useThread   ,
 					    this        ,
@@ -1018,6 +1072,7 @@ void Rdb::doneSaving ( ) {
 
 bool Rdb::isSavingTree ( ) {
 	if ( m_useTree ) return m_tree.m_isSaving;
+	if ( m_doubleBuffer && m_sealedBuckets.m_isSaving ) return true;
 	return m_buckets.m_isSaving;
 }
 
@@ -1042,11 +1097,19 @@ bool Rdb::saveTree ( bool useThread ) {
 				 NULL        );// callback
 	}
 	else {
-		return m_buckets.fastSave ( getDir()    ,
+		bool status = true;
+		if ( m_doubleBuffer &&
+		     ! m_sealedBuckets.fastSave ( getDir() ,
+						  useThread ,
+						  NULL , // state
+						  NULL ) ) // callback
+			status = false;
+		if ( ! m_buckets.fastSave ( getDir()    ,
 				 useThread   ,
 				 NULL        , // state
-				 NULL        );// callback
-
+				 NULL        ) )// callback
+			status = false;
+		return status;
 	}
 }
 
@@ -1135,6 +1198,18 @@ bool Rdb::loadTree ( ) {
 			char *xx = NULL; *xx = 0;
 		}
 
+		// the sealed buckets never got dumped, load them too
+		if ( m_doubleBuffer ) {
+			if ( ! m_sealedBuckets.loadBuckets ( m_sealedName ) )
+				return log("db: Could not load saved sealed "
+					   "buckets.");
+			if ( ! m_sealedBuckets.testAndRepair() ) {
+				log("db: unrepairable sealed buckets, "
+				    "remove and restart.");
+				char *xx = NULL; *xx = 0;
+			}
+		}
+
 		
 		if(treeExists) {
 			m_buckets.addTree(&m_tree);
@@ -1173,7 +1248,9 @@ bool Rdb::dumpTree ( int32_t niceness ) {
 	if ( m_useTree ) {
 		if (m_tree.getNumUsedNodes() <= 0 ) return true;
 	}
-	else if (m_buckets.getNumKeys() <= 0 ) return true;
+	else if ( m_buckets.getNumKeys() <= 0 &&
+		  ( ! m_doubleBuffer ||
+		    m_sealedBuckets.getNumKeys() <= 0 ) ) return true;
 
 	// never dump indexdb if we are the wikipedia cluster
 	if ( g_conf.m_isWikipedia && m_rdbId == RDB_INDEXDB )
@@ -1218,6 +1295,7 @@ bool Rdb::dumpTree ( int32_t niceness ) {
 	//   both happened at once
 	if ( m_useTree) { if(m_tree.m_isSaving ) return true; }
 	else if(m_buckets.isSaving()) return true;
+	if ( m_doubleBuffer && m_sealedBuckets.isSaving() ) return true;
 	// . if Process is saving, don't start a dump
 	if ( g_process.m_mode == SAVE_MODE ) return true;
 	// if it has been less than 3 seconds since our last failed attempt
@@ -1414,6 +1492,20 @@ bool Rdb::gotTokenForDump ( ) {
 	    "db: Checking validity of in memory data of %s before dumping, "
 	    "took %"INT64" ms.",m_dbname,gettimeofdayInMilliseconds()-start);
 
+	// . if double buffering, seal the full buckets and dump those so
+	//   adds can keep going into the fresh buckets while we dump
+	// . if the sealed buckets still have recs from a dump that
+	//   failed, dump those first, the active ones will wait
+	// . a save thread may have started while we waited for the token
+	//   and it is working on the object, so do not swap under it
+	if ( m_doubleBuffer && m_sealedBuckets.getNumKeys() <= 0 &&
+	     ! m_buckets.isSaving() && ! m_sealedBuckets.isSaving() ) {
+		m_buckets.swap ( &m_sealedBuckets );
+		log(LOG_INFO,"db: Sealed %"INT32" recs of %s for dump.",
+		    m_sealedBuckets.getNumKeys(),m_dbname);
+	}
+	RdbBuckets *dumpBuckets = getDumpBuckets();
+
 	////
 	//
 	// see what collnums are in the tree and just try those
@@ -1436,9 +1528,15 @@ bool Rdb::gotTokenForDump ( ) {
 			if ( cr ) cr->m_treeCount++;
 		}
 	}
+	else if ( dumpBuckets->m_skipList ) {
+		for ( int32_t i = 0 ; i < g_collectiondb.m_numRecs ; i++ ) {
+			cr = g_collectiondb.m_recs[i];
+			if ( cr ) cr->m_treeCount = dumpBuckets->getNumKeys(i);
+		}
+	}
 	else {
-		for(int32_t i = 0; i < m_buckets.m_numBuckets; i++) {
-			RdbBucket *b = m_buckets.m_buckets[i];
+		for(int32_t i = 0; i < dumpBuckets->m_numBuckets; i++) {
+			RdbBucket *b = dumpBuckets->m_buckets[i];
 			collnum_t cn = b->getCollnum();
 			int32_t nk = b->getNumKeys();
 			// for ( int32_t j = 0 ; j < nk; j++ ) {
@@ -1555,7 +1653,7 @@ bool Rdb::dumpCollLoop ( ) {
 		if ( m_tree.m_collnums[nn] != m_dumpCollnum ) goto loop;
 	}
 	else {
-		if(!m_buckets.collExists(m_dumpCollnum)) goto loop;
+		if(!getDumpBuckets()->collExists(m_dumpCollnum)) goto loop;
 	}
 	// . MDW ADDING A NEW FILE SHOULD BE IN RDBDUMP.CPP NOW... NO!
 	// . get the biggest fileId
@@ -1595,6 +1693,14 @@ bool Rdb::dumpCollLoop ( ) {
 	    base->m_files[m_fn]->getDir(),
 	    base->m_files[m_fn]->getFilename() , 
 	    g_collectiondb.getCollName ( m_dumpCollnum ) );
+
+	// . build a bloom filter of the keys we dump for point lookups
+	// . recs added while we dump may get dumped too, so pad it
+	int64_t maxKeys = getNumUsedNodes();
+	maxKeys = maxKeys * 120LL / 100LL;
+	base->m_maps[m_fn]->initBloom ( m_rdbId , maxKeys );
+	// linkdb and spiderdb may write it as compressed blocks
+	base->m_maps[m_fn]->initBlocks ( m_rdbId );
 	// . append it to "sync" state we have in memory
 	// . when host #0 sends a OP_SYNCTIME signal we dump to disk
 	//g_sync.addOp ( OP_OPEN , base->m_files[m_fn] , 0 );
@@ -1615,8 +1721,8 @@ bool Rdb::dumpCollLoop ( ) {
 		avgSize = m_tree.getMemOccupiedForList() / numRecs;
 	} 
 	else {
-		numRecs = m_buckets.getNumKeys();
-		avgSize = m_buckets.getRecSize();
+		numRecs = getDumpBuckets()->getNumKeys();
+		avgSize = getDumpBuckets()->getRecSize();
 	}
 	// . it really depends on the rdb, for small rec rdbs 200k is too big
 	//   because when getting an indexdb list from tree of 200k that's
@@ -1648,7 +1754,7 @@ bool Rdb::dumpCollLoop ( ) {
 	//         breaching its buffer! since this is somewhat rare i will
 	//         just modify DiskPageCache.cpp to ignore breaches. 
 	if(m_useTree) maxFileSize = m_tree.getMemOccupiedForList ();
-	else          maxFileSize = m_buckets.getMemOccupied();
+	else          maxFileSize = getDumpBuckets()->getMemOccupied();
 	// sanity
 	if ( maxFileSize < 0 ) { char *xx=NULL;*xx=0; }
 	// because we are actively spidering the list we dump ends up
@@ -1662,7 +1768,7 @@ bool Rdb::dumpCollLoop ( ) {
 	RdbBuckets *buckets = NULL;
 	RdbTree    *tree = NULL;
 	if(m_useTree) tree = &m_tree;
-	else          buckets = &m_buckets;
+	else          buckets = getDumpBuckets();
 	// . RdbDump will set the filename of the map we pass to this
 	// . RdbMap should dump itself out CLOSE!
 	// . it returns false if blocked, true otherwise & sets g_errno on err
@@ -1774,6 +1880,8 @@ void Rdb::doneDumping ( ) {
 	//g_msg35.releaseToken();
 	// free mem in the primary buffer
 	if ( ! m_dumpErrno ) m_mem.freeDumpedMem( &m_tree );
+	// the dumped recs are in a new file now
+	m_generation++;
 	// . tell RdbDump it is done
 	// . we have to set this here otherwise RdbMem's memory ring buffer
 	//   will think the dumping is no longer going on and use the primary
@@ -2338,6 +2446,29 @@ bool Rdb::needsDump ( ) {
 	return false;
 }
 
+int32_t Rdb::getPercentFull ( ) {
+	int32_t max = 0;
+	int32_t total = m_mem.getTotalMem();
+	if ( total > 0 )
+		max = (int32_t)((int64_t)m_mem.getUsedMem() * 100 / total);
+	int32_t used = 0;
+	if ( m_useTree ) {
+		used  = m_tree.getNumUsedNodes();
+		total = m_tree.getNumTotalNodes();
+	}
+	else if ( m_buckets.m_skipList ) {
+		used  = m_buckets.getMemOccupied();
+		total = m_buckets.getMaxMem();
+	}
+	else {
+		used  = m_buckets.m_numBuckets;
+		total = m_buckets.m_maxBucketsCapacity;
+	}
+	if ( total > 0 && (int64_t)used * 100 / total > max )
+		max = (int32_t)((int64_t)used * 100 / total);
+	return max;
+}
+
 bool Rdb::hasRoom ( RdbList *list , int32_t niceness ) {
 	// how many nodes will tree need?
 	int32_t numNodes = list->getNumRecs( );
@@ -2468,7 +2599,10 @@ bool Rdb::addRecord ( collnum_t collnum,
 	// dump completes it calls deleteList() and removes the nodes from
 	// the tree, so if you were overriding a node currently being dumped
 	// we would lose it.
-	if ( m_dump.isDumping() &&
+	// . not a problem if double buffering, we are dumping the sealed
+	//   buckets and adding to the other ones
+	if ( ! m_doubleBuffer &&
+	     m_dump.isDumping() &&
 	     //oppKey >= m_dump.getFirstKeyInQueue() &&
 	     // ensure the dump is dumping the collnum of this key
 	     m_dump.m_collnum == collnum &&
@@ -3029,6 +3163,76 @@ int64_t Rdb::getListSize ( collnum_t collnum,
 					    oldTruncationLimit);
 }
 
+// . like RdbBuckets::getList() but includes the sealed buckets if we are
+//   double buffering and they are being dumped
+// . returns false and sets g_errno on error
+bool Rdb::getBucketsList ( collnum_t collnum ,
+			   char *startKey , char *endKey ,
+			   int32_t minRecSizes , RdbList *list ,
+			   int32_t *numPosRecs , int32_t *numNegRecs ,
+			   bool useHalfKeys ) {
+	// the common case
+	if ( ! m_doubleBuffer || ! m_sealedBuckets.collExists ( collnum ) )
+		return m_buckets.getList ( collnum , startKey , endKey ,
+					   minRecSizes , list , numPosRecs ,
+					   numNegRecs , useHalfKeys );
+	// the sealed recs are older so they go first, the merge
+	// keeps the rec from the last list when the keys are the same
+	RdbList sealedList;
+	RdbList activeList;
+	int32_t np1 = 0, nn1 = 0, np2 = 0, nn2 = 0;
+	if ( ! m_sealedBuckets.getList ( collnum , startKey , endKey ,
+					 minRecSizes , &sealedList ,
+					 &np1 , &nn1 , useHalfKeys ) )
+		return false;
+	if ( ! m_buckets.getList ( collnum , startKey , endKey ,
+				   minRecSizes , &activeList ,
+				   &np2 , &nn2 , useHalfKeys ) )
+		return false;
+	// . each list may have stopped short because of minRecSizes so
+	//   we are only complete up to the smaller of their end keys
+	// . an overcount is ok here, it is only used to boost
+	//   minRecSizes to make up for negative recs
+	// . copy it, constrain() below changes the lists' end keys
+	char end[MAX_KEY_BYTES];
+	KEYSET ( end , sealedList.getEndKey() , m_ks );
+	if ( KEYCMP ( activeList.getEndKey() , end , m_ks ) < 0 )
+		KEYSET ( end , activeList.getEndKey() , m_ks );
+	if ( numPosRecs ) *numPosRecs = np1 + np2;
+	if ( numNegRecs ) *numNegRecs = nn1 + nn2;
+	if ( minRecSizes < 0 ) minRecSizes = 0x7fffffff;
+	list->reset();
+	list->m_ks = m_ks;
+	list->setFixedDataSize ( m_fixedDataSize );
+	list->setUseHalfKeys   ( useHalfKeys     );
+	RdbList *lists[2];
+	lists[0] = &sealedList;
+	lists[1] = &activeList;
+	// . drop the recs past "end" from the longer list, we do not have
+	//   the other list's recs there. posdbMerge_r() does not stop at
+	//   the end key like merge_r() does.
+	for ( int32_t i = 0 ; i < 2 ; i++ ) {
+		if ( lists[i]->isEmpty() ) continue;
+		char k[MAX_KEY_BYTES];
+		lists[i]->getCurrentKey ( k );
+		if ( ! lists[i]->constrain ( startKey , end , -1 , 0 , k ,
+					     "buckets" , 0 ) )
+			return false;
+	}
+	if ( ! list->prepareForMerge ( lists , 2 , minRecSizes ) )
+		return false;
+	// keep the negative recs, they have to annihilate recs on disk
+	if ( m_rdbId == RDB_POSDB || m_rdbId == RDB2_POSDB2 ) {
+		list->posdbMerge_r ( lists , 2 , startKey , end ,
+				     minRecSizes , false , NULL ,
+				     false , false , 0 );
+		return true;
+	}
+	list->merge_r ( lists , 2 , startKey , end , minRecSizes , false ,
+			m_rdbId , NULL , NULL , NULL , false , 0 );
+	return true;
+}
+
 int64_t Rdb::getNumGlobalRecs ( ) {
 	return getNumTotalRecs() * g_hostdb.m_numShards;//Groups;
 }
@@ -3504,37 +3708,52 @@ bool Rdb::addRecord ( char *coll , char *key, char *data, int32_t dataSize,
 
 int32_t Rdb::getNumUsedNodes ( ) {
 	 if(m_useTree) return m_tree.getNumUsedNodes(); 
+	 if(m_doubleBuffer)
+		 return m_buckets.getNumKeys()+m_sealedBuckets.getNumKeys();
 	 return m_buckets.getNumKeys();
 }
 
 int32_t Rdb::getMaxTreeMem() {
 	if(m_useTree) return m_tree.getMaxMem();
+	if(m_doubleBuffer)
+		return m_buckets.getMaxMem()+m_sealedBuckets.getMaxMem();
 	return m_buckets.getMaxMem();
 }
 
 int32_t Rdb::getNumNegativeKeys() {
 	 if(m_useTree) return m_tree.getNumNegativeKeys(); 
+	 if(m_doubleBuffer)
+		 return m_buckets.getNumNegativeKeys() +
+			 m_sealedBuckets.getNumNegativeKeys();
 	 return m_buckets.getNumNegativeKeys();
 }
 
 
 int32_t Rdb::getTreeMemOccupied() {
 	 if(m_useTree) return m_tree.getMemOccupied(); 
+	 if(m_doubleBuffer)
+		 return m_buckets.getMemOccupied() +
+			 m_sealedBuckets.getMemOccupied();
 	 return m_buckets.getMemOccupied();
 }
 
 int32_t Rdb::getTreeMemAlloced () {
 	 if(m_useTree) return m_tree.getMemAlloced(); 
+	 if(m_doubleBuffer)
+		 return m_buckets.getMemAlloced() +
+			 m_sealedBuckets.getMemAlloced();
 	 return m_buckets.getMemAlloced();
 }
 
 void Rdb::disableWrites () {
 	if(m_useTree) m_tree.disableWrites();
 	else m_buckets.disableWrites();
+	if(m_doubleBuffer) m_sealedBuckets.disableWrites();
 }
 void Rdb::enableWrites  () {
 	if(m_useTree) m_tree.enableWrites();
 	else m_buckets.enableWrites();
+	if(m_doubleBuffer) m_sealedBuckets.enableWrites();
 }
 
 bool Rdb::isWritable ( ) {
@@ -3545,7 +3764,8 @@ bool Rdb::isWritable ( ) {
 
 bool Rdb::needsSave() {
 	if(m_useTree) return m_tree.m_needsSave; 
-	else return m_buckets.needsSave();
+	if(m_doubleBuffer && m_sealedBuckets.needsSave()) return true;
+	return m_buckets.needsSave();
 }
 
 // if we are doledb, we are a tree-only rdb, so try to reclaim
@@ -197,6 +197,18 @@ class Rdb {
 	//RdbCache   *getCache   ( ) { return &m_cache; };
 	RdbMem     *getRdbMem  ( ) { return &m_mem; };
 	bool       useTree     ( ) { return m_useTree;};
+	// the buckets being dumped, only differs if double buffering
+	RdbBuckets *getDumpBuckets ( ) {
+		if ( m_doubleBuffer ) return &m_sealedBuckets;
+		return &m_buckets; };
+
+	// . get a list from the buckets and the sealed buckets, if any
+	// . returns false and sets g_errno on error
+	bool getBucketsList ( collnum_t collnum ,
+			      char *startKey , char *endKey ,
+			      int32_t minRecSizes , RdbList *list ,
+			      int32_t *numPosRecs , int32_t *numNegRecs ,
+			      bool useHalfKeys );
 
 	int32_t       getNumUsedNodes ( );
 	int32_t       getMaxTreeMem();
@@ -320,6 +332,10 @@ class Rdb {
 
 	bool needsDump ( );
 
+	// . how close the tree or its mem is to full, 0 to 100
+	// . Msg4 replies carry this back so spiders can ease off
+	int32_t getPercentFull ( );
+
 	// these are used by Msg34 class for computing load on a machine
 	bool isMerging ( ) ;
 	bool isDumping ( ) { return m_dump.isDumping(); };
@@ -388,6 +404,12 @@ class Rdb {
 	RdbTree    m_tree;  
 	RdbBuckets m_buckets;
 	bool       m_useTree;
+	// . if double buffering, m_buckets is swapped in here when full and
+	//   dumped from here, so adds to m_buckets never wait on the dump
+	// . each gets half the tree mem
+	RdbBuckets m_sealedBuckets;
+	bool       m_doubleBuffer;
+	char       m_sealedName [ 64 ];
 	// for dumping a table to an rdb file
 	RdbDump   m_dump;  
 	// memory for us to use to avoid calling malloc()/mdup()/...
@@ -400,6 +422,15 @@ class Rdb {
 
 	int32_t m_numMergesOut;
 
+	// . bytes written to disk by dumping the tree/buckets and by merging
+	// . the stats page shows (dumped+merged)/dumped as write amplification
+	int64_t m_bytesDumped;
+	int64_t m_bytesMerged;
+
+	// . bumped every time a dump or merge changes our files so caches
+	//   of results computed from them, like Msg39's, can tell they are old
+	int32_t m_generation;
+
 	// . this is now static in Rdb.cpp
 	// . for merging many rdb files into one 
 	// . no we brought it back so tfndb can merge while titledb is merging
@@ -22,6 +22,7 @@
 //#include "CollectionRec.h"
 #include "Repair.h"
 #include "Rebalance.h"
+#include "DiskPageCache.h"
 //#include "Msg3.h" // debug include
 
 // how many rdbs are in "urgent merge" mode?
@@ -448,6 +449,8 @@ bool RdbBase::moveToTrash ( char *dstDir ) {
 		char dstFilename [1024];
 		f = m_maps[i]->getFile();
 		sprintf ( dstFilename , "%s" , f->getFilename());
+		// and its bloom filter, if any
+		m_maps[i]->renameBloom ( dstFilename , dstDir );
 		// ALWAYS log what we are doing
 		logf(LOG_INFO,"repair: Renaming %s to %s%s",
 		     f->getFilename(),dstDir,dstFilename);
@@ -487,6 +490,15 @@ bool RdbBase::removeRebuildFromFilenames ( ) {
 		removeRebuildFromFilename(f);
 		// rename the map file now too!
 		f = m_maps[i]->getFile();
+		// and its bloom filter, if any
+		char nbuf[1024];
+		strncpy ( nbuf , f->getFilename() , 1000 );
+		nbuf[1000] = '\0';
+		char *rp = strstr ( nbuf , "Rebuild" );
+		if ( rp ) {
+			memmove ( rp , rp + 7 , gbstrlen(rp + 7) + 1 );
+			m_maps[i]->renameBloom ( nbuf , NULL );
+		}
 		// return false if it fails
 		//if ( ! removeRebuildFromFilename(f) ) return false;
 		// DON'T STOP IF ONE FAILS
@@ -788,6 +800,10 @@ int32_t RdbBase::addFile ( int32_t id , bool isNew , int32_t mergeNum ,
 	mnew ( m , sizeof(RdbMap) , "RdbBMap" );
 	// reinstate the memory limit
 	g_conf.m_maxMem = mm;
+	// . cache the pages we read from this file, if this rdb does that
+	// . set it even for new files because RdbDump/RdbMerge open those
+	//   without a page cache and we read from them once they are done
+	f->setDiskPageCache ( getBigFilePageCache ( m_rdb->m_rdbId ) );
 	// sanity check
 	if ( id2 < 0 && m_isTitledb ) { char *xx = NULL; *xx = 0; }
 
@@ -899,8 +915,11 @@ int32_t RdbBase::addFile ( int32_t id , bool isNew , int32_t mergeNum ,
 
 	// open this big data file for reading only
 	if ( ! isNew ) {
-		if ( mergeNum < 0 ) 
+		if ( mergeNum < 0 ) {
 			f->open ( O_RDONLY | O_NONBLOCK | O_ASYNC , NULL );
+			// nobody writes to it again, so we can mmap it
+			f->setMmapReads ( true );
+		}
 		// otherwise, merge will have to be resumed so this file
 		// should be writable
 		else
@@ -1114,6 +1133,12 @@ bool RdbBase::incorporateMerge ( ) {
 		    "bytes. Most likely a discrepancy caused by a power "
 		    "outage and the generated map file is off a bit.");
 	}
+	// the merged file is done being written so we can mmap it now
+	m_files[x]->setMmapReads ( true );
+	// for the write amplification stats
+	m_rdb->m_bytesMerged += fs;
+	// the merged recs are in a new file now
+	m_rdb->m_generation++;
 
 	// on success unlink the files we merged and free them
 	for ( int32_t i = a ; i < b ; i++ ) {
@@ -1676,9 +1701,18 @@ bool RdbBase::attemptMerge ( int32_t niceness, bool forceMergeAll, bool doLog ,
 	}
 
 
+	// . see if the merge policy wants to merge something before we
+	//   hit the min # of files. the classic policy never does.
+	int32_t policyStart = -1;
+	int32_t policyNum   = 0;
+	if ( ! resuming && ! forceMergeAll && 
+	     g_conf.m_mergePolicy != MERGE_POLICY_CLASSIC )
+		policyStart = getMergePolicyRange ( numFiles , &policyNum );
+
 	// . don't merge if we don't have the min # of files
 	// . but skip this check if there is a merge to be resumed from b4
-	if ( ! resuming && ! forceMergeAll && numFiles < minToMerge ) {
+	if ( ! resuming && ! forceMergeAll && numFiles < minToMerge &&
+	     policyStart < 0 ) {
 		// now we no longer have to check this collection rdb for
 		// merging. this will save a lot of cpu time when we have
 		// 20,000+ collections. if we dump a file to disk for it
@@ -1973,6 +2007,12 @@ void RdbBase::gotTokenForMerge ( ) {
 
 	minToMerge = m_minToMerge;
 
+	// use the range the merge policy picked above
+	if ( policyStart >= 0 && ! m_nextMergeForced ) {
+		mini = policyStart;
+		n    = policyNum;
+		goto gotRange;
+	}
 
 	// if we are reblancing this coll then keep merges tight so all
 	// the negative recs annihilate with the positive recs to free
@@ -2174,6 +2214,7 @@ void RdbBase::gotTokenForMerge ( ) {
 	//	n    = sn;
 	//}
 	// if no valid range, bail
+ gotRange:
 	if ( mini == -1 ) { 
 		log(LOG_LOGIC,"merge: gotTokenForMerge: Bad engineer. mini "
 		    "is -1.");
@@ -2263,6 +2304,13 @@ void RdbBase::gotTokenForMerge ( ) {
 	log(LOG_INFO,"merge: Total positive = %"INT64" Total negative = %"INT64".",
 	     m_numPos,m_numNeg);
 
+	// . build a bloom filter of the merged keys for point lookups
+	// . does nothing if we are resuming a killed merge
+	m_maps[mergeFileNum]->initBloom ( rdbId , m_numPos + m_numNeg );
+	// . and maybe write it as compressed blocks
+	// . a resumed merge keeps the format it had
+	m_maps[mergeFileNum]->initBlocks ( rdbId );
+
 	// assume we are now officially merging
 	m_isMerging = true;
 
@@ -2397,6 +2445,10 @@ int64_t RdbBase::getListSize ( char *startKey , char *endKey , char *max ,
 					     startKey , endKey , NULL , NULL );
 	else n = m_buckets->getListSize ( m_collnum ,
 					  startKey , endKey , NULL , NULL );
+	if ( ! m_tree && m_rdb->m_doubleBuffer )
+		n += m_rdb->m_sealedBuckets.getListSize ( m_collnum ,
+							  startKey , endKey ,
+							  NULL , NULL );
 
 	// debug
 	// RdbList list;
@@ -2453,6 +2505,9 @@ int64_t RdbBase::getNumTotalRecs ( ) {
 		if ( ! m_buckets ) return 0;
 		//these routines are slow because they count every time.
 		numPositiveRecs += m_buckets->getNumKeys(m_collnum);
+		if ( m_rdb->m_doubleBuffer )
+			numPositiveRecs +=
+				m_rdb->m_sealedBuckets.getNumKeys(m_collnum);
 		//numPositiveRecs += m_buckets->getNumPositiveKeys(m_collnum);
 		//numNegativeRecs += m_buckets->getNumNegativeKeys(m_collnum);
 	}
@@ -2694,3 +2749,92 @@ float RdbBase::getPercentNegativeRecsOnDisk ( int64_t *totalArg ) {
 	float percent = (float)numNeg / (float)total;
 	return percent;
 }
+
+// . files smaller than this are all in the same tier for the size-tiered
+//   merge policy, otherwise a run of tiny dumps would never qualify
+#define MIN_TIER_SIZE (8*1024*1024)
+
+// . the merge must be of consecutive files since the newer file wins key
+//   ties, so all policies pick a range of files [start,start+*n)
+// . returns -1 if the policy does not want to merge anything yet
+int32_t RdbBase::getMergePolicyRange ( int32_t numFiles , int32_t *n ) {
+	if ( numFiles < 2 ) return -1;
+	int32_t ratio = g_conf.m_mergeSizeRatio;
+	if ( ratio < 2 ) ratio = 2;
+	// our merge routine does not scale well to many files
+	int32_t maxFiles = numFiles;
+	if ( m_absMaxFiles > 0 && maxFiles > m_absMaxFiles ) 
+		maxFiles = m_absMaxFiles;
+
+	// . leveled: every file should be "ratio" times bigger than all the
+	//   newer files combined, like the levels of an lsm tree, so a read
+	//   only has to hit about log(total/dumpsize)/log(ratio) files
+	// . so merge the newest files into the first older file that is
+	//   not big enough to stand on its own
+	if ( g_conf.m_mergePolicy == MERGE_POLICY_LEVELED ) {
+		int64_t newer = m_files[numFiles-1]->getFileSize();
+		int32_t start = numFiles - 1;
+		for ( int32_t i = numFiles - 2 ; i >= 0 ; i-- ) {
+			if ( numFiles - i > maxFiles ) break;
+			int64_t size = m_files[i]->getFileSize();
+			if ( size > newer * ratio ) break;
+			newer += size;
+			start  = i;
+		}
+		if ( numFiles - start < 2 ) return -1;
+		*n = numFiles - start;
+		log(LOG_INFO,"merge: leveled policy merging %"INT32" %s files "
+		    "starting at #%"INT32" (%"INT64" bytes) collnum=%"INT32"",
+		    *n,m_dbname,start,newer,(int32_t)m_collnum);
+		return start;
+	}
+
+	// . size-tiered: runs of consecutive files whose sizes are within
+	//   "ratio" of each other are a tier. merge the tier that gets rid of
+	//   the most files per byte we have to write, since every file costs
+	//   a seek on every read.
+	// . if the run starts at file #0 the negative recs annihilate with
+	//   the positives they delete, so count that as a benefit too
+	int32_t minFiles = g_conf.m_mergeTierMinFiles;
+	if ( minFiles < 2 ) minFiles = 2;
+	double  bestScore = 0.0;
+	int32_t best      = -1;
+	int32_t bestNum   = 0;
+	int64_t bestTotal = 0;
+	for ( int32_t i = 0 ; i + minFiles <= numFiles ; i++ ) {
+		int64_t lo    = m_files[i]->getFileSize();
+		int64_t hi    = lo;
+		int64_t total = 0;
+		int64_t neg   = 0;
+		int64_t recs  = 0;
+		for ( int32_t j = i ; j < numFiles && j - i < maxFiles ; j++ ) {
+			int64_t size = m_files[j]->getFileSize();
+			if ( size < lo ) lo = size;
+			if ( size > hi ) hi = size;
+			int64_t floor = lo;
+			if ( floor < MIN_TIER_SIZE ) floor = MIN_TIER_SIZE;
+			if ( hi > floor * ratio ) break;
+			total += size;
+			neg   += m_maps[j]->getNumNegativeRecs();
+			recs  += m_maps[j]->getNumNegativeRecs();
+			recs  += m_maps[j]->getNumPositiveRecs();
+			int32_t k = j - i + 1;
+			if ( k < minFiles ) continue;
+			double benefit = k - 1;
+			if ( i == 0 && recs > 0 ) 
+				benefit += 2.0 * k * (double)neg / (double)recs;
+			double score = benefit / (double)(total + 1);
+			if ( score <= bestScore ) continue;
+			bestScore = score;
+			best      = i;
+			bestNum   = k;
+			bestTotal = total;
+		}
+	}
+	if ( best < 0 ) return -1;
+	*n = bestNum;
+	log(LOG_INFO,"merge: tiered policy merging %"INT32" %s files "
+	    "starting at #%"INT32" (%"INT64" bytes) collnum=%"INT32"",
+	    bestNum,m_dbname,best,bestTotal,(int32_t)m_collnum);
+	return best;
+}
@@ -38,6 +38,11 @@
 #include "Dir.h"
 #include "RdbMem.h"
 
+// values for g_conf.m_mergePolicy
+#define MERGE_POLICY_CLASSIC 0
+#define MERGE_POLICY_TIERED  1
+#define MERGE_POLICY_LEVELED 2
+
 // how many rdbs are in "urgent merge" mode?
 extern int32_t g_numUrgentMerges;
 
@@ -171,6 +176,10 @@ class RdbBase {
 
 	float getPercentNegativeRecsOnDisk ( int64_t *totalArg ) ;
 
+	// . picks the files to merge for g_conf.m_mergePolicy
+	// . returns first file # to merge, or -1 if no merge is needed yet
+	int32_t getMergePolicyRange ( int32_t numFiles , int32_t *n ) ;
+
 	// how much mem is alloced for our maps?
 	int64_t getMapMemAlloced ();
 
@@ -0,0 +1,336 @@
+#include "gb-include.h"
+
+#include "RdbBlocks.h"
+#include "Rdb.h"
+#include "Conf.h"
+#include "Mem.h"
+#include "XmlDoc.h"  // gbcompress()
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// the data of the header record that starts a block compressed file
+#define RDBBLOCK_MAGIC      "GBRDBBLK"
+#define RDBBLOCK_MAGIC_SIZE 8
+
+// codec, # positive keys, # negative keys, encoded size, uncompressed
+// size and the last key
+#define RDBBLOCK_HDR_SIZE(ks) (1 + 4 + 4 + 4 + 4 + (ks))
+
+bool isBlockCompressedRdb ( char rdbId ) {
+	if ( ! g_conf.m_useBlockCompression ) return false;
+	if ( rdbId == RDB_LINKDB   || rdbId == RDB2_LINKDB2   ) return true;
+	if ( rdbId == RDB_SPIDERDB || rdbId == RDB2_SPIDERDB2 ) return true;
+	return false;
+}
+
+// . parse the block record "rec" of "recSize" bytes
+// . returns false if it is corrupt
+static bool getBlockInfo2 ( char *rec , int32_t recSize , char ks ,
+			    char *codec , char *lastKey ,
+			    int32_t *numPos , int32_t *numNeg ,
+			    int32_t *encSize , int32_t *outSize ,
+			    char **data , int32_t *dataSize ,
+			    bool *isHeader ) {
+	*isHeader = false;
+	if ( recSize < ks + 4 ) return false;
+	int32_t ds = *(int32_t *)(rec + ks);
+	if ( ds < 0 || ks + 4 + ds != recSize ) return false;
+	char *p = rec + ks + 4;
+	if ( ds == RDBBLOCK_MAGIC_SIZE &&
+	     memcmp ( p , RDBBLOCK_MAGIC , RDBBLOCK_MAGIC_SIZE ) == 0 ) {
+		*isHeader = true;
+		return true;
+	}
+	if ( ds < RDBBLOCK_HDR_SIZE(ks) ) return false;
+	*codec   = *p;                p += 1;
+	*numPos  = *(int32_t *)p;     p += 4;
+	*numNeg  = *(int32_t *)p;     p += 4;
+	*encSize = *(int32_t *)p;     p += 4;
+	*outSize = *(int32_t *)p;     p += 4;
+	KEYSET ( lastKey , p , ks );  p += ks;
+	*data     = p;
+	*dataSize = ds - RDBBLOCK_HDR_SIZE(ks);
+	if ( *codec != RDBBLOCK_RAW  &&
+	     *codec != RDBBLOCK_ZLIB &&
+	     *codec != RDBBLOCK_ZSTD ) return false;
+	if ( *numPos < 0 || *numNeg < 0 || *numPos + *numNeg <= 0 )
+		return false;
+	if ( *encSize <= 0 || *outSize < ks ) return false;
+	if ( *codec == RDBBLOCK_RAW && *dataSize != *encSize ) return false;
+	// the first key in the block is the key of the block record
+	if ( KEYCMP ( rec , lastKey , ks ) > 0 ) return false;
+	return true;
+}
+
+bool getBlockInfo ( char *rec , int32_t recSize , char ks ,
+		    char *lastKey , int32_t *numPos , int32_t *numNeg ,
+		    bool *isHeader ) {
+	char     codec;
+	int32_t  encSize;
+	int32_t  outSize;
+	char    *data;
+	int32_t  dataSize;
+	return getBlockInfo2 ( rec , recSize , ks , &codec , lastKey ,
+			       numPos , numNeg , &encSize , &outSize ,
+			       &data , &dataSize , isHeader );
+}
+
+bool compressBlockList ( RdbList *list , bool addHeader , SafeBuf *out ) {
+	char ks = list->m_ks;
+	// we walk the records ourselves, the list must be plain
+	if ( list->m_useHalfKeys ) { char *xx=NULL;*xx=0; }
+	if ( addHeader ) {
+		char hk[MAX_KEY_BYTES];
+		KEYMIN ( hk , ks );
+		// make it a positive key
+		hk[0] = 0x01;
+		int32_t ds = RDBBLOCK_MAGIC_SIZE;
+		if ( ! out->safeMemcpy ( hk , ks ) ||
+		     ! out->safeMemcpy ( &ds , 4 ) ||
+		     ! out->safeMemcpy ( RDBBLOCK_MAGIC , RDBBLOCK_MAGIC_SIZE ))
+			return false;
+	}
+	// the prefix compressed records of the current block
+	SafeBuf enc;
+	char *p   = list->getList();
+	char *end = list->getListEnd();
+	while ( p < end ) {
+		char     firstKey[MAX_KEY_BYTES];
+		char    *prev    = NULL;
+		int32_t  numPos  = 0;
+		int32_t  numNeg  = 0;
+		int32_t  outSize = 0;
+		enc.setLength ( 0 );
+		KEYSET ( firstKey , p , ks );
+		// . fill up a block
+		// . each key is the # of high bytes it shares with the key
+		//   before it and then the rest of the key, low bytes first,
+		//   then the dataSize and data just like in the list
+		while ( p < end && outSize < RDBBLOCK_SIZE ) {
+			int32_t recSize = list->getRecSize ( p );
+			if ( recSize < ks || p + recSize > end ) {
+				g_errno = ECORRUPTDATA;
+				return log("db: Got bad record size of %"INT32" "
+					   "while compressing list.",recSize);
+			}
+			int32_t shared = 0;
+			while ( prev && shared < ks &&
+				p[ks-1-shared] == prev[ks-1-shared] )
+				shared++;
+			if ( ! enc.pushChar ( (char)shared ) ||
+			     ! enc.safeMemcpy ( p , ks - shared ) ||
+			     ! enc.safeMemcpy ( p + ks , recSize - ks ) )
+				return false;
+			if ( KEYNEG(p) ) numNeg++;
+			else             numPos++;
+			outSize += recSize;
+			prev     = p;
+			p       += recSize;
+		}
+		int32_t encSize = enc.length();
+		// same bound titleRecCompressBound() uses for zlib
+		int32_t bound = ((int64_t)encSize * 1001LL) / 1000LL + 25;
+#ifdef HAVE_ZSTD
+		int32_t bound2 = ZSTD_compressBound ( encSize );
+		if ( bound2 > bound ) bound = bound2;
+#endif
+		int32_t hdrSize = ks + 4 + RDBBLOCK_HDR_SIZE(ks);
+		if ( ! out->reserve ( hdrSize + bound , "RdbBlocks" ) )
+			return false;
+		char *dst     = out->getBuf();
+		char *data    = dst + hdrSize;
+		char  codec   = RDBBLOCK_RAW;
+		int32_t dataSize = encSize;
+#ifdef HAVE_ZSTD
+		size_t n = ZSTD_compress ( data , bound , enc.getBufStart() ,
+					   encSize , 1 );
+		if ( ! ZSTD_isError ( n ) && (int32_t)n < encSize ) {
+			codec    = RDBBLOCK_ZSTD;
+			dataSize = (int32_t)n;
+		}
+#else
+		uint32_t n = bound;
+		if ( gbcompress ( (unsigned char *)data , &n ,
+				  (unsigned char *)enc.getBufStart() ,
+				  encSize ) == Z_OK &&
+		     (int32_t)n < encSize ) {
+			codec    = RDBBLOCK_ZLIB;
+			dataSize = (int32_t)n;
+		}
+#endif
+		// did not compress, keep it prefix compressed only
+		if ( codec == RDBBLOCK_RAW )
+			gbmemcpy ( data , enc.getBufStart() , encSize );
+		char *x = dst;
+		KEYSET ( x , firstKey , ks );              x += ks;
+		*(int32_t *)x = RDBBLOCK_HDR_SIZE(ks) + dataSize; x += 4;
+		*x = codec;                                x += 1;
+		*(int32_t *)x = numPos;                    x += 4;
+		*(int32_t *)x = numNeg;                    x += 4;
+		*(int32_t *)x = encSize;                   x += 4;
+		*(int32_t *)x = outSize;                   x += 4;
+		KEYSET ( x , prev , ks );                  x += ks;
+		out->incrementLength ( hdrSize + dataSize );
+	}
+	return true;
+}
+
+// . expand the prefix compressed records in "src" into "dst"
+// . the first and last keys must be those in the block header
+// . returns false if corrupt
+static bool unprefixBlock ( char *src , int32_t srcSize ,
+			    char *dst , int32_t dstSize ,
+			    char ks , int32_t fixedDataSize ,
+			    char *firstKey , char *lastKey ) {
+	char  prev[MAX_KEY_BYTES];
+	char *s    = src;
+	char *send = src + srcSize;
+	char *o    = dst;
+	char *oend = dst + dstSize;
+	bool  first = true;
+	while ( s < send ) {
+		int32_t shared = (unsigned char)*s++;
+		if ( shared > ks || ( first && shared ) ) return false;
+		if ( s + ks - shared > send || o + ks > oend ) return false;
+		// the low bytes are stored, the high ones are the last key's
+		gbmemcpy ( o , s , ks - shared );
+		gbmemcpy ( o + ks - shared , prev + ks - shared , shared );
+		s += ks - shared;
+		if ( first && KEYCMP ( o , firstKey , ks ) ) return false;
+		KEYSET ( prev , o , ks );
+		first = false;
+		// same as RdbList::getRecSize()
+		int32_t rest;
+		if      ( fixedDataSize == 0 ) rest = 0;
+		else if ( KEYNEG(o)          ) rest = 0;
+		else if ( fixedDataSize >  0 ) rest = fixedDataSize;
+		else {
+			if ( s + 4 > send ) return false;
+			rest = 4 + *(int32_t *)s;
+			if ( rest < 4 ) return false;
+		}
+		if ( s + rest > send || o + ks + rest > oend ) return false;
+		gbmemcpy ( o + ks , s , rest );
+		s += rest;
+		o += ks + rest;
+	}
+	if ( first || KEYCMP ( prev , lastKey , ks ) ) return false;
+	return ( o == oend );
+}
+
+bool uncompressBlockList ( RdbList *list , int32_t fixedDataSize ,
+			   int32_t niceness ) {
+	char  ks  = list->m_ks;
+	char *p   = list->getList();
+	char *end = list->getListEnd();
+	char  startKey[MAX_KEY_BYTES];
+	char  endKey  [MAX_KEY_BYTES];
+	KEYSET ( startKey , list->m_startKey , ks );
+	KEYSET ( endKey   , list->m_endKey   , ks );
+	char     codec;
+	char     lastKey[MAX_KEY_BYTES];
+	int32_t  numPos , numNeg , encSize , outSize , dataSize;
+	char    *data;
+	bool     isHeader;
+	// . first see how much room we need
+	// . the tmp buf is for uncompressing into before we expand
+	int64_t need   = 0;
+	int32_t tmpMax = 0;
+	for ( char *q = p ; q < end ; ) {
+		if ( q + ks + 4 > end ) goto corrupt;
+		int32_t recSize = ks + 4 + *(int32_t *)(q + ks);
+		if ( recSize < ks + 4 || q + recSize > end ) goto corrupt;
+		if ( ! getBlockInfo2 ( q , recSize , ks , &codec , lastKey ,
+				       &numPos , &numNeg , &encSize , &outSize,
+				       &data , &dataSize , &isHeader ) )
+			goto corrupt;
+		q += recSize;
+		if ( isHeader ) continue;
+		need += outSize;
+		if ( codec != RDBBLOCK_RAW && encSize > tmpMax )
+			tmpMax = encSize;
+	}
+	if ( need > 0x7fffffff ) goto corrupt;
+	{
+	char *buf = NULL;
+	char *tmp = NULL;
+	if ( need > 0 ) {
+		buf = (char *)mmalloc ( need , "RdbBlocks" );
+		if ( ! buf ) {
+			list->freeList();
+			return log("db: Failed to alloc %"INT64" bytes to "
+				   "uncompress list.",need);
+		}
+	}
+	if ( tmpMax > 0 ) {
+		tmp = (char *)mmalloc ( tmpMax , "RdbBlocks" );
+		if ( ! tmp ) {
+			if ( buf ) mfree ( buf , need , "RdbBlocks" );
+			list->freeList();
+			return log("db: Failed to alloc %"INT32" bytes to "
+				   "uncompress list.",tmpMax);
+		}
+	}
+	char *o = buf;
+	bool  ok = true;
+	for ( char *q = p ; q < end && ok ; ) {
+		QUICKPOLL ( niceness );
+		int32_t recSize = ks + 4 + *(int32_t *)(q + ks);
+		getBlockInfo2 ( q , recSize , ks , &codec , lastKey ,
+				&numPos , &numNeg , &encSize , &outSize ,
+				&data , &dataSize , &isHeader );
+		q += recSize;
+		if ( isHeader ) continue;
+		char *src = data;
+		if ( codec == RDBBLOCK_ZLIB ) {
+			uint32_t n = encSize;
+			if ( gbuncompress ( (unsigned char *)tmp , &n ,
+					    (unsigned char *)data ,
+					    dataSize ) != Z_OK ||
+			     (int32_t)n != encSize ) {
+				ok = false;
+				break;
+			}
+			src = tmp;
+		}
+		if ( codec == RDBBLOCK_ZSTD ) {
+#ifdef HAVE_ZSTD
+			size_t n = ZSTD_decompress ( tmp , encSize ,
+						     data , dataSize );
+			if ( ZSTD_isError ( n ) || (int32_t)n != encSize ) {
+				ok = false;
+				break;
+			}
+			src = tmp;
+#else
+			log("db: Can not read zstd compressed block, gb was "
+			    "compiled without zstd.");
+			ok = false;
+			break;
+#endif
+		}
+		if ( ! unprefixBlock ( src , encSize , o , outSize , ks ,
+				       fixedDataSize , q - recSize , lastKey ) ) {
+			ok = false;
+			break;
+		}
+		o += outSize;
+	}
+	if ( tmp ) mfree ( tmp , tmpMax , "RdbBlocks" );
+	if ( ! ok ) {
+		if ( buf ) mfree ( buf , need , "RdbBlocks" );
+		goto corrupt;
+	}
+	// this frees the blocks we read
+	list->set ( buf , need , buf , need , startKey , endKey ,
+		    fixedDataSize , true , false , ks );
+	return true;
+	}
+ corrupt:
+	list->freeList();
+	g_errno = ECORRUPTDATA;
+	return log("db: Compressed block in list is corrupt.");
+}
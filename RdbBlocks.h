@@ -0,0 +1,57 @@
+// . a compressed block format for rdb data files, for rdbs with big keys
+//   and small or no data like linkdb and spiderdb
+// . the records of a file are cut into blocks of about RDBBLOCK_SIZE bytes.
+//   each key in a block only stores the bytes that differ from the key
+//   before it, starting with the low bytes since the most significant
+//   bytes are at the end, and then the whole block is compressed with
+//   zstd (if compiled in) or zlib, unless that does not make it smaller.
+// . each block is stored as one record so RdbMap and Msg3 work unchanged:
+//   the key is the first key in the block, then the 4 byte dataSize, then
+//   the block header and the compressed keys and data.
+//   the block header is the codec, the # of positive and negative keys,
+//   the size of the prefix compressed keys and data, the size they
+//   uncompress to and the last key in the block.
+// . the first record of a file is a header record with our magic as its
+//   data, so generateMap() knows how to parse a file without its map
+// . the map file has a flag saying if its data file is in this format,
+//   see RdbMap::isBlockCompressed(). Msg3 reads whole blocks because the
+//   map only knows where the blocks start and uncompresses them into a
+//   regular list before constraining it.
+
+#ifndef _RDBBLOCKS_H_
+#define _RDBBLOCKS_H_
+
+#include "RdbList.h"
+#include "SafeBuf.h"
+
+// about how many bytes of uncompressed records go into a block
+#define RDBBLOCK_SIZE (16*1024)
+
+// the codecs
+#define RDBBLOCK_RAW  0
+#define RDBBLOCK_ZLIB 1
+#define RDBBLOCK_ZSTD 2
+
+// . do new files of this rdb get written in blocks?
+// . only linkdb and spiderdb, and only if the parm is on
+bool isBlockCompressedRdb ( char rdbId );
+
+// . append "list" to "out" as blocks of compressed records
+// . "addHeader" is true for the first list written to a file
+// . returns false and sets g_errno on error
+bool compressBlockList ( RdbList *list , bool addHeader , SafeBuf *out );
+
+// . replace the blocks read from a file with the records in them
+// . "fixedDataSize" is that of the rdb
+// . returns false and sets g_errno on error, the list is empty then
+bool uncompressBlockList ( RdbList *list , int32_t fixedDataSize ,
+			   int32_t niceness );
+
+// . get the info from the header of the block record "rec"
+// . sets *isHeader if it is the header record of the file
+// . returns false if the block is corrupt
+bool getBlockInfo ( char *rec , int32_t recSize , char ks ,
+		    char *lastKey , int32_t *numPos , int32_t *numNeg ,
+		    bool *isHeader );
+
+#endif
@@ -0,0 +1,208 @@
+#include "gb-include.h"
+
+#include "RdbBloom.h"
+#include "Rdb.h"
+#include "File.h"
+#include "Mem.h"
+#include "Conf.h"
+
+#define BLOOM_VERSION 1
+// do not hog more than this much mem for one file, just read it
+#define BLOOM_MAX_BYTES (256*1024*1024)
+#define BLOOM_HDR_SIZE  (4+4+4+4+8+8+8)
+
+RdbBloom::RdbBloom() {
+	m_bits     = NULL;
+	m_numBytes = 0;
+	reset();
+}
+
+RdbBloom::~RdbBloom() {
+	reset();
+}
+
+void RdbBloom::reset() {
+	if ( m_bits ) mfree ( m_bits , m_numBytes , "RdbBloom" );
+	m_bits          = NULL;
+	m_numBytes      = 0;
+	m_numHashes     = 0;
+	m_prefixBits    = 0;
+	m_ks            = 0;
+	m_state         = BLOOM_NONE;
+	m_lastHash      = 0LL;
+	m_lastHashValid = false;
+}
+
+// . titledb and clusterdb keys start with the docid, clusterdb has 23
+//   zero bits before it, tagdb keys start with the 64 bit site hash and
+//   spiderdb keys start with the firstip
+// . the rest do not do point lookups, or they have too many keys
+int32_t RdbBloom::getPrefixBits ( char rdbId ) {
+	if ( rdbId == RDB_TITLEDB   || rdbId == RDB2_TITLEDB2   ) return 38;
+	if ( rdbId == RDB_CLUSTERDB || rdbId == RDB2_CLUSTERDB2 ) return 61;
+	if ( rdbId == RDB_TAGDB     || rdbId == RDB2_TAGDB2     ) return 64;
+	if ( rdbId == RDB_SPIDERDB  || rdbId == RDB2_SPIDERDB2  ) return 32;
+	return 0;
+}
+
+bool RdbBloom::init ( char rdbId , int64_t maxKeys ) {
+	reset();
+	int32_t bitsPerKey = g_conf.m_bloomBitsPerKey;
+	int32_t prefixBits = getPrefixBits ( rdbId );
+	if ( bitsPerKey <= 0 || prefixBits <= 0 ) return true;
+	if ( maxKeys < 1 ) maxKeys = 1;
+	int64_t numBytes = (maxKeys * bitsPerKey + 7) / 8;
+	// keep a little so a tiny file does not fill up
+	if ( numBytes < 64 ) numBytes = 64;
+	if ( numBytes > BLOOM_MAX_BYTES ) {
+		log("db: Not making bloom filter for %"INT64" keys, it "
+		    "would take %"INT64" bytes.",maxKeys,numBytes);
+		return true;
+	}
+	m_bits = (char *)mcalloc ( numBytes , "RdbBloom" );
+	if ( ! m_bits )
+		return log("db: Failed to alloc %"INT64" bytes for bloom "
+			   "filter: %s.",numBytes,mstrerror(g_errno));
+	m_numBytes   = (int32_t)numBytes;
+	m_prefixBits = prefixBits;
+	m_ks         = getKeySizeFromRdbId ( rdbId );
+	// ln(2) * bits per key is the best # of hashes
+	m_numHashes  = (bitsPerKey * 69) / 100;
+	if ( m_numHashes < 1  ) m_numHashes = 1;
+	if ( m_numHashes > 16 ) m_numHashes = 16;
+	m_state      = BLOOM_BUILDING;
+	return true;
+}
+
+// . the prefix is the top m_prefixBits of the key, the most significant
+//   bytes are at the end
+uint64_t RdbBloom::getPrefixHash ( char *key ) {
+	int32_t nb = (m_prefixBits + 7) / 8;
+	char buf[MAX_KEY_BYTES];
+	gbmemcpy ( buf , key + m_ks - nb , nb );
+	buf[0] &= (unsigned char)(0xff << (nb * 8 - m_prefixBits));
+	return hash64 ( buf , nb , 0 );
+}
+
+bool RdbBloom::samePrefix ( char *k1 , char *k2 ) {
+	int32_t nb = (m_prefixBits + 7) / 8;
+	char *p1 = k1 + m_ks - nb;
+	char *p2 = k2 + m_ks - nb;
+	if ( memcmp ( p1 + 1 , p2 + 1 , nb - 1 ) ) return false;
+	unsigned char mask = (unsigned char)(0xff << (nb*8 - m_prefixBits));
+	return ( (p1[0] & mask) == (p2[0] & mask) );
+}
+
+// . double hashing, the k probes are h1 + i*h2
+void RdbBloom::addKey ( char *key ) {
+	if ( m_state != BLOOM_BUILDING ) return;
+	uint64_t h = getPrefixHash ( key );
+	if ( m_lastHashValid && h == m_lastHash ) return;
+	m_lastHash      = h;
+	m_lastHashValid = true;
+	uint32_t numBits = (uint32_t)m_numBytes * 8;
+	uint32_t h1 = (uint32_t)h;
+	uint32_t h2 = (uint32_t)(h >> 32) | 1;
+	for ( int32_t i = 0 ; i < m_numHashes ; i++ ) {
+		uint32_t b = (h1 + i * h2) % numBits;
+		m_bits[b >> 3] |= (1 << (b & 7));
+	}
+}
+
+bool RdbBloom::mayContain ( char *startKey , char *endKey ) {
+	if ( m_state != BLOOM_READY ) return true;
+	// a range read, not a point lookup
+	if ( ! samePrefix ( startKey , endKey ) ) return true;
+	uint64_t h = getPrefixHash ( startKey );
+	uint32_t numBits = (uint32_t)m_numBytes * 8;
+	uint32_t h1 = (uint32_t)h;
+	uint32_t h2 = (uint32_t)(h >> 32) | 1;
+	for ( int32_t i = 0 ; i < m_numHashes ; i++ ) {
+		uint32_t b = (h1 + i * h2) % numBits;
+		if ( ! (m_bits[b >> 3] & (1 << (b & 7))) ) return false;
+	}
+	return true;
+}
+
+bool RdbBloom::save ( char *dir , char *filename , int64_t fileSize ,
+		      int64_t numPos , int64_t numNeg ) {
+	if ( m_state != BLOOM_READY ) return true;
+	File f;
+	f.set ( dir , filename );
+	if ( ! f.open ( O_RDWR | O_CREAT | O_TRUNC ) )
+		return log("db: Could not open %s for writing: %s.",
+			   f.getFilename(),mstrerror(g_errno));
+	char hdr[BLOOM_HDR_SIZE];
+	char *p = hdr;
+	*(int32_t *)p = BLOOM_VERSION; p += 4;
+	*(int32_t *)p = m_prefixBits;  p += 4;
+	*(int32_t *)p = m_numHashes;   p += 4;
+	*(int32_t *)p = m_numBytes;    p += 4;
+	*(int64_t *)p = fileSize;      p += 8;
+	*(int64_t *)p = numPos;        p += 8;
+	*(int64_t *)p = numNeg;        p += 8;
+	bool status = true;
+	if ( f.write ( hdr , BLOOM_HDR_SIZE , 0 ) != BLOOM_HDR_SIZE ||
+	     f.write ( m_bits , m_numBytes , BLOOM_HDR_SIZE ) != m_numBytes ) {
+		log("db: Failed to write %s: %s.",
+		    f.getFilename(),mstrerror(errno));
+		status = false;
+	}
+	f.close();
+	// do not leave a partial one around
+	if ( ! status ) f.unlink();
+	return status;
+}
+
+bool RdbBloom::load ( char *dir , char *filename , char keySize ,
+		      int64_t fileSize , int64_t numPos , int64_t numNeg ) {
+	reset();
+	File f;
+	f.set ( dir , filename );
+	// no filter, we just read the file every time
+	if ( f.doesExist() <= 0 ) return true;
+	if ( ! f.open ( O_RDONLY ) )
+		return log("db: Could not open %s for reading: %s.",
+			   f.getFilename(),mstrerror(g_errno));
+	char hdr[BLOOM_HDR_SIZE];
+	if ( f.read ( hdr , BLOOM_HDR_SIZE , 0 ) != BLOOM_HDR_SIZE ) {
+		f.close();
+		return log("db: Failed to read %s.",f.getFilename());
+	}
+	char *p = hdr;
+	int32_t version    = *(int32_t *)p; p += 4;
+	int32_t prefixBits = *(int32_t *)p; p += 4;
+	int32_t numHashes  = *(int32_t *)p; p += 4;
+	int32_t numBytes   = *(int32_t *)p; p += 4;
+	int64_t fs         = *(int64_t *)p; p += 8;
+	int64_t np         = *(int64_t *)p; p += 8;
+	int64_t nn         = *(int64_t *)p; p += 8;
+	// . stale, the map was rebuilt or the file was resumed after a
+	//   merge got killed. ignore it.
+	if ( version != BLOOM_VERSION || fs != fileSize || np != numPos ||
+	     nn != numNeg || prefixBits <= 0 || prefixBits > keySize * 8 ||
+	     numHashes <= 0 || numBytes <= 0 || numBytes > BLOOM_MAX_BYTES ||
+	     f.getFileSize() != BLOOM_HDR_SIZE + numBytes ) {
+		log("db: Ignoring stale bloom filter %s.",f.getFilename());
+		f.close();
+		return true;
+	}
+	m_bits = (char *)mmalloc ( numBytes , "RdbBloom" );
+	if ( ! m_bits ) {
+		f.close();
+		return log("db: Failed to alloc %"INT32" bytes for bloom "
+			   "filter: %s.",numBytes,mstrerror(g_errno));
+	}
+	m_numBytes = numBytes;
+	if ( f.read ( m_bits , numBytes , BLOOM_HDR_SIZE ) != numBytes ) {
+		f.close();
+		reset();
+		return log("db: Failed to read %s.",f.getFilename());
+	}
+	f.close();
+	m_prefixBits = prefixBits;
+	m_numHashes  = numHashes;
+	m_ks         = keySize;
+	m_state      = BLOOM_READY;
+	return true;
+}
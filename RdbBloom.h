@@ -0,0 +1,78 @@
+// . a bloom filter of the key prefixes in one rdb data file so Msg3 can
+//   skip the files that can not have what a point lookup wants
+// . the prefix is the top bits of the key that name a docid, a site or
+//   an ip, see getPrefixBits(). a read of [startKey,endKey] can use the
+//   filter when both keys have the same prefix, like Msg22 reading a
+//   titlerec or Msg8a reading the tags of a site.
+// . RdbMap builds it as RdbDump and RdbMerge add the keys to the map and
+//   saves it next to the map file as a .bloom file
+// . false positives just mean we read the file like we used to
+
+#ifndef _RDBBLOOM_H_
+#define _RDBBLOOM_H_
+
+#define BLOOM_NONE     0
+#define BLOOM_BUILDING 1
+#define BLOOM_READY    2
+
+class RdbBloom {
+
+ public:
+
+	RdbBloom();
+	~RdbBloom();
+
+	void reset();
+
+	// . start building a filter for a file that will have at most
+	//   "maxKeys" keys
+	// . returns false and sets g_errno on error
+	// . builds nothing if the rdb has no prefix or the parm is 0
+	bool init ( char rdbId , int64_t maxKeys );
+
+	// . called for each key added to the file, in order
+	void addKey ( char *key );
+
+	// the file is complete, we can use the filter now
+	void setReady ( ) { if ( m_state == BLOOM_BUILDING )
+			m_state = BLOOM_READY; };
+
+	bool isBuilding ( ) { return m_state == BLOOM_BUILDING; };
+	bool isReady    ( ) { return m_state == BLOOM_READY;    };
+
+	// . returns false if the file has no key in [startKey,endKey]
+	// . returns true if it might, or if we can not tell
+	bool mayContain ( char *startKey , char *endKey );
+
+	// . the data file's size and rec counts are saved with the filter
+	//   and must match on load, otherwise the filter is for some other
+	//   version of the file and we ignore it
+	// . returns false and sets g_errno on error
+	bool save ( char *dir , char *filename , int64_t fileSize ,
+		    int64_t numPos , int64_t numNeg );
+	bool load ( char *dir , char *filename , char keySize ,
+		    int64_t fileSize , int64_t numPos , int64_t numNeg );
+
+	int32_t getMemAlloced ( ) { return m_numBytes; };
+
+	// how many of the key's top bits identify a doc, site or ip
+	static int32_t getPrefixBits ( char rdbId );
+
+ private:
+
+	uint64_t getPrefixHash ( char *key );
+	bool     samePrefix    ( char *k1 , char *k2 );
+
+	char     *m_bits;
+	int32_t   m_numBytes;
+	int32_t   m_numHashes;
+	int32_t   m_prefixBits;
+	char      m_ks;
+	char      m_state;
+
+	// keys come in order so skip the repeats of a prefix
+	uint64_t  m_lastHash;
+	bool      m_lastHashValid;
+};
+
+#endif
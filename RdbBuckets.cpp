@@ -142,12 +142,15 @@ void RdbBucket::reset() {
 }
 
 int32_t RdbBuckets::getMemAlloced () {
+	if ( m_skipList ) return sizeof(RdbBuckets) + m_skipList->getMemAlloced();
 	int32_t alloced = sizeof(RdbBuckets) + m_masterSize + m_dataMemOccupied;
 	return alloced;
 }
 
 //includes data in the data ptrs
 int32_t RdbBuckets::getMemOccupied() {
+	if ( m_skipList ) 
+		return sizeof(RdbBuckets) + m_skipList->getMemOccupied();
 	return (m_numKeysApprox * m_recSize) + m_dataMemOccupied +
 		sizeof(RdbBuckets) + 
 		m_sortBufSize + 
@@ -156,15 +159,18 @@ int32_t RdbBuckets::getMemOccupied() {
 
 
 int32_t RdbBuckets::getMemAvailable() {
+	if ( m_skipList ) return m_skipList->getMemAvailable();
 	return m_maxMem - getMemOccupied();
 }
 
 
 bool RdbBuckets::is90PercentFull() {
+	if ( m_skipList ) return m_skipList->is90PercentFull();
 	return getMemOccupied () > m_maxMem * .9;
 }
 
 bool RdbBuckets::needsDump() {
+	if ( m_skipList ) return m_skipList->is90PercentFull();
 	if(m_numBuckets + 1 < m_maxBuckets) return false;
 	if(m_maxBuckets == m_maxBucketsCapacity) return true;
 	return false;
@@ -174,6 +180,7 @@ bool RdbBuckets::needsDump() {
 //and we can't then we'll get a partial list added and we will
 //add the whole list again.
 bool RdbBuckets::hasRoom ( int32_t numRecs ) {
+	if ( m_skipList ) return m_skipList->hasRoom ( numRecs );
 	int32_t numBucketsRequired = (((numRecs / BUCKET_SIZE)+1) * 2);
 	if(m_maxBucketsCapacity - m_numBuckets < numBucketsRequired) 
 		return false;
@@ -537,6 +544,7 @@ RdbBuckets::RdbBuckets() {
 	m_dataMemOccupied = 0;
 	m_needsSave = false;
 	m_repairMode = false;
+	m_skipList = NULL;
 }
 
 
@@ -572,6 +580,22 @@ bool RdbBuckets::set ( int32_t fixedDataSize , int32_t maxMem,
 	m_masterPtr =  NULL;
 	m_maxMem = maxMem;
 
+	// . data-less rdbs, like posdb, can keep their keys in a concurrent
+	//   skiplist instead. it saves in our format so either can load it.
+	// . takes effect on restart
+	if ( g_conf.m_useSkipListMemtable && m_fixedDataSize == 0 ) {
+		try { m_skipList = new (RdbSkipList); }
+		catch ( ... ) {
+			g_errno = ENOMEM;
+			return log("db: Failed to allocate %"INT32" bytes for "
+				   "skiplist.",(int32_t)sizeof(RdbSkipList));
+		}
+		mnew ( m_skipList , sizeof(RdbSkipList) , "RdbSkipList" );
+		return m_skipList->set ( m_maxMem - sizeof(RdbBuckets) , 
+					 m_rdbId , m_ks , BUCKET_SIZE ,
+					 m_dbname , m_allocName );
+	}
+
 	int32_t perBucket = sizeof(RdbBucket*) + 
 		sizeof(RdbBucket)
 		+ BUCKET_SIZE * m_recSize;
@@ -646,6 +670,11 @@ void RdbBuckets::setNeedsSave(bool s) {
 
 
 void RdbBuckets::reset() {
+	if ( m_skipList ) {
+		mdelete ( m_skipList , sizeof(RdbSkipList) , "RdbSkipList" );
+		delete ( m_skipList );
+		m_skipList = NULL;
+	}
 	for(int32_t j = 0; j < m_numBuckets; j++) {
 		m_buckets[j]->reset();
 	}
@@ -665,6 +694,7 @@ void RdbBuckets::reset() {
 
 
 void RdbBuckets::clear() {
+	if ( m_skipList ) m_skipList->clear();
 	for(int32_t j = 0; j < m_numBuckets; j++) {
 		m_buckets[j]->reset();
 	}
@@ -679,6 +709,54 @@ void RdbBuckets::clear() {
 
 
 
+template <class T> static void swapMember ( T &x , T &y ) {
+	T tmp = x; x = y; y = tmp;
+}
+
+// . Rdb seals its full buckets this way and dumps them while the empty
+//   ones take the adds
+// . both must have been set() with the same parms
+// . swaps every member but m_dbname, we save to a file named after it so
+//   that stays put
+void RdbBuckets::swap ( RdbBuckets *b ) {
+	swapMember ( m_buckets            , b->m_buckets            );
+	swapMember ( m_bucketsSpace       , b->m_bucketsSpace       );
+	swapMember ( m_masterPtr          , b->m_masterPtr          );
+	swapMember ( m_masterSize         , b->m_masterSize         );
+	swapMember ( m_firstOpenSlot      , b->m_firstOpenSlot      );
+	swapMember ( m_numBuckets         , b->m_numBuckets         );
+	swapMember ( m_maxBuckets         , b->m_maxBuckets         );
+	swapMember ( m_ks                 , b->m_ks                 );
+	swapMember ( m_fixedDataSize      , b->m_fixedDataSize      );
+	swapMember ( m_recSize            , b->m_recSize            );
+	swapMember ( m_numKeysApprox      , b->m_numKeysApprox      );
+	swapMember ( m_numNegKeys         , b->m_numNegKeys         );
+	swapMember ( m_maxMem             , b->m_maxMem             );
+	swapMember ( m_maxBucketsCapacity , b->m_maxBucketsCapacity );
+	swapMember ( m_dataMemOccupied    , b->m_dataMemOccupied    );
+	swapMember ( m_rdbId              , b->m_rdbId              );
+	swapMember ( m_swapBuf            , b->m_swapBuf            );
+	swapMember ( m_sortBuf            , b->m_sortBuf            );
+	swapMember ( m_sortBufSize        , b->m_sortBufSize        );
+	swapMember ( m_repairMode         , b->m_repairMode         );
+	swapMember ( m_isWritable         , b->m_isWritable         );
+	swapMember ( m_isSaving           , b->m_isSaving           );
+	swapMember ( m_needsSave          , b->m_needsSave          );
+	swapMember ( m_dir                , b->m_dir                );
+	swapMember ( m_state              , b->m_state              );
+	swapMember ( m_saveErrno          , b->m_saveErrno          );
+	swapMember ( m_allocName          , b->m_allocName          );
+	swapMember ( m_skipList           , b->m_skipList           );
+	// the buckets point back to us
+	for ( int32_t i = 0 ; i < m_maxBuckets ; i++ )
+		m_bucketsSpace[i].setParent ( this );
+	for ( int32_t i = 0 ; i < b->m_maxBuckets ; i++ )
+		b->m_bucketsSpace[i].setParent ( b );
+	m_needsSave    = true;
+	b->m_needsSave = true;
+}
+
+
 RdbBucket* RdbBuckets::bucketFactory() {
 
 	if(m_numBuckets == m_maxBuckets - 1) {
@@ -811,6 +889,8 @@ int32_t RdbBuckets::addNode (collnum_t collnum,
 
 	m_needsSave = true;
 
+	if ( m_skipList ) return m_skipList->addNode ( collnum , key );
+
 	int32_t i;
 
 	i = getBucketNum(key, collnum);
@@ -920,6 +1000,11 @@ bool RdbBuckets::getList ( collnum_t collnum ,
 	if ( minRecSizes == 0 ) return true;
 	if ( minRecSizes < 0 ) minRecSizes = 0x7fffffff;//LONG_MAX;
 
+	if ( m_skipList )
+		return m_skipList->getList ( collnum , startKey , endKey ,
+					     minRecSizes , list , numPosRecs ,
+					     numNegRecs , useHalfKeys );
+
 	int32_t startBucket = getBucketNum(startKey, collnum);
 	if(startBucket > 0 && 
 	   bucketCmp(startKey, collnum, m_buckets[startBucket-1]) < 0)
@@ -1018,6 +1103,9 @@ int RdbBuckets::getListSizeExact ( collnum_t collnum ,
 				   char *startKey, 
 				   char *endKey ) {
 
+	if ( m_skipList )
+		return m_skipList->getListSizeExact(collnum,startKey,endKey);
+
 	int numBytes = 0;
 
 	int32_t startBucket = getBucketNum(startKey, collnum);
@@ -1052,6 +1140,8 @@ int RdbBuckets::getListSizeExact ( collnum_t collnum ,
 }
 
 bool RdbBuckets::testAndRepair() {
+	// the skiplist fixes its counts itself, it can not repair order
+	if ( m_skipList ) return m_skipList->selfTest();
 	if(!selfTest(true/*thorough*/, 
 		     false/*core on error*/)) {
 		if(!repair()) return false;
@@ -1232,6 +1322,7 @@ int32_t RdbBuckets::getBucketNum(char* key, collnum_t collnum) {
 
 
 bool RdbBuckets::collExists(collnum_t collnum) {
+	if ( m_skipList ) return m_skipList->collExists ( collnum );
 	for(int32_t i = 0; i < m_numBuckets; i++) {
 		if(m_buckets[i]->getCollnum() == collnum)return true;
 		if(m_buckets[i]->getCollnum() > collnum)  break;
@@ -1240,6 +1331,7 @@ bool RdbBuckets::collExists(collnum_t collnum) {
 }
 
 int32_t RdbBuckets::getNumKeys(collnum_t collnum) {
+	if ( m_skipList ) return m_skipList->getNumKeys ( collnum );
 	int32_t numKeys = 0;
 	for(int32_t i = 0; i < m_numBuckets; i++) {
 		if(m_buckets[i]->getCollnum() == collnum) 
@@ -1251,6 +1343,7 @@ int32_t RdbBuckets::getNumKeys(collnum_t collnum) {
 
 	
 int32_t RdbBuckets::getNumKeys() {
+	if ( m_skipList ) return m_skipList->getNumKeys();
 	return m_numKeysApprox;
 }
 
@@ -1266,6 +1359,7 @@ int32_t RdbBuckets::getNumKeys() {
 
 
 int32_t RdbBuckets::getNumNegativeKeys ( ) {
+	if ( m_skipList ) return m_skipList->getNumNegativeKeys();
 	return m_numNegKeys;
 }
 
@@ -1278,6 +1372,8 @@ int32_t  RdbBuckets::getNumPositiveKeys ( ) {
 char* RdbBuckets::getKeyVal ( collnum_t collnum , char *key , 
 			      char **data , int32_t* dataSize ) {
 
+	if ( m_skipList ) return m_skipList->getKeyVal ( collnum , key );
+
 	int32_t i = getBucketNum(key, collnum);
 	if(i == m_numBuckets ||
 	   m_buckets[i]->getCollnum() != collnum ) return NULL;
@@ -1651,6 +1747,8 @@ bool RdbBuckets::deleteList(collnum_t collnum, RdbList *list) {
 	// . need to save
 	m_needsSave = true;
 
+	if ( m_skipList ) return m_skipList->deleteList ( collnum , list );
+
 	char startKey [ MAX_KEY_BYTES ];
 	char endKey   [ MAX_KEY_BYTES ];
 	list->getStartKey ( startKey );
@@ -1781,6 +1879,16 @@ void RdbBuckets::cleanBuckets ( ) {
 	// what buckets have -1 rdbid???
 	if ( m_rdbId < 0 ) return;
 
+	if ( m_skipList ) {
+		// same as below, but we have no buckets to find the colls in
+		for ( collnum_t i = 0 ; i < g_collectiondb.m_numRecs ; i++ ) {
+			if ( g_collectiondb.m_recs[i] ) continue;
+			if ( ! m_skipList->collExists ( i ) ) continue;
+			delColl ( i );
+		}
+		return;
+	}
+
 	// the liberation count
 	int32_t count = 0;
 
@@ -1841,6 +1949,7 @@ void RdbBuckets::cleanBuckets ( ) {
 bool RdbBuckets::delColl(collnum_t collnum) {
 
 	m_needsSave = true;
+	if ( m_skipList ) return m_skipList->delColl ( collnum );
 	RdbList list;
 	int32_t minRecSizes = 1024*1024;
 	int32_t numPosRecs  = 0;
@@ -1925,6 +2034,9 @@ int64_t RdbBuckets::getListSize ( collnum_t collnum,
 	if ( minKey ) KEYSET ( minKey , endKey   , m_ks );
 	if ( maxKey ) KEYSET ( maxKey , startKey , m_ks );
 
+	if ( m_skipList )
+		return m_skipList->getListSize ( collnum , startKey , endKey );
+
 	int32_t startBucket = getBucketNum(startKey, collnum);
 	if(startBucket > 0 && 
 	   bucketCmp(startKey, collnum, m_buckets[startBucket-1]) < 0)
@@ -2091,6 +2203,11 @@ bool RdbBuckets::fastSave_r() {
 }
 
 int64_t RdbBuckets::fastSaveColl_r(int fd, int64_t offset) {
+	if ( m_skipList ) {
+		offset = m_skipList->fastSave_r ( fd , offset );
+		if ( offset < 0 ) m_saveErrno = errno;
+		return offset;
+	}
 	if(m_numKeysApprox == 0) return offset;
 	int32_t version = SAVE_VERSION;
 	int32_t err = 0;
@@ -2199,6 +2316,8 @@ int64_t RdbBuckets::fastLoadColl( BigFile *f,
 	int32_t numBuckets;
 	int32_t version;
 
+	if ( m_skipList ) return m_skipList->fastLoad ( f , offset );
+
 	f->read  ( &version,sizeof(int32_t), offset ); 
 	offset += sizeof(int32_t);
 	if(version > SAVE_VERSION) {
@@ -28,6 +28,7 @@
 #include "RdbList.h"
 #include "RdbMem.h"
 #include "RdbTree.h"
+#include "RdbSkipList.h"
 class RdbBuckets;
 class RdbBucket {
 public:
@@ -44,6 +45,7 @@ public:
 	char *getKeys()    { return m_keys; }
 	collnum_t getCollnum()    { return m_collnum; }
 	void  setCollnum(collnum_t c){ m_collnum = c; }
+	void  setParent(RdbBuckets *p){ m_parent = p; }
 
 	bool  addKey(char *key , char *data , int32_t dataSize);
 	char *getKeyVal ( char *key , char **data , int32_t* dataSize ); 
@@ -107,6 +109,9 @@ class RdbBuckets {
 
 	bool resizeTable(int32_t numNeeded);
 
+	// trade all our keys with "b", but keep our names
+	void swap ( RdbBuckets *b );
+
 	
 	int32_t addNode ( collnum_t collnum , 
 		       char *key , char *data , int32_t dataSize );
@@ -237,6 +242,8 @@ class RdbBuckets {
 	void  (*m_callback) (void *state);
 	int32_t    m_saveErrno;
 	char   *m_allocName;
+	// if non-NULL all the keys live in here instead of in m_buckets
+	RdbSkipList *m_skipList;
 };
 
 #endif
@@ -1,6 +1,7 @@
 #include "gb-include.h"
 
 #include "RdbDump.h"
+#include "RdbBlocks.h"
 #include "Rdb.h"
 //#include "Tfndb.h"
 //#include "Sync.h"
@@ -199,6 +200,7 @@ void RdbDump::reset ( ) {
 		mfree ( m_verifyBuf , m_verifyBufSize , "RdbDump4");
 		m_verifyBuf = NULL;
 	}
+	m_blockBuf.purge();
 }	
 
 void RdbDump::doneDumping ( ) {
@@ -636,6 +638,19 @@ bool RdbDump::dumpList ( RdbList *list , int32_t niceness , bool recall ) {
 	// now write it to disk
 	m_buf          = m_list->getList    ();
 	m_bytesToWrite = m_list->getListSize();
+	// . or write it as compressed blocks, see RdbBlocks.h
+	// . the first list in the file gets the header record
+	if ( m_map && m_map->isBlockCompressed() ) {
+		m_blockBuf.setLength ( 0 );
+		if ( ! compressBlockList ( m_list , m_offset == 0 ,
+					   &m_blockBuf ) ) {
+			log("db: Failed to compress list to dump: %s.",
+			    mstrerror(g_errno));
+			return true;
+		}
+		m_buf          = m_blockBuf.getBufStart();
+		m_bytesToWrite = m_blockBuf.length();
+	}
 	//#ifdef GBSANITYCHECK
 	//if (m_list->getListSize()!=m_list->getListEnd() - m_list->getList()){
 	//	log("RdbDump::dumpList: major problem here!");
@@ -737,6 +752,11 @@ bool RdbDump::doneDumpingList ( bool addToMap ) {
 	//   us to do saves without deleting our data! good!
 	if ( ! m_orderedDump ) return true; //--turn this off until save works
 
+	// count bytes dumped from memory for the write amplification stats.
+	// RdbMerge's dump has no m_rdb, RdbBase::incorporateMerge() counts it
+	if ( m_rdb && ( m_tree || m_buckets ) )
+		m_rdb->m_bytesDumped += m_bytesToWrite;
+
 	// save for verify routine
 	m_addToMap = addToMap;
 
@@ -832,7 +852,11 @@ bool RdbDump::doneReadingForVerify ( ) {
 	// . add the list to the rdb map if we have one
 	// . we don't have maps when we do unordered dumps
 	// . careful, map is NULL if we're doing unordered dump
-	if ( m_addToMap && m_map && ! m_map->addList ( m_list ) ) {
+	// . a list we wrote as compressed blocks adds the blocks
+	if ( m_addToMap && m_map &&
+	     ! ( m_map->isBlockCompressed() ?
+		 m_map->addBlockList ( m_buf , m_bytesToWrite , m_list ) :
+		 m_map->addList ( m_list ) ) ) {
 		// keys  out of order in list from tree?
 		if ( g_errno == ECORRUPTDATA ) {
 			log("db: trying to fix tree or buckets");
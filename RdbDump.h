@@ -121,6 +121,7 @@ class RdbDump {
 	RdbList  *m_list          ; // holds list to dump
 	RdbList   m_ourList       ; // we use for dumping a tree, point m_list
 	char     *m_buf           ; // points into list
+	SafeBuf   m_blockBuf      ; // the list as compressed blocks
 	char     *m_verifyBuf     ;
 	int32_t      m_verifyBufSize ;
 	int32_t      m_bytesToWrite  ;
@@ -1638,6 +1638,100 @@ bool RdbList::constrain ( char   *startKey    ,
 	return true;
 }
 
+////////
+//
+// LOSER TREE FOR THE MERGES
+//
+///////
+
+// . merge_r() and posdbMerge_r() used to scan every list to find the next
+//   smallest key, which costs numLists compares per key. a 200 file titledb
+//   merge spent most of its time in that scan.
+// . now we use a loser tree (tournament tree) which takes log2(numLists)
+// . tree[0] is the overall winner and tree[t] for t in [1,n) holds the
+//   list that lost the match played at node t. leaf i plays at (i+n)/2.
+// . an exhausted list loses to everyone. if two keys tie then the newer
+//   list, the one with the higher list #, wins, since the newest rec must
+//   win key ties
+// . build the tree by setting tree[0..n-1] to -1 and replaying every list,
+//   then replay just the winning list every time it advances
+
+// . returns true if list #a beats list #b
+// . "keys" are the current keys of each list with the negative bit and
+//   the posdb compression bits masked out
+static inline bool keyBeats ( int32_t a , int32_t b , char *keys , 
+			      char *gone , char ks ) {
+	if ( gone[b] ) return true;
+	if ( gone[a] ) return false;
+	int32_t c = KEYCMP ( keys + a * ks , keys + b * ks , ks );
+	if ( c ) return ( c < 0 );
+	return ( a > b );
+}
+
+static void keyReplay ( int16_t *tree , int32_t n , int32_t s , char *keys ,
+			char *gone , char ks ) {
+	for ( int32_t t = ( s + n ) >> 1 ; t > 0 ; t >>= 1 ) {
+		// empty node? only happens while building the tree
+		if ( tree[t] < 0 ) { tree[t] = s; return; }
+		// the loser stays at the node, the winner plays on up
+		if ( ! keyBeats ( tree[t] , s , keys , gone , ks ) ) continue;
+		int16_t tmp = tree[t]; tree[t] = s; s = tmp;
+	}
+	tree[0] = s;
+}
+
+// . store the masked current key of "list" into "k" for keyBeats()
+static inline void keyLoad ( RdbList *list , char *k , char *gone , char ks ){
+	if ( list->isExhausted() ) { *gone = 1; return; }
+	*gone = 0;
+	list->getCurrentKey ( k );
+	// treat negatives and positives as equals for this
+	*k |= 0x01;
+	// clear compression bits if posdb
+	if ( ks == 18 ) *k &= 0xf9;
+}
+
+// . same as keyBeats() but for the compressed lists of posdbMerge_r()
+// . an exhausted list has a NULL ptr
+static inline bool posdbBeats ( int32_t a , int32_t b , char **ptrs ,
+				char **loKeys , char **hiKeys ) {
+	if ( ! ptrs[b] ) return true;
+	if ( ! ptrs[a] ) return false;
+	char ss = bfcmpPosdb ( ptrs[a] , loKeys[a] , hiKeys[a] ,
+			       ptrs[b] , loKeys[b] , hiKeys[b] );
+	if ( ss ) return ( ss < 0 );
+	return ( a > b );
+}
+
+static void posdbReplay ( int16_t *tree , int32_t n , int32_t s ,
+			  char **ptrs , char **loKeys , char **hiKeys ) {
+	for ( int32_t t = ( s + n ) >> 1 ; t > 0 ; t >>= 1 ) {
+		if ( tree[t] < 0 ) { tree[t] = s; return; }
+		if ( ! posdbBeats ( tree[t] , s , ptrs , loKeys , hiKeys ) )
+			continue;
+		int16_t tmp = tree[t]; tree[t] = s; s = tmp;
+	}
+	tree[0] = s;
+}
+
+// . advance list #i of posdbMerge_r() to its next key
+// . sets its ptr to NULL and returns false if it is now exhausted
+static inline bool posdbAdvance ( int32_t i , char **ptrs , char **ends ,
+				  char **loKeys , char **hiKeys ) {
+	if      ( ptrs[i][0] & 0x04 ) ptrs [ i ] += 6;
+	else if ( ptrs[i][0] & 0x02 ) ptrs [ i ] += 12;
+	else                          ptrs [ i ] += 18;
+	if ( ptrs[i] >= ends[i] ) { ptrs[i] = NULL; return false; }
+	// is new key 6 bytes? then do not touch hi/lo ptrs
+	if ( ptrs[i][0] & 0x04 ) return true;
+	// is new key 12 bytes?
+	loKeys [ i ] = ptrs [ i ] + 6;
+	if ( ptrs[i][0] & 0x02 ) return true;
+	// is new key 18 bytes? full key.
+	hiKeys [ i ] = ptrs [ i ] + 12;
+	return true;
+}
+
 // . merges a bunch of lists together
 // . one of the most complicated routines in Gigablast
 // . the newest record (in the highest list #) wins key ties
@@ -1800,17 +1894,32 @@ void RdbList::merge_r ( RdbList **lists         ,
 	//key_t savedHighestKey;
 	char  savedLastKey[MAX_KEY_BYTES];
 	char  savedHighestKey[MAX_KEY_BYTES];
+	// bitch if too many lists for the loser tree
+	if ( numLists > MAX_RDB_FILES + 1 ) {
+		log(LOG_LOGIC,"db: rdblist: merge_r: Too many "
+		    "lists for merging.");
+		char *xx=NULL;*xx=0;
+	}
+	// the masked current key of each list, and the loser tree on them
+	char    mkeys [ (MAX_RDB_FILES + 1) * MAX_KEY_BYTES ];
+	char    gone  [ MAX_RDB_FILES + 1 ];
+	int16_t tree  [ MAX_RDB_FILES + 1 ];
+	// the masked key of the last winner, to skip its older dups
+	char    lastMinKey[MAX_KEY_BYTES];
 	// reset each list's ptr
 	for ( i = 0 ; i < numLists ; i++ ) lists[i]->resetListPtr();
+	// build the loser tree
+	for ( i = 0 ; i < numLists ; i++ ) {
+		keyLoad ( lists[i] , mkeys + i * m_ks , &gone[i] , m_ks );
+		tree[i] = -1;
+	}
+	for ( i = 0 ; i < numLists ; i++ )
+		keyReplay ( tree , numLists , i , mkeys , gone , m_ks );
 	// don't breech the list's boundary when adding keys from merge
 	char *allocEnd = m_alloc + m_allocSize;
 	// sanity
 	//if ( ! m_alloc ) { char *xx=NULL;*xx=0; }
 	// now begin the merge loop
-	//key_t ckey;
-	//key_t mkey;
-	char ckey[MAX_KEY_BYTES];
-	char mkey[MAX_KEY_BYTES];
 	//int64_t prevDocId = 0LL;
 	// set the yield point for yielding the processor
 	char *yieldPoint = NULL;
@@ -1827,58 +1936,11 @@ void RdbList::merge_r ( RdbList **lists         ,
 #endif
 
  top:
-	// get the biggest possible minKey so everyone's <= it
-	//key_t minKey;
-	//minKey.n0 = 0xffffffffffffffffLL;
-	//minKey.n1 = 0xffffffff;
-	KEYSET(minKey,KEYMAX(),m_ks);
-	// assume we have no min key
-	mini = -1;
-	// . loop over the lists
-	// . get newer rec with same key as older rec FIRST
-	for ( i = 0 ; i < numLists ; i++ ) {
-		// TODO: to speed up extract from list of RdbLists
-		if ( lists[i]->isExhausted() ) continue;
-		// see if the current key from this scan's read buffer is 2 big
-		//ckey = lists[i]->getCurrentKey();
-		//mkey = minKey;
-		lists[i]->getCurrentKey(ckey);
-		KEYSET(mkey,minKey,m_ks);
-		// treat negatives and positives as equals for this
-		//ckey.n0 |= 0x01;
-		//mkey.n0 |= 0x01;
-		*ckey |= 0x01;
-		*mkey |= 0x01;
-		// clear compression bits if posdb
-		if ( m_ks == 18 ) *ckey &= 0xf9;
-		//
-		// TODO: if merging titledb recs mask out all but the docids???
-		// then we don't have to worry about adding the negative
-		// key in Msg14.cpp adding to RDB_TITLEDB. that was causing
-		// us to add then delete the tfndb rec for the same docid
-		// because of the TITLEDB/TFNDB logic in Rdb::addList/Record()
-		// crap, then i would have to deal with rdbtree too! so
-		// comment this out..
-		//if ( rdbId == RDB_TITLEDB ) {
-		//	// all but the least significant 7 bytes are docid bits
-		//	// for the most part
-		//	memset(ckey,7,0);
-		//	memset(mkey,7,0);
-		//	// these 2 bits are not docid bits
-		//	ckey[7] &= 0xfc;
-		//	mkey[7] &= 0xfc;
-		//}
-                //if ( ckey > mkey ) continue;
-		if ( KEYCMP(ckey,mkey,m_ks)>0 ) continue;
-		// if this guy is newer and equal, skip the old guy
-		//if ( ckey == mkey && mini >= 0 ) 
-		if ( KEYCMP(ckey,mkey,m_ks)==0 && mini >= 0 ) 
-			lists[mini]->skipCurrentRecord();
-		// now this new guy is the min key
-                //minKey  = lists[i]->getCurrentKey();
-		lists[i]->getCurrentKey(minKey);
-                mini    = i;
-	}
+	// . the loser tree's winner has the smallest key
+	// . on a tie it is the newest rec, the older dups are skipped below
+	mini = tree[0];
+	if ( gone[mini] ) mini = -1;
+	else              lists[mini]->getCurrentKey(minKey);
 	// if we are high niceness, yield every 100k we merge
 	if ( m_listPtr >= yieldPoint ) {
 		if ( niceness > 0 ) yieldPoint = m_listPtr + 100000;
@@ -2037,8 +2099,21 @@ void RdbList::merge_r ( RdbList **lists         ,
 	//lastMini       = mini;
 	lastKeyIsValid = true;
  skip:
+	// save the winning key so we can skip it in the older lists
+	KEYSET(lastMinKey,mkeys+mini*m_ks,m_ks);
 	// get the next key in line and goto top
 	lists[mini]->skipCurrentRecord(); 
+	keyLoad ( lists[mini] , mkeys + mini * m_ks , &gone[mini] , m_ks );
+	keyReplay ( tree , numLists , mini , mkeys , gone , m_ks );
+	// . the newest rec won the tie, so skip the same key in older lists
+	// . ties go to the higher list # so those come out of the tree next
+	while ( tree[0] != mini && ! gone[tree[0]] &&
+		KEYCMP(mkeys+tree[0]*m_ks,lastMinKey,m_ks) == 0 ) {
+		i = tree[0];
+		lists[i]->skipCurrentRecord();
+		keyLoad ( lists[i] , mkeys + i * m_ks , &gone[i] , m_ks );
+		keyReplay ( tree , numLists , i , mkeys , gone , m_ks );
+	}
 	// keep adding/merging more records if we still have more room w/o grow
 	if ( m_listSize < m_mergeMinListSize ) goto top;
 
@@ -3194,6 +3269,12 @@ bool RdbList::posdbMerge_r ( RdbList **lists         ,
 	// . all their keys are supposed to be <= m_endKey
 	if ( numLists <= 0 ) return true;
 
+	// build the loser tree over the lists, see posdbReplay()
+	int16_t tree [ MAX_RDB_FILES + 1 ];
+	for ( i = 0 ; i < n ; i++ ) tree[i] = -1;
+	for ( i = 0 ; i < n ; i++ ) 
+		posdbReplay ( tree , n , i , ptrs , loKeys , hiKeys );
+
 	// debug msg
 	//log("merge start.n1=%"XINT32" n0=%"XINT64"", m_startKey.n1 , m_startKey.n0 );
 	//log("merge end  .n1=%"XINT32" n0=%"XINT64"", m_endKey.n1   , m_endKey.n0   );
@@ -3222,7 +3303,6 @@ bool RdbList::posdbMerge_r ( RdbList **lists         ,
 	// have troubles look into this.
 	if ( isRealMerge ) uflag = 1;
 
-	char ss;
 	//int32_t foo;
 
 #ifdef ALLOW_SCALE
@@ -3244,38 +3324,12 @@ bool RdbList::posdbMerge_r ( RdbList **lists         ,
  top:
 	//	sched_yield();
 
-	// assume key in first list is the winner
-	minPtrBase = ptrs  [0];
-	minPtrLo   = loKeys[0];
-	minPtrHi   = hiKeys[0];
-	mini       = 0;
-
-	// merge loop over the lists, get the smallest key
-	for ( i = 1 ; i < numLists ; i++ ) { 
-		// sanity check
-		//if ( fcmp (minPtrBase,minPtrHi,ptrs[i],hiKeys[i]) !=
-		//     cmp (minPtrBase,minPtrHi,ptrs[i],hiKeys[i])  ) {
-		//	char *xx = NULL; *xx = 0; }
-		// this cmp() function is inlined in RdbList.h
-		ss = bfcmpPosdb (minPtrBase,minPtrLo,minPtrHi,
-				 ptrs[i],loKeys[i],hiKeys[i]);
-		// . continue if tie, so we get the oldest first
-		// . treat negative and positive keys as identical for this
-		if ( ss <  0 ) continue;
-		// advance old winner. this happens if this key is positive
-		// and minPtrBase/Lo/Hi was a negative key! so this is
-		// the annihilation. skip the positive key.
-		if ( ss == 0 ) goto skip;
-		// we got a new min
-		minPtrBase = ptrs  [i];
-		minPtrLo   = loKeys[i];
-		minPtrHi   = hiKeys[i];
-		mini     = i;
-	}
-
-	// watch out
-	//if ( m_ks == 18 && m_listPtr - m_list == 20136 )
-	//	foo = 1;
+	// . the loser tree's winner has the smallest key
+	// . on a tie it is the newest rec, the older dups are skipped below
+	mini       = tree  [0];
+	minPtrBase = ptrs  [mini];
+	minPtrLo   = loKeys[mini];
+	minPtrHi   = hiKeys[mini];
 
 	// ignore if negative i guess, just skip it
 	if ( removeNegKeys && (minPtrBase[0] & 0x01) == 0x00 ) goto skip;
@@ -3392,53 +3446,24 @@ bool RdbList::posdbMerge_r ( RdbList **lists         ,
 	// . TODO: what if last key we were able to add was NEGATIVE???
 
  skip:
-	//sched_yield();
-	// if lastKey was not from root list, mark it as so now
-	//lastmini = mini;
-	// advance winning src list ptr
-	if      ( ptrs[mini][0] & 0x04 ) ptrs [ mini ] += 6;
-	else if ( ptrs[mini][0] & 0x02 ) ptrs [ mini ] += 12;
-	else                             ptrs [ mini ] += 18;
-
-	// if the src list that we advanced is not exhausted, then continue
-	if ( ptrs[mini] < ends[mini] ) {
-		// is new key 6 bytes? then do not touch hi/lo ptrs
-		if ( ptrs[mini][0] & 0x04 ) {
-		}
-		// is new key 12 bytes?
-		else if ( ptrs[mini][0] & 0x02 ) {
-			loKeys [ mini ]  = ptrs [ mini ] + 6;
-		}
-		// is new key 18 bytes? full key.
-		else {
-			hiKeys [ mini ]  = ptrs [ mini ] + 12;
-			loKeys [ mini ]  = ptrs [ mini ] + 6;
-		}
-		// but if we got enough recs and this list doesn't need to
-		// be remove, we should be about done
-		if ( m_listPtr >= maxPtr ) goto done;
-		// otherwise, we need more recs and this list is NOT exhausted
-		goto top;
-	}
-
-	//
-	// REMOVE THE LIST at mini
-	//
-
-	// debug msg
-	//log("removing list #%"INT32"", mini);
-	// otherwise, remove him from array
-	for ( int32_t i = mini ; i < numLists - 1 ; i++ ) {
-		ptrs    [i] = ptrs    [i+1];
-		ends    [i] = ends    [i+1];
-		hiKeys  [i] = hiKeys  [i+1];
-		loKeys  [i] = loKeys  [i+1];
-#ifdef _MERGEDEBUG_
-		fns     [i] = fns     [i+1];
-#endif
+	// . advance winning src list ptr
+	// . one less list to worry about if it is exhausted now
+	if ( ! posdbAdvance ( mini , ptrs , ends , loKeys , hiKeys ) )
+		numLists--;
+	posdbReplay ( tree , n , mini , ptrs , loKeys , hiKeys );
+	// . the newest rec won the tie, so skip the same key in older lists.
+	//   this is the annihilation of a positive key by a newer negative.
+	// . ties go to the higher list # so those come out of the tree next
+	// . minPtrBase/Lo/Hi still point into the src list so are still good
+	while ( numLists > 0 && tree[0] != mini ) {
+		i = tree[0];
+		if ( bfcmpPosdb ( ptrs[i] , loKeys[i] , hiKeys[i] ,
+				  minPtrBase , minPtrLo , minPtrHi ) != 0 )
+			break;
+		if ( ! posdbAdvance ( i , ptrs , ends , loKeys , hiKeys ) )
+			numLists--;
+		posdbReplay ( tree , n , i , ptrs , loKeys , hiKeys );
 	}
-	// one less list to worry about
-	numLists--;
 	// if we got minRecSizes, we're done
 	if ( m_listPtr >= maxPtr ) goto done;
 	// if we have more lists, continue adding
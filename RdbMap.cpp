@@ -1,10 +1,15 @@
 #include "gb-include.h"
 
 #include "RdbMap.h"
+#include "RdbBlocks.h"
 #include "BigFile.h"
 #include "IndexList.h"
+#include "File.h"
+#include <sys/mman.h>
 
 RdbMap::RdbMap() {
+	m_mapBuf = NULL;
+	m_mapBufSize = 0;
 	m_numSegments = 0;
 	m_numSegmentPtrs = 0;
 	m_numSegmentOffs = 0;
@@ -61,6 +66,12 @@ void RdbMap::reset ( ) {
 	if ( m_newPagesPerSegment > 0 ) pps = m_newPagesPerSegment;
 
 	for ( int32_t i = 0 ; i < m_numSegments; i++ ) {
+		// segments in our mmap of the map file are freed below
+		if ( isMapped ( m_keys[i] ) ) {
+			m_keys   [i] = NULL;
+			m_offsets[i] = NULL;
+			continue;
+		}
 		//mfree(m_keys[i],sizeof(key_t)*PAGES_PER_SEGMENT,"RdbMap");
 		mfree(m_keys[i],m_ks *pps,"RdbMap");
 		mfree(m_offsets[i], 2*pps,"RdbMap");
@@ -69,6 +80,10 @@ void RdbMap::reset ( ) {
 		m_offsets[i] = NULL;
 	}
 
+	if ( m_mapBuf ) munmap ( m_mapBuf , m_mapBufSize );
+	m_mapBuf     = NULL;
+	m_mapBufSize = 0;
+
 	// the ptrs themselves are now a dynamic array to save mem
 	// when we have thousands of collections
 	mfree(m_keys,m_numSegmentPtrs*sizeof(char *),"MapPtrs1");
@@ -79,6 +94,7 @@ void RdbMap::reset ( ) {
 	m_newPagesPerSegment = 0;
 
 	m_needToWrite     = false;
+	m_blockCompressed = false;
 	m_fileStartOffset = 0LL;
 	m_numSegments     = 0;
 	m_numPages        = 0;
@@ -95,15 +111,28 @@ void RdbMap::reset ( ) {
 	m_badKeys     = 0;
 	m_needVerify  = false;
 
+	m_bloom.reset();
+
 	m_file.reset();
 }
 
 
 bool RdbMap::writeMap ( bool allDone ) {
 	if ( g_conf.m_readOnlyMode ) return true;
+	// . the file is complete so its bloom filter is too
+	// . if the save fails we just read the file for every lookup
+	if ( allDone && m_bloom.isBuilding() ) {
+		m_bloom.setReady();
+		char bname[1024];
+		getBloomFilename ( m_file.getFilename() , bname );
+		m_bloom.save ( m_file.getDir() , bname , m_offset ,
+			       m_numPositiveRecs , m_numNegativeRecs );
+	}
 	// return true if nothing to write out
 	// mdw if ( m_numPages <= 0 ) return true;
 	if ( ! m_needToWrite ) return true;
+	// we truncate the map file below, so get off of our mmap of it
+	if ( m_mapBuf && ! copyMapToMem() ) return false;
 	// open a new file
 	if ( ! m_file.open ( O_RDWR | O_CREAT | O_TRUNC ) ) 
 		return log("db: Could not open %s for writing: %s.",
@@ -130,8 +159,11 @@ bool RdbMap::writeMap2 ( ) {
 	if ( g_errno ) return log("db: Failed to write to %s: %s",
 				  m_file.getFilename(),mstrerror(g_errno));
 	offset += 8;
-	// when a BigFile gets chopped, keep up a start offset for it
-	m_file.write ( &m_fileStartOffset , 8 , offset );
+	// . when a BigFile gets chopped, keep up a start offset for it
+	// . a bit of it says if the data file is in compressed blocks
+	int64_t startOffset = m_fileStartOffset;
+	if ( m_blockCompressed ) startOffset |= MAP_BLOCKS_BIT;
+	m_file.write ( &startOffset , 8 , offset );
 	if ( g_errno ) return log("db: Failed to write to %s: %s",
 				  m_file.getFilename(),mstrerror(g_errno));
 	offset += 8;
@@ -213,7 +245,12 @@ bool RdbMap::readMap ( BigFile *dataFile ) {
 	if ( ! m_file.open ( O_RDWR ) ) 
 		return log("db: Could not open %s for reading: %s.",
 			   m_file.getFilename(),mstrerror(g_errno));
-	bool status = readMap2 ( );
+	// . try to use the map file as is, it is already laid out in
+	//   segments like we keep it in memory
+	// . fall back to reading it in if we can not mmap it
+	bool status;
+	if ( ! g_conf.m_mmapRdbMaps || ! mmapMap2 ( ) ) status = readMap2 ( );
+	else                                            status = true;
 	// . close map
 	// . no longer since we use BigFile
 	// . no, we have to close since we will hog all the fds
@@ -223,10 +260,66 @@ bool RdbMap::readMap ( BigFile *dataFile ) {
 	m_file.closeFds ( );
 	// verify and fix map, data on disk could be corrupted
 	if ( ! verifyMap ( dataFile ) ) return false;
+	// if it is missing or stale we just read the file for every lookup
+	if ( status ) readBloom ( );
 	// return status
 	return status;
 }
 
+bool RdbMap::readBloom ( ) {
+	char bname[1024];
+	getBloomFilename ( m_file.getFilename() , bname );
+	return m_bloom.load ( m_file.getDir() , bname , m_ks , m_offset ,
+			      m_numPositiveRecs , m_numNegativeRecs );
+}
+
+void RdbMap::getBloomFilename ( char *mapFilename , char *buf ) {
+	int32_t len = gbstrlen ( mapFilename );
+	if ( len > 1000 ) len = 1000;
+	gbmemcpy ( buf , mapFilename , len );
+	if ( len >= 4 && ! strncmp ( buf + len - 4 , ".map" , 4 ) ) len -= 4;
+	strcpy ( buf + len , ".bloom" );
+}
+
+bool RdbMap::initBloom ( char rdbId , int64_t maxKeys ) {
+	// only for a new file, we would miss the keys already in it
+	if ( m_offset > 0 || m_numPages > 0 ) return true;
+	return m_bloom.init ( rdbId , maxKeys );
+}
+
+void RdbMap::initBlocks ( char rdbId ) {
+	// only for a new file, one we resume keeps its format
+	if ( m_offset > 0 || m_numPages > 0 ) return;
+	m_blockCompressed = isBlockCompressedRdb ( rdbId );
+}
+
+// . rename the bloom filter file along with the map file
+// . it is small so we just do it now
+void RdbMap::renameBloom ( char *newMapFilename , char *newDir ) {
+	char oldName[1024];
+	char newName[1024];
+	getBloomFilename ( m_file.getFilename() , oldName );
+	getBloomFilename ( newMapFilename , newName );
+	File f;
+	f.set ( m_file.getDir() , oldName );
+	if ( f.doesExist() <= 0 ) return;
+	File g;
+	if ( newDir ) g.set ( newDir , newName );
+	else          g.set ( m_file.getDir() , newName );
+	if ( ::rename ( f.getFilename() , g.getFilename() ) != 0 )
+		log("db: Failed to rename %s to %s: %s.",
+		    f.getFilename(),g.getFilename(),mstrerror(errno));
+}
+
+void RdbMap::unlinkBloom ( ) {
+	char bname[1024];
+	getBloomFilename ( m_file.getFilename() , bname );
+	File f;
+	f.set ( m_file.getDir() , bname );
+	if ( f.doesExist() <= 0 ) return;
+	f.unlink();
+}
+
 bool RdbMap::verifyMap ( BigFile *dataFile ) {
 
 	int64_t diff = m_offset - m_fileStartOffset;
@@ -430,6 +523,8 @@ bool RdbMap::readMap2 ( ) {
 	if ( g_errno ) return log("db: Had error reading %s: %s.",
 				  m_file.getFilename(),mstrerror(g_errno));
 	offset += 8;
+	m_blockCompressed = ( m_fileStartOffset & MAP_BLOCKS_BIT );
+	m_fileStartOffset &= ~MAP_BLOCKS_BIT;
 	// read total number of non-deleted records
 	m_file.read ( &m_numPositiveRecs , 8 , offset );
 	if ( g_errno ) return log("db: Had error reading %s: %s.",
@@ -464,6 +559,103 @@ bool RdbMap::readMap2 ( ) {
 	return true;
 }
 
+// . point m_keys[] and m_offsets[] right into an mmap of the map file
+// . the format on disk is the header followed by each segment's keys and
+//   then its offsets, PAGES_PER_SEGMENT of each, except the last segment
+// . we map it MAP_PRIVATE so verifyMap2() can fix keys without changing
+//   the file, but anything that adds pages calls copyMapToMem() first
+// . returns false if we could not, then caller should call readMap2()
+bool RdbMap::mmapMap2 ( ) {
+	// must be just one part file
+	if ( m_file.getNumParts() != 1 ) return false;
+	int64_t fileSize = m_file.getFileSize();
+	int32_t hdrSize  = 8 + 8 + 8 + 8 + m_ks;
+	if ( fileSize < hdrSize ) return false;
+	int32_t slotSize = m_ks + 2;
+	if ( ( (fileSize - hdrSize) % slotSize ) != 0 ) return false;
+	int fd = m_file.getfd ( 0 , true );
+	if ( fd < 0 ) { g_errno = 0; return false; }
+	void *p = mmap ( NULL , fileSize , PROT_READ | PROT_WRITE ,
+			 MAP_PRIVATE , fd , 0 );
+	if ( p == MAP_FAILED ) {
+		log("db: mmap of %s failed: %s. Reading it instead.",
+		    m_file.getFilename(),mstrerror(errno));
+		return false;
+	}
+	char *buf = (char *)p;
+	gbmemcpy ( &m_offset          , buf      , 8 );
+	gbmemcpy ( &m_fileStartOffset , buf + 8  , 8 );
+	m_blockCompressed = ( m_fileStartOffset & MAP_BLOCKS_BIT );
+	m_fileStartOffset &= ~MAP_BLOCKS_BIT;
+	gbmemcpy ( &m_numPositiveRecs , buf + 16 , 8 );
+	gbmemcpy ( &m_numNegativeRecs , buf + 24 , 8 );
+	gbmemcpy (  m_lastKey         , buf + 32 , m_ks );
+	m_mapBuf     = buf;
+	m_mapBufSize = fileSize;
+	int64_t offset = hdrSize;
+	for ( int32_t i = 0 ; offset < fileSize ; i++ ) {
+		if ( ! addSegmentPtr ( i ) ) {
+			log("db: Failed to allocate memory for seg ptrs "
+			    "of map file %s.", m_file.getFilename());
+			// undo so caller can call readMap2()
+			for ( int32_t j = 0 ; j < m_numSegments ; j++ ) {
+				m_keys   [j] = NULL;
+				m_offsets[j] = NULL;
+			}
+			m_numSegments = 0;
+			m_numPages    = 0;
+			m_maxNumPages = 0;
+			munmap ( m_mapBuf , m_mapBufSize );
+			m_mapBuf     = NULL;
+			m_mapBufSize = 0;
+			g_errno = 0;
+			return false;
+		}
+		int32_t numKeys = (fileSize - offset) / slotSize;
+		if ( numKeys > PAGES_PER_SEGMENT ) numKeys = PAGES_PER_SEGMENT;
+		m_keys   [i] = buf + offset;
+		offset += numKeys * m_ks;
+		m_offsets[i] = (int16_t *)(buf + offset);
+		offset += numKeys * 2;
+		m_numSegments++;
+		m_maxNumPages += PAGES_PER_SEGMENT;
+		m_numPages    += numKeys;
+	}
+	return true;
+}
+
+// . copy the segments that are in our mmap of the map file into memory
+//   and unmap it, so we can add to the map or rewrite the map file
+// . returns false and sets g_errno on error
+bool RdbMap::copyMapToMem ( ) {
+	if ( ! m_mapBuf ) return true;
+	int32_t pps = PAGES_PER_SEGMENT;
+	for ( int32_t i = 0 ; i < m_numSegments ; i++ ) {
+		if ( ! isMapped ( m_keys[i] ) ) continue;
+		char    *k = (char    *)mmalloc ( m_ks * pps , "RdbMap" );
+		int16_t *o = (int16_t *)mmalloc ( 2    * pps , "RdbMap" );
+		if ( ! k || ! o ) {
+			if ( k ) mfree ( k , m_ks * pps , "RdbMap" );
+			if ( o ) mfree ( o , 2    * pps , "RdbMap" );
+			return log("db: Failed to allocate memory for "
+				   "copying map file %s.",m_file.getFilename());
+		}
+		// the last segment may be partial
+		int32_t n = m_numPages - i * pps;
+		if ( n > pps ) n = pps;
+		if ( n < 0   ) n = 0;
+		gbmemcpy ( k , m_keys   [i] , n * m_ks );
+		gbmemcpy ( o , m_offsets[i] , n * 2    );
+		for ( int32_t j = n ; j < pps ; j++ ) o[j] = -1;
+		m_keys   [i] = k;
+		m_offsets[i] = o;
+	}
+	munmap ( m_mapBuf , m_mapBufSize );
+	m_mapBuf     = NULL;
+	m_mapBufSize = 0;
+	return true;
+}
+
 int64_t RdbMap::readSegment ( int32_t seg , int64_t offset , int32_t fileSize ) {
 	// . add a new segment for this
 	// . increments m_numSegments and increases m_maxNumPages
@@ -513,6 +705,8 @@ bool RdbMap::addRecord ( char *key, char *rec , int32_t recSize ) {
 	// calculate size of the whole slot
 	//int32_t size = sizeof(key_t) ;
 	if ( m_reducedMem ) { char *xx=NULL;*xx=0; }
+	// copy an mmap'd map into memory before we add to it
+	if ( m_mapBuf && ! copyMapToMem() ) return false;
 	// include the dataSize, 4 bytes, for each slot if it's not fixed
 	//if ( m_fixedDataSize == -1 ) size += 4;
 	// include the data
@@ -536,6 +730,11 @@ bool RdbMap::addRecord ( char *key, char *rec , int32_t recSize ) {
 			char *xx = NULL; *xx = 0;
 		}
 	}
+	// . keep the bloom filter up to date
+	// . if we are adding to a file that already had one, like when
+	//   resuming a killed merge, it is missing keys now so toss it
+	if      ( m_bloom.isBuilding() ) m_bloom.addKey ( key );
+	else if ( m_bloom.isReady()    ) { m_bloom.reset(); unlinkBloom(); }
 	// we need to call writeMap() before we exit
 	m_needToWrite = true;
 
@@ -672,6 +871,8 @@ bool RdbMap::prealloc ( RdbList *list ) {
 	if ( list->isEmpty() ) return true;
 
 	if ( m_reducedMem ) { char *xx=NULL;*xx=0; }
+	// copy an mmap'd map into memory before we add to it
+	if ( m_mapBuf && ! copyMapToMem() ) return false;
 
 	// what is the last page we touch?
 	int32_t lastPageNum = (m_offset + list->getListSize() - 1) / m_pageSize;
@@ -704,6 +905,8 @@ bool RdbMap::addList ( RdbList *list ) {
 	int32_t lastPageNum = (m_offset + list->getListSize() - 1) / m_pageSize;
 
 	if ( m_reducedMem ) { char *xx=NULL;*xx=0; }
+	// copy an mmap'd map into memory before we add to it
+	if ( m_mapBuf && ! copyMapToMem() ) return false;
 
 	// . need to pre-alloc up here so malloc does not fail mid stream
 	// . TODO: only do it if list is big enough
@@ -763,6 +966,57 @@ bool RdbMap::addList ( RdbList *list ) {
 	return true; 
 }
 
+bool RdbMap::addBlock ( char *rec , int32_t recSize ) {
+	char    lastKey[MAX_KEY_BYTES];
+	int32_t numPos;
+	int32_t numNeg;
+	bool    isHeader;
+	if ( ! getBlockInfo ( rec , recSize , m_ks , lastKey ,
+			      &numPos , &numNeg , &isHeader ) ) {
+		g_errno = ECORRUPTDATA;
+		return log("db: Bad compressed block at offset %"INT64" of "
+			   "%s.",m_offset,m_file.getFilename());
+	}
+	char saved[MAX_KEY_BYTES];
+	KEYSET ( saved , m_lastKey , m_ks );
+	// the key of the block record is the first key in the block
+	if ( ! addRecord ( rec , rec , recSize ) ) return false;
+	// addRecord() counted the block as one record
+	if ( KEYNEG(rec) ) m_numNegativeRecs--;
+	else               m_numPositiveRecs--;
+	// the header record of the file has no keys in it
+	if ( isHeader ) {
+		KEYSET ( m_lastKey , saved , m_ks );
+		return true;
+	}
+	m_numPositiveRecs += numPos;
+	m_numNegativeRecs += numNeg;
+	KEYSET ( m_lastKey , lastKey , m_ks );
+	return true;
+}
+
+bool RdbMap::addBlockList ( char *blocks , int32_t blocksSize ,
+			    RdbList *list ) {
+	char *p   = blocks;
+	char *end = blocks + blocksSize;
+	while ( p < end ) {
+		int32_t recSize = m_ks + 4 + *(int32_t *)(p + m_ks);
+		if ( ! addBlock ( p , recSize ) ) {
+			log("db: Failed to add block to map: %s.",
+			    mstrerror(g_errno));
+			return false;
+		}
+		p += recSize;
+	}
+	// addRecord() only added the first key of each block
+	if ( ! m_bloom.isBuilding() ) return true;
+	char *rec = list->getList();
+	char *recEnd = list->getListEnd();
+	for ( ; rec < recEnd ; rec += list->getRecSize ( rec ) )
+		m_bloom.addKey ( rec );
+	return true;
+}
+
 // . a int16_t list is a data-less list whose keys are 12 bytes or 6 bytes
 // . the 6 byte keys are compressed 12 byte keys that actually have the
 //   same most significant 6 bytes as the closest 12 byte key before them
@@ -775,6 +1029,8 @@ bool RdbMap::addIndexList ( IndexList *list ) {
 	if ( list->isEmpty() ) return true;
 
 	if ( m_reducedMem ) { char *xx=NULL;*xx=0; }
+	// copy an mmap'd map into memory before we add to it
+	if ( m_mapBuf && ! copyMapToMem() ) return false;
 
 	// we need to call writeMap() before we exit
 	m_needToWrite = true;
@@ -1243,8 +1499,12 @@ int64_t RdbMap::getMemAlloced ( ) {
 	// . each page has a key and a 2 byte offset
 	//int64_t space = PAGES_PER_SEGMENT * (sizeof(key_t) + 2);
 	int64_t space = PAGES_PER_SEGMENT * (m_ks + 2);
+	// the segments in our mmap of the map file are not allocated
+	int32_t numAlloced = 0;
+	for ( int32_t i = 0 ; i < m_numSegments ; i++ )
+		if ( ! isMapped ( m_keys[i] ) ) numAlloced++;
 	// how many segments we use * segment allocation
-	return (int64_t)m_numSegments * space;
+	return (int64_t)numAlloced * space + m_bloom.getMemAlloced();
 }
 
 bool RdbMap::addSegmentPtr ( int32_t n ) {
@@ -1284,6 +1544,8 @@ bool RdbMap::addSegmentPtr ( int32_t n ) {
 // try to save memory when there are many collections with tiny files on disk
 void RdbMap::reduceMemFootPrint () {
 	if ( m_numSegments != 1 ) return;
+	// an mmap'd map uses no memory of ours
+	if ( m_mapBuf ) return;
 	if ( m_numPages >= 100 ) return;
 	// if already reduced, return now
 	if ( m_newPagesPerSegment > 0 ) return;
@@ -1333,6 +1595,8 @@ bool RdbMap::addSegment (  ) {
 	//				    "too big. Critical error.");
 
 	if ( m_reducedMem ) { char *xx=NULL;*xx=0; }
+	// copy an mmap'd map into memory before we add to it
+	if ( m_mapBuf && ! copyMapToMem() ) return false;
 
 	// the array of up to MAX_SEGMENT pool ptrs is now dynamic too!
 	// because diffbot uses thousands of collections, this will save
@@ -1397,8 +1661,13 @@ bool RdbMap::chopHead ( int32_t fileHeadSize ) {
 	int32_t ks = m_ks;
 	// remove segments before segNum
 	for ( int32_t i = 0 ; i < segNum ; i++ ) {
-		mfree ( m_keys   [i] , ks * PAGES_PER_SEGMENT , "RdbMap" );
-		mfree ( m_offsets[i] , 2  * PAGES_PER_SEGMENT , "RdbMap" );
+		// leave ones in our mmap of the map file for reset()
+		if ( ! isMapped ( m_keys[i] ) ) {
+			mfree ( m_keys   [i] , ks * PAGES_PER_SEGMENT ,
+				"RdbMap" );
+			mfree ( m_offsets[i] , 2  * PAGES_PER_SEGMENT ,
+				"RdbMap" );
+		}
 		// set to NULL so we know if accessed illegally
 		m_keys   [i] = NULL;
 		m_offsets[i] = NULL;
@@ -1432,6 +1701,22 @@ bool RdbMap::generateMap ( BigFile *f ) {
 
 	log("db: Generating map for %s/%s",f->getDir(),f->getFilename());
 
+	// . is it a file of compressed blocks? it starts with a header
+	//   record then. see RdbBlocks.h.
+	int32_t hdrSize = m_ks + 4 + 8;
+	if ( f->doesPartExist(0) && f->getFileSize() >= hdrSize ) {
+		char    hdr[MAX_KEY_BYTES + 4 + 8];
+		char    lastKey[MAX_KEY_BYTES];
+		int32_t numPos , numNeg;
+		bool    isHeader = false;
+		if ( f->read ( hdr , hdrSize , 0 ) &&
+		     getBlockInfo ( hdr , hdrSize , m_ks , lastKey ,
+				    &numPos , &numNeg , &isHeader ) &&
+		     isHeader )
+			return generateBlockMap ( f );
+		g_errno = 0;
+	}
+
 	// we don't support headless datafiles right now
 	bool allowHeadless = true;
 	if ( m_fixedDataSize != 0 ) allowHeadless = false;
@@ -1701,6 +1986,57 @@ done:
 	return true; 
 }
 
+// . the blocks are records of key, dataSize and data, whatever the
+//   fixedDataSize of the rdb is
+// . returns false and sets g_errno on error
+bool RdbMap::generateBlockMap ( BigFile *f ) {
+	m_blockCompressed = true;
+	int64_t fileSize = f->getFileSize();
+	int64_t offset   = 0LL;
+	int32_t bufSize  = 10*1024*1024;
+	if ( bufSize > fileSize ) bufSize = fileSize;
+	char *buf = (char *)mmalloc ( bufSize , "RdbMap" );
+	if ( ! buf ) return log("db: Failed to alloc %"INT32" bytes to "
+				"generate map.",bufSize);
+	m_generatingMap = true;
+	g_errno = 0;
+	while ( offset < fileSize ) {
+		int32_t readSize = bufSize;
+		if ( readSize > fileSize - offset ) readSize = fileSize - offset;
+		if ( ! f->read ( buf , readSize , offset ) ) {
+			mfree ( buf , bufSize , "RdbMap" );
+			return log("db: Failed to read %"INT32" bytes of %s at "
+				   "offset=%"INT64". Map generation failed.",
+				   readSize,f->getFilename(),offset);
+		}
+		char *p   = buf;
+		char *end = buf + readSize;
+		while ( p + m_ks + 4 <= end ) {
+			int32_t recSize = m_ks + 4 + *(int32_t *)(p + m_ks);
+			if ( recSize < m_ks + 4 ) break;
+			// cut off by our read?
+			if ( p + recSize > end ) break;
+			if ( ! addBlock ( p , recSize ) ) break;
+			p += recSize;
+		}
+		// . a block we could not add, the rest of the file is junk
+		// . or the last block was cut off, blocks are way smaller
+		//   than our buf
+		if ( g_errno || p == buf ) break;
+		offset += p - buf;
+	}
+	mfree ( buf , bufSize , "RdbMap" );
+	m_generatingMap = false;
+	// like generateMap() we drop a partial or bad tail
+	if ( m_offset < fileSize ) {
+		g_errno = 0;
+		log("db: Last %"INT64" bytes of %s are not whole blocks. "
+		    "Truncating.",fileSize - m_offset,f->getFilename());
+		if ( ! truncateFile ( f ) ) return false;
+	}
+	return true;
+}
+
 // 5MB is a typical write buffer size, so do a little more than that
 #define MAX_TRUNC_SIZE 6000000
 
@@ -14,6 +14,7 @@
 
 #include "BigFile.h"
 #include "RdbList.h"
+#include "RdbBloom.h"
 
 // . this can be increased to provide greater disk coverage but it will 
 //   increase delays because each seek will have to read more
@@ -58,6 +59,10 @@
 //   segments (we chop the leading Files of a BigFile during merges)
 #define PAGES_PER_SEGMENT (2*1024)
 #define PAGES_PER_SEG     (PAGES_PER_SEGMENT)
+
+// . the start offset of a data file never gets this big, so the map file
+//   sets this bit of it if the data file is in compressed blocks
+#define MAP_BLOCKS_BIT 0x4000000000000000LL
 // MAX_SEGMENTS of 16*1024 allows for 32 million pages = 256gigs of disk data
 //#define MAX_SEGMENTS      (16*1024)  
 
@@ -79,12 +84,37 @@ class RdbMap {
 		   int32_t pageSize );
 
 	bool rename ( char *newMapFilename ) {
+		renameBloom ( newMapFilename , NULL );
 		return m_file.rename ( newMapFilename ); };
 
 	bool rename ( char *newMapFilename ,
 		      void (* callback)(void *state) , void *state ) { 
+		renameBloom ( newMapFilename , NULL );
 		return m_file.rename ( newMapFilename , callback , state ); };
 
+	// . the bloom filter file goes along with the map file
+	// . "newDir" is NULL to keep it in the same dir
+	void renameBloom ( char *newMapFilename , char *newDir );
+	void unlinkBloom ( );
+
+	// . start a bloom filter of the keys we are about to add to this
+	//   empty map. RdbDump and RdbMerge call this for new files.
+	// . it is saved by writeMap(true) once the file is complete
+	bool initBloom ( char rdbId , int64_t maxKeys );
+
+	// . returns false if the file we map can not have any key in
+	//   [startKey,endKey], used by Msg3 to skip reading it
+	bool mayContain ( char *startKey , char *endKey ) {
+		return m_bloom.mayContain ( startKey , endKey ); };
+
+	// . is the data file made of compressed blocks? see RdbBlocks.h
+	// . saved in the map file, so it is known even after chopHead()
+	bool isBlockCompressed ( ) { return m_blockCompressed; };
+
+	// . RdbDump and RdbMerge call this for new files so they are
+	//   written as compressed blocks if the rdb wants that
+	void initBlocks ( char rdbId );
+
 	char *getFilename ( ) { return m_file.getFilename(); };
 
 	BigFile *getFile  ( ) { return &m_file; };
@@ -121,6 +151,12 @@ class RdbMap {
 	bool addList ( RdbList *list );
 	bool prealloc ( RdbList *list );
 
+	// . like addList() for the blocks compressBlockList() made of
+	//   "list", the list is just for the bloom filter
+	// . returns false and sets g_errno on error
+	bool addBlockList ( char *blocks , int32_t blocksSize ,
+			    RdbList *list );
+
 	// . like above but faster
 	// . just for adding data-less keys
 	// . NOTE: disabled until it works correctly
@@ -256,15 +292,19 @@ class RdbMap {
 	// . reads the keys and offsets into buffers allocated during open().
 	bool readMap     ( BigFile *dataFile );
 	bool readMap2    ( );
+	bool mmapMap2    ( );
+	// copy the map into memory if it is mmap'd, see mmapMap2()
+	bool copyMapToMem ( );
 	int64_t readSegment ( int32_t segment, int64_t offset, int32_t fileSize);
 
 	// due to disk corruption keys or offsets can be out of order in map
 	bool verifyMap   ( BigFile *dataFile );
 	bool verifyMap2  ( );
 
-	bool unlink ( ) { return m_file.unlink ( ); };
+	bool unlink ( ) { unlinkBloom(); return m_file.unlink ( ); };
 
 	bool unlink ( void (* callback)(void *state) , void *state ) { 
+		unlinkBloom();
 		return m_file.unlink ( callback , state ); };
 
 	int32_t getNumPages ( ) { return m_numPages; };
@@ -318,11 +358,26 @@ class RdbMap {
 
  private:
 
+	// . add the block record "rec" as if it was one record, but count
+	//   the keys in it and use its last key as our last key
+	bool addBlock ( char *rec , int32_t recSize );
+
+	// generateMap() for a file of compressed blocks
+	bool generateBlockMap ( BigFile *f );
+
 	// specialized routine for adding a list to an indexdb map
 	bool addIndexList ( class IndexList *list ) ;
 
 	void printMap ();
 
+	// "titledb0001.map" has its filter in "titledb0001.bloom"
+	void getBloomFilename ( char *mapFilename , char *buf );
+	bool readBloom ( );
+
+	RdbBloom m_bloom;
+
+	bool m_blockCompressed;
+
 	// the map file
         BigFile m_file;
 
@@ -346,6 +401,14 @@ class RdbMap {
 
 	bool m_reducedMem;
 
+	// . if mmapMap2() mapped the map file, the first segments point
+	//   into this instead of being mmalloc'd
+	char   *m_mapBuf;
+	int64_t m_mapBufSize;
+	bool isMapped ( char *p ) {
+		return m_mapBuf && p >= m_mapBuf && p < m_mapBuf+m_mapBufSize;
+	};
+
 	// number of valid pages in the map.
 	int32_t          m_numPages;     
 
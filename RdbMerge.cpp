@@ -15,9 +15,18 @@ static void dumpListWrapper ( void *state ) ;
 static void gotListWrapper  ( void *state , RdbList *list , Msg5 *msg5 ) ;
 static void tryAgainWrapper ( int fd , void *state ) ;
 
-RdbMerge::RdbMerge   () {}; 
+RdbMerge::RdbMerge   () { reset(); }; 
 RdbMerge::~RdbMerge  () {}; 
-void RdbMerge::reset () { m_isMerging = false; m_isSuspended = false; }
+void RdbMerge::reset () { 
+	m_isMerging   = false; 
+	m_isSuspended = false; 
+	m_list        = &m_lists[0];
+	m_dumpList    = &m_lists[1];
+	m_readAhead   = false;
+	m_listWaiting = false;
+	m_listErrno   = 0;
+	m_dumpErrno   = 0;
+}
 
 // . buffer is used for reading and writing
 // . return false if blocked, true otherwise
@@ -290,14 +299,18 @@ static void chopWrapper ( void *state ) ;
 bool RdbMerge::getNextList ( ) {
 	// return true if g_errno is set
 	if ( g_errno || m_doneMerging ) return true;
-	// it's suspended so we count this as blocking
+	// . it's suspended so we count this as blocking
+	// . if the dump we overlapped is still writing we are not ready to
+	//   save yet, so have dumpListWrapper() come back through dumpList()
+	//   which will set m_isReadyToSave when the dump is done
 	if ( m_isSuspended ) {
-		m_isReadyToSave = true;
+		if ( m_readAhead ) { m_listWaiting = true; m_listErrno = 0; }
+		else                 m_isReadyToSave = true;
 		return false;
 	}
 	// if the power is off, suspend the merging
 	if ( ! g_process.m_powerIsOn ) {
-		m_isReadyToSave = true;
+		if ( ! m_readAhead ) m_isReadyToSave = true;
 		doSleep();
 		return false;
 	}
@@ -312,11 +325,15 @@ bool RdbMerge::getNextList ( ) {
 		g_errno = ENOCOLLREC;
 		return true;
 	}
+	// . while reading ahead m_startKey is already past m_dumpList, which
+	//   is not on disk yet, so only chop what is before m_dumpList
+	char *chopKey = m_startKey;
+	if ( m_readAhead ) chopKey = m_dumpStartKey;
 	// . if a contributor has just surpassed a "part" in his BigFile
 	//   then we can delete that part from the BigFile and the map
 	for ( int32_t i = m_startFileNum ; i < m_startFileNum + m_numFiles; i++ ){
 		RdbMap    *map    = base->m_maps[i];
-		int32_t       page   = map->getPage ( m_startKey );
+		int32_t       page   = map->getPage ( chopKey );
 		int64_t  offset = map->getAbsoluteOffset ( page );
 		BigFile   *file   = base->m_files[i];
 		int32_t       part   = file->getPartNum ( offset ) ;
@@ -449,7 +466,7 @@ bool RdbMerge::getAnotherList ( ) {
 	// get it
 	return m_msg5.getList ( m_rdbId        ,
 				m_collnum           ,
-				&m_list        ,
+				m_list         ,
 				m_startKey     ,
 				newEndKey      , // usually is maxed!
 				bufSize        ,
@@ -476,6 +493,19 @@ void gotListWrapper ( void *state , RdbList *list , Msg5 *msg5 ) {
 	// get a ptr to ourselves
 	RdbMerge *THIS = (RdbMerge *)state;
  loop:
+	// . if the last list is still being dumped, wait for it
+	// . dumpListWrapper() calls us again when the dump completes
+	if ( THIS->m_readAhead ) {
+		THIS->m_listWaiting = true;
+		THIS->m_listErrno   = g_errno;
+		g_errno             = 0;
+		return;
+	}
+	// pick up any error from the dump we overlapped
+	if ( THIS->m_dumpErrno ) {
+		g_errno           = THIS->m_dumpErrno;
+		THIS->m_dumpErrno = 0;
+	}
 	// if g_errno is out of memory then msg3 wasn't able to get the lists
 	// so we should sleep and retry
 	if ( g_errno == ENOMEM || g_errno == ENOTHREADSLOTS ) { 
@@ -513,6 +543,21 @@ void dumpListWrapper ( void *state ) {
 	// get a ptr to ourselves
 	RdbMerge *THIS = (RdbMerge *)state;
 
+	// . if we were reading ahead while this dump was writing, the read
+	//   may still be outstanding, in which case gotListWrapper() will
+	//   dump it when it completes
+	if ( THIS->m_readAhead ) {
+		THIS->m_readAhead = false;
+		THIS->m_dumpErrno = g_errno;
+		g_errno           = 0;
+		if ( ! THIS->m_listWaiting ) return;
+		// the read ahead is waiting for us, so dump it now
+		THIS->m_listWaiting = false;
+		g_errno = THIS->m_listErrno;
+		gotListWrapper ( THIS , NULL , NULL );
+		return;
+	}
+
  loop:
 	// collection reset or deleted while RdbDump.cpp was writing out?
 	if ( g_errno == ENOCOLLREC ) { THIS->doneMerging(); return; }
@@ -544,6 +589,14 @@ bool RdbMerge::dumpList ( ) {
 	// return true on g_errno
 	if ( g_errno ) return true;
 
+	// . if the last list is still being written then wait for it
+	// . dumpListWrapper() will call gotListWrapper() to dump this one
+	if ( m_readAhead ) {
+		m_listWaiting = true;
+		m_listErrno   = 0;
+		return false;
+	}
+
 	// . it's suspended so we count this as blocking
 	// . resumeMerge() will call getNextList() again, not dumpList() so
 	//   don't advance m_startKey
@@ -565,12 +618,14 @@ bool RdbMerge::dumpList ( ) {
 	//   but there may still be data left
 	//m_startKey = m_list.getLastKey() ;
 	//m_list.getLastKey(m_startKey) ;
+	// m_list is about to become m_dumpList, so this is its first key
+	KEYSET(m_dumpStartKey,m_startKey,m_ks);
 	// if we use getLastKey() for this the merge completes but then
 	// tries to merge two empty lists and cores in the merge function
 	// because of that. i guess it relies on endkey rollover only and
 	// not on reading less than minRecSizes to determine when to stop
 	// doing the merge.
-	m_list.getEndKey(m_startKey) ;
+	m_list->getEndKey(m_startKey) ;
 	//m_startKey += (uint32_t)1;
 	KEYADD(m_startKey,1,m_ks);
 
@@ -581,7 +636,7 @@ bool RdbMerge::dumpList ( ) {
 	/////
 	if ( m_rdbId == RDB_SPIDERDB )
 		// removeNegRecs? = false
-		dedupSpiderdbList(&m_list,m_niceness,false); 
+		dedupSpiderdbList(m_list,m_niceness,false); 
 
 	// if the startKey rolled over we're done
 	//if ( m_startKey.n0 == 0LL && m_startKey.n1 == 0 ) m_doneMerging=true;
@@ -601,10 +656,31 @@ bool RdbMerge::dumpList ( ) {
 	// . it calls dumpListWrapper when done dumping
 	// . return true if m_dump had an error or it did not block
 	// . if it gets a EFILECLOSED error it will keep retrying forever
-	return m_dump.dumpList ( &m_list , m_niceness , false/*recall?*/ ) ;
+	// . swap the lists so the next list is read into the other one
+	RdbList *tmp = m_dumpList;
+	m_dumpList   = m_list;
+	m_list       = tmp;
+	if ( m_dump.dumpList ( m_dumpList , m_niceness , false/*recall?*/ ) )
+		return true;
+	// . the dump blocked. if this was the last list we just wait.
+	// . otherwise read and merge the next list while this one is being
+	//   written, that way the merge thread and the disk write overlap.
+	//   we just say we did not block so the caller calls getNextList().
+	if ( m_doneMerging || ! g_conf.m_mergeReadAhead ) return false;
+	m_readAhead = true;
+	return true;
 }
 
 void RdbMerge::doneMerging ( ) {
+	// . if the read ahead had an error or was the last list we still
+	//   must wait for the dump it overlapped before we can finish
+	// . dumpListWrapper() will call us back through gotListWrapper()
+	if ( m_readAhead ) {
+		m_listWaiting = true;
+		m_listErrno   = g_errno;
+		g_errno       = 0;
+		return;
+	}
 	// save this
 	int32_t saved = g_errno;
 	// let RdbDump free its m_verifyBuf buffer if it existed
@@ -615,7 +691,8 @@ void RdbMerge::doneMerging ( ) {
 	// . free the list's memory, reset() doesn't do it
 	// . when merging titledb i'm still seeing 200MB allocs to read from
 	//   tfndb.
-	m_list.freeList();
+	m_lists[0].freeList();
+	m_lists[1].freeList();
 	// nuke our msg3
 	//delete (m_msg3);
 	// log a msg
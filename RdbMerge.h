@@ -144,7 +144,25 @@ class RdbMerge {
 	Msg5        m_msg5;
 	Msg5        m_msg5b;
 
-	RdbList     m_list;
+	// . m_list is what we read and merge into, m_dumpList is what the
+	//   RdbDump is writing out. they point into m_lists[] and we swap
+	//   them on every dump so we can read and merge the next list while
+	//   the last one is being written. see g_conf.m_mergeReadAhead.
+	RdbList     m_lists[2];
+	RdbList    *m_list;
+	RdbList    *m_dumpList;
+
+	// true while m_dumpList is being written and we are reading ahead
+	bool        m_readAhead;
+	// true if the read ahead completed before the dump did, so it is
+	// waiting for dumpListWrapper() to dump it
+	bool        m_listWaiting;
+	// the g_errno of the read ahead and of the dump it overlapped
+	int32_t     m_listErrno;
+	int32_t     m_dumpErrno;
+	// . the first key of m_dumpList. all keys before it are on disk in
+	//   the target file, even while m_dumpList is still being written.
+	char        m_dumpStartKey[MAX_KEY_BYTES];
 
 	int32_t        m_niceness;
 
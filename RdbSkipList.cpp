@@ -0,0 +1,669 @@
+#include "gb-include.h"
+
+#include "RdbSkipList.h"
+#include "Mem.h"
+#include "Rdb.h"
+#include <sched.h>
+
+// nodes are carved out of slabs this big
+#define SL_SLAB_SIZE (1024*1024)
+
+// . each bucket in the saved file starts with collnum, numKeys,
+//   lastSorted and endKeyOffset
+#define SL_BUCKET_HDR_SIZE ((int32_t)sizeof(collnum_t) + 12)
+// version, numBuckets, maxBuckets, ks, fixedDataSize, recSize,
+// numKeys, numNegKeys, dataMemOccupied, bucketSize
+#define SL_FILE_HDR_SIZE (4+4+4+1+4+4+4+4+4+4)
+
+RdbSkipList::RdbSkipList() {
+	m_head      = NULL;
+	m_slabs     = NULL;
+	m_numSlabs  = 0;
+	m_maxSlabs  = 0;
+	m_slabUsed  = 0;
+	m_numKeys   = 0;
+	m_numNegKeys  = 0;
+	m_memOccupied = 0;
+	m_numShared = 0;
+	m_exclusive = 0;
+	m_seed      = 0;
+	for ( int32_t i = 0 ; i <= SL_MAX_LEVEL ; i++ ) m_freeLists[i] = NULL;
+	pthread_mutex_init ( &m_allocLock , NULL );
+}
+
+RdbSkipList::~RdbSkipList() {
+	reset();
+	pthread_mutex_destroy ( &m_allocLock );
+}
+
+bool RdbSkipList::set ( int32_t maxMem , char rdbId , uint8_t keySize ,
+			int32_t bucketSize , char *dbname , char *allocName ) {
+	reset();
+	m_maxMem     = maxMem;
+	m_rdbId      = rdbId;
+	m_ks         = keySize;
+	m_bucketSize = bucketSize;
+	m_dbname     = dbname;
+	m_allocName  = allocName;
+	m_seed       = (uint32_t)gettimeofdayInMilliseconds();
+
+	int32_t headSize = getNodeSize ( SL_MAX_LEVEL );
+	m_maxSlabs = (m_maxMem - headSize - (int32_t)sizeof(RdbSkipList)) /
+		SL_SLAB_SIZE;
+	if ( m_maxSlabs <= 0 ) {
+		log("db: max memory for %s's skiplist is way too small to "
+		    "accomodate even 1 slab, increase max mem(%"INT32")",
+		    m_dbname, m_maxMem);
+		char *xx = NULL; *xx = 0;
+	}
+
+	m_slabs = (char **)mmalloc ( m_maxSlabs * sizeof(char *) ,
+				     m_allocName );
+	if ( ! m_slabs ) return false;
+	m_head = (char *)mmalloc ( headSize , m_allocName );
+	if ( ! m_head ) return false;
+	memset ( m_head , 0 , headSize );
+	m_head[2] = SL_MAX_LEVEL;
+	m_head[3] = SL_MAX_LEVEL;
+	return true;
+}
+
+void RdbSkipList::reset() {
+	freeSlabs ( 0 );
+	if ( m_slabs ) mfree ( m_slabs , m_maxSlabs * sizeof(char *) ,
+			       m_allocName );
+	if ( m_head ) mfree ( m_head , getNodeSize(SL_MAX_LEVEL) ,
+			      m_allocName );
+	m_slabs = NULL;
+	m_head  = NULL;
+	m_numKeys    = 0;
+	m_numNegKeys = 0;
+}
+
+// . only call when no nodes are linked in anymore
+// . keeps the first "keep" slabs around so we do not thrash the allocator
+//   after every dump
+void RdbSkipList::freeSlabs ( int32_t keep ) {
+	pthread_mutex_lock ( &m_allocLock );
+	for ( int32_t i = keep ; i < m_numSlabs ; i++ )
+		mfree ( m_slabs[i] , SL_SLAB_SIZE , m_allocName );
+	if ( m_numSlabs > keep ) m_numSlabs = keep;
+	m_slabUsed = 0;
+	for ( int32_t i = 0 ; i <= SL_MAX_LEVEL ; i++ ) m_freeLists[i] = NULL;
+	m_memOccupied = 0;
+	pthread_mutex_unlock ( &m_allocLock );
+}
+
+void RdbSkipList::clear() {
+	enterExclusive();
+	memset ( getNext(m_head) , 0 , SL_MAX_LEVEL * sizeof(char *) );
+	m_numKeys    = 0;
+	m_numNegKeys = 0;
+	freeSlabs ( 1 );
+	exitExclusive();
+}
+
+// . spin while a removal is going on. removals are rare and quick.
+// . we bump the count first and then check so a remover that sets
+//   m_exclusive after we checked will see our count and wait for us
+void RdbSkipList::enterShared ( ) {
+	while ( 1 ) {
+		__sync_fetch_and_add ( &m_numShared , 1 );
+		if ( ! m_exclusive ) return;
+		__sync_fetch_and_sub ( &m_numShared , 1 );
+		while ( m_exclusive ) sched_yield();
+	}
+}
+
+void RdbSkipList::exitShared ( ) {
+	__sync_fetch_and_sub ( &m_numShared , 1 );
+}
+
+void RdbSkipList::enterExclusive ( ) {
+	while ( ! __sync_bool_compare_and_swap ( &m_exclusive , 0 , 1 ) )
+		sched_yield();
+	while ( m_numShared ) sched_yield();
+}
+
+void RdbSkipList::exitExclusive ( ) {
+	__sync_synchronize();
+	m_exclusive = 0;
+}
+
+char *RdbSkipList::allocNode ( int32_t h ) {
+	char *n    = NULL;
+	int32_t ah = h;
+	int32_t size = getNodeSize ( h );
+	pthread_mutex_lock ( &m_allocLock );
+	if ( m_freeLists[h] ) {
+		n = m_freeLists[h];
+		m_freeLists[h] = getNext(n)[0];
+	}
+	else if ( m_numSlabs > 0 && m_slabUsed + size <= SL_SLAB_SIZE ) {
+		n = m_slabs[m_numSlabs-1] + m_slabUsed;
+		m_slabUsed += size;
+	}
+	else if ( m_numSlabs < m_maxSlabs ) {
+		n = (char *)mmalloc ( SL_SLAB_SIZE , m_allocName );
+		if ( n ) {
+			m_slabs[m_numSlabs++] = n;
+			m_slabUsed = size;
+		}
+	}
+	else {
+		// out of slabs, settle for a taller recycled node
+		for ( ah = h + 1 ; ah <= SL_MAX_LEVEL ; ah++ ) {
+			if ( ! m_freeLists[ah] ) continue;
+			n = m_freeLists[ah];
+			m_freeLists[ah] = getNext(n)[0];
+			break;
+		}
+	}
+	if ( n ) m_memOccupied += getNodeSize ( ah );
+	pthread_mutex_unlock ( &m_allocLock );
+	if ( ! n ) return NULL;
+	n[2] = h;
+	n[3] = ah;
+	return n;
+}
+
+void RdbSkipList::freeNode ( char *n ) {
+	int32_t ah = (uint8_t)n[3];
+	pthread_mutex_lock ( &m_allocLock );
+	getNext(n)[0] = m_freeLists[ah];
+	m_freeLists[ah] = n;
+	m_memOccupied -= getNodeSize ( ah );
+	pthread_mutex_unlock ( &m_allocLock );
+}
+
+// p = 1/4, so on average a node has 1.33 next ptrs
+int32_t RdbSkipList::getRandomHeight ( ) {
+	uint32_t x = __sync_add_and_fetch ( &m_seed , 0x9e3779b9 );
+	x ^= x >> 16; x *= 0x7feb352d;
+	x ^= x >> 15; x *= 0x846ca68b;
+	x ^= x >> 16;
+	int32_t h = 1;
+	while ( h < SL_MAX_LEVEL && (x & 0x03) == 0 ) {
+		h++;
+		x >>= 2;
+	}
+	return h;
+}
+
+// collnum first, then the key with the delbit masked off
+char RdbSkipList::nodeCmp ( char *n , collnum_t collnum , char *key ) {
+	if ( getCollnum(n) < collnum ) return -1;
+	if ( getCollnum(n) > collnum ) return  1;
+	return KEYCMPNEGEQ ( getKey(n) , key , m_ks );
+}
+
+// . returns the first node >= key at level 0, or NULL
+// . fills in the last node < key and the first node >= key on every level
+char *RdbSkipList::findNode ( collnum_t collnum , char *key ,
+			      char **preds , char **succs ) {
+	char *x = m_head;
+	char *n = NULL;
+	for ( int32_t i = SL_MAX_LEVEL - 1 ; i >= 0 ; i-- ) {
+		n = loadNext ( x , i );
+		while ( n && nodeCmp ( n , collnum , key ) < 0 ) {
+			x = n;
+			n = loadNext ( x , i );
+		}
+		if ( preds ) preds[i] = x;
+		if ( succs ) succs[i] = n;
+	}
+	return n;
+}
+
+int32_t RdbSkipList::addNode ( collnum_t collnum , char *key ) {
+	char *preds[SL_MAX_LEVEL];
+	char *succs[SL_MAX_LEVEL];
+	char *node = NULL;
+	int32_t h  = 0;
+	bool isNeg = KEYNEG(key);
+
+	enterShared();
+
+	while ( 1 ) {
+		char *n = findNode ( collnum , key , preds , succs );
+		if ( n && nodeCmp ( n , collnum , key ) == 0 ) {
+			// . same key but maybe a different delbit, the
+			//   newest one wins
+			// . only the low bit of byte 0 can differ
+			if ( node ) freeNode ( node );
+			char *k = getKey(n);
+			char old = k[0];
+			while ( old != key[0] &&
+				! __sync_bool_compare_and_swap(k,old,key[0]) )
+				old = k[0];
+			if ( old != key[0] ) {
+				if ( isNeg ) __sync_fetch_and_add(&m_numNegKeys,1);
+				else         __sync_fetch_and_sub(&m_numNegKeys,1);
+			}
+			exitShared();
+			return 0;
+		}
+		if ( ! node ) {
+			h    = getRandomHeight();
+			node = allocNode ( h );
+			if ( ! node ) {
+				exitShared();
+				g_errno = ENOMEM;
+				return -1;
+			}
+			*(collnum_t *)node = collnum;
+			gbmemcpy ( getKey(node) , key , m_ks );
+		}
+		for ( int32_t i = 0 ; i < h ; i++ ) getNext(node)[i] = succs[i];
+		// . linking it in at level 0 is what makes it visible
+		// . if this fails somebody beat us to it, so look again
+		if ( __sync_bool_compare_and_swap ( &getNext(preds[0])[0] ,
+						    succs[0] , node ) )
+			break;
+	}
+
+	// now the express lanes, these are just hints for findNode()
+	for ( int32_t i = 1 ; i < h ; i++ ) {
+		while ( ! __sync_bool_compare_and_swap ( &getNext(preds[i])[i],
+							 succs[i] , node ) ) {
+			findNode ( collnum , key , preds , succs );
+			getNext(node)[i] = succs[i];
+		}
+	}
+
+	__sync_fetch_and_add ( &m_numKeys , 1 );
+	if ( isNeg ) __sync_fetch_and_add ( &m_numNegKeys , 1 );
+	exitShared();
+	return 0;
+}
+
+char *RdbSkipList::getKeyVal ( collnum_t collnum , char *key ) {
+	enterShared();
+	char *n = findNode ( collnum , key , NULL , NULL );
+	if ( n && (getCollnum(n) != collnum ||
+		   KEYCMP(getKey(n),key,m_ks) != 0) ) n = NULL;
+	exitShared();
+	if ( ! n ) return NULL;
+	return getKey(n);
+}
+
+bool RdbSkipList::collExists ( collnum_t collnum ) {
+	enterShared();
+	char *n = findNode ( collnum , KEYMIN() , NULL , NULL );
+	bool exists = ( n && getCollnum(n) == collnum );
+	exitShared();
+	return exists;
+}
+
+int32_t RdbSkipList::getNumKeys ( collnum_t collnum ) {
+	int32_t count = 0;
+	enterShared();
+	char *n = findNode ( collnum , KEYMIN() , NULL , NULL );
+	for ( ; n && getCollnum(n) == collnum ; n = loadNext(n,0) ) count++;
+	exitShared();
+	return count;
+}
+
+int32_t RdbSkipList::getMemAlloced ( ) {
+	return sizeof(RdbSkipList) + getNodeSize(SL_MAX_LEVEL) +
+		m_maxSlabs * sizeof(char *) + m_numSlabs * SL_SLAB_SIZE;
+}
+
+int32_t RdbSkipList::getMemOccupied ( ) {
+	return sizeof(RdbSkipList) + getNodeSize(SL_MAX_LEVEL) +
+		m_maxSlabs * sizeof(char *) + m_memOccupied;
+}
+
+// . dump with 10% to spare so adds can keep coming in while we dump
+bool RdbSkipList::is90PercentFull ( ) {
+	return getMemOccupied() > m_maxMem * .9;
+}
+
+// . be conservative, a partially added list gets added again
+// . the average node has 1.33 next ptrs, assume 2
+bool RdbSkipList::hasRoom ( int32_t numRecs ) {
+	int64_t need = (int64_t)numRecs * getNodeSize ( 2 );
+	return getMemOccupied() + need + SL_SLAB_SIZE <= m_maxMem;
+}
+
+// . estimate by counting on the lowest level that has less than 64 nodes
+//   in the range, each node on level i stands for about 4^i nodes
+int64_t RdbSkipList::getListSize ( collnum_t collnum ,
+				   char *startKey , char *endKey ) {
+	char *succs[SL_MAX_LEVEL];
+	int64_t count = 0;
+	enterShared();
+	findNode ( collnum , startKey , NULL , succs );
+	for ( int32_t i = 0 ; i < SL_MAX_LEVEL ; i++ ) {
+		int32_t c = 0;
+		char *n = succs[i];
+		for ( ; n && c < 64 ; n = loadNext(n,i) , c++ )
+			if ( getCollnum(n) != collnum ||
+			     KEYCMP(getKey(n),endKey,m_ks) > 0 ) break;
+		count = (int64_t)c << (2*i);
+		if ( c < 64 ) break;
+	}
+	exitShared();
+	return count * m_ks;
+}
+
+int RdbSkipList::getListSizeExact ( collnum_t collnum ,
+				    char *startKey , char *endKey ) {
+	int numBytes = 0;
+	enterShared();
+	char *n = findNode ( collnum , startKey , NULL , NULL );
+	for ( ; n && getCollnum(n) == collnum ; n = loadNext(n,0) ) {
+		char *k = getKey(n);
+		if ( KEYCMP(k,endKey,m_ks) > 0 ) break;
+		if ( KEYCMP(k,startKey,m_ks) < 0 ) continue;
+		numBytes += m_ks;
+	}
+	exitShared();
+	return numBytes;
+}
+
+// . the caller, RdbBuckets::getList(), already set the list's keys and
+//   fixed data size and made sure minRecSizes is positive
+bool RdbSkipList::getList ( collnum_t collnum ,
+			    char *startKey, char *endKey, int32_t minRecSizes ,
+			    RdbList *list , int32_t *numPosRecs ,
+			    int32_t *numNegRecs , bool useHalfKeys ) {
+	// reserve about what we think we need up front so addRecord()
+	// does not realloc for every key
+	int64_t growth = getListSize ( collnum , startKey , endKey );
+	if ( growth > minRecSizes ) growth = (int64_t)minRecSizes + m_ks;
+	if ( growth > 0 && ! list->growList ( growth ) )
+		return log("db: Failed to grow list to %"INT64" bytes for "
+			   "storing records from skiplist: %s.",
+			   growth,mstrerror(g_errno));
+
+	int32_t numNeg = 0;
+	int32_t numPos = 0;
+	char lastKey [ MAX_KEY_BYTES ];
+	bool haveLast = false;
+
+	enterShared();
+	char *n = findNode ( collnum , startKey , NULL , NULL );
+	for ( ; n && list->getListSize() < minRecSizes ; n = loadNext(n,0)) {
+		if ( getCollnum(n) != collnum ) break;
+		// . copy it out first, an add can flip the delbit under us
+		// . findNode() masks the delbit so a negative key right
+		//   below a positive startKey can show up here
+		char k [ MAX_KEY_BYTES ];
+		KEYSET ( k , getKey(n) , m_ks );
+		if ( KEYCMP(k,startKey,m_ks) < 0 ) continue;
+		if ( KEYCMP(k,endKey  ,m_ks) > 0 ) break;
+		if ( list->getListSize() + m_ks > list->getAllocSize() ) {
+			int64_t newSize = (int64_t)list->getAllocSize() * 2;
+			if ( newSize > (int64_t)minRecSizes + m_ks )
+				newSize = (int64_t)minRecSizes + m_ks;
+			if ( newSize < list->getListSize() + m_ks )
+				newSize = list->getListSize() + m_ks;
+			if ( ! list->growList ( newSize ) ) {
+				exitShared();
+				return log("db: Failed to grow list to "
+					   "%"INT64" bytes for storing records "
+					   "from skiplist: %s.",
+					   newSize,mstrerror(g_errno));
+			}
+		}
+		if ( ! list->addRecord ( k , 0 , NULL ) ) {
+			exitShared();
+			return log("db: Failed to add record to list for "
+				   "%s: %s.", m_dbname,mstrerror(g_errno));
+		}
+		if ( KEYNEG(k) ) numNeg++;
+		else             numPos++;
+		KEYSET ( lastKey , k , m_ks );
+		haveLast = true;
+	}
+	exitShared();
+
+	if ( numNegRecs ) *numNegRecs += numNeg;
+	if ( numPosRecs ) *numPosRecs += numPos;
+
+	if ( haveLast ) list->setLastKey ( lastKey );
+
+	// . reset the list's endKey if we hit the minRecSizes barrier cuz
+	//   there may be more records before endKey than we put in "list"
+	// . same as RdbBucket::getList()
+	if ( list->getListSize() >= minRecSizes && haveLast ) {
+		char newEndKey[MAX_KEY_BYTES];
+		KEYSET(newEndKey, lastKey, m_ks);
+		// endKeys are not allowed to be negative
+		if ( KEYNEG(newEndKey,0,m_ks) ) KEYADD(newEndKey,1,m_ks);
+		if ( useHalfKeys ) KEYOR(newEndKey,0x02);
+		if ( m_rdbId == RDB_POSDB || m_rdbId == RDB2_POSDB2 )
+			newEndKey[0] |= 0x04;
+		list->setEndKey ( newEndKey );
+	}
+	list->resetListPtr();
+	return true;
+}
+
+// . must be in exclusive mode
+// . "last" holds the last node before "n" on each of its levels
+void RdbSkipList::unlinkNode ( char *n , char **last ) {
+	int32_t h = getHeight(n);
+	for ( int32_t i = 0 ; i < h ; i++ )
+		getNext(last[i])[i] = getNext(n)[i];
+	m_numKeys--;
+	if ( KEYNEG(getKey(n)) ) m_numNegKeys--;
+	freeNode ( n );
+}
+
+// . a single merge-like pass over level 0, keeping track of the last node
+//   on every level so unlinking is O(1)
+// . only removes keys that match exactly, delbit and all
+bool RdbSkipList::deleteList ( collnum_t collnum , RdbList *list ) {
+	char startKey [ MAX_KEY_BYTES ];
+	char listKey  [ MAX_KEY_BYTES ];
+	char *last    [ SL_MAX_LEVEL ];
+	list->getStartKey ( startKey );
+
+	enterExclusive();
+	findNode ( collnum , startKey , last , NULL );
+	char *n = getNext(last[0])[0];
+	list->resetListPtr();
+	while ( n && ! list->isExhausted() && getCollnum(n) == collnum ) {
+		list->getCurrentKey ( listKey );
+		char v = KEYCMP ( getKey(n) , listKey , m_ks );
+		if ( v == 0 ) {
+			char *next = getNext(n)[0];
+			unlinkNode ( n , last );
+			n = next;
+			list->skipCurrentRecord();
+			continue;
+		}
+		if ( v > 0 ) {
+			list->skipCurrentRecord();
+			continue;
+		}
+		for ( int32_t i = 0 ; i < getHeight(n) ; i++ ) last[i] = n;
+		n = getNext(n)[0];
+	}
+	// give back the slabs if we dumped everything
+	if ( m_numKeys == 0 ) freeSlabs ( 1 );
+	exitExclusive();
+	return true;
+}
+
+bool RdbSkipList::delColl ( collnum_t collnum ) {
+	char *last [ SL_MAX_LEVEL ];
+	int32_t count = 0;
+	enterExclusive();
+	char *n = findNode ( collnum , KEYMIN() , last , NULL );
+	while ( n && getCollnum(n) == collnum ) {
+		char *next = getNext(n)[0];
+		unlinkNode ( n , last );
+		n = next;
+		count++;
+	}
+	if ( m_numKeys == 0 ) freeSlabs ( 1 );
+	exitExclusive();
+	log("skiplist: deleted %"INT32" keys for collnum %"INT32,
+	    count,(int32_t)collnum);
+	return true;
+}
+
+bool RdbSkipList::selfTest ( ) {
+	int32_t numKeys = 0;
+	int32_t numNeg  = 0;
+	char *prev = NULL;
+	bool ok = true;
+	enterShared();
+	for ( char *n = loadNext(m_head,0) ; n ; n = loadNext(n,0) ) {
+		if ( prev && nodeCmp ( n , getCollnum(prev) ,
+				       getKey(prev) ) <= 0 ) {
+			log("db: skiplist for %s has key out of order.",
+			    m_dbname);
+			ok = false;
+			break;
+		}
+		numKeys++;
+		if ( KEYNEG(getKey(n)) ) numNeg++;
+		prev = n;
+	}
+	exitShared();
+	if ( ok && (numKeys != m_numKeys || numNeg != m_numNegKeys) ) {
+		log("db: skiplist for %s has %"INT32" keys, %"INT32" negative, "
+		    "should have %"INT32" and %"INT32". fixing.",
+		    m_dbname,numKeys,numNeg,
+		    (int32_t)m_numKeys,(int32_t)m_numNegKeys);
+		m_numKeys    = numKeys;
+		m_numNegKeys = numNeg;
+	}
+	return ok;
+}
+
+// . write out the keys as fully sorted buckets so RdbBuckets can load them
+// . NO USING g_errno IN HERE, we may be in a thread
+int64_t RdbSkipList::fastSave_r ( int fd , int64_t offset ) {
+	if ( m_numKeys == 0 ) return offset;
+	int32_t bufSize = SL_BUCKET_HDR_SIZE + m_bucketSize * m_ks;
+	char *buf = (char *)mmalloc ( bufSize , m_allocName );
+	if ( ! buf ) {
+		errno = ENOMEM;
+		return -1;
+	}
+	int64_t start = offset;
+	offset += SL_FILE_HDR_SIZE;
+	int32_t numBuckets = 0;
+	int32_t numKeys    = 0;
+	int32_t numNeg     = 0;
+	errno = 0;
+
+	enterShared();
+	char *n = loadNext ( m_head , 0 );
+	while ( n ) {
+		collnum_t c = getCollnum(n);
+		char *p = buf + SL_BUCKET_HDR_SIZE;
+		int32_t nk = 0;
+		for ( ; n && nk < m_bucketSize && getCollnum(n) == c ;
+		      n = loadNext(n,0) ) {
+			KEYSET ( p , getKey(n) , m_ks );
+			if ( KEYNEG(p) ) numNeg++;
+			p += m_ks;
+			nk++;
+		}
+		// bucket header, all keys are sorted
+		char *h = buf;
+		*(collnum_t *)h = c;  h += sizeof(collnum_t);
+		*(int32_t *)h = nk;   h += 4;
+		*(int32_t *)h = nk;   h += 4;
+		*(int32_t *)h = (nk - 1) * m_ks;
+		int32_t size = p - buf;
+		if ( pwrite ( fd , buf , size , offset ) != size ) {
+			if ( ! errno ) errno = EIO;
+			break;
+		}
+		offset += size;
+		numKeys += nk;
+		numBuckets++;
+	}
+	exitShared();
+	mfree ( buf , bufSize , m_allocName );
+
+	char hdr[SL_FILE_HDR_SIZE];
+	char *p = hdr;
+	int32_t fixedDataSize = 0;
+	int32_t recSize       = m_ks;
+	int32_t dataMem       = 0;
+	int32_t version       = 0;
+	*(int32_t *)p = version;       p += 4;
+	*(int32_t *)p = numBuckets;    p += 4;
+	*(int32_t *)p = numBuckets;    p += 4;
+	*p = m_ks;                     p += 1;
+	*(int32_t *)p = fixedDataSize; p += 4;
+	*(int32_t *)p = recSize;       p += 4;
+	*(int32_t *)p = numKeys;       p += 4;
+	*(int32_t *)p = numNeg;        p += 4;
+	*(int32_t *)p = dataMem;       p += 4;
+	*(int32_t *)p = m_bucketSize;  p += 4;
+	if ( ! errno &&
+	     pwrite ( fd , hdr , SL_FILE_HDR_SIZE , start ) != SL_FILE_HDR_SIZE
+	     && ! errno )
+		errno = EIO;
+
+	if ( errno ) {
+		log("db: Failed to save skiplist for %s: %s.",
+		    m_dbname,mstrerror(errno));
+		return -1;
+	}
+	return offset;
+}
+
+// . the buckets may have been saved by RdbBuckets, so the tail of each
+//   might be unsorted and have dups. adding them in order takes care of
+//   that since the newest key wins.
+// . returns -1 and sets g_errno on error
+int64_t RdbSkipList::fastLoad ( BigFile *f , int64_t offset ) {
+	char hdr[SL_FILE_HDR_SIZE];
+	f->read ( hdr , SL_FILE_HDR_SIZE , offset );
+	if ( g_errno ) return -1;
+	offset += SL_FILE_HDR_SIZE;
+	char *p = hdr;
+	int32_t version       = *(int32_t *)p; p += 4;
+	int32_t numBuckets    = *(int32_t *)p; p += 8;
+	uint8_t ks            = *p;            p += 1;
+	int32_t fixedDataSize = *(int32_t *)p; p += 4;
+	int32_t recSize       = *(int32_t *)p; p += 4*4;
+	int32_t bucketSize    = *(int32_t *)p;
+	if ( version != 0 || ks != m_ks || fixedDataSize != 0 ||
+	     recSize != m_ks || bucketSize <= 0 || numBuckets < 0 ) {
+		log("db: Failed to load skiplist for %s: saved buckets "
+		    "are corrupt or from an incompatible version.",m_dbname);
+		g_errno = ECORRUPTDATA;
+		return -1;
+	}
+
+	int32_t bufSize = bucketSize * recSize;
+	char *buf = (char *)mmalloc ( bufSize , m_allocName );
+	if ( ! buf ) return -1;
+	for ( int32_t i = 0 ; i < numBuckets ; i++ ) {
+		char bh[SL_BUCKET_HDR_SIZE];
+		f->read ( bh , SL_BUCKET_HDR_SIZE , offset );
+		if ( g_errno ) break;
+		offset += SL_BUCKET_HDR_SIZE;
+		collnum_t collnum = *(collnum_t *)bh;
+		int32_t nk = *(int32_t *)(bh + sizeof(collnum_t));
+		if ( nk < 0 || nk > bucketSize ) {
+			log("db: Failed to load skiplist for %s: bucket #%"
+			    INT32" has %"INT32" keys.",m_dbname,i,nk);
+			g_errno = ECORRUPTDATA;
+			break;
+		}
+		f->read ( buf , nk * recSize , offset );
+		if ( g_errno ) break;
+		offset += nk * recSize;
+		for ( int32_t j = 0 ; j < nk ; j++ )
+			if ( addNode ( collnum , buf + j * recSize ) < 0 )
+				break;
+		if ( g_errno ) break;
+	}
+	mfree ( buf , bufSize , m_allocName );
+	if ( g_errno ) return -1;
+	log(LOG_INIT,"db: Loaded %"INT32" keys into skiplist for %s.",
+	    (int32_t)m_numKeys,m_dbname);
+	return offset;
+}
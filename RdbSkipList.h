@@ -0,0 +1,136 @@
+// A concurrent skiplist memtable for rdbs with data-less fixed size keys,
+// like posdb. RdbBuckets hands all of its calls off to one of these when
+// the "use skiplist memtable" parm is on, so Rdb, RdbDump and Msg5 do not
+// know the difference.
+
+// . keys are ordered by collnum then by KEYCMPNEGEQ so a positive key and
+//   its negative annihilate each other just like in RdbBuckets, only the
+//   newest one survives
+// . adds and reads take no locks. adds link in a new node bottom up with
+//   compare and swap, so readers always see a valid sorted list at level 0
+// . removals (deleteList after a dump, delColl, clear) are rare so they
+//   wait for the adds and reads in progress to drain and then run alone.
+//   that way a reader never walks into a node that was just freed.
+// . nodes are carved out of slabs and recycled through per-height free
+//   lists. only the allocator takes a lock and it is held for a few
+//   instructions.
+// . it saves to and loads from the same -buckets-saved.dat format that
+//   RdbBuckets uses so the parm can be flipped across a restart
+
+#ifndef _RDBSKIPLIST_H_
+#define _RDBSKIPLIST_H_
+
+#include <pthread.h>
+#include "RdbList.h"
+#include "BigFile.h"
+
+// 4^20 nodes is way more than we will ever fit in memory
+#define SL_MAX_LEVEL 20
+
+class RdbSkipList {
+ public:
+
+	RdbSkipList();
+	~RdbSkipList();
+
+	// . returns false and sets g_errno on error
+	// . "bucketSize" is the # of keys per bucket in the saved file
+	bool set ( int32_t maxMem , char rdbId , uint8_t keySize ,
+		   int32_t bucketSize , char *dbname , char *allocName );
+	void reset();
+	void clear();
+
+	// returns -1 and sets g_errno on error, 0 on success
+	int32_t addNode ( collnum_t collnum , char *key );
+
+	char *getKeyVal ( collnum_t collnum , char *key );
+
+	bool getList ( collnum_t collnum ,
+		       char *startKey, char *endKey, int32_t minRecSizes ,
+		       RdbList *list , int32_t *numPosRecs , int32_t *numNegRecs ,
+		       bool useHalfKeys );
+
+	bool deleteList ( collnum_t collnum , RdbList *list );
+	bool delColl    ( collnum_t collnum );
+	bool collExists ( collnum_t collnum );
+
+	// estimate, counts nodes at the lowest level that has few of them
+	int64_t getListSize ( collnum_t collnum ,
+			      char *startKey , char *endKey );
+	int getListSizeExact ( collnum_t collnum ,
+			       char *startKey , char *endKey );
+
+	int32_t getNumKeys         ( ) { return m_numKeys;    }
+	int32_t getNumKeys         ( collnum_t collnum );
+	int32_t getNumNegativeKeys ( ) { return m_numNegKeys; }
+
+	int32_t getMemAlloced   ( );
+	int32_t getMemOccupied  ( );
+	int32_t getMemAvailable ( ) { return m_maxMem - getMemOccupied(); }
+	bool    is90PercentFull ( );
+	bool    hasRoom         ( int32_t numRecs );
+
+	// checks order and recounts the keys, fixing the counts
+	bool selfTest ( );
+
+	// same format as RdbBuckets::fastSaveColl_r(). returns the new
+	// offset or -1 and sets errno on error.
+	int64_t fastSave_r ( int fd , int64_t offset );
+	int64_t fastLoad   ( BigFile *f , int64_t offset );
+
+ private:
+
+	// node layout: collnum, height, allocated height, then the next
+	// ptrs, then the key
+	char      **getNext     ( char *n ) { return (char **)(n + 8); }
+	collnum_t   getCollnum  ( char *n ) { return *(collnum_t *)n; }
+	int32_t     getHeight   ( char *n ) { return (uint8_t)n[2]; }
+	char       *getKey      ( char *n ) { return n + 8 + 8*getHeight(n); }
+	int32_t     getNodeSize ( int32_t h ) {
+		return (8 + 8*h + m_ks + 7) & ~7; }
+
+	char *loadNext ( char *n , int32_t i ) {
+		return ((char * volatile *)getNext(n))[i]; }
+
+	char  nodeCmp ( char *n , collnum_t collnum , char *key );
+	char *findNode ( collnum_t collnum , char *key ,
+			 char **preds , char **succs );
+	int32_t getRandomHeight ( );
+
+	char *allocNode ( int32_t h );
+	void  freeNode  ( char *n );
+	void  freeSlabs ( int32_t keep );
+	void  unlinkNode ( char *n , char **last );
+
+	// adds and reads are "shared", removals are "exclusive"
+	void enterShared    ( );
+	void exitShared     ( );
+	void enterExclusive ( );
+	void exitExclusive  ( );
+
+	char      *m_head;
+	uint8_t    m_ks;
+	char       m_rdbId;
+	int32_t    m_maxMem;
+	int32_t    m_bucketSize;
+	char      *m_dbname;
+	char      *m_allocName;
+
+	int32_t volatile m_numKeys;
+	int32_t volatile m_numNegKeys;
+	int32_t volatile m_memOccupied;
+	uint32_t volatile m_seed;
+
+	int32_t volatile m_numShared;
+	int32_t volatile m_exclusive;
+
+	// slab allocator, protected by m_allocLock
+	pthread_mutex_t m_allocLock;
+	char     **m_slabs;
+	int32_t    m_numSlabs;
+	int32_t    m_maxSlabs;
+	int32_t    m_slabUsed;
+	char      *m_freeLists [ SL_MAX_LEVEL + 1 ];
+};
+
+#endif
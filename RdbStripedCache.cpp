@@ -0,0 +1,510 @@
+#include "gb-include.h"
+
+#include "RdbStripedCache.h"
+#include "Mem.h"
+#include "hash.h"
+
+// . the header of a rec in a stripe's ring, followed by the key and data
+// . recs are 8 byte aligned
+class StripedRec {
+ public:
+	// low 32 bits of the key hash so we can rehash without the key
+	uint32_t  m_hash;
+	// total bytes of this rec in the ring, header and padding included
+	int32_t   m_size;
+	int32_t   m_dataSize;
+	int32_t   m_timestamp;
+	collnum_t m_collnum;
+	// CLOCK reference bit, set when the rec is used
+	char      m_ref;
+	// removed or replaced, skip over it when evicting
+	char      m_dead;
+};
+
+#define RSC_ALIGN(x) (((x) + 7) & ~7)
+#define RSC_HDR_SIZE RSC_ALIGN((int32_t)sizeof(StripedRec))
+
+// halve the sketch after this many lookups per slot
+#define RSC_SKETCH_AGE 10
+
+static RdbStripedCache *s_caches[RSC_MAX_CACHES];
+static int32_t          s_numCaches = 0;
+
+static uint32_t s_seeds[RSC_DEPTH] = {
+	0x9e3779b1, 0x85ebca77, 0xc2b2ae3d, 0x27d4eb2f };
+
+RdbStripedCache::RdbStripedCache () {
+	memset ( m_stripes , 0 , sizeof(m_stripes) );
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		pthread_mutex_init ( &m_stripes[i].m_lock , NULL );
+	m_enabled    = false;
+	m_maxMem     = 0;
+	m_cks        = 0;
+	m_dbname[0]  = '\0';
+	m_registered = false;
+}
+
+RdbStripedCache::~RdbStripedCache() {
+	reset();
+	for ( int32_t i = 0 ; m_registered && i < s_numCaches ; i++ ) {
+		if ( s_caches[i] != this ) continue;
+		s_caches[i] = s_caches[--s_numCaches];
+		break;
+	}
+}
+
+void RdbStripedCache::reset() {
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ ) {
+		RdbStripe *s = &m_stripes[i];
+		if ( s->m_allocSize )
+			mfree ( s->m_buf , s->m_allocSize , m_dbname );
+		s->m_buf         = NULL;
+		s->m_bufSize     = 0;
+		s->m_head        = 0;
+		s->m_tail        = 0;
+		s->m_wrap        = -1;
+		s->m_slots       = NULL;
+		s->m_numSlots    = 0;
+		s->m_numRecs     = 0;
+		s->m_memOccupied = 0;
+		s->m_sketch      = NULL;
+		s->m_sketchAdds  = 0;
+		s->m_allocSize   = 0;
+	}
+	m_enabled = false;
+	m_maxMem  = 0;
+}
+
+bool RdbStripedCache::init ( int64_t maxMem , int32_t maxRecs ,
+			     char *dbname , char cks ) {
+	reset();
+	strncpy ( m_dbname , dbname , 63 );
+	m_dbname[63] = '\0';
+	m_cks    = cks;
+	m_maxMem = maxMem;
+	if ( ! m_registered && s_numCaches < RSC_MAX_CACHES ) {
+		s_caches[s_numCaches++] = this;
+		m_registered = true;
+	}
+	int32_t bufSize = (int32_t)(maxMem / RSC_STRIPES) & ~7;
+	// too small to hold anything useful, leave it disabled
+	if ( bufSize < 4096 ) return true;
+	// . keep the hash tables half empty
+	// . the slot count is a power of 2 so we can mask
+	int32_t numSlots = 16;
+	while ( numSlots < 2 * (maxRecs / RSC_STRIPES) ) numSlots <<= 1;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ ) {
+		RdbStripe *s = &m_stripes[i];
+		int64_t need = (int64_t)bufSize + numSlots * 4 +
+			numSlots * RSC_DEPTH;
+		char *p = (char *)mmalloc ( need , m_dbname );
+		if ( ! p ) {
+			reset();
+			return log("db: Failed to alloc %"INT64" bytes for "
+				   "%s: %s.",need,m_dbname,mstrerror(g_errno));
+		}
+		s->m_allocSize = need;
+		s->m_buf       = p;
+		s->m_bufSize   = bufSize;
+		p += bufSize;
+		s->m_slots     = (int32_t *)p;
+		s->m_numSlots  = numSlots;
+		memset ( s->m_slots , -1 , numSlots * 4 );
+		p += numSlots * 4;
+		s->m_sketch    = (unsigned char *)p;
+		memset ( s->m_sketch , 0 , numSlots * RSC_DEPTH );
+	}
+	m_enabled = true;
+	return true;
+}
+
+// . count a lookup of the key in the sketch and return its new count
+// . caller must have the stripe lock
+int32_t RdbStripedCache::incFreq ( RdbStripe *s , uint32_t h ) {
+	int32_t mask = s->m_numSlots - 1;
+	int32_t min = 255;
+	for ( int32_t i = 0 ; i < RSC_DEPTH ; i++ ) {
+		uint32_t x = h * s_seeds[i];
+		unsigned char *c = s->m_sketch + i * s->m_numSlots +
+			((x ^ (x >> 15)) & mask);
+		// the counts are 4 bits in spirit
+		if ( *c < 15 ) (*c)++;
+		if ( *c < min ) min = *c;
+	}
+	// . age the counts so keys that were popular a while ago do not
+	//   keep new recs out forever
+	if ( ++s->m_sketchAdds >= s->m_numSlots * RSC_SKETCH_AGE ) {
+		int32_t n = s->m_numSlots * RSC_DEPTH;
+		for ( int32_t i = 0 ; i < n ; i++ ) s->m_sketch[i] >>= 1;
+		s->m_sketchAdds = 0;
+	}
+	return min;
+}
+
+int32_t RdbStripedCache::getFreq ( RdbStripe *s , uint32_t h ) {
+	int32_t mask = s->m_numSlots - 1;
+	int32_t min = 255;
+	for ( int32_t i = 0 ; i < RSC_DEPTH ; i++ ) {
+		uint32_t x = h * s_seeds[i];
+		unsigned char c = s->m_sketch[i * s->m_numSlots +
+					      ((x ^ (x >> 15)) & mask)];
+		if ( c < min ) min = c;
+	}
+	return min;
+}
+
+// . returns the slot of the key, or the empty slot it would go in
+// . the table is never more than half full so this always ends
+int32_t RdbStripedCache::findSlot ( RdbStripe *s , uint32_t h ,
+				    collnum_t collnum , char *key ) {
+	int32_t mask = s->m_numSlots - 1;
+	int32_t n = h & mask;
+	for ( ; ; n = (n + 1) & mask ) {
+		int32_t off = s->m_slots[n];
+		if ( off < 0 ) return n;
+		StripedRec *r = (StripedRec *)(s->m_buf + off);
+		if ( r->m_hash    == h       &&
+		     r->m_collnum == collnum &&
+		     memcmp ( (char *)r + RSC_HDR_SIZE , key , m_cks ) == 0 )
+			return n;
+	}
+}
+
+// the rec at offset "from" was moved to "to"
+void RdbStripedCache::fixSlot ( RdbStripe *s , uint32_t h ,
+				int32_t from , int32_t to ) {
+	int32_t mask = s->m_numSlots - 1;
+	int32_t n = h & mask;
+	for ( ; s->m_slots[n] >= 0 ; n = (n + 1) & mask ) {
+		if ( s->m_slots[n] != from ) continue;
+		s->m_slots[n] = to;
+		return;
+	}
+	// it has to be there
+	char *xx=NULL;*xx=0;
+}
+
+// . empty slot "n" and shift back the slots after it that probed past it
+//   so findSlot() still finds them
+void RdbStripedCache::removeSlot ( RdbStripe *s , int32_t n ) {
+	int32_t mask = s->m_numSlots - 1;
+	s->m_slots[n] = -1;
+	int32_t j = n;
+	for ( ; ; ) {
+		j = (j + 1) & mask;
+		int32_t off = s->m_slots[j];
+		if ( off < 0 ) return;
+		int32_t k = ((StripedRec *)(s->m_buf + off))->m_hash & mask;
+		// leave it if its home slot is cyclically in (n,j]
+		if ( n <= j ) { if ( n < k && k <= j ) continue; }
+		else          { if ( n < k || k <= j ) continue; }
+		s->m_slots[n] = off;
+		s->m_slots[j] = -1;
+		n = j;
+	}
+}
+
+// the space stays in the ring until the tail gets to it
+void RdbStripedCache::killRec ( RdbStripe *s , int32_t n ) {
+	StripedRec *r = (StripedRec *)(s->m_buf + s->m_slots[n]);
+	r->m_dead = 1;
+	s->m_numRecs--;
+	s->m_memOccupied -= r->m_size;
+	removeSlot ( s , n );
+}
+
+void RdbStripedCache::advanceTail ( RdbStripe *s , int32_t size ) {
+	s->m_tail += size;
+	if ( s->m_wrap >= 0 && s->m_tail >= s->m_wrap ) {
+		s->m_tail = 0;
+		s->m_wrap = -1;
+	}
+}
+
+// . drop or move the rec at the tail
+// . a rec that was used since it was added is moved to the head with its
+//   bit cleared. when the ring has wrapped the free space is right before
+//   the tail, so sliding the rec down by that much keeps the free space
+//   the same and never runs into anything.
+// . returns false if the rec at the tail was asked for more often than
+//   the new rec of frequency "freq", so the new rec should not get in
+bool RdbStripedCache::evictTail ( RdbStripe *s , int32_t freq ) {
+	StripedRec *r = (StripedRec *)(s->m_buf + s->m_tail);
+	int32_t size = r->m_size;
+	if ( r->m_dead ) {
+		advanceTail ( s , size );
+		return true;
+	}
+	if ( r->m_ref ) {
+		if ( s->m_wrap < 0 && s->m_head + size > s->m_bufSize ) {
+			s->m_wrap = s->m_head;
+			s->m_head = 0;
+		}
+		int32_t from = s->m_tail;
+		int32_t to   = s->m_head;
+		if ( from != to ) {
+			memmove ( s->m_buf + to , s->m_buf + from , size );
+			r = (StripedRec *)(s->m_buf + to);
+			fixSlot ( s , r->m_hash , from , to );
+		}
+		r->m_ref = 0;
+		s->m_head += size;
+		advanceTail ( s , size );
+		s->m_numMoves++;
+		return true;
+	}
+	if ( getFreq ( s , r->m_hash ) > freq ) return false;
+	killRec ( s , findSlot ( s , r->m_hash , r->m_collnum ,
+				 (char *)r + RSC_HDR_SIZE ) );
+	advanceTail ( s , size );
+	s->m_numDrops++;
+	return true;
+}
+
+// . returns the offset in the ring to write a rec of "need" bytes, making
+//   room and a free slot for it first
+// . returns -1 if the new rec was not admitted
+int32_t RdbStripedCache::reserve ( RdbStripe *s , int32_t need ,
+				   int32_t freq ) {
+	for ( ; ; ) {
+		if ( s->m_numRecs < s->m_numSlots / 2 ) {
+			if ( s->m_wrap < 0 ) {
+				if ( s->m_head + need <= s->m_bufSize )
+					return s->m_head;
+				// empty? start over at the top
+				if ( s->m_head == s->m_tail ) {
+					s->m_head = 0;
+					s->m_tail = 0;
+					continue;
+				}
+				// wrap, now the free space is before the tail
+				s->m_wrap = s->m_head;
+				s->m_head = 0;
+				continue;
+			}
+			if ( s->m_head + need <= s->m_tail )
+				return s->m_head;
+		}
+		if ( ! evictTail ( s , freq ) ) return -1;
+	}
+}
+
+// . caller must have the stripe lock
+// . sets the CLOCK bit of the rec on a hit
+StripedRec *RdbStripedCache::lookup ( RdbStripe *s , uint32_t h ,
+				      collnum_t collnum , char *key ,
+				      int32_t maxAge ) {
+	incFreq ( s , h );
+	int32_t n = findSlot ( s , h , collnum , key );
+	if ( s->m_slots[n] < 0 ) {
+		s->m_numMisses++;
+		return NULL;
+	}
+	StripedRec *r = (StripedRec *)(s->m_buf + s->m_slots[n]);
+	if ( maxAge > 0 && getTimeLocal() - r->m_timestamp > maxAge ) {
+		killRec ( s , n );
+		s->m_numMisses++;
+		return NULL;
+	}
+	r->m_ref = 1;
+	s->m_numHits++;
+	return r;
+}
+
+bool RdbStripedCache::getRecord ( collnum_t  collnum ,
+				  char      *key     ,
+				  char      *buf     ,
+				  int32_t    bufMax  ,
+				  int32_t   *recSize ,
+				  int32_t    maxAge  ,
+				  int32_t   *cachedTime ) {
+	*recSize = 0;
+	if ( ! m_enabled ) return false;
+	uint64_t h64 = hash64 ( key , m_cks , (uint64_t)collnum );
+	RdbStripe *s = getStripe ( h64 );
+	pthread_mutex_lock ( &s->m_lock );
+	StripedRec *r = lookup ( s , (uint32_t)h64 , collnum , key , maxAge );
+	bool status = false;
+	if ( r ) {
+		*recSize = r->m_dataSize;
+		if ( cachedTime ) *cachedTime = r->m_timestamp;
+		if ( r->m_dataSize <= bufMax ) {
+			gbmemcpy ( buf , (char *)r + RSC_HDR_SIZE + m_cks ,
+				   r->m_dataSize );
+			status = true;
+		}
+	}
+	pthread_mutex_unlock ( &s->m_lock );
+	return status;
+}
+
+bool RdbStripedCache::getRecord ( collnum_t  collnum ,
+				  char      *key     ,
+				  char     **rec     ,
+				  int32_t   *recSize ,
+				  int32_t    maxAge  ,
+				  int32_t   *cachedTime ) {
+	*rec     = NULL;
+	*recSize = 0;
+	if ( ! m_enabled ) return false;
+	uint64_t h64 = hash64 ( key , m_cks , (uint64_t)collnum );
+	RdbStripe *s = getStripe ( h64 );
+	pthread_mutex_lock ( &s->m_lock );
+	StripedRec *r = lookup ( s , (uint32_t)h64 , collnum , key , maxAge );
+	char *copy = NULL;
+	// only the main thread mallocs so holding the lock while we do
+	// can not deadlock
+	if ( r ) copy = (char *)mmalloc ( r->m_dataSize , m_dbname );
+	if ( copy ) {
+		gbmemcpy ( copy , (char *)r + RSC_HDR_SIZE + m_cks ,
+			   r->m_dataSize );
+		*rec     = copy;
+		*recSize = r->m_dataSize;
+		if ( cachedTime ) *cachedTime = r->m_timestamp;
+	}
+	pthread_mutex_unlock ( &s->m_lock );
+	return ( copy != NULL );
+}
+
+bool RdbStripedCache::addRecord ( collnum_t  collnum  ,
+				  char      *key      ,
+				  char      *rec1     ,
+				  int32_t    recSize1 ,
+				  char      *rec2     ,
+				  int32_t    recSize2 ,
+				  int32_t    timestamp ) {
+	if ( ! m_enabled ) return false;
+	int32_t dataSize = recSize1 + recSize2;
+	int32_t need = RSC_ALIGN ( RSC_HDR_SIZE + m_cks + dataSize );
+	uint64_t h64 = hash64 ( key , m_cks , (uint64_t)collnum );
+	uint32_t h   = (uint32_t)h64;
+	RdbStripe *s = getStripe ( h64 );
+	// . do not let one big list flush out a quarter of the stripe
+	// . this is what RdbCache's caller Msg3 does with big reads anyway
+	if ( need > s->m_bufSize / 4 ) return false;
+	if ( timestamp == 0 ) timestamp = getTimeLocal();
+	pthread_mutex_lock ( &s->m_lock );
+	// replace the old rec if there
+	int32_t n = findSlot ( s , h , collnum , key );
+	if ( s->m_slots[n] >= 0 ) killRec ( s , n );
+	// an add counts as a use too, callers do not always look first
+	int32_t off = reserve ( s , need , incFreq ( s , h ) );
+	if ( off < 0 ) {
+		s->m_numRejects++;
+		pthread_mutex_unlock ( &s->m_lock );
+		return false;
+	}
+	StripedRec *r = (StripedRec *)(s->m_buf + off);
+	r->m_hash      = h;
+	r->m_size      = need;
+	r->m_dataSize  = dataSize;
+	r->m_timestamp = timestamp;
+	r->m_collnum   = collnum;
+	r->m_ref       = 0;
+	r->m_dead      = 0;
+	char *p = (char *)r + RSC_HDR_SIZE;
+	gbmemcpy ( p , key , m_cks );
+	p += m_cks;
+	gbmemcpy ( p , rec1 , recSize1 );
+	p += recSize1;
+	gbmemcpy ( p , rec2 , recSize2 );
+	s->m_head = off + need;
+	// evicting may have moved things around in the table
+	n = findSlot ( s , h , collnum , key );
+	s->m_slots[n] = off;
+	s->m_numRecs++;
+	s->m_memOccupied += need;
+	s->m_numAdds++;
+	pthread_mutex_unlock ( &s->m_lock );
+	return true;
+}
+
+void RdbStripedCache::removeKey ( collnum_t collnum , char *key ) {
+	if ( ! m_enabled ) return;
+	uint64_t h64 = hash64 ( key , m_cks , (uint64_t)collnum );
+	RdbStripe *s = getStripe ( h64 );
+	pthread_mutex_lock ( &s->m_lock );
+	int32_t n = findSlot ( s , (uint32_t)h64 , collnum , key );
+	if ( s->m_slots[n] >= 0 ) killRec ( s , n );
+	pthread_mutex_unlock ( &s->m_lock );
+}
+
+int64_t RdbStripedCache::getNumHits ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		n += m_stripes[i].m_numHits;
+	return n;
+}
+
+int64_t RdbStripedCache::getNumMisses ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		n += m_stripes[i].m_numMisses;
+	return n;
+}
+
+int64_t RdbStripedCache::getNumAdds ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		n += m_stripes[i].m_numAdds;
+	return n;
+}
+
+int64_t RdbStripedCache::getNumDrops ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		n += m_stripes[i].m_numDrops;
+	return n;
+}
+
+int64_t RdbStripedCache::getNumRejects ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		n += m_stripes[i].m_numRejects;
+	return n;
+}
+
+int64_t RdbStripedCache::getNumMoves ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		n += m_stripes[i].m_numMoves;
+	return n;
+}
+
+int64_t RdbStripedCache::getNumUsedNodes ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		n += m_stripes[i].m_numRecs;
+	return n;
+}
+
+// the most recs the hash tables will take
+int64_t RdbStripedCache::getNumTotalNodes ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		n += m_stripes[i].m_numSlots / 2;
+	return n;
+}
+
+int64_t RdbStripedCache::getMemOccupied ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		n += m_stripes[i].m_memOccupied;
+	return n;
+}
+
+int64_t RdbStripedCache::getMemAlloced ( ) {
+	int64_t n = 0;
+	for ( int32_t i = 0 ; i < RSC_STRIPES ; i++ )
+		n += m_stripes[i].m_allocSize;
+	return n;
+}
+
+int32_t RdbStripedCache::getNumCaches ( ) {
+	return s_numCaches;
+}
+
+RdbStripedCache *RdbStripedCache::getCache ( int32_t i ) {
+	if ( i < 0 || i >= s_numCaches ) return NULL;
+	return s_caches[i];
+}
@@ -0,0 +1,160 @@
+// . a thread safe variant of RdbCache for recs with a fixed size key, like
+//   the lists Msg3 reads from disk, so disk threads and intersection
+//   threads can look in it directly and not just the main thread
+// . the cache is split into RSC_STRIPES stripes by the hash of the key.
+//   each stripe has its own lock, memory, hash table and counts so
+//   threads rarely wait on each other.
+// . each stripe is a ring buffer like RdbCache. recs are added at the head
+//   and evicted from the tail, but a rec that was used since it was added
+//   is moved to the head instead and gets another lap. that is the CLOCK
+//   algorithm, so a scan that reads everything once does not flush out the
+//   hot recs.
+// . when a stripe is full a new rec is only let in if it was asked for at
+//   least as often as the rec it would evict, that is TinyLFU admission.
+//   how often a key was asked for is kept in a count-min sketch per stripe
+//   whose counts we halve every so often so old popularity fades.
+// . getRecord() copies the rec out while holding the stripe lock, since
+//   it can be moved or evicted as soon as we release it
+// . init() and reset() are main thread only and no thread may be using
+//   the cache when they are called
+
+#ifndef _RDBSTRIPEDCACHE_H_
+#define _RDBSTRIPEDCACHE_H_
+
+#include <pthread.h>
+
+#define RSC_STRIPES 16
+// rows in the count-min sketch
+#define RSC_DEPTH   4
+// most caches we list on the stats page
+#define RSC_MAX_CACHES 32
+
+class RdbStripe {
+ public:
+	// the ring buffer of recs
+	char           *m_buf;
+	int32_t         m_bufSize;
+	// recs are added at m_head and evicted from m_tail
+	int32_t         m_head;
+	int32_t         m_tail;
+	// where the recs end before wrapping to the top of m_buf, -1 if the
+	// head has not wrapped around past the tail
+	int32_t         m_wrap;
+	// the hash table of offsets into m_buf, -1 if empty
+	int32_t        *m_slots;
+	int32_t         m_numSlots;
+	int32_t         m_numRecs;
+	int32_t         m_memOccupied;
+	// the TinyLFU sketch, RSC_DEPTH rows of m_numSlots counts
+	unsigned char  *m_sketch;
+	int32_t         m_sketchAdds;
+	int64_t         m_allocSize;
+	int64_t         m_numHits;
+	int64_t         m_numMisses;
+	int64_t         m_numAdds;
+	int64_t         m_numDrops;
+	int64_t         m_numRejects;
+	int64_t         m_numMoves;
+	pthread_mutex_t m_lock;
+};
+
+class RdbStripedCache {
+
+ public:
+
+	RdbStripedCache();
+	~RdbStripedCache();
+	void reset();
+
+	// . "maxRecs" is about how many recs we expect to hold, it sizes the
+	//   hash tables
+	// . "cks" is the key size
+	// . returns false and sets g_errno on error
+	bool init ( int64_t maxMem , int32_t maxRecs , char *dbname ,
+		    char cks );
+
+	// . copy the rec into "buf" if it is in the cache and fits
+	// . *recSize is set to the size of the rec even if it did not fit
+	// . recs older than "maxAge" seconds are a miss, -1 means no limit
+	// . safe to call from any thread
+	bool getRecord ( collnum_t  collnum ,
+			 char      *key     ,
+			 char      *buf     ,
+			 int32_t    bufMax  ,
+			 int32_t   *recSize ,
+			 int32_t    maxAge  ,
+			 int32_t   *cachedTime = NULL );
+
+	// . same, but the copy is mmalloc'd and you must mfree it
+	// . main thread only since mmalloc is not thread safe
+	bool getRecord ( collnum_t  collnum ,
+			 char      *key     ,
+			 char     **rec     ,
+			 int32_t   *recSize ,
+			 int32_t    maxAge  ,
+			 int32_t   *cachedTime = NULL );
+
+	// . the rec is "rec1" followed by "rec2" like RdbCache::addRecord()
+	// . returns false if it was too big or it was not admitted, that is
+	//   not an error
+	// . "timestamp" of 0 means now
+	// . safe to call from any thread
+	bool addRecord ( collnum_t  collnum  ,
+			 char      *key      ,
+			 char      *rec1     ,
+			 int32_t    recSize1 ,
+			 char      *rec2     ,
+			 int32_t    recSize2 ,
+			 int32_t    timestamp );
+
+	void removeKey ( collnum_t collnum , char *key );
+
+	char   *getDbname       ( ) { return m_dbname; };
+	int64_t getMaxMem       ( ) { return m_maxMem; };
+	// these add up the stripes without locking, so they are approximate
+	// while threads are using the cache
+	int64_t getNumHits      ( ) ;
+	int64_t getNumMisses    ( ) ;
+	int64_t getNumAdds      ( ) ;
+	int64_t getNumDrops     ( ) ;
+	int64_t getNumRejects   ( ) ;
+	int64_t getNumMoves     ( ) ;
+	int64_t getNumUsedNodes ( ) ;
+	int64_t getNumTotalNodes( ) ;
+	int64_t getMemOccupied  ( ) ;
+	int64_t getMemAlloced   ( ) ;
+
+	// every cache that was init'd, for the stats page
+	static int32_t          getNumCaches ( ) ;
+	static RdbStripedCache *getCache     ( int32_t i ) ;
+
+ private:
+
+	RdbStripe *getStripe ( uint64_t h ) {
+		return &m_stripes[(h >> 32) % RSC_STRIPES]; };
+
+	class StripedRec *lookup ( RdbStripe *s , uint32_t h ,
+				   collnum_t collnum , char *key ,
+				   int32_t maxAge ) ;
+	int32_t findSlot   ( RdbStripe *s , uint32_t h , collnum_t collnum ,
+			     char *key ) ;
+	void    fixSlot    ( RdbStripe *s , uint32_t h , int32_t from ,
+			     int32_t to ) ;
+	void    removeSlot ( RdbStripe *s , int32_t n ) ;
+	void    killRec    ( RdbStripe *s , int32_t n ) ;
+	int32_t reserve    ( RdbStripe *s , int32_t need , int32_t freq ) ;
+	bool    evictTail  ( RdbStripe *s , int32_t freq ) ;
+	void    advanceTail( RdbStripe *s , int32_t size ) ;
+	int32_t incFreq    ( RdbStripe *s , uint32_t h ) ;
+	int32_t getFreq    ( RdbStripe *s , uint32_t h ) ;
+
+	RdbStripe m_stripes[RSC_STRIPES];
+	// false if not init'd or too small to hold anything
+	bool      m_enabled;
+	int64_t   m_maxMem;
+	char      m_cks;
+	char      m_dbname[64];
+	bool      m_registered;
+};
+
+#endif
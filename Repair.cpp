@@ -702,6 +702,7 @@ void Repair::initScan ( ) {
 		// clean tree in case loaded from saved file
 		Rdb *r = g_posdb2.getRdb();
 		if ( r ) r->m_buckets.cleanBuckets();
+		if ( r && r->m_doubleBuffer ) r->m_sealedBuckets.cleanBuckets();
 	}
 
 
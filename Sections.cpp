@@ -17,6 +17,7 @@
 //#include "HashTableX.h"
 #include "XmlDoc.h"
 #include "Bits.h"
+#include "Arena.h"
 #include "sort.h"
 #include "Abbreviations.h"
 
@@ -32,6 +33,7 @@ Sections::Sections ( ) {
 	m_sections = NULL;
 	m_buf      = NULL;
 	m_buf2     = NULL;
+	m_arena    = NULL;
 	reset();
 }
 
@@ -110,6 +112,16 @@ public:
 // we are done because that will often breach this stack.
 #define MAXTAGSTACK 300
 
+// . point "sb" at "need" bytes from the arena, or reserve them like before
+// . the SafeBuf treats the arena's bytes like a stack buf so it never
+//   frees them
+static bool reserveSectionBuf ( SafeBuf *sb , int32_t need , Arena *arena ) {
+	if ( ! arena ) return sb->reserve ( need );
+	char *p = arena->alloc ( need );
+	if ( ! p ) return false;
+	return sb->setBuf ( p , need , 0 , false );
+}
+
 // . returns false if blocked, true otherwise
 // . returns true and sets g_errno on error
 // . sets m_sections[] array, 1-1 with words array "w"
@@ -261,7 +273,9 @@ bool Sections::set ( Words     *w                       ,
 	m_sectionPtrBuf.setLabel("psectbuf");
 
 	// separate buf now for section ptr for each word
-	if ( ! m_sectionPtrBuf.reserve ( nw *sizeof(Section *)) ) return true;
+	if ( ! reserveSectionBuf ( &m_sectionPtrBuf , nw * sizeof(Section *) ,
+				   m_arena ) )
+		return true;
 	m_sectionPtrs = (Section **)m_sectionPtrBuf.getBufStart();
 	m_sectionPtrsEnd = (Section **)m_sectionPtrBuf.getBufEnd();
 
@@ -270,7 +284,7 @@ bool Sections::set ( Words     *w                       ,
 
 	m_sectionBuf.setLabel ( "sectbuf" );
 
-	if ( ! m_sectionBuf.reserve ( need ) )
+	if ( ! reserveSectionBuf ( &m_sectionBuf , need , m_arena ) )
 		return true;
 
 	// point into it
@@ -2167,6 +2181,7 @@ bool Sections::set ( Words     *w                       ,
 
 	// . "ot" = occurence table
 	// . we use this to set Section::m_occNum and m_numOccurences
+	m_ot.m_arena = m_arena;
 	if ( ! m_ot.set (4,8,5000,NULL, 0 , false ,m_niceness,"sect-occrnc") )
 		return true;
 
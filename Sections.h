@@ -865,6 +865,10 @@ class Sections {
 	int32_t            m_numSections;
 	int32_t            m_maxNumSections;
 
+	// XmlDoc's arena, m_sectionBuf and m_sectionPtrBuf come from it if
+	// set, and the occurence table
+	class Arena *m_arena;
+
 	// this holds the Sections instances in a growable array
 	SafeBuf m_sectionBuf;
 
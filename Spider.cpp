@@ -6836,6 +6836,10 @@ void SpiderLoop::spiderDoledUrls ( ) {
 	if ( m_numSpidersOut >= MAX_SPIDERS ) return;
 	// a new global conf rule
 	if ( m_numSpidersOut >= g_conf.m_maxTotalSpiders ) return;
+	// . the docs we would index now would just wait in line for msg4
+	//   or get ETRYAGAIN from a shard whose tree is about to dump
+	// . this is checked every 50ms so we pick right back up
+	if ( isMsg4Backlogged() ) return;
 	// bail if no collections
 	if ( g_collectiondb.m_numRecs <= 0 ) return;
 	// not while repairing
@@ -8079,7 +8083,7 @@ bool SpiderLoop::spiderUrl9 ( SpiderRequest *sreq ,
 	// this causes us to dead lock when spiders use up all the mem, and
 	// file merge operation can not get any, and spiders need to add to 
 	// titledb but can not until the merge completes!!
-	if ( g_conf.m_maxMem - g_mem.m_used < 25*1024*1024 ) {
+	if ( g_conf.m_maxMem - g_mem.getUsedMem() < 25*1024*1024 ) {
 		static int32_t s_lastTime = 0;
 		static int32_t s_missed   = 0;
 		s_missed++;
@@ -8088,7 +8092,7 @@ bool SpiderLoop::spiderUrl9 ( SpiderRequest *sreq ,
 		if ( now - s_lastTime > 10 ) {
 			log("spider: Need 25MB of free mem to launch spider, "
 			    "only have %"INT64". Failed to launch %"INT32" times so "
-			    "far.", g_conf.m_maxMem - g_mem.m_used , s_missed );
+			    "far.", g_conf.m_maxMem - g_mem.getUsedMem() , s_missed );
 			s_lastTime = now;
 		}
 	}
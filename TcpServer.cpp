@@ -818,15 +818,15 @@ TcpSocket *TcpServer::getNewSocket ( ) {
 		//::close(sd);
 		sd = newSock;
 	}
-	if ( sd >= MAX_NUM_FDS ) {
-		log("tcp: using statically linked libc that only supports "
+	if ( sd >= g_loop.getMaxFd() ) {
+		log("tcp: Loop.cpp only supports "
 		    "an fd of up to %"INT32", but got an fd = %"INT32". fd_set is "
 		    "only geared for 1024 bits of file descriptors for "
-		    "doing poll() in Loop.cpp. Ensure 'ulimit -a' limits "
-		    "open files to 1024. "
+		    "doing select() in Loop.cpp, so turn on \"use epoll\" or "
+		    "ensure 'ulimit -a' limits open files to 1024. "
 		    "Check open fds using ls /proc/<gb-pid>/fds/ and ensure "
-		    "they are all BELOW 1024.",
-		    (int32_t)MAX_NUM_FDS,(int32_t)sd);
+		    "they are all BELOW %"INT32".",
+		    g_loop.getMaxFd(),(int32_t)sd,g_loop.getMaxFd());
 		char *xx=NULL;*xx=0; 
 	}
 	// return NULL and set g_errno on failure
@@ -0,0 +1,264 @@
+#include "gb-include.h"
+
+#include "ThreadPool.h"
+#include "Mem.h"
+#include "Conf.h"
+#include <signal.h>
+#include <unistd.h>      // sysconf()
+
+// a global class extern'd in .h file
+ThreadPool g_threadPool;
+
+// . the worker threads get a stack of this size from pthread_create()
+// . as big as the main thread's since PARSE_THREADs run XmlDoc code that
+//   was written for the main thread. it is only touched as it is used.
+#define TP_STACK_SIZE (8*1024*1024)
+
+ThreadPool::ThreadPool ( ) {
+	m_numWorkers  = 0;
+	m_next        = 0;
+	m_numQueued   = 0;
+	m_ringBuf     = NULL;
+	m_ringBufSize = 0;
+	m_initialized = false;
+	m_failed      = false;
+}
+
+bool ThreadPool::isReady ( ) {
+#ifndef PTHREADS
+	return false;
+#else
+	if ( ! g_conf.m_useThreadPool ) return false;
+	if ( m_initialized ) return true;
+	if ( m_failed      ) return false;
+	if ( init() ) return true;
+	m_failed = true;
+	return false;
+#endif
+}
+
+#ifdef PTHREADS
+
+static void *workerStart ( void *state ) {
+	PoolWorker *w = (PoolWorker *)state;
+	// . same signals as startUp() in Threads.cpp. sigalrm is only for
+	//   the main process and sigint is so gdb does not kill us.
+	sigset_t set;
+	sigemptyset ( &set );
+	sigaddset   ( &set , SIGINT );
+	sigaddset   ( &set , SIGALRM );
+	sigaddset   ( &set , SIGVTALRM );
+	pthread_sigmask ( SIG_BLOCK , &set , NULL );
+	g_threadPool.workerLoop ( w );
+	return NULL;
+}
+
+bool ThreadPool::init ( ) {
+
+	int32_t n = g_conf.m_threadPoolThreads;
+	// 0 means one worker per core
+	if ( n <= 0 ) n = (int32_t)sysconf ( _SC_NPROCESSORS_ONLN );
+	if ( n <= 0 ) n = 1;
+	if ( n > TP_MAX_WORKERS ) n = TP_MAX_WORKERS;
+
+	// . a deque must be able to hold every entry the pool types can
+	//   have queued, then push() never finds the deque it picks full
+	// . the queues are registered in Threads::init() which is before
+	//   anything can be launched
+	int32_t maxEntries = 0;
+	ThreadQueue *qs = g_threads.getThreadQueues();
+	for ( int32_t i = 0 ; i < g_threads.getNumThreadQueues() ; i++ )
+		if ( isPoolType ( qs[i].m_threadType ) )
+			maxEntries += qs[i].m_maxEntries;
+	if ( maxEntries <= 0 )
+		return log("thread: No thread types for the pool.");
+
+	m_ringBufSize = n * TP_CLASSES * maxEntries * sizeof(ThreadEntry *);
+	m_ringBuf = (char *)mmalloc ( m_ringBufSize , "ThreadPool" );
+	if ( ! m_ringBuf )
+		return log("thread: Could not allocate %"INT32" bytes for "
+			   "the thread pool: %s.",
+			   m_ringBufSize,mstrerror(g_errno));
+
+	pthread_mutex_init ( &m_sleepLock , NULL );
+	pthread_cond_init  ( &m_wake      , NULL );
+	m_numQueued = 0;
+	m_next      = 0;
+
+	ThreadEntry **p = (ThreadEntry **)m_ringBuf;
+	for ( int32_t i = 0 ; i < n ; i++ ) {
+		PoolWorker *w = &m_workers[i];
+		for ( int32_t c = 0 ; c < TP_CLASSES ; c++ ) {
+			PoolDeque *d = &w->m_deques[c];
+			d->m_ring  = p;
+			d->m_size  = maxEntries;
+			d->m_head  = 0;
+			d->m_count = 0;
+			p += maxEntries;
+		}
+		pthread_mutex_init ( &w->m_lock , NULL );
+		w->m_id        = i;
+		w->m_numRun    = 0;
+		w->m_numStolen = 0;
+	}
+
+	pthread_attr_t attr;
+	pthread_attr_init ( &attr );
+	pthread_attr_setstacksize ( &attr , TP_STACK_SIZE );
+	// . the workers can look at each other's deques as soon as they
+	//   start so set m_numWorkers to the ones we got so far
+	// . if we could not start any we are not ready
+	for ( int32_t i = 0 ; i < n ; i++ ) {
+		PoolWorker *w = &m_workers[i];
+		int err = pthread_create ( &w->m_tid , &attr , workerStart , w );
+		if ( err ) {
+			log("thread: Could only start %"INT32" of %"INT32" "
+			    "thread pool workers: %s.",i,n,mstrerror(err));
+			break;
+		}
+		m_numWorkers = i + 1;
+	}
+	pthread_attr_destroy ( &attr );
+
+	if ( m_numWorkers == 0 ) {
+		mfree ( m_ringBuf , m_ringBufSize , "ThreadPool" );
+		m_ringBuf = NULL;
+		return false;
+	}
+
+	log(LOG_INIT,"thread: Started %"INT32" thread pool workers.",
+	    m_numWorkers);
+	m_initialized = true;
+	return true;
+}
+
+static int32_t getClass ( ThreadEntry *t ) {
+	if ( t->m_niceness <= 0 ) return 0;
+	if ( t->m_niceness >= TP_CLASSES - 1 ) return TP_CLASSES - 1;
+	return t->m_niceness;
+}
+
+void ThreadPool::push ( ThreadEntry *t ) {
+	// deal them out round robin so each core gets work without stealing
+	PoolWorker *w = &m_workers[m_next];
+	if ( ++m_next >= m_numWorkers ) m_next = 0;
+	PoolDeque *d = &w->m_deques[getClass(t)];
+	pthread_mutex_lock ( &w->m_lock );
+	// init() sized the deques so this can not happen
+	if ( d->m_count >= d->m_size ) { char *xx=NULL;*xx=0; }
+	d->m_ring[(d->m_head + d->m_count) % d->m_size] = t;
+	d->m_count++;
+	pthread_mutex_unlock ( &w->m_lock );
+	// . count it and wake up a sleeping worker
+	// . we count it after it is in the deque, so a worker that sees
+	//   m_numQueued > 0 will find something to run
+	pthread_mutex_lock ( &m_sleepLock );
+	__sync_add_and_fetch ( &m_numQueued , 1 );
+	pthread_cond_signal ( &m_wake );
+	pthread_mutex_unlock ( &m_sleepLock );
+}
+
+ThreadEntry *ThreadPool::getWork ( PoolWorker *w ) {
+	for ( int32_t c = 0 ; c < TP_CLASSES ; c++ ) {
+		ThreadEntry *t = NULL;
+		// the oldest of our own first
+		PoolDeque *d = &w->m_deques[c];
+		pthread_mutex_lock ( &w->m_lock );
+		if ( d->m_count > 0 ) {
+			t = d->m_ring[d->m_head];
+			if ( ++d->m_head >= d->m_size ) d->m_head = 0;
+			d->m_count--;
+		}
+		pthread_mutex_unlock ( &w->m_lock );
+		if ( t ) {
+			__sync_sub_and_fetch ( &m_numQueued , 1 );
+			return t;
+		}
+		// . then steal the newest of this class from the others.
+		//   their owners take from the other end.
+		// . start at the next worker so we do not all rob the same one
+		for ( int32_t i = 1 ; i < m_numWorkers ; i++ ) {
+			PoolWorker *v = &m_workers[(w->m_id + i) % m_numWorkers];
+			d = &v->m_deques[c];
+			// peek without the lock, it is just a hint
+			if ( d->m_count <= 0 ) continue;
+			pthread_mutex_lock ( &v->m_lock );
+			if ( d->m_count > 0 ) {
+				d->m_count--;
+				t = d->m_ring[(d->m_head+d->m_count)%d->m_size];
+			}
+			pthread_mutex_unlock ( &v->m_lock );
+			if ( ! t ) continue;
+			__sync_sub_and_fetch ( &m_numQueued , 1 );
+			w->m_numStolen++;
+			return t;
+		}
+	}
+	return NULL;
+}
+
+void ThreadPool::workerLoop ( PoolWorker *w ) {
+	for ( ; ; ) {
+		ThreadEntry *t = getWork ( w );
+		if ( t ) {
+			run ( w , t );
+			continue;
+		}
+		// nothing anywhere, sleep until push() adds something
+		pthread_mutex_lock ( &m_sleepLock );
+		while ( m_numQueued <= 0 )
+			pthread_cond_wait ( &m_wake , &m_sleepLock );
+		pthread_mutex_unlock ( &m_sleepLock );
+	}
+}
+
+void ThreadPool::run ( PoolWorker *w , ThreadEntry *t ) {
+	// it was launched when the main thread pushed it, but it starts
+	// running now
+	t->m_launchedTime = gettimeofdayInMilliseconds();
+	// . call the startRoutine
+	// . IMPORTANT: this can NEVER do non-blocking stuff
+	t->m_startRoutine ( t->m_state , t );
+	int64_t now = gettimeofdayInMilliseconds();
+	t->m_preExitTime = now;
+	t->m_exitTime    = now;
+	w->m_numRun++;
+	if ( g_conf.m_logDebugThread )
+		log(LOG_DEBUG,"thread: [t=0x%"PTRFMT"] done in pool worker "
+		    "#%"INT32"",(PTRTYPE)t,w->m_id);
+	// . now mark it ready for ThreadQueue::cleanUp(), which will not
+	//   pthread_join() it since m_needsJoin is false
+	// . do not touch "t" after this, the main thread may reuse it
+	__sync_synchronize();
+	t->m_isDone = true;
+	g_threads.m_needsCleanup = true;
+	// breaks select() in Loop.cpp out of its sleep
+	g_threads.wakeMainThread();
+}
+
+void ThreadPool::printState ( ) {
+	if ( ! m_initialized ) return;
+	for ( int32_t i = 0 ; i < m_numWorkers ; i++ ) {
+		PoolWorker *w = &m_workers[i];
+		log(LOG_TIMING,
+		    "admin: Thread pool worker #%"INT32" "
+		    "queued: %"INT32" %"INT32" %"INT32" "
+		    "run: %"INT64" "
+		    "stolen: %"INT64"",
+		    i,
+		    w->m_deques[0].m_count,
+		    w->m_deques[1].m_count,
+		    w->m_deques[2].m_count,
+		    w->m_numRun,
+		    w->m_numStolen);
+	}
+}
+
+#else
+
+// the pool needs pthreads, isReady() always says no without them
+void ThreadPool::push       ( ThreadEntry *t ) { char *xx=NULL;*xx=0; }
+void ThreadPool::workerLoop ( PoolWorker  *w ) { }
+void ThreadPool::printState (                ) { }
+
+#endif
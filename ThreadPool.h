@@ -0,0 +1,104 @@
+// . a pool of persistent worker threads for the cpu bound thread types,
+//   MERGE_THREAD, INTERSECT_THREAD and PARSE_THREAD, so they can use every
+//   core instead of being held to the per type caps set in Threads::init()
+// . each worker has a deque per priority class, the class being the
+//   niceness of the ThreadEntry, 0, 1 or 2. the main thread deals the
+//   entries out to the workers round robin.
+// . a worker runs the oldest entry in its own deque of the best class. if
+//   it has none it steals the newest entry of that class from another
+//   worker before it looks at a lower class, so a niceness 0 intersection
+//   does not sit behind spider merges queued on another core.
+// . when an entry is done the worker marks it done and signals the main
+//   thread like startUp() in Threads.cpp does, so ThreadQueue::cleanUp()
+//   calls the callback just like before. the worker never touches the
+//   entry after marking it done because the main thread may reuse it.
+// . disk, unlink, savetree, filter and generic threads do not use the
+//   pool. they still get their own thread and stack, so disk i/o stays
+//   bounded by its own caps.
+
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <pthread.h>
+#include "Threads.h"
+
+#define TP_MAX_WORKERS 64
+// one class per niceness
+#define TP_CLASSES     (MAX_NICENESS+1)
+
+// a ring of entries, oldest at m_head
+class PoolDeque {
+ public:
+	ThreadEntry **m_ring;
+	int32_t       m_size;
+	int32_t       m_head;
+	int32_t       m_count;
+};
+
+class PoolWorker {
+ public:
+	PoolDeque       m_deques[TP_CLASSES];
+	// protects m_deques
+	pthread_mutex_t m_lock;
+	pthread_t       m_tid;
+	int32_t         m_id;
+	// stats, only the worker writes these
+	int64_t         m_numRun;
+	int64_t         m_numStolen;
+};
+
+class ThreadPool {
+
+ public:
+
+	ThreadPool();
+
+	// . is this thread type run in the pool if the pool is on?
+	bool isPoolType ( char type ) {
+		return ( type == MERGE_THREAD     ||
+			 type == INTERSECT_THREAD ||
+			 type == PARSE_THREAD     ); };
+
+	// . true if the pool parm is on and the workers are up. starts the
+	//   workers the first time it is called with the parm on.
+	// . main thread only
+	bool isReady ( ) ;
+
+	// . hand a launched entry to a worker
+	// . main thread only
+	void push ( ThreadEntry *t ) ;
+
+	// entries handed to the pool that no worker has picked up yet
+	int32_t getNumQueued  ( ) { return m_numQueued; };
+	int32_t getNumWorkers ( ) { return m_numWorkers; };
+
+	void printState ( ) ;
+
+	// called by each worker thread
+	void workerLoop ( PoolWorker *w ) ;
+
+ private:
+
+	bool         init    ( ) ;
+	ThreadEntry *getWork ( PoolWorker *w ) ;
+	void         run     ( PoolWorker *w , ThreadEntry *t ) ;
+
+	PoolWorker      m_workers[TP_MAX_WORKERS];
+	int32_t         m_numWorkers;
+	// the worker the next push() goes to
+	int32_t         m_next;
+	// idle workers sleep on m_wake
+	pthread_mutex_t m_sleepLock;
+	pthread_cond_t  m_wake;
+	volatile int32_t m_numQueued;
+	// the ring buffers for all the deques
+	char           *m_ringBuf;
+	int32_t         m_ringBufSize;
+	bool            m_initialized;
+	// do not keep trying to start the workers if it failed once
+	bool            m_failed;
+};
+
+extern class ThreadPool g_threadPool;
+
+#endif
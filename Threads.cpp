@@ -15,6 +15,7 @@
 #include "Profiler.h"
 #include "Stats.h"
 #include "Process.h"
+#include "ThreadPool.h"
 
 // try using pthreads again
 //#define PTHREADS
@@ -339,6 +340,12 @@ bool Threads::init ( ) {
 	// generic multipurpose
 	if ( ! g_threads.registerType (GENERIC_THREAD,20/*maxThreads*/,100) ) 
 		return log("thread: Failed to register thread type." );
+	// . XmlDoc parses and hashes docs in these. they only run in the
+	//   thread pool, so maxThreads just keeps them from taking the
+	//   stacks the disk threads need if the pool gets turned off.
+	// . one entry per XmlDoc being indexed at the same time
+	if ( ! g_threads.registerType (PARSE_THREAD,2/*maxThreads*/,500) ) 
+		return log("thread: Failed to register thread type." );
 	// for call SSL_accept() which blocks for 10ms even when socket
 	// is non-blocking...
 	//if (!g_threads.registerType (SSLACCEPT_THREAD,20/*maxThreads*/,100)) 
@@ -2102,6 +2109,27 @@ int32_t Threads::getNumActiveHighPriorityThreads() {
 // . i.e. don't launch a high niceness thread if a low niceness is running
 bool ThreadQueue::launchThread2 ( ) {
 
+	// . merge and intersect threads go to the work stealing pool if it
+	//   is on. it runs them by niceness on every core, so they do not
+	//   need a stack or the per type cap below, and they do not wait for
+	//   high priority cpu threads because the pool does that ordering.
+	// . disk threads keep their own stacks and caps
+	if ( g_threadPool.isPoolType ( m_threadType ) &&
+	     g_threadPool.isReady ( ) ) {
+		ThreadEntry **bestHeadPtr = &m_waitHead0;
+		ThreadEntry **bestTailPtr = &m_waitTail0;
+		if ( ! *bestHeadPtr ) {
+			bestHeadPtr = &m_waitHead1;
+			bestTailPtr = &m_waitTail1;
+		}
+		if ( ! *bestHeadPtr ) {
+			bestHeadPtr = &m_waitHead2;
+			bestTailPtr = &m_waitTail2;
+		}
+		if ( ! *bestHeadPtr ) return false;
+		return launchThreadIntoPool ( bestHeadPtr , bestTailPtr );
+	}
+
 	// or if no stacks left, don't even try
 	if ( s_head == -1 ) return false;
 	// . how many threads are active now?
@@ -2516,6 +2544,36 @@ bool ThreadQueue::launchThread2 ( ) {
 	*/
 }
 
+bool ThreadQueue::launchThreadIntoPool ( ThreadEntry **headPtr ,
+					 ThreadEntry **tailPtr ) {
+
+	ThreadEntry *t = *headPtr;
+
+	if ( g_conf.m_logDebugThread )
+		log(LOG_DEBUG,"thread: [t=0x%"PTRFMT"] launched %s thread "
+		    "into pool. niceness=%"INT32". waited %"UINT64" ms in "
+		    "queue.",
+		    (PTRTYPE)t, getThreadType(), t->m_niceness ,
+		    gettimeofdayInMilliseconds() - t->m_queuedTime);
+
+	// remove from waiting linked list, whichever one it was in
+	removeLink2 ( headPtr , tailPtr , t );
+	// add to 'launched' linked list so cleanUp() finds it when done
+	addLink ( &m_launchedHead , t );
+	t->m_bestHeadPtr = headPtr;
+	t->m_bestTailPtr = tailPtr;
+
+	m_launched++;
+	t->m_isLaunched   = true;
+	t->m_launchedTime = gettimeofdayInMilliseconds();
+	// a pool worker is not ours to join and has no stack of ours
+	t->m_needsJoin    = false;
+	t->m_stack        = NULL;
+
+	g_threadPool.push ( t );
+	return true;
+}
+
 bool ThreadQueue::launchThreadForReals ( ThreadEntry **headPtr ,
 					 ThreadEntry **tailPtr ) {
 
@@ -3076,6 +3134,16 @@ int startUp ( void *state ) {
 	return 0;
 }
 
+void Threads::wakeMainThread ( ) {
+#ifndef PTHREADS
+	sigval_t svt; 
+	svt.sival_int = 1;
+	sigqueue ( (pid_t)(int64_t)s_pid, SIGCHLD, svt ) ;
+#else
+	pthread_kill ( s_pid , SIGCHLD );
+#endif
+}
+
 // pthread_create uses this one
 void *startUp2 ( void *state ) {
   startUp ( state );
@@ -3140,6 +3208,7 @@ const char *ThreadQueue::getThreadType ( ) {
 	if ( m_threadType == SAVETREE_THREAD  ) s = "savetree";
 	if ( m_threadType == UNLINK_THREAD    ) s = "unlink";
 	if ( m_threadType == GENERIC_THREAD   ) s = "generic";
+	if ( m_threadType == PARSE_THREAD     ) s = "parse";
 	return s;
 }
 
@@ -3344,6 +3413,8 @@ void Threads::printState() {
 			
 		}
 	}
+
+	g_threadPool.printState();
 }
 
 void ThreadQueue::killAllThreads ( ) {
@@ -3351,6 +3422,9 @@ void ThreadQueue::killAllThreads ( ) {
 		ThreadEntry *e = &m_entries[i];
 		if ( ! e->m_isOccupied ) continue;
 		if ( ! e->m_isLaunched ) continue;
+		// . pool threads are not ours to kill and m_joinTid is not
+		//   set for the entries they run, see launchThreadIntoPool()
+		if ( ! e->m_needsJoin ) continue;
 		log("threads: killling thread id %i",(int)e->m_joinTid);
 		pthread_kill ( e->m_joinTid , SIGKILL );
 		log("threads: joining with thread id %i",(int)e->m_joinTid);
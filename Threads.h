@@ -6,7 +6,7 @@
 #ifndef _GBTHREADS_
 #define _GBTHREADS_
 
-#define MAX_THREAD_QUEUES 7
+#define MAX_THREAD_QUEUES 8
 
 #include <sys/types.h>  // pid_t
 
@@ -28,6 +28,8 @@ pthread_t getpidtid();
 #define SAVETREE_THREAD  4
 #define UNLINK_THREAD    5
 #define GENERIC_THREAD   6
+// XmlDoc's cpu heavy indexing stages, see XmlDoc::launchStage()
+#define PARSE_THREAD     7
 //#define SSLACCEPT_THREAD 7
 //#define GB_SIGRTMIN	 (SIGRTMIN+4)
 #define MAX_NICENESS     2
@@ -187,6 +189,10 @@ class ThreadQueue {
 	bool launchThreadForReals ( ThreadEntry **headPtr ,
 				    ThreadEntry **tailPtr ) ;
 
+	// hand the entry to g_threadPool instead of giving it its own thread
+	bool launchThreadIntoPool ( ThreadEntry **headPtr ,
+				    ThreadEntry **tailPtr ) ;
+
 	void removeThreads2 ( ThreadEntry **headPtr ,
 			      ThreadEntry **tailPtr ,
 			      class BigFile *bf ) ;
@@ -251,6 +257,10 @@ class Threads {
 
 	void killAllThreads();
 
+	// . a thread calls this after marking its entry done so Loop.cpp
+	//   wakes up and calls cleanUp()
+	void wakeMainThread ( ) ;
+
 	// . returns false and sets errno if thread launch failed
 	// . returns true on success
 	// . when thread is done a signal will be put on the g_loop's
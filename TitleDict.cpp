@@ -0,0 +1,421 @@
+#include "gb-include.h"
+
+#include "TitleDict.h"
+#include "XmlDoc.h"
+#include "Collectiondb.h"
+#include "Threads.h"
+#include "Stats.h"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+TitleDicts g_titleDicts;
+
+// train when we have this many samples or this many bytes of them
+#define TITLEDICT_SAMPLES      4000
+#define TITLEDICT_SAMPLE_BYTES (8*1024*1024)
+// only use the first this many bytes of each titlerec to train
+#define TITLEDICT_MAX_SAMPLE   (64*1024)
+// the size of the dictionary to train
+#define TITLEDICT_SIZE         (112*1024)
+// we can have up to this many dictionaries per collection
+#define TITLEDICT_MAX_NUM      1024
+
+// . the dict id is made from the collnum and the dict #, so we know what
+//   collection dir to load a dict from when uncompressing
+// . ids below 32768 are reserved by zstd
+static uint32_t makeDictId ( collnum_t collnum , int32_t num ) {
+	return 32768 + ((uint32_t)collnum << 10) + (uint32_t)num;
+}
+
+static collnum_t getCollnumFromDictId ( uint32_t dictId ) {
+	return (collnum_t)((dictId - 32768) >> 10);
+}
+
+class TitleDictTrainer {
+ public:
+	collnum_t m_collnum;
+	// the samples back to back, and the size_t size of each one
+	SafeBuf   m_samples;
+	SafeBuf   m_sizes;
+	int32_t   m_numSamples;
+	// set when the thread is launched, we stop taking samples then
+	bool      m_launched;
+	// the trained dict, set in the thread
+	char     *m_dict;
+	int32_t   m_dictSize;
+};
+
+int32_t titleRecCompressBound ( int32_t srcLen ) {
+	// . according to zlib.h line 613 compress buffer must be .1% larger
+	//   than source plus 12 bytes. (i add one for round off error)
+	// . now i added another extra 12 bytes cuz compress seemed to want it
+	int32_t need = ((int64_t)srcLen * 1001LL) / 1000LL + 13 + 12;
+#ifdef HAVE_ZSTD
+	int32_t need2 = ZSTD_compressBound ( srcLen );
+	if ( need2 > need ) need = need2;
+#endif
+	return need;
+}
+
+int32_t titleRecCompress ( collnum_t  collnum ,
+			   char      *dest    ,
+			   int32_t   *destLen ,
+			   char      *src     ,
+			   int32_t    srcLen  ) {
+#ifdef HAVE_ZSTD
+	TitleDict *td = NULL;
+	if ( g_conf.m_useZstdTitleRecs )
+		td = g_titleDicts.getCompressDict ( collnum );
+	// . keep zlib until the collection has a dictionary, a zstd frame
+	//   without one is not much smaller
+	// . save this titlerec to train the dictionary with
+	if ( g_conf.m_useZstdTitleRecs && ! td )
+		g_titleDicts.addSample ( collnum , src , srcLen );
+	if ( td ) {
+		// we are only called from the main thread
+		static ZSTD_CCtx *s_cctx = NULL;
+		if ( ! s_cctx ) s_cctx = ZSTD_createCCtx();
+		if ( ! s_cctx ) { g_errno = ENOMEM; return -1; }
+		size_t n = ZSTD_compress_usingCDict ( s_cctx ,
+						      dest , *destLen ,
+						      src  , srcLen ,
+						      (ZSTD_CDict *)td->m_cdict );
+		if ( ZSTD_isError ( n ) ) {
+			g_errno = ECOMPRESSFAILED;
+			log("db: zstd compress of titlerec failed: %s",
+			    ZSTD_getErrorName(n));
+			return -1;
+		}
+		*destLen = n;
+		return TRC_ZSTD;
+	}
+#endif
+	uint32_t size = *destLen;
+	int err = gbcompress ( (unsigned char *)dest ,
+			       &size ,
+			       (unsigned char *)src ,
+			       (uint32_t)srcLen );
+	if ( err != Z_OK || size > (uint32_t)*destLen ) {
+		g_errno = ECOMPRESSFAILED;
+		log("db: Failed to compress document of %"INT32" bytes.",
+		    srcLen);
+		return -1;
+	}
+	*destLen = size;
+	return TRC_ZLIB;
+}
+
+bool titleRecUncompress ( char     codec   ,
+			  char    *dest    ,
+			  int32_t *destLen ,
+			  char    *src     ,
+			  int32_t  srcLen  ) {
+	if ( codec == TRC_ZLIB ) {
+		uint32_t size = *destLen;
+		int err = gbuncompress ( (unsigned char *)dest ,
+					 &size ,
+					 (unsigned char *)src ,
+					 (uint32_t)srcLen );
+		// hmmmm...
+		if ( err == Z_BUF_ERROR ) {
+			log("db: Buffer is too small to hold uncompressed "
+			    "document. Probable disk corruption in a titledb "
+			    "file.");
+			g_errno = EUNCOMPRESSERROR;
+			return false;
+		}
+		if ( err != Z_OK ) {
+			g_errno = EUNCOMPRESSERROR;
+			return log("db: Uncompress of document failed. "
+				   "ZG_ERRNO=%i. srcLen=%"INT32" "
+				   "destLen=%"INT32"",
+				   err , srcLen , *destLen );
+		}
+		*destLen = size;
+		return true;
+	}
+#ifdef HAVE_ZSTD
+	if ( codec == TRC_ZSTD ) {
+		uint32_t dictId = ZSTD_getDictID_fromFrame ( src , srcLen );
+		TitleDict *td = NULL;
+		if ( dictId ) td = g_titleDicts.getUncompressDict ( dictId );
+		if ( dictId && ! td ) {
+			g_errno = EUNCOMPRESSERROR;
+			return log("db: Missing titledict for dict id "
+				   "%"UINT32". Can not uncompress titlerec.",
+				   dictId);
+		}
+		// a disk thread never sets an XmlDoc, but be safe
+		static ZSTD_DCtx *s_dctx = NULL;
+		ZSTD_DCtx *dctx = s_dctx;
+		bool isThread = g_threads.amThread();
+		if ( isThread     ) dctx = ZSTD_createDCtx();
+		else if ( ! dctx ) dctx = s_dctx = ZSTD_createDCtx();
+		if ( ! dctx ) { g_errno = ENOMEM; return false; }
+		size_t n;
+		if ( td ) n = ZSTD_decompress_usingDDict ( dctx ,
+						   dest , *destLen ,
+						   src  , srcLen ,
+						   (ZSTD_DDict *)td->m_ddict );
+		else      n = ZSTD_decompressDCtx ( dctx ,
+						    dest , *destLen ,
+						    src  , srcLen );
+		if ( isThread ) ZSTD_freeDCtx ( dctx );
+		if ( ZSTD_isError ( n ) ) {
+			g_errno = EUNCOMPRESSERROR;
+			return log("db: zstd uncompress of titlerec failed: "
+				   "%s. srcLen=%"INT32" destLen=%"INT32"",
+				   ZSTD_getErrorName(n), srcLen, *destLen);
+		}
+		*destLen = n;
+		return true;
+	}
+#endif
+	g_errno = EUNCOMPRESSERROR;
+	return log("db: Titlerec has unsupported compression codec %"INT32". "
+		   "Was it made by a gb compiled with zstd?",(int32_t)codec);
+}
+
+TitleDicts::TitleDicts() {
+	m_initialized = false;
+}
+
+void TitleDicts::reset() {
+#ifdef HAVE_ZSTD
+	for ( int32_t i = 0 ; i < m_byId.getNumSlots() ; i++ ) {
+		if ( ! m_byId.m_flags[i] ) continue;
+		TitleDict *td = *(TitleDict **)m_byId.getValueFromSlot(i);
+		ZSTD_freeCDict ( (ZSTD_CDict *)td->m_cdict );
+		ZSTD_freeDDict ( (ZSTD_DDict *)td->m_ddict );
+		mdelete ( td , sizeof(TitleDict) , "TitleDict" );
+		delete ( td );
+	}
+#endif
+	// trainers in a thread are leaked, we are exiting anyway
+	m_byId    .reset();
+	m_byColl  .reset();
+	m_nextNum .reset();
+	m_trainers.reset();
+	m_initialized = false;
+}
+
+bool TitleDicts::init ( ) {
+	if ( m_initialized ) return true;
+	if ( ! m_byId.set ( 4 , sizeof(TitleDict *) , 32 , NULL , 0 ,
+			    false , 0 , "tdictid" ) )
+		return false;
+	if ( ! m_byColl.set ( sizeof(collnum_t) , sizeof(TitleDict *) , 32 ,
+			      NULL , 0 , false , 0 , "tdictcoll" ) )
+		return false;
+	if ( ! m_nextNum.set ( sizeof(collnum_t) , 4 , 32 , NULL , 0 ,
+			       false , 0 , "tdictnum" ) )
+		return false;
+	if ( ! m_trainers.set ( sizeof(collnum_t) , sizeof(TitleDictTrainer *),
+				32 , NULL , 0 , false , 0 , "tdicttrain" ) )
+		return false;
+	m_initialized = true;
+	return true;
+}
+
+TitleDict *TitleDicts::getCompressDict ( collnum_t collnum ) {
+	if ( ! init() ) return NULL;
+	loadDicts ( collnum );
+	TitleDict **tdp = (TitleDict **)m_byColl.getValue ( &collnum );
+	if ( ! tdp ) return NULL;
+	return *tdp;
+}
+
+TitleDict *TitleDicts::getUncompressDict ( uint32_t dictId ) {
+	if ( ! init() ) return NULL;
+	TitleDict **tdp = (TitleDict **)m_byId.getValue ( &dictId );
+	if ( tdp ) return *tdp;
+	// maybe we have not loaded the dicts of its collection yet
+	loadDicts ( getCollnumFromDictId ( dictId ) );
+	tdp = (TitleDict **)m_byId.getValue ( &dictId );
+	if ( tdp ) return *tdp;
+	return NULL;
+}
+
+TitleDict *TitleDicts::addDict ( collnum_t collnum , uint32_t dictId ,
+				 char *buf , int32_t bufSize ) {
+#ifdef HAVE_ZSTD
+	TitleDict *td;
+	try { td = new (TitleDict); }
+	catch ( ... ) {
+		g_errno = ENOMEM;
+		log("db: new(%i): %s",(int)sizeof(TitleDict),
+		    mstrerror(g_errno));
+		return NULL;
+	}
+	mnew ( td , sizeof(TitleDict) , "TitleDict" );
+	td->m_dictId  = dictId;
+	td->m_collnum = collnum;
+	// these copy the dict
+	td->m_cdict = ZSTD_createCDict ( buf , bufSize ,
+					 g_conf.m_zstdTitleRecLevel );
+	td->m_ddict = ZSTD_createDDict ( buf , bufSize );
+	if ( ! td->m_cdict || ! td->m_ddict ||
+	     ! m_byId.addKey ( &dictId , &td ) ) {
+		ZSTD_freeCDict ( (ZSTD_CDict *)td->m_cdict );
+		ZSTD_freeDDict ( (ZSTD_DDict *)td->m_ddict );
+		mdelete ( td , sizeof(TitleDict) , "TitleDict" );
+		delete ( td );
+		g_errno = ENOMEM;
+		log("db: Failed to load titledict %"UINT32".",dictId);
+		return NULL;
+	}
+	return td;
+#else
+	return NULL;
+#endif
+}
+
+void TitleDicts::loadDicts ( collnum_t collnum ) {
+	// already loaded?
+	if ( m_nextNum.getValue ( &collnum ) ) return;
+	CollectionRec *cr = g_collectiondb.getRec ( collnum );
+	if ( ! cr ) return;
+	int32_t num = 0;
+	for ( ; num < TITLEDICT_MAX_NUM ; num++ ) {
+		char filename[1024];
+		snprintf ( filename , 1024 ,
+			   "%scoll.%s.%"INT32"/titledict%04"INT32".dat",
+			   g_hostdb.m_dir , cr->m_coll , (int32_t)collnum ,
+			   num );
+		SafeBuf sb;
+		if ( sb.fillFromFile ( filename ) <= 0 ) break;
+		uint32_t dictId = makeDictId ( collnum , num );
+		TitleDict *td = addDict ( collnum , dictId ,
+					  sb.getBufStart() , sb.length() );
+		if ( ! td ) continue;
+		m_byColl.removeKey ( &collnum );
+		m_byColl.addKey ( &collnum , &td );
+	}
+	if ( num > 0 )
+		log(LOG_INFO,"db: Loaded %"INT32" titledicts for collection "
+		    "%s.",num,cr->m_coll);
+	m_nextNum.addKey ( &collnum , &num );
+}
+
+#ifdef HAVE_ZSTD
+static void *trainStartWrapper_r ( void *state , ThreadEntry *t ) {
+	TitleDictTrainer *tr = (TitleDictTrainer *)state;
+	tr->m_dictSize = 0;
+	tr->m_dict = (char *)mmalloc ( TITLEDICT_SIZE , "TitleDictBuf" );
+	if ( ! tr->m_dict ) return NULL;
+	size_t n = ZDICT_trainFromBuffer ( tr->m_dict , TITLEDICT_SIZE ,
+					   tr->m_samples.getBufStart() ,
+					   (size_t *)tr->m_sizes.getBufStart(),
+					   tr->m_numSamples );
+	if ( ZDICT_isError ( n ) ) return NULL;
+	tr->m_dictSize = n;
+	return NULL;
+}
+
+static void trainDoneWrapper ( void *state , ThreadEntry *t ) {
+	g_titleDicts.doneTraining ( (TitleDictTrainer *)state );
+}
+#endif
+
+void TitleDicts::addSample ( collnum_t collnum , char *rec , int32_t recSize ) {
+#ifdef HAVE_ZSTD
+	if ( ! init() ) return;
+	TitleDictTrainer **trp;
+	trp = (TitleDictTrainer **)m_trainers.getValue ( &collnum );
+	TitleDictTrainer *tr = NULL;
+	if ( trp ) tr = *trp;
+	if ( tr && tr->m_launched ) return;
+	if ( ! tr ) {
+		try { tr = new (TitleDictTrainer); }
+		catch ( ... ) { g_errno = 0; return; }
+		mnew ( tr , sizeof(TitleDictTrainer) , "TitleDictTr" );
+		tr->m_collnum    = collnum;
+		tr->m_numSamples = 0;
+		tr->m_launched   = false;
+		tr->m_dict       = NULL;
+		tr->m_dictSize   = 0;
+		if ( ! m_trainers.addKey ( &collnum , &tr ) ) {
+			mdelete ( tr , sizeof(TitleDictTrainer),"TitleDictTr");
+			delete ( tr );
+			g_errno = 0;
+			return;
+		}
+	}
+	if ( recSize > TITLEDICT_MAX_SAMPLE ) recSize = TITLEDICT_MAX_SAMPLE;
+	size_t size = recSize;
+	if ( ! tr->m_samples.safeMemcpy ( rec , recSize ) ||
+	     ! tr->m_sizes.safeMemcpy ( (char *)&size , sizeof(size_t) ) ) {
+		g_errno = 0;
+		return;
+	}
+	tr->m_numSamples++;
+	if ( tr->m_numSamples < TITLEDICT_SAMPLES &&
+	     tr->m_samples.length() < TITLEDICT_SAMPLE_BYTES )
+		return;
+	// . train it in a thread, it takes a second or two
+	// . if we can not launch a thread now, try again next sample
+	tr->m_launched = true;
+	if ( g_threads.call ( GENERIC_THREAD      ,
+			      MAX_NICENESS        ,
+			      tr                  ,
+			      trainDoneWrapper    ,
+			      trainStartWrapper_r ) )
+		return;
+	g_errno = 0;
+	tr->m_launched = false;
+#endif
+}
+
+void TitleDicts::doneTraining ( TitleDictTrainer *tr ) {
+	collnum_t collnum = tr->m_collnum;
+	m_trainers.removeKey ( &collnum );
+	CollectionRec *cr = g_collectiondb.getRec ( collnum );
+	// make sure we know the next dict # to use
+	if ( cr ) loadDicts ( collnum );
+	int32_t *nump = (int32_t *)m_nextNum.getValue ( &collnum );
+	// . the dict starts with a magic number and then its id
+	// . use our own id so we know the collection from it
+	if ( cr && nump && *nump < TITLEDICT_MAX_NUM &&
+	     tr->m_dictSize > 8 &&
+	     *(uint32_t *)tr->m_dict == 0xEC30A437 ) {
+		int32_t  num    = *nump;
+		uint32_t dictId = makeDictId ( collnum , num );
+		*(uint32_t *)(tr->m_dict + 4) = dictId;
+		char filename[1024];
+		snprintf ( filename , 1024 ,
+			   "%scoll.%s.%"INT32"/titledict%04"INT32".dat",
+			   g_hostdb.m_dir , cr->m_coll , (int32_t)collnum ,
+			   num );
+		// . save it before we compress anything with it
+		// . it is only ~100k
+		SafeBuf sb;
+		sb.setBuf ( tr->m_dict , tr->m_dictSize , tr->m_dictSize ,
+			    false );
+		TitleDict *td = NULL;
+		if ( sb.dumpToFile ( filename ) < 0 )
+			log("db: Failed to save %s: %s",filename,
+			    mstrerror(g_errno));
+		else
+			td = addDict ( collnum , dictId , tr->m_dict ,
+				       tr->m_dictSize );
+		if ( td ) {
+			m_byColl.removeKey ( &collnum );
+			m_byColl.addKey ( &collnum , &td );
+			*nump = num + 1;
+			log("db: Trained titledict %s from %"INT32" titlerecs "
+			    "for collection %s.",
+			    filename,tr->m_numSamples,cr->m_coll);
+		}
+	}
+	else if ( cr ) {
+		log("db: Failed to train titledict for collection %s.",
+		    cr->m_coll);
+	}
+	g_errno = 0;
+	if ( tr->m_dict ) mfree ( tr->m_dict , TITLEDICT_SIZE , "TitleDictBuf");
+	mdelete ( tr , sizeof(TitleDictTrainer) , "TitleDictTr" );
+	delete ( tr );
+}
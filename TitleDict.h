@@ -0,0 +1,100 @@
+// Copyright Matt Wells
+
+// . versioned compression of titledb records
+// . a titlerec is key, dataSize, uncompressed size, compressed data. the
+//   top bits of the uncompressed size now say what codec compressed the
+//   data. old titlerecs have 0 there, which is zlib.
+// . zstd compression uses a dictionary trained on the titlerecs of the
+//   collection, so the small titlerecs compress much better. the first
+//   titlerecs of a collection are sampled and the dictionary is trained in
+//   a thread, saved to the collection's dir as titledict<n>.dat, and then
+//   used for all titlerecs added after that.
+// . the dictionary id is stored in each zstd frame, so we can still
+//   uncompress titlerecs compressed with older dictionaries.
+// . zstd is only compiled in if HAVE_ZSTD is defined, see the Makefile.
+//   without it we still compress with zlib and can not read zstd titlerecs.
+
+#ifndef _TITLEDICT_H_
+#define _TITLEDICT_H_
+
+#include "SafeBuf.h"
+#include "HashTableX.h"
+
+#define TRC_ZLIB 0
+#define TRC_ZSTD 1
+
+// the codec is in these bits of the uncompressed size in the titlerec
+#define TRC_CODEC_SHIFT 28
+#define TRC_SIZE_MASK   0x0fffffff
+
+// . how big of a buf to give titleRecCompress()
+int32_t titleRecCompressBound ( int32_t srcLen );
+
+// . compress a titlerec of collection "collnum" into "dest"
+// . sets *destLen to the compressed size
+// . returns the codec used, or -1 and sets g_errno on error
+int32_t titleRecCompress ( collnum_t  collnum ,
+			   char      *dest    ,
+			   int32_t   *destLen ,
+			   char      *src     ,
+			   int32_t    srcLen  );
+
+// . uncompress a titlerec compressed with "codec"
+// . *destLen is the size of "dest" and is set to the uncompressed size
+// . returns false and sets g_errno on error
+bool titleRecUncompress ( char     codec   ,
+			  char    *dest    ,
+			  int32_t *destLen ,
+			  char    *src     ,
+			  int32_t  srcLen  );
+
+class TitleDict {
+ public:
+	uint32_t  m_dictId;
+	collnum_t m_collnum;
+	// ZSTD_CDict and ZSTD_DDict
+	void     *m_cdict;
+	void     *m_ddict;
+};
+
+// the dictionaries of all the collections
+class TitleDicts {
+
+ public:
+
+	TitleDicts();
+	void reset();
+
+	// the newest dictionary of the collection, for compressing
+	TitleDict *getCompressDict   ( collnum_t collnum );
+	// the dictionary a titlerec was compressed with
+	TitleDict *getUncompressDict ( uint32_t dictId );
+
+	// remember this titlerec for training if we have no dict yet
+	void addSample ( collnum_t collnum , char *rec , int32_t recSize );
+
+	// called by the training thread's callback
+	void doneTraining ( class TitleDictTrainer *t );
+
+ private:
+
+	bool       init ( );
+	// load titledict<n>.dat files from the collection's dir
+	void       loadDicts ( collnum_t collnum );
+	TitleDict *addDict   ( collnum_t collnum , uint32_t dictId ,
+			       char *buf , int32_t bufSize );
+
+	bool m_initialized;
+	// dictId -> TitleDict *
+	HashTableX m_byId;
+	// collnum -> newest TitleDict *
+	HashTableX m_byColl;
+	// collnum -> next dict # on disk, -1 if not loaded yet
+	HashTableX m_nextNum;
+	// collnum -> TitleDictTrainer *, while sampling or training
+	HashTableX m_trainers;
+};
+
+extern class TitleDicts g_titleDicts;
+
+#endif
@@ -179,6 +179,8 @@ void UdpServer::reset() {
 	m_slots = NULL;
 	if ( m_buf ) mfree ( m_buf , m_bufSize , "UdpServer");
 	m_buf = NULL;
+	if ( m_batchBuf ) mfree ( m_batchBuf , m_batchBufSize , "UdpBatch" );
+	m_batchBuf = NULL;
 	/*
 	// clear this
 	m_isShuttingDown = false;
@@ -209,8 +211,20 @@ UdpServer::UdpServer ( ) {
 	m_buf = NULL;
 	m_outstandingConverts = 0;
 	m_writeRegistered = false;
+	m_batchBuf = NULL;
+	m_recvNum = 0;
+	m_recvCur = 0;
+	m_sendNum = 0;
+	m_sendCur = 0;
+	m_deferFlush = false;
 }
 
+// . so udpRecvfrom() and udpSendmsg() can map the socket UdpSlot gives them
+//   back to its UdpServer
+#define MAX_UDP_SERVERS 8
+static UdpServer *s_servers [ MAX_UDP_SERVERS ];
+static int32_t    s_numServers = 0;
+
 UdpServer::~UdpServer() {
 	reset();
 }
@@ -462,6 +476,57 @@ bool UdpServer::init ( uint16_t port, UdpProtocol *proto, int32_t niceness,
 	m_outsiderPacketsOut = 0LL;
 	m_outsiderBytesOut   = 0LL;
 
+	m_recvCalls  = 0LL;
+	m_recvDgrams = 0LL;
+	m_sendCalls  = 0LL;
+	m_sendDgrams = 0LL;
+
+	// . set up the recvmmsg()/sendmmsg() staging areas if we should
+	// . each received dgram gets a DGRAM_SIZE_CEILING buffer so we never
+	//   truncate, but sent dgrams just need room for their header
+	m_recvNum    = 0;
+	m_recvCur    = 0;
+	m_sendNum    = 0;
+	m_sendCur    = 0;
+	m_deferFlush = false;
+	if ( s_numServers < MAX_UDP_SERVERS )
+		s_servers [ s_numServers++ ] = this;
+	if ( g_conf.m_udpBatchIo && ! m_batchBuf ) {
+		int32_t n = UDP_BATCH_SIZE;
+		int32_t fixed = n * ( 2 * sizeof(mmsghdr) + 3 * sizeof(iovec) +
+				      2 * sizeof(sockaddr_in) +
+				      sizeof(UdpSlot *) );
+		m_batchBufSize = fixed + n * ( DGRAM_SIZE_CEILING + UDP_MAX_HDR );
+		m_batchBuf = (char *)mmalloc ( m_batchBufSize , "UdpBatch" );
+		if ( ! m_batchBuf )
+			return log("udp: Failed to allocate %"INT32" bytes for "
+				   "batched dgram io.",m_batchBufSize);
+		memset ( m_batchBuf , 0 , fixed );
+		char *p = m_batchBuf;
+		m_recvMsgs  = (mmsghdr     *)p; p += n * sizeof(mmsghdr);
+		m_sendMsgs  = (mmsghdr     *)p; p += n * sizeof(mmsghdr);
+		m_recvIovs  = (iovec       *)p; p += n * sizeof(iovec);
+		m_sendIovs  = (iovec       *)p; p += 2 * n * sizeof(iovec);
+		m_recvFrom  = (sockaddr_in *)p; p += n * sizeof(sockaddr_in);
+		m_sendTo    = (sockaddr_in *)p; p += n * sizeof(sockaddr_in);
+		m_sendSlots = (UdpSlot    **)p; p += n * sizeof(UdpSlot *);
+		m_recvBufs  = p;                p += n * DGRAM_SIZE_CEILING;
+		m_sendHdrs  = p;                p += n * UDP_MAX_HDR;
+		// point each msg at its buffer and address, these never move
+		for ( int32_t i = 0 ; i < n ; i++ ) {
+			m_recvIovs[i].iov_base = m_recvBufs+i*DGRAM_SIZE_CEILING;
+			m_recvIovs[i].iov_len  = DGRAM_SIZE_CEILING;
+			m_recvMsgs[i].msg_hdr.msg_iov     = &m_recvIovs[i];
+			m_recvMsgs[i].msg_hdr.msg_iovlen  = 1;
+			m_recvMsgs[i].msg_hdr.msg_name    = &m_recvFrom[i];
+			m_sendIovs[2*i].iov_base = m_sendHdrs + i * UDP_MAX_HDR;
+			m_sendMsgs[i].msg_hdr.msg_iov     = &m_sendIovs[2*i];
+			m_sendMsgs[i].msg_hdr.msg_iovlen  = 2;
+			m_sendMsgs[i].msg_hdr.msg_name    = &m_sendTo[i];
+			m_sendMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		}
+	}
+
 	// log an innocent msg
 	//log ( 0, "udp: listening on port %hu with sd=%"INT32" and "
 	//      "niceness=%"INT32"", m_port, m_sock, m_niceness );
@@ -805,6 +870,174 @@ void sendPollWrapper_ass ( int fd , void *state ) {
 	THIS->sendPoll_ass ( true , g_now );
 }
 
+// . returns -1 and sets errno on error like recvfrom()
+// . returns the next dgram from the last recvmmsg() call, calling it
+//   again when we have handed them all out
+int UdpServer::recvDgram ( void *buf , int len , int flags ,
+			   sockaddr *from , socklen_t *fromLen ) {
+	if ( m_recvCur >= m_recvNum ) {
+		m_recvNum = 0;
+		m_recvCur = 0;
+		// the kernel shrinks these to the address size it stored
+		for ( int32_t i = 0 ; i < UDP_BATCH_SIZE ; i++ )
+			m_recvMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+	retry:
+		int n = recvmmsg ( m_sock , m_recvMsgs , UDP_BATCH_SIZE ,
+				   MSG_DONTWAIT , NULL );
+		m_recvCalls++;
+		if ( n < 0 && errno == EINTR ) goto retry;
+		if ( n <= 0 ) return n;
+		m_recvDgrams += n;
+		m_recvNum     = n;
+	}
+	mmsghdr *m    = &m_recvMsgs[m_recvCur];
+	int      size = m->msg_len;
+	// like recvfrom() we silently truncate if caller's buf is too small
+	if ( size > len ) size = len;
+	memcpy_ass ( buf , m_recvBufs + m_recvCur * DGRAM_SIZE_CEILING , size );
+	if ( from && fromLen ) {
+		socklen_t fl = m->msg_hdr.msg_namelen;
+		if ( fl > *fromLen ) fl = *fromLen;
+		memcpy_ass ( from , &m_recvFrom[m_recvCur] , fl );
+		*fromLen = fl;
+	}
+	// a peek leaves the dgram there for the real read
+	if ( ! ( flags & MSG_PEEK ) ) m_recvCur++;
+	return size;
+}
+
+// . returns -1 and sets errno to EAGAIN if the send queue is full and
+//   the socket is still not writable, otherwise returns the dgram size
+// . only the header is copied, "data" is sent from where it is
+int UdpServer::sendDgram ( char *hdr , int hdrSize , char *data ,
+			   int dataSize , sockaddr_in *to , UdpSlot *slot ) {
+	// make room if we need to
+	if ( m_sendNum >= UDP_BATCH_SIZE ) flushSends();
+	if ( m_sendNum >= UDP_BATCH_SIZE ) { errno = EAGAIN; return -1; }
+	// sanity check
+	if ( hdrSize > UDP_MAX_HDR ) { char *xx=NULL;*xx=0; }
+	int32_t i = m_sendNum++;
+	memcpy_ass ( m_sendHdrs + i * UDP_MAX_HDR , hdr , hdrSize );
+	m_sendIovs[2*i  ].iov_len  = hdrSize;
+	m_sendIovs[2*i+1].iov_base = data;
+	m_sendIovs[2*i+1].iov_len  = dataSize;
+	m_sendTo   [i]             = *to;
+	m_sendSlots[i]             = slot;
+	return hdrSize + dataSize;
+}
+// . write the send queue with as few sendmmsg() calls as we can
+// . returns true if the queue is empty, false if the socket blocked
+bool UdpServer::flushSends ( ) {
+	if ( m_sendNum == 0 ) return true;
+	// if we were shut down just drop them
+	if ( m_sock < 0 ) { m_sendNum = 0; m_sendCur = 0; return true; }
+	while ( m_sendCur < m_sendNum ) {
+		int n = sendmmsg ( m_sock , &m_sendMsgs[m_sendCur] ,
+				   m_sendNum - m_sendCur , MSG_DONTWAIT );
+		m_sendCalls++;
+		if ( n > 0 ) { m_sendDgrams += n; m_sendCur += n; continue; }
+		if ( errno == EINTR ) continue;
+		if ( errno == EAGAIN || errno == ENOBUFS ) break;
+		// . skip the dgram that had the error, we'll resend it when
+		//   its ACK does not come back just like any lost dgram
+		log("udp: Call to sendmmsg had error (ignoring): %s.",
+		    mstrerror(errno));
+		m_sendCur++;
+	}
+	// all sent?
+	if ( m_sendCur >= m_sendNum ) {
+		m_sendNum = 0;
+		m_sendCur = 0;
+		return true;
+	}
+	// slide what is left down to the front of the queue
+	int32_t j = 0;
+	for ( int32_t i = m_sendCur ; i < m_sendNum ; i++ , j++ )
+		moveSend ( j , i );
+	m_sendNum = j;
+	m_sendCur = 0;
+	// have Loop call sendPoll_ass() when we can write again
+	m_needToSend = true;
+	if ( ! m_writeRegistered ) {
+		g_loop.registerWriteCallback ( m_sock,
+					       this,
+					       sendPollWrapper_ass,
+					       0 ); // niceness
+		m_writeRegistered = true;
+	}
+	return false;
+}
+
+// move queued dgram #i into queue position #j
+void UdpServer::moveSend ( int32_t j , int32_t i ) {
+	if ( i == j ) return;
+	memcpy_ass ( m_sendHdrs + j * UDP_MAX_HDR ,
+		     m_sendHdrs + i * UDP_MAX_HDR ,
+		     m_sendIovs[2*i].iov_len );
+	m_sendIovs[2*j  ].iov_len  = m_sendIovs[2*i  ].iov_len;
+	m_sendIovs[2*j+1]          = m_sendIovs[2*i+1];
+	m_sendTo   [j]             = m_sendTo   [i];
+	m_sendSlots[j]             = m_sendSlots[i];
+}
+
+void UdpServer::dropSends ( UdpSlot *slot ) {
+	if ( m_sendNum == 0 ) return;
+	// if the socket is writable they all go out and we are done
+	if ( flushSends() ) return;
+	// . otherwise forget this slot's dgrams. if the slot is not done
+	//   the resend logic sends them again like lost dgrams.
+	int32_t j = 0;
+	for ( int32_t i = 0 ; i < m_sendNum ; i++ ) {
+		if ( m_sendSlots[i] == slot ) continue;
+		moveSend ( j++ , i );
+	}
+	m_sendNum = j;
+}
+
+static UdpServer *getServerBySock ( int sock ) {
+	for ( int32_t i = 0 ; i < s_numServers ; i++ )
+		if ( s_servers[i]->m_sock == sock ) return s_servers[i];
+	return NULL;
+}
+
+int udpRecvfrom ( int sock , void *buf , int len , int flags ,
+		  sockaddr *from , socklen_t *fromLen ) {
+	UdpServer *us = getServerBySock ( sock );
+	// batching can not be turned on without a restart so if it was off
+	// in init() we have no batch buffers
+	if ( us && us->m_batchBuf )
+		return us->recvDgram ( buf , len , flags , from , fromLen );
+	int n = recvfrom ( sock , buf , len , flags , from , fromLen );
+	// count the unbatched syscalls too so the stats page can compare
+	if ( ! us ) return n;
+	us->m_recvCalls++;
+	if ( n >= 0 && ! ( flags & MSG_PEEK ) ) us->m_recvDgrams++;
+	return n;
+}
+
+int udpSendmsg ( int sock , char *hdr , int hdrSize ,
+		 char *data , int dataSize , sockaddr_in *to , UdpSlot *slot ) {
+	UdpServer *us = getServerBySock ( sock );
+	if ( us && us->m_batchBuf )
+		return us->sendDgram(hdr,hdrSize,data,dataSize,to,slot);
+	iovec iov[2];
+	iov[0].iov_base = hdr;
+	iov[0].iov_len  = hdrSize;
+	iov[1].iov_base = data;
+	iov[1].iov_len  = dataSize;
+	msghdr mh;
+	memset_ass ( (char *)&mh , 0 , sizeof(msghdr) );
+	mh.msg_name    = to;
+	mh.msg_namelen = sizeof(sockaddr_in);
+	mh.msg_iov     = iov;
+	mh.msg_iovlen  = 2;
+	int n = sendmsg ( sock , &mh , 0 );
+	if ( ! us ) return n;
+	us->m_sendCalls++;
+	if ( n >= 0 ) us->m_sendDgrams++;
+	return n;
+}
+
 // . returns false and sets g_errno on error, true otherwise
 // . will send an ACK or dgram
 // . you need to occupy s_token  to do large reads/sends on a slot
@@ -899,6 +1132,8 @@ bool UdpServer::doSending_ass (UdpSlot *slot,bool allowResends,int64_t now) {
 	goto loop;
 	// come here to turn the interrupts back on if we turned them off
  done:
+	// write out the queued dgrams unless process_ass() will do it
+	if ( ! m_deferFlush ) flushSends();
 	if ( flipped ) interruptsOn();
 	if ( status == -1 ) return false;
 	return true;
@@ -919,6 +1154,9 @@ bool UdpServer::sendPoll_ass ( bool allowResends , int64_t now ) {
 	bool flipped = interruptsOff();
 	// just so caller knows we don't need to send again yet
 	m_needToSend = false;
+	// . write out dgrams left in the send queue when the socket blocked
+	// . this sets m_needToSend again if it still blocks
+	flushSends();
 	// if we don'thave anything to send, or we're waiting on ACKS, then
 	// just return false, we didn't do anything.
 	//mdw int32_t status;
@@ -1088,6 +1326,10 @@ void UdpServer::process_ass ( int64_t now , int32_t maxNiceness) {
 	// . readSock() and doSending() are not Async Signal Safe (ass)
 	bool flipped = interruptsOff();
 	bool needCallback = false;
+	// . queue up the ACKs we send while reading and write them all
+	//   with one sendmmsg() when the socket has no more dgrams
+	bool deferred = m_deferFlush;
+	m_deferFlush = true;
  loop:
 	// did we read or send something?
 	bool something = false;
@@ -1096,7 +1338,7 @@ void UdpServer::process_ass ( int64_t now , int32_t maxNiceness) {
 	// read loop
  readAgain:
 	// bail if no main sock, could have been shutdown in the middle
-	if ( m_sock < 0 ) return ;
+	if ( m_sock < 0 ) { m_deferFlush = deferred; return; }
 	// . returns -1 on error, 0 if blocked, 1 if completed reading dgram
 	// . *slot is set to the slot on which the dgram was read
 	// . *slot will be NULL on some errors (read errors or alloc errors)
@@ -1130,6 +1372,9 @@ void UdpServer::process_ass ( int64_t now , int32_t maxNiceness) {
 		needCallback = true; 
 		goto loop; 
 	}
+	// send the ACKs we queued up
+	m_deferFlush = deferred;
+	if ( ! deferred ) flushSends();
 	// if we read nothing this round, reinstate interrupts
 	if ( flipped ) interruptsOn();
 	// if we don't need a callback, bail
@@ -1250,7 +1495,7 @@ int32_t UdpServer::readSock_ass ( UdpSlot **slotPtr , int64_t now ) {
 	// watch out for overflow
 	//if ( maxPeekSize > 32 ) maxPeekSize = 32;
 	// peak so we can read directly into the right slot, zero-copy
-	int peekSize = recvfrom ( m_sock            , 
+	int peekSize = udpRecvfrom ( m_sock            , 
 				  peek              , 
 				  maxPeekSize       ,
 				  MSG_PEEK          ,
@@ -1757,7 +2002,7 @@ int32_t UdpServer::readSock_ass ( UdpSlot **slotPtr , int64_t now ) {
  discard:
 	// discard if we should
 	if ( discard ) {
-	       readSize=recvfrom(m_sock,tmpbuf,DGRAM_SIZE_CEILING,0,NULL,NULL);
+	       readSize=udpRecvfrom(m_sock,tmpbuf,DGRAM_SIZE_CEILING,0,NULL,NULL);
 	       //log("udp: recvfrom3 = %i",(int)readSize);
 	}
 	// . update stats, just put them all in g_udpServer
@@ -1794,7 +2039,7 @@ int32_t UdpServer::readSock_ass ( UdpSlot **slotPtr , int64_t now ) {
 	/*
  discard:
 	// read it into the temporary discard buf
-	recvfrom(m_sock,tmpbuf,DGRAM_SIZE_CEILING,0,NULL,NULL);
+	udpRecvfrom(m_sock,tmpbuf,DGRAM_SIZE_CEILING,0,NULL,NULL);
 	// turn off
 	if ( flipped ) interruptsOn();
 	// return 1 cuz we did read something
@@ -2422,6 +2667,10 @@ bool UdpServer::makeCallback_ass ( UdpSlot *slot ) {
 		// use the transId of the slot to count!
 		g_callSlot = slot;
 
+		// . the callback may free or reuse the request buf, so do
+		//   not leave any dgrams of it queued up for sendmmsg()
+		dropSends ( slot );
+
 		slot->m_callback ( slot->m_state , slot ); 
 
 		g_callSlot = NULL;
@@ -2520,6 +2769,9 @@ bool UdpServer::makeCallback_ass ( UdpSlot *slot ) {
 				log(LOG_DEBUG,"loop: enter callback2 for "
 				    "0x%"XINT32"",(int32_t)slot->m_msgType);
 
+			// . callback2 may release the send buf if it was
+			//   not ours to free, so let go of it first
+			dropSends ( slot );
 			// call it
 			slot->m_callback2 ( slot->m_state , slot ); 
 
@@ -3121,6 +3373,8 @@ void UdpServer::destroySlot ( UdpSlot *slot ) {
 	if ( ! slot ) return;
 	// core if we should
 	if ( slot->m_coreOnDestroy ) { char *xx = NULL; *xx = 0; }
+	// queued dgrams point into its send buf which we free below
+	dropSends ( slot );
 	// if we're deleting a slot that was an incoming request then
 	// decrement m_requestsInWaiting (exclude pings)
 	if ( ! slot->m_callback && slot->m_msgType != 0x11 ) {
@@ -3445,6 +3699,8 @@ void UdpServer::removeFromCallbackLinkedList ( UdpSlot *slot ) {
 // verified that this is not interruptible
 void UdpServer::freeUdpSlot_ass ( UdpSlot *slot ) {
 	bool flipped = interruptsOff();
+	// give back its share of the host's congestion window
+	slot->ccRelease ( slot->m_inFlight );
 	// set the new head/tail if we were it
 	if ( slot == m_tail2 ) m_tail2 = slot->m_prev2;
 	if ( slot == m_head2 ) m_head2 = slot->m_next2;
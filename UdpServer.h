@@ -40,6 +40,14 @@
 #include "UdpProtocol.h"
 #include "Hostdb.h"
 #include "Loop.h"   // loop class that handles signals on our socket
+#include <sys/socket.h>       // recvmmsg() sendmmsg()
+
+// . how many dgrams we try to read or write per recvmmsg()/sendmmsg() call
+//   when g_conf.m_udpBatchIo is true
+#define UDP_BATCH_SIZE 16
+// . queued dgrams keep a copy of their header, but their data is referenced
+//   in place by an iovec, so this must hold any UdpProtocol header or ACK
+#define UDP_MAX_HDR 32
 
 //#ifdef _SMALLDGRAMS_
 //#define MAX_UDP_SLOTS 1000
@@ -141,6 +149,9 @@ class UdpServer {
 	// . send a reply to the host specified in "slot"
 	// . slot is destroyed on error or completion of the send
 	// . the "msg" will be freed unless slot->m_sendBufAlloc is set to NULL
+	// . "msg" goes out on the wire from where it is, it is never copied
+	//   or written to, so if "alloc" is NULL it can be memory you do not
+	//   own and you can release it in "callback2"
 	// . backoff is how long to wait for an ACK in ms before we resend
 	// . we double backoff each time we wait w/o getting any ACK
 	// . don't wait longer than maxWait for a resend
@@ -282,6 +293,29 @@ class UdpServer {
 
 	bool m_writeRegistered;
 
+	// . batched dgram i/o. readSock_ass() and the UdpSlot send/read
+	//   routines go through udpRecvfrom()/udpSendmsg() below which call
+	//   these when we allocated the batch buffers in init()
+	// . recvDgram() returns dgrams staged by one recvmmsg() call and
+	//   honors MSG_PEEK so readSock_ass() can still peek at the header
+	// . sendDgram() copies the dgram header into the send queue which
+	//   is written with one sendmmsg() call by flushSends(). the data
+	//   is not copied, it is sent from where "slot" keeps it.
+	int  recvDgram ( void *buf , int len , int flags ,
+			 sockaddr *from , socklen_t *fromLen );
+	int  sendDgram ( char *hdr , int hdrSize , char *data , int dataSize ,
+			 sockaddr_in *to , UdpSlot *slot );
+	// . returns false if some dgrams are still queued because the
+	//   socket buffer was full, in which case we set m_needToSend
+	bool flushSends ( );
+	// . flush, then forget any dgrams still queued for "slot" since
+	//   they reference its send buffer which is about to be released
+	void dropSends ( UdpSlot *slot );
+	void moveSend  ( int32_t j , int32_t i );
+	// true while process_ass() or sendPoll_ass() are sending on many
+	// slots so we only flush the send queue once at the end
+	bool m_deferFlush;
+
 	UdpSlot *getActiveHead ( ) { return m_head2; };
 
 	// callback linked list functions (m_head3)
@@ -347,6 +381,25 @@ class UdpServer {
 	// a debug util
 	void dumpdgram ( char *dgram , int32_t dgramSize );
 
+	// recvmmsg() staging area. m_recvCur is the next dgram to hand out.
+	char          *m_batchBuf;
+	int32_t        m_batchBufSize;
+	char          *m_recvBufs;
+	mmsghdr       *m_recvMsgs;
+	iovec         *m_recvIovs;
+	sockaddr_in   *m_recvFrom;
+	int32_t        m_recvNum;
+	int32_t        m_recvCur;
+	// sendmmsg() queue. m_sendCur is the next dgram to write. each dgram
+	// has two iovecs, one for its header in m_sendHdrs and one for data.
+	char          *m_sendHdrs;
+	mmsghdr       *m_sendMsgs;
+	iovec         *m_sendIovs;
+	sockaddr_in   *m_sendTo;
+	UdpSlot      **m_sendSlots;
+	int32_t        m_sendNum;
+	int32_t        m_sendCur;
+
 	// returns false if cannot shutdown right now due to pending traffic
 	//bool tryShuttingDown ( bool callCallback ) ;
 
@@ -463,10 +516,27 @@ class UdpServer {
 	int64_t       m_outsiderPacketsOut;
 	int64_t       m_outsiderBytesIn;
 	int64_t       m_outsiderBytesOut;
+
+	// syscalls made to read or send dgrams and the dgrams they moved,
+	// so we can show the dgrams per syscall batching gets us
+	int64_t       m_recvCalls;
+	int64_t       m_recvDgrams;
+	int64_t       m_sendCalls;
+	int64_t       m_sendDgrams;
 };
 
 extern class UdpServer g_udpServer;
 
+// . replacements for recvfrom()/sendmsg() on a UdpServer's socket
+// . they use the UdpServer's batch buffers if it has them
+// . udpSendmsg() sends "hdr" followed by "data" as one dgram without
+//   copying "data", which must stay put until "slot" is destroyed
+int udpRecvfrom ( int sock , void *buf , int len , int flags ,
+		  sockaddr *from , socklen_t *fromLen );
+int udpSendmsg  ( int sock , char *hdr , int hdrSize ,
+		  char *data , int dataSize , sockaddr_in *to ,
+		  UdpSlot *slot );
+
 // this is the high priority udpServer, it's requests are handled first
 extern class UdpServer g_udpServer2;
 
@@ -111,6 +111,16 @@ int32_t g_cancelAcksRead = 0;
 // see comment above for why we put this back from 12 to 4
 #define ACK_WINDOW_SIZE_LB    4
 
+// . with g_conf.m_udpCongestionControl the window is per host, not per slot,
+//   so many slots replying to the same host at once (incast) share it
+// . start out at the fixed window size and grow as acks come back
+#define CC_INIT_CWND  4.0
+#define CC_MIN_CWND   2.0
+#define CC_MAX_CWND 256.0
+// . do not resend before this many ms even if the rtt is tiny. the other
+//   side may be blocked in a handler for a bit before it sends its ACK.
+#define CC_MIN_RTO   40
+
 static char s_shotgunBit = 0;
 
 // i add this to resend time to jiggle it so it doesn't collide as much
@@ -520,6 +530,8 @@ void UdpSlot::prepareForResend ( int64_t now , bool resendAll ) {
 	Host *h = m_host;
 	if ( ! h && m_hostId >= 0 ) h = g_hostdb.getHost ( m_hostId );
 	if ( h                    ) h->m_pingInfo.m_totalResends += cleared;
+	// no ack in m_resendTime is a timeout so shrink the window way down
+	ccLost ( cleared , true );
 	// . set the resend time based on m_resendCount and m_niceness
 	// . this typically doubles m_resendTime with each resendCount
 	setResendTime ();
@@ -574,6 +586,13 @@ void UdpSlot::setResendTime() {
 		// if size is int16_t we typically use smaller resend time
 		if ( m_dgramsToSend <= 1 ) m_resendTime = RESEND_0_SHORT;
 		else                       m_resendTime = RESEND_0;
+		// . if we measured the round trip time to the host use that
+		// . srtt + 4 deviations like tcp's rto, but in ms
+		Host *h = getCcHost();
+		if ( h && h->m_srtt > 0 ) {
+			m_resendTime = (h->m_srtt + 4 * h->m_rttVar) / 1000;
+			if ( m_resendTime < CC_MIN_RTO ) m_resendTime = CC_MIN_RTO;
+		}
 		// save for checking for overflow
 		int32_t tt = m_resendTime;
 		// 30 ms resend time for starters for high priority slots
@@ -652,11 +671,11 @@ int32_t UdpSlot::sendDatagramOrAck ( int sock, bool allowResends, int64_t now ){
 	int32_t dgramNum = m_nextToSend;
 	// debug msg
 	//log("setDgram");
-	// . store dgram #dgramNum from this send buf into "dgram"
-	// . let the protocol set the dgram from the m_sendBuf for us
-	char buf [ DGRAM_SIZE_CEILING ];
-	// should hold all headers
-	char saved [ 32 ];
+	// . the protocol stores the header for dgram #dgramNum in here
+	// . the data goes out straight from m_sendBuf as the second element
+	//   of an iovec, so we never copy it or write into it. that way
+	//   m_sendBuf can be an RdbList or other memory we do not own.
+	char hdr [ 32 ];
 	// the header size
 	int32_t headerSize = m_proto->getHeaderSize(0);
 	// bitch if too big
@@ -674,19 +693,10 @@ int32_t UdpSlot::sendDatagramOrAck ( int sock, bool allowResends, int64_t now ){
 	// truncate to max size of dgram we're allowed
 	if ( sendSize > m_maxDgramSize - headerSize ) 
 		sendSize = m_maxDgramSize - headerSize;
-	// where to store the dgram, header and data, assume "buf"
-	char *dgram = buf;
 	// size of dgram, header and data
 	int32_t  dgramSize = headerSize + sendSize;
-	// if we're NOT the 1st dgram we can store into send buf directly
-	if ( dgramNum != 0 ) {
-		// where to store the header? right into send buf
-		dgram = send - headerSize;
-		// but save before overwriting
-		memcpy_ass ( saved , dgram , headerSize );
-	}
-	// store header into "dgram"
-	m_proto->setHeader ( dgram         ,
+	// store header into "hdr"
+	m_proto->setHeader ( hdr           ,
 			     m_sendBufSize ,
 			     m_msgType     ,
 			     dgramNum      , 
@@ -694,10 +704,6 @@ int32_t UdpSlot::sendDatagramOrAck ( int sock, bool allowResends, int64_t now ){
 			     m_callback    ,  // weInitiated?
 			     m_localErrno  ,  // hadError?
 			     m_niceness    );  
-	// . if we're the first dgram, we can't back up for the header...
-	// . copy data into dgram if we're the 1st dgram
-	if ( dgramNum == 0 ) 
-		memcpy_ass ( dgram + headerSize , send , sendSize );
 	//log("done set");
 
 	// if we are the proxy sending a udp packet to our flock, then make
@@ -786,14 +792,9 @@ int32_t UdpSlot::sendDatagramOrAck ( int sock, bool allowResends, int64_t now ){
 	//log("sending dgram of size=%"INT32" (max=%"INT32")",dgramSize,m_maxDgramSize);
 	// . this socket should be non-blocking (i.e. return immediately)
 	// . this should set g_errno on error!
-	int bytesSent = sendto ( sock      , 
-				 dgram     ,
-				 dgramSize ,
-				 0         , // makes dns fail->MSG_DONTROUTE ,
-				 (struct sockaddr *)&to , 
-				 sizeof ( to ) );
-	// restore what we overwrote
-	if ( dgramNum != 0 ) memcpy_ass ( dgram , saved , headerSize );
+	// . this may just queue it for a sendmmsg() if batching udp io
+	int bytesSent = udpSendmsg ( sock , hdr , headerSize ,
+				     send , sendSize , &to , this );
 	// debug msg
 	//log("back");
 	// return -1 on error or 0 if blocked
@@ -859,6 +860,8 @@ int32_t UdpSlot::sendDatagramOrAck ( int sock, bool allowResends, int64_t now ){
 	setBit ( dgramNum , m_sentBits2 );
 	// count the bit we lit
 	m_sentBitsOn++;
+	// count it against the host's congestion window
+	ccSent ( dgramNum );
 	// update last send time stamp even if we're a resend
 	m_lastSendTime = now;
 	// update m_nextToSend
@@ -1098,12 +1101,8 @@ int32_t UdpSlot::sendAck ( int sock , int64_t now ,
 	if ( cancelTrans ) g_cancelAcksSent++;
 	// . this socket should be non-blocking (i.e. return immediately)
 	// . this should set g_errno on error
-	int bytesSent = sendto ( sock      , 
-				 dgram     ,
-				 dgramSize ,
-				 0         ,
-				 (struct sockaddr *)&to , 
-				 sizeof ( to ) );
+	int bytesSent = udpSendmsg ( sock , dgram , dgramSize ,
+				     NULL , 0 , &to , this );
 	// return -1 on error, 0 if blocked
 	if ( bytesSent < 0 ) {
 		// copy errno to g_errno
@@ -1572,7 +1571,7 @@ bool UdpSlot::readDatagramOrAck ( int        sock    ,
 		// save what's before us
 		char tmp[32];
 		memcpy_ass ( tmp , dest , headerSize );
-		int numRead = recvfrom ( sock   , 
+		int numRead = udpRecvfrom ( sock   , 
 					 dest   ,
 					 toRead ,
 					 0      ,
@@ -1615,7 +1614,7 @@ bool UdpSlot::readDatagramOrAck ( int        sock    ,
 	char dgram [DGRAM_SIZE_CEILING];
  retry2:
 	// read in the whole dgram
-	int dgramSize = recvfrom ( sock          , 
+	int dgramSize = udpRecvfrom ( sock          , 
 				   dgram         , 
 				   DGRAM_SIZE_CEILING , 
 				   0             , 
@@ -1687,6 +1686,9 @@ void UdpSlot::readAck ( int sock , int32_t dgramNum , int64_t now ) {
 	setBit ( dgramNum , m_readAckBits2 );
 	// update lit bit count
 	m_readAckBitsOn++;
+	// . it is out of flight now, so grow the window and maybe sample rtt
+	// . if it was marked unsent we already took it out of flight
+	ccAcked ( dgramNum , isOn ( dgramNum , m_sentBits2 ) );
 	// if it was marked as unsent, fix that
 	if ( ! isOn ( dgramNum , m_sentBits2 ) ) {
 		// bitch if we do not even have a send buffer. why is he acking
@@ -1705,6 +1707,7 @@ void UdpSlot::readAck ( int sock , int32_t dgramNum , int64_t now ) {
 	// . we detect this gap and automatically re-send the dgrams w/o delay
 	// . if our right neighbor read ack bit is off then mark all off bits 
 	//   on our right as having sent bits of 0, until we hit a lit ack bit
+	int32_t gap = 0;
 	for ( int32_t i = dgramNum - 1 ; i >= 0 ; i-- ) {
 		// stop after hitting a lit bit
 		if ( isOn ( i , m_readAckBits2 ) ) break;
@@ -1716,7 +1719,10 @@ void UdpSlot::readAck ( int sock , int32_t dgramNum , int64_t now ) {
 		m_sentBitsOn--;
 		// update m_nextToSend
 		if ( i < m_nextToSend ) m_nextToSend = i;
+		gap++;
 	}
+	// an ack gap means the dgrams were likely dropped, so halve window
+	if ( gap ) ccLost ( gap , false );
 
 	// if the reply or request was fully acknowledged by the receiver
 	// then record some statistics
@@ -1924,7 +1930,21 @@ int32_t UdpSlot::getScore ( int64_t now ) {
 	// . if send is local, use a larger ack window of ?64? dgrams
 	//if ( ( m_ip != g_hostdb.getMyIp() || g_conf.m_interfaceMachine ) &&
 	//if ( ( ! g_hostdb.isMyIp(m_ip)  || g_conf.m_interfaceMachine ) &&
-	if ( ! g_hostdb.isMyIp(m_ip) &&
+	// . with congestion control the window is the host's m_cwnd which
+	//   all slots sending to that host share
+	// . a slot with nothing in flight may always send one dgram, so if
+	//   the window is full of other slots' dgrams we still make progress
+	//   and will get an ack back to clock out the next send
+	Host *h = getCcHost();
+	if ( h && m_inFlight > 0 ) {
+		if ( h->m_inFlight >= (int32_t)h->m_cwnd ) return -1;
+		// . pace the window out over the round trip rather than
+		//   bursting it into the switch all at once
+		// . getBestSlotToSend() will pick another host's slot
+		if ( h->m_nextSendTime > (int64_t)gettimeofdayInMicroseconds())
+			return -1;
+	}
+	if ( ! h && ! g_hostdb.isMyIp(m_ip) &&
 	     m_sentBitsOn >= m_readAckBitsOn + ACK_WINDOW_SIZE    ) return -1;
 	// well, give a window size of 100 to loopbacks
 	//if ( ( m_ip == g_hostdb.getMyIp() && !g_conf.m_interfaceMachine ) &&
@@ -1968,6 +1988,94 @@ int32_t UdpSlot::getScore ( int64_t now ) {
 }
 
 
+Host *UdpSlot::getCcHost ( ) {
+	if ( ! g_conf.m_udpCongestionControl ) return NULL;
+	// dns and other ackless protocols just resend on a timer
+	if ( ! m_host || ! m_proto->useAcks() ) return NULL;
+	// loopback does not congest, keep the fixed ACK_WINDOW_SIZE_LB
+	if ( g_hostdb.isMyIp ( m_ip ) ) return NULL;
+	// first time sending to this host?
+	if ( m_host->m_cwnd <= 0.0 ) {
+		m_host->m_cwnd     = CC_INIT_CWND;
+		m_host->m_ssthresh = CC_MAX_CWND;
+	}
+	return m_host;
+}
+
+void UdpSlot::ccSent ( int32_t dgramNum ) {
+	Host *h = getCcHost();
+	if ( ! h ) return;
+	m_inFlight++;
+	h->m_inFlight++;
+	int64_t nowUs = gettimeofdayInMicroseconds();
+	// . time one dgram at a time, but never a resend since we would not
+	//   know which send its ack was for (Karn's rule)
+	if ( ! m_rttSendTime && dgramNum >= m_sentHigh ) {
+		m_rttDgram    = dgramNum;
+		m_rttSendTime = nowUs;
+	}
+	if ( dgramNum >= m_sentHigh ) m_sentHigh = dgramNum + 1;
+	// spread the window out over one round trip
+	if ( h->m_srtt > 0 )
+		h->m_nextSendTime = nowUs + (int64_t)(h->m_srtt / h->m_cwnd);
+}
+
+void UdpSlot::ccAcked ( int32_t dgramNum , bool wasSent ) {
+	if ( wasSent ) ccRelease ( 1 );
+	Host *h = getCcHost();
+	if ( ! h ) return;
+	// sample the round trip time if this is the dgram we were timing
+	if ( m_rttSendTime && dgramNum == m_rttDgram ) {
+		int32_t rtt = gettimeofdayInMicroseconds() - m_rttSendTime;
+		if ( rtt < 0 ) rtt = 0;
+		m_rttSendTime = 0;
+		if ( h->m_srtt <= 0 ) {
+			h->m_srtt   = rtt;
+			h->m_rttVar = rtt / 2;
+		}
+		else {
+			int32_t err = rtt - h->m_srtt;
+			h->m_srtt += err / 8;
+			if ( err < 0 ) err = -err;
+			h->m_rttVar += ( err - h->m_rttVar ) / 4;
+		}
+	}
+	if ( ! wasSent ) return;
+	// slow start until we hit m_ssthresh then grow by one per window
+	if ( h->m_cwnd < h->m_ssthresh ) h->m_cwnd += 1.0;
+	else                             h->m_cwnd += 1.0 / h->m_cwnd;
+	if ( h->m_cwnd > CC_MAX_CWND ) h->m_cwnd = CC_MAX_CWND;
+}
+
+void UdpSlot::ccLost ( int32_t cleared , bool timedOut ) {
+	ccRelease ( cleared );
+	// whatever we were timing may be resent now
+	m_rttSendTime = 0;
+	Host *h = getCcHost();
+	if ( ! h ) return;
+	h->m_dgramsLost += cleared;
+	// . only back off once per round trip, the rest of the losses are
+	//   probably from the same burst
+	int64_t nowUs = gettimeofdayInMicroseconds();
+	if ( nowUs - h->m_lastCwndCut < h->m_srtt ) return;
+	h->m_lastCwndCut = nowUs;
+	h->m_ssthresh = h->m_cwnd / 2.0;
+	if ( h->m_ssthresh < CC_MIN_CWND ) h->m_ssthresh = CC_MIN_CWND;
+	// a timeout means the acks stopped so start over from the bottom
+	if ( timedOut ) h->m_cwnd = CC_MIN_CWND;
+	else            h->m_cwnd = h->m_ssthresh;
+}
+
+void UdpSlot::ccRelease ( int32_t n ) {
+	if ( n > m_inFlight ) n = m_inFlight;
+	if ( n <= 0 ) return;
+	m_inFlight -= n;
+	// the host count may have been counted under a different conf
+	if ( ! m_host ) return;
+	m_host->m_inFlight -= n;
+	if ( m_host->m_inFlight < 0 ) m_host->m_inFlight = 0;
+}
+
 void UdpSlot::printState() {
 	//int64_t now = gettimeofdayInMilliseconds();
 	log(LOG_TIMING, 
@@ -300,6 +300,17 @@ class UdpSlot {
 	//		uint32_t s_tokenTime , int32_t LARGE_MSG ) ;
 	int32_t getScore ( int64_t now );
 
+	// . congestion control. returns m_host if we are windowing our
+	//   sends to it with its m_cwnd, NULL to use the fixed ack window
+	Host *getCcHost ( );
+	// call these when we send a dgram, read its ack, or give up on dgrams
+	// we sent and mark them for resending
+	void ccSent  ( int32_t dgramNum );
+	void ccAcked ( int32_t dgramNum , bool wasSent );
+	void ccLost  ( int32_t cleared , bool timedOut );
+	// take dgrams out of our and m_host's in flight counts
+	void ccRelease ( int32_t n );
+
 	// what is our niceness level?
 	int32_t getNiceness ( ) { return m_niceness; };
 
@@ -422,6 +433,13 @@ class UdpSlot {
 	// save cpu by not having to call memset() on m_sentBits et al
 	int32_t m_numBitsInitialized;
 
+	// . unacked dgrams we count in m_host->m_inFlight
+	// . we time one never before sent dgram per round trip for the rtt
+	int32_t        m_inFlight;
+	int32_t        m_sentHigh;
+	int32_t        m_rttDgram;
+	int64_t        m_rttSendTime;
+
 	// and for doubly linked list of callback candidates
  	class UdpSlot *m_next3;
 	class UdpSlot *m_prev3;
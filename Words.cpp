@@ -8,12 +8,14 @@
 #include "HashTableX.h"
 #include "Sections.h"
 #include "XmlNode.h" // getTagLen()
+#include "Arena.h"
 
 //static int32_t printstring ( char *s , int32_t len ) ;
 
 Words::Words ( ) {
 	m_buf = NULL;
 	m_bufSize = 0;
+	m_arena = NULL;
 	reset();
 }
 Words::~Words ( ) {
@@ -24,7 +26,8 @@ void Words::reset ( ) {
 	m_numAlnumWords = 0;
 	m_xml = NULL;
 	m_preCount = 0;
-	if ( m_buf && m_buf != m_localBuf && m_buf != m_localBuf2 )
+	if ( m_buf && m_buf != m_localBuf && m_buf != m_localBuf2 &&
+	     ! m_arena )
 		mfree ( m_buf , m_bufSize , "Words" );
 	m_buf = NULL;
 	m_bufSize = 0;
@@ -63,6 +66,10 @@ int32_t countWords ( char *p , int32_t plen , int32_t niceness ) {
 
 	// sequence of punct
 	for  ( ; p < pend && ! is_alnum_utf8 (p) ; p += getUtf8CharSize(p) ) {
+		// . skip the plain ascii quickly
+		// . callers pass sub ranges so do not go past pend
+		p = skipAsciiPunct ( p , pend );
+		if ( p >= pend || is_alnum_utf8 ( p ) ) break;
 		// breathe
 		QUICKPOLL ( niceness );
 		// in case being set from xml tags, count as words now
@@ -71,9 +78,13 @@ int32_t countWords ( char *p , int32_t plen , int32_t niceness ) {
 	count++;
 
 	// sequence of alnum
-	for  ( ; p < pend && is_alnum_utf8 (p) ; p += getUtf8CharSize(p) )
+	for  ( ; p < pend && is_alnum_utf8 (p) ; p += getUtf8CharSize(p) ) {
+		// skip the plain ascii quickly
+		p = skipAsciiAlnum ( p , pend );
+		if ( p >= pend || ! is_alnum_utf8 ( p ) ) break;
 		// breathe
 		QUICKPOLL ( niceness );
+	}
 
 	count++;
 
@@ -88,6 +99,9 @@ int32_t countWords ( char *p , int32_t niceness ) {
 
 	// sequence of punct
 	for  ( ; *p && ! is_alnum_utf8 (p) ; p += getUtf8CharSize(p) ) {
+		// skip the plain ascii quickly
+		p = skipAsciiPunct ( p );
+		if ( ! *p || is_alnum_utf8 ( p ) ) break;
 		// breathe
 		QUICKPOLL ( niceness );
 		// in case being set from xml tags, count as words now
@@ -96,9 +110,13 @@ int32_t countWords ( char *p , int32_t niceness ) {
 	count++;
 
 	// sequence of alnum
-	for  ( ; *p && is_alnum_utf8 (p) ; p += getUtf8CharSize(p) )
+	for  ( ; *p && is_alnum_utf8 (p) ; p += getUtf8CharSize(p) ) {
+		// skip the plain ascii quickly
+		p = skipAsciiAlnum ( p );
+		if ( ! *p || ! is_alnum_utf8 ( p ) ) break;
 		// breathe
 		QUICKPOLL ( niceness );
+	}
 
 	count++;
 
@@ -330,6 +348,9 @@ bool Words::addWords(char *s,int32_t nodeLen,bool computeWordIds, int32_t nicene
 		char *start = s+i;
 		//for (;s[i] && ! is_alnum_utf8(s+i);i+=getUtf8CharSize(s+i));
 		for ( ; s[i] ; i += getUtf8CharSize(s+i)){
+			// skip plain ascii punct quickly
+			i = skipAsciiPunct ( s + i ) - s;
+			if ( ! s[i] ) break;
 			// stop on < if we got tags
 			if ( s[i] == '<' && m_hasTags ) break;
 			// breathe
@@ -365,6 +386,9 @@ bool Words::addWords(char *s,int32_t nodeLen,bool computeWordIds, int32_t nicene
  again:
 	//for ( ; is_alnum_utf8 (&s[i] ) ; i += getUtf8CharSize(s+i) );
 	for ( ; s[i] ; i += getUtf8CharSize(s+i) ) {
+		// skip plain ascii alnum quickly
+		i = skipAsciiAlnum ( s + i ) - s;
+		if ( ! s[i] ) break;
 		// breathe
 		QUICKPOLL(niceness);
 		// simple ascii?
@@ -541,6 +565,12 @@ bool Words::allocateWordBuffers(int32_t count, bool tagIds) {
 	else if ( m_bufSize <= WORDS_LOCALBUFSIZE ) {
 		m_buf = m_localBuf;
 	}
+	else if ( m_arena ) {
+		m_buf = m_arena->alloc ( m_bufSize );
+		if ( ! m_buf ) return log("build: Could not allocate %"INT32" "
+					  "bytes for parsing document.",
+					  m_bufSize);
+	}
 	else {
 		m_buf = (char *)mmalloc ( m_bufSize , "Words" );
 		if ( ! m_buf ) return log("build: Could not allocate %"INT32" "
@@ -372,6 +372,9 @@ class Words {
 	char *m_localBuf2;
 	int32_t  m_localBufSize2;
 
+	// XmlDoc's arena, alloc m_buf from it and do not free it
+	class Arena *m_arena;
+
 	char *m_buf;
 	int32_t  m_bufSize;
         Xml  *m_xml ;  // if the class is set from xml, rather than a string
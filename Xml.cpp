@@ -3,6 +3,7 @@
 #include "Xml.h"
 
 #include "Mem.h"     // mfree(), mmalloc()
+#include "Arena.h"
 #include "Unicode.h" // for html entities that return unicode
 #include "Titledb.h"
 #include "Words.h"
@@ -13,6 +14,7 @@ Xml::Xml  () {
 	m_xmlLen = 0; 
 	m_nodes = NULL; 
 	m_numNodes=0; 
+	m_arena = NULL;
 	m_ownData = false;
 	m_version = TITLEREC_CURRENT_VERSION;
 }
@@ -185,9 +187,17 @@ int32_t Xml::getNodeNum ( int32_t n0 , int32_t n1 , char *tagName , int32_t tagN
 	return i;
 }
 
+// m_maxNumNodes of them from the arena if we have one
+XmlNode *Xml::allocNodes ( ) {
+	int32_t need = sizeof(XmlNode) * m_maxNumNodes;
+	if ( m_arena ) return (XmlNode *)m_arena->alloc ( need );
+	return (XmlNode *)mmalloc ( need , "Xml1" );
+}
+
 void Xml::reset ( ) {
 	// free old nodes array if any
-	if ( m_nodes ) mfree ( m_nodes, m_maxNumNodes*sizeof(XmlNode),"Xml1"); 
+	if ( m_nodes && ! m_arena )
+		mfree ( m_nodes, m_maxNumNodes*sizeof(XmlNode),"Xml1"); 
 	if ( m_ownData && m_xml ) mfree ( m_xml, m_allocSize, "Xml1");
 	m_xml         = NULL;
 	m_nodes       = NULL; 
@@ -228,6 +238,13 @@ bool Xml::getCompoundName ( int32_t node , SafeBuf *sb ) {
 #include "HttpMime.h" // CT_JSON
 
 // "s" must be in utf8
+// . true if one of the 8 bytes in "x" is "c"
+// . (y - 0x0101..) & ~y & 0x8080.. is non-zero iff y has a 0 byte
+static inline bool hasByte64 ( uint64_t x , unsigned char c ) {
+	uint64_t y = x ^ ( 0x0101010101010101ULL * c );
+	return ( (y - 0x0101010101010101ULL) & ~y & 0x8080808080808080ULL );
+}
+
 bool Xml::set ( char  *s             , 
 	        int32_t   slen          , 
 	        bool   ownData       , 
@@ -271,7 +288,7 @@ bool Xml::set ( char  *s             ,
 		m_numNodes = 0;
 		// make the array
 		m_maxNumNodes = 1;
-		m_nodes =(XmlNode *)mmalloc(sizeof(XmlNode)*m_maxNumNodes,"x");
+		m_nodes = (XmlNode *)allocNodes ( );
 		if ( ! m_nodes ) return false;
 		XmlNode *xd = &m_nodes[m_numNodes];
 		// hack the node
@@ -306,10 +323,22 @@ bool Xml::set ( char  *s             ,
 
 	// . replacing NULL bytes with spaces in the buffer
 	// . utf8 should never have any 0 bytes in it either!
-	for ( i = 0 ; i < slen ; i++ ) if ( !s[i] ) s[i] = ' ';
-
-	// counting the max num nodes
-	for ( i = 0 ; s[i] ; i++ ) if ( s[i] == '<' ) m_maxNumNodes++;
+	// . and count the '<'s for the max num nodes in the same pass
+	// . look at 8 bytes at a time and only go byte by byte through
+	//   the ones that have a 0 or a '<' in them
+	for ( i = 0 ; i + 8 <= slen ; i += 8 ) {
+		uint64_t x = *(uint64_t *)(s+i);
+		if ( ! hasByte64 ( x , 0 ) && ! hasByte64 ( x , '<' ) )
+			continue;
+		for ( int32_t k = i ; k < i + 8 ; k++ ) {
+			if      ( ! s[k]       ) s[k] = ' ';
+			else if ( s[k] == '<' ) m_maxNumNodes++;
+		}
+	}
+	for ( ; i < slen ; i++ ) {
+		if      ( ! s[i]       ) s[i] = ' ';
+		else if ( s[i] == '<' ) m_maxNumNodes++;
+	}
 
 	// account for the text (non-tag) nodes (padding nodes between tags)
 	m_maxNumNodes *= 2 ;
@@ -339,7 +368,7 @@ bool Xml::set ( char  *s             ,
 	// breathe
 	QUICKPOLL ( niceness );
 
-	m_nodes = (XmlNode *) mmalloc (sizeof(XmlNode) * m_maxNumNodes,"Xml1");
+	m_nodes = allocNodes ( );
 	if ( ! m_nodes ) { 
 		reset(); 
 		return log("build: Could not allocate %"INT32" "
@@ -205,6 +205,8 @@ class Xml {
 
 	// private:
 
+	XmlNode *allocNodes ( ) ;
+
 	// . used by getValueAsBool/Long/String()
 	// . tagName is compound for xml tags, simple for html tags
 	char *getTextForXmlTag ( int32_t n0, int32_t n1, char *tagName, int32_t *len ,
@@ -230,6 +232,9 @@ class Xml {
 	int32_t       m_numNodes;
 	int32_t       m_maxNumNodes;
 
+	// XmlDoc's arena, alloc m_nodes from it and do not free them
+	class Arena *m_arena;
+
 	bool m_pureXml;
 
 	char      *m_xml;
@@ -34,6 +34,9 @@
 #include "Synonyms.h"
 //#include "Revdb.h"
 #include "Timedb.h"
+#include "ThreadPool.h"   // g_threadPool
+#include "StopWords.h"    // isStopWord()
+#include "Abbreviations.h" // isAbbr()
 #ifdef _USETURKS_
 //#include "PageTurk.h"
 #endif
@@ -47,6 +50,7 @@
 //#include <regex.h>
 #include "PingServer.h"
 #include "Parms.h"
+#include "TitleDict.h"
 
 extern int g_inMemcpy;
 
@@ -113,6 +117,8 @@ void doneReadingArchiveFileWrapper ( int fd, void *state );
 
 XmlDoc::XmlDoc() { 
 	m_readThreadOut = false;
+	m_stageThreadOut = false;
+	m_stageState     = NULL;
 	for ( int32_t i = 0 ; i < MAXMSG7S ; i++ ) m_msg7s[i] = NULL;
 	m_esbuf.setLabel("exputfbuf");
 	for ( int32_t i = 0 ; i < MAX_XML_DOCS ; i++ ) m_xmlDocs[i] = NULL;
@@ -197,6 +203,17 @@ XmlDoc::XmlDoc() {
 	//	m_currentBinPtrs[i] = NULL;
 	m_registeredWgetReadCallback = false;
 	m_pipe = NULL;
+
+	// parse into the arena and skip mmalloc() and its leak table for
+	// all those buffers. they never free, reset() frees the arena.
+	m_xml.m_arena      = &m_arena;
+	m_words.m_arena    = &m_arena;
+	m_bits.m_arena     = &m_arena;
+	m_bits2.m_arena    = &m_arena;
+	m_phrases.m_arena  = &m_arena;
+	m_sections.m_arena = &m_arena;
+	m_tt1.m_arena      = &m_arena;
+
 	reset();
 };
 
@@ -225,6 +242,14 @@ void XmlDoc::reset ( ) {
 	if ( m_readThreadOut ) 
 		log("build: deleting xmldoc class that has a read thread out "
 		    "on a warc file");
+
+	// . the thread is writing into us so wait for it to finish
+	// . its callback will see we are gone and not call m_masterLoop
+	if ( m_stageThreadOut ) {
+		log("build: deleting xmldoc class that has a parse thread "
+		    "out. waiting for it.");
+		stopStage();
+	}
 		
 	if ( m_fileValid ) {
 		m_file.close();
@@ -392,6 +417,10 @@ void XmlDoc::reset ( ) {
 	m_checkedCachedbForPage = false;
 	m_allHashed = false;
 
+	m_stage           = 0;
+	m_parseStageDone  = false;
+	m_tt1.reset();
+
 	// nuke it
 	if ( m_tempMsg25Page ) {
 		mdelete ( m_tempMsg25Page , sizeof(Msg25), "m25li" );
@@ -959,6 +988,9 @@ void XmlDoc::reset ( ) {
 	m_hasMetadata = false;
 	ptr_metadata = NULL;
 	size_metadata = 0;
+
+	// everything that used it was reset above
+	m_arena.reset();
 }
 
 // . set the url with the intention of adding it or deleting it from the index
@@ -1637,6 +1669,9 @@ bool XmlDoc::set2 ( char    *titleRec ,
 	// . the actual data follows "dataSize"
 	// . what's the size of the uncompressed compressed stuff below here?
 	m_ubufSize = *(int32_t  *) p ; p += 4;
+	// the top bits say how it was compressed, zlib or zstd
+	char codec = ((uint32_t)m_ubufSize) >> TRC_CODEC_SHIFT;
+	m_ubufSize &= TRC_SIZE_MASK;
 	// . because of disk/network data corruption this may be wrong! 
 	// . we can now have absolutely huge titlerecs...
 	if ( m_ubufSize <= 0 ) { //m_ubufSize > 2*1024*1024 || m_ubufSize < 0 )
@@ -1678,24 +1713,16 @@ bool XmlDoc::set2 ( char    *titleRec ,
 	setStatus( "Uncompressing title rec." );
 	// . uncompress the data into m_ubuf
 	// . m_ubufSize should remain unchanged since we stored it
-	int err = gbuncompress ( (unsigned char *)  m_ubuf ,
-				 (uint32_t *) &realSize   ,
-				 (unsigned char *)  p , 
-				 (uint32_t  ) (dataSize - 4) );
-	// hmmmm...
-	if ( err == Z_BUF_ERROR ) {
-		log("db: Buffer is too small to hold uncompressed "
-		    "document. Probable disk corruption in a titledb file.");
-		g_errno = EUNCOMPRESSERROR;
+	// . sets g_errno and returns false on error
+	if ( ! titleRecUncompress ( codec ,
+				    m_ubuf ,
+				    &realSize ,
+				    p ,
+				    dataSize - 4 ) ) {
+		log("db: Uncompress of document failed. cbufSize=%"INT32" "
+		    "ubufsize=%"INT32"", cbufSize , m_ubufSize );
 		return false;
 	}
-	// set g_errno and return false on error
-	if ( err != Z_OK ) {
-		g_errno = EUNCOMPRESSERROR;
-		return log("db: Uncompress of document failed. ZG_ERRNO=%i. "
-			   "cbufSize=%"INT32" ubufsize=%"INT32" realSize=%"INT32"", 
-			   err , cbufSize , m_ubufSize , realSize );
-	}
 	if ( realSize != m_ubufSize ) {
 		g_errno = EBADENGINEER;
 		return log("db: Uncompressed document size is not what we "
@@ -2113,6 +2140,9 @@ void indexDocWrapper ( void *state ) {
 	XmlDoc *THIS = (XmlDoc *)state;
 	// make sure has not been freed from under us!
 	if ( THIS->m_freed ) { char *xx=NULL;*xx=0;}
+	// . stay out while a parse thread is using us, it calls us back
+	//   when it is done and we will see whatever this was for then
+	if ( THIS->m_stageThreadOut ) return;
 	// note it
 	THIS->setStatus ( "in index doc wrapper" );
 	// return if it blocked
@@ -5241,6 +5271,13 @@ bool XmlDoc::setTitleRecBuf ( SafeBuf *tbuf, int64_t docId, int64_t uh48 ){
 		// add it in
 		m_internalFlags1 |= mask;
 	}
+	// . the codec is stored in the top bits of the uncompressed size
+	//   so the size can not use them
+	if ( need1 > TRC_SIZE_MASK ) {
+		g_errno = EDOCTOOBIG;
+		return log("build: titlerec of %"INT32" bytes is too big to "
+			   "store",need1);
+	}
 	// alloc the buffer
 	char *ubuf = (char *) mmalloc ( need1 , "xdtrb" );
 	// return NULL with g_errno set on error
@@ -5287,10 +5324,8 @@ bool XmlDoc::setTitleRecBuf ( SafeBuf *tbuf, int64_t docId, int64_t uh48 ){
 	// should we free cbuf on our reset/destruction?
 	//m_owncbuf = ownCompressedData;
 	// . make a buf big enough to hold compressed, we'll realloc afterwards
-	// . according to zlib.h line 613 compress buffer must be .1% larger
-	//   than source plus 12 bytes. (i add one for round off error)
-	// . now i added another extra 12 bytes cuz compress seemed to want it
-	int32_t need2 = ((int64_t)need1 * 1001LL) / 1000LL + 13 + 12;
+	// . big enough for zlib or zstd
+	int32_t need2 = titleRecCompressBound ( need1 );
 	// we also need to store a key then regular dataSize then 
 	// the uncompressed size in cbuf before the compression of m_ubuf
 	int32_t hdrSize = sizeof(key_t) + 4 + 4;
@@ -5315,31 +5350,22 @@ bool XmlDoc::setTitleRecBuf ( SafeBuf *tbuf, int64_t docId, int64_t uh48 ){
 	// . uncompress the data into ubuf
 	// . this will reset cbufSize to a smaller value probably
 	// . "size" is set to how many bytes we wrote into "cbuf + hdrSize"
-	int err = gbcompress ( (unsigned char *)cbuf + hdrSize, 
-			       (uint32_t *)&size,
-			       (unsigned char *)ubuf , 
-			       (uint32_t  )need1 );
+	// . this uses zstd if the collection has a trained dictionary
+	// . returns the codec it used, or -1 with g_errno set
+	int32_t codec = titleRecCompress ( m_collnum ,
+					   cbuf + hdrSize ,
+					   &size ,
+					   ubuf ,
+					   need1 );
 	// note it
 	//log("test: compressed %s from %"INT32" to %"INT32" bytes",
 	//    m_firstUrl.m_url,need2-hdrSize,size);
 	// free the buf we were trying to compress now
 	mfree ( ubuf , need1 , "trub" );
-	// we should check ourselves
-	if ( err == Z_OK && size > (need2 - hdrSize ) ) { 
-		//mfree ( cbuf , need2 ,"TitleRecc" ); 
-		tbuf->purge();
-		g_errno = ECOMPRESSFAILED; 
-		log("db: Failed to compress document of %"INT32" bytes. "
-		    "Provided buffer of %"INT32" bytes.",
-		    size, (need2 - hdrSize ) );
-		return false;
-	}
 	// check for error
-	if ( err != Z_OK ) {
+	if ( codec < 0 ) {
 		//mfree ( cbuf , need2 ,"TitleRecc" ); 
 		tbuf->purge();
-		g_errno = ECOMPRESSFAILED; 
-		log("db: Failed to compress document.");
 		return false;
 	}
 	// calc cbufSize, the uncompressed header + compressed stuff
@@ -5365,8 +5391,9 @@ bool XmlDoc::setTitleRecBuf ( SafeBuf *tbuf, int64_t docId, int64_t uh48 ){
 	int32_t dataSize = size + 4;
 	*(int32_t  *) p = dataSize ;
 	p += 4;
-	// store uncompressed size in header
-	*(int32_t  *) p = need1 ; p += 4;
+	// . store uncompressed size in header
+	// . the top bits are the codec, 0 for zlib like old titlerecs
+	*(int32_t  *) p = need1 | (codec << TRC_CODEC_SHIFT) ; p += 4;
 	// sanity check
 	if ( p != cbuf + hdrSize ) { char *xx = NULL; *xx = 0; }
 	// sanity check 
@@ -6954,6 +6981,9 @@ Xml *XmlDoc::getXml ( ) {
 	// return it if it is set
 	if ( m_xmlValid ) return &m_xml;
 
+	// the parse thread is setting it, we get called back when it is done
+	if ( m_stageThreadOut && ! g_threads.amThread() ) return (Xml *)-1;
+
 	// note it
 	setStatus ( "parsing html");
 
@@ -6965,6 +6995,15 @@ Xml *XmlDoc::getXml ( ) {
 	uint8_t *ct = getContentType();
 	if ( ! ct || ct == (void *)-1 ) return (Xml *)ct;
 
+	// . set the xml, words, bits, phrases and pos in a thread since
+	//   that is a lot of cpu for a big doc. the thread calls us to set
+	//   the xml.
+	// . if the thread had an error we do it again here to get g_errno
+	if ( ! m_parseStageDone && ! g_threads.amThread() ) {
+		m_parseStageDone = true;
+		if ( launchStage ( XDS_PARSE ) ) return (Xml *)-1;
+	}
+
 	// set it
 	if ( ! m_xml.set ( *u8        , 
 			   u8len      , 
@@ -23826,6 +23865,9 @@ char *XmlDoc::getMetaList ( bool forDelete ) {
 
 	if ( m_metaListValid ) return m_metaList;
 
+	// the parse thread is still setting our words, it calls us back
+	if ( m_stageThreadOut ) return (char *)-1;
+
 	setStatus ( "getting meta list" );
 
 	// force it true?
@@ -25158,7 +25200,8 @@ char *XmlDoc::getMetaList ( bool forDelete ) {
 	// CAUTION
 	//
 	// We should never "block" after this point, lest the hashtables
-	// we create get messed up.
+	// we create get messed up. the hash thread is the exception, it
+	// hashes into m_tt1 which is kept for when it calls us back.
 	//
 
 	//
@@ -25187,7 +25230,8 @@ char *XmlDoc::getMetaList ( bool forDelete ) {
 	// . hash our documents terms into "tt1"
 	// . hash the old document's terms into "tt2"
 	// . by old, we mean the older versioned doc of this url spidered b4
-	HashTableX tt1;
+	// . tt1 is a member so its slots come from m_arena
+	HashTableX &tt1 = m_tt1;
 	HashTableX tt2; 
 	// how many words we got?
 	int32_t nw = m_words.getNumWords();
@@ -28951,6 +28995,164 @@ bool XmlDoc::hashNoSplit ( HashTableX *tt ) {
 	return true;
 }
 
+static void  stageDoneWrapper    ( void *state , ThreadEntry *te ) ;
+static void *stageStartWrapper_r ( void *state , ThreadEntry *te ) ;
+
+// . what the PARSE_THREAD gets as its state instead of the XmlDoc so its
+//   callback can tell if reset() let go of the doc while it was out
+// . m_running is cleared by the thread itself, m_xd is NULLed by reset()
+class StageState {
+public:
+	XmlDoc        *m_xd;
+	volatile bool  m_running;
+};
+
+static bool s_parseTablesReady = false;
+
+// . the code the parse stage runs builds some tables the first time it is
+//   called, like the tag ids in XmlNode.cpp, the stop words and the
+//   abbreviations. build them here in the main thread before the loop is
+//   running so two PARSE_THREADs never do it at once.
+// . launchStage() will not launch anything until this was called
+bool initParseTables ( ) {
+	// sanity check, XmlNode.cpp cores if the tag table is bad
+	if ( getTagId ( "br" ) != TAG_BR ) { char *xx=NULL;*xx=0; }
+	char *sw = "the";
+	if ( ! isStopWord ( sw , 3 , hash64Lower_utf8 ( sw , 3 ) ) )
+		return log("build: could not init stop words table");
+	isAbbr ( hash64Lower_utf8 ( "dr" ) );
+	// . then do the parse stage on a little doc so whatever else it
+	//   sets up on its first call is set up now
+	// . it has a bit of everything the parser cares about
+	// . not a string constant, Words::set() writes into it
+	char html[] = 
+		"<html><head><title>Mr. Smith's page</title>"
+		"<meta name=\"description\" content=\"a test\"></head>"
+		"<body><h1>The U.S. and Dr. Jones</h1>"
+		"<p>It is a well-known fact that 3.14 is not pi, "
+		"e.g. in New York &amp; L.A. at 10:30am.</p>"
+		"<ul><li><a href=\"/x.html\">one</a></li><li>two</li></ul>"
+		"<table><tr><td>a&nbsp;b</td></tr></table><br>"
+		"<script>var x = 1;</script></body></html>";
+	int32_t hlen = gbstrlen ( html );
+	Xml     xml;
+	Words   words;
+	Bits    bits;
+	Phrases phrases;
+	Pos     pos;
+	if ( ! xml.set ( html , hlen , false , 0 , false ,
+			 TITLEREC_CURRENT_VERSION , false , 0 , CT_HTML ) ||
+	     ! words.set ( &xml , true , 0 ) ||
+	     ! bits.set ( &words , TITLEREC_CURRENT_VERSION , 0 ) ||
+	     ! phrases.set ( &words , &bits , true , false ,
+			     TITLEREC_CURRENT_VERSION , 0 ) ||
+	     ! pos.set ( &words , NULL ) )
+		return log("build: could not init parse tables: %s",
+			   mstrerror(g_errno));
+	s_parseTablesReady = true;
+	return true;
+}
+
+// . run the cpu heavy "stage" in a PARSE_THREAD in the thread pool so the
+//   docs we index at the same time are parsed on all the cores and the
+//   main loop is free to serve queries meanwhile
+// . returns true if launched, then m_masterLoop is called when it is done
+// . returns false if the caller should do it itself
+// . the code the thread runs must not block, use Multicast or UdpServer,
+//   or touch the caches. QUICKPOLL() is a noop in a thread. mmalloc() is
+//   locked and g_errno is per thread so it can use those.
+// . hashAll() is not done in a thread, it gets to getSummary(), 
+//   getSections(), getDates() and more, and those set up static tables on
+//   their first call that initParseTables() does not
+bool XmlDoc::launchStage ( char stage ) {
+	// main.cpp did not call initParseTables(), so not in a thread
+	if ( ! s_parseTablesReady ) return false;
+	if ( ! g_conf.m_useIndexThreads ) return false;
+	// . only docs being indexed by the spider, not the docs we make
+	//   summaries of for a query. the query needs the doc right now
+	//   and a PARSE_THREAD would just add the queue time to it.
+	if ( m_niceness <= 0 ) return false;
+	if ( m_masterLoop != indexDocWrapper ) return false;
+	// page parser and term list info write into m_pbuf and m_wts
+	if ( m_pbuf || m_storeTermListInfo ) return false;
+	// . only the pool, the disk threads need the stacks Threads.cpp has
+	// . PARSE_THREADs only have a couple of those, so without the pool
+	//   most docs would end up here anyway
+	if ( ! g_threadPool.isReady() ) return false;
+	StageState *ss = (StageState *)mmalloc ( sizeof(StageState),"stgst");
+	if ( ! ss ) { g_errno = 0; return false; }
+	ss->m_xd         = this;
+	ss->m_running    = true;
+	m_stageState     = ss;
+	m_stage          = stage;
+	m_stageThreadOut = true;
+	if ( g_threads.call ( PARSE_THREAD         ,
+			      m_niceness           ,
+			      ss                   ,
+			      stageDoneWrapper     ,
+			      stageStartWrapper_r ) )
+		return true;
+	// the queue is full, do it ourselves
+	mfree ( ss , sizeof(StageState) , "stgst" );
+	m_stageState     = NULL;
+	m_stageThreadOut = false;
+	g_errno = 0;
+	return false;
+}
+
+// . called by reset() when the parse thread is still out
+// . waits for the thread to finish with us, then its callback only frees
+//   the StageState
+void XmlDoc::stopStage ( ) {
+	StageState *ss = m_stageState;
+	// . the thread might still be queued behind other PARSE_THREADs and
+	//   the niceness 0 work in the pool, so this can stall the loop for
+	//   that long plus the parse of one doc. that is ok since we only get
+	//   here when a doc being indexed is deleted from under the spider,
+	//   like on a collection delete or a shutdown, which is rare.
+	// . can not use usleep(), it is a core in the main thread
+	while ( ss->m_running ) sched_yield();
+	ss->m_xd         = NULL;
+	m_stageState     = NULL;
+	m_stageThreadOut = false;
+}
+
+// come back here
+void stageDoneWrapper ( void *state , ThreadEntry *te ) {
+	StageState *ss = (StageState *)state;
+	XmlDoc *THIS = ss->m_xd;
+	mfree ( ss , sizeof(StageState) , "stgst" );
+	// reset() already waited for us and let go of the doc
+	if ( ! THIS ) return;
+	THIS->m_stageState     = NULL;
+	THIS->m_stageThreadOut = false;
+	// . call the master callback
+	// . it will ultimately re-call getXml()
+	THIS->m_masterLoop ( THIS->m_masterState );
+}
+
+// thread starts here
+void *stageStartWrapper_r ( void *state , ThreadEntry *te ) {
+	StageState *ss = (StageState *)state;
+	ss->m_xd->stageStart_r ( );
+	// let reset() know we are done with the doc
+	__sync_synchronize();
+	ss->m_running = false;
+	return NULL;
+}
+
+// . errors are dropped, the getters redo whatever is not valid in the
+//   main thread when m_masterLoop calls them and that sets g_errno there
+void XmlDoc::stageStart_r ( ) {
+	if ( m_stage == XDS_PARSE ) {
+		// . this calls getXml(), getWords() and getBits()
+		// . getXml() validated all it needs before launching us so
+		//   nothing should block
+		Phrases *phrases = getPhrases();
+		if ( phrases && phrases != (Phrases *)-1 ) getPos();
+	}
+}
+
 // . returns -1 if blocked, returns NULL and sets g_errno on error
 // . "sr" is the tagdb Record
 // . "ws" store the terms for PageParser.cpp display
@@ -59,6 +59,7 @@
 #include "Title.h"
 #include "Summary.h"
 #include "Msg8b.h"
+#include "Arena.h"
 #include "Address.h"
 #include "zlib.h" // Z_OK
 #include "Spider.h" // SpiderRequest/SpiderReply definitions
@@ -251,6 +252,13 @@ public:
 
 #define MAXMSG7S 50
 
+// the stages XmlDoc::launchStage() can run in a thread
+#define XDS_PARSE 1
+
+// . main.cpp calls this at startup so the parse stage tables are built
+//   by the main thread before any PARSE_THREAD can use them
+bool initParseTables ( ) ;
+
 class XmlDoc {
 
  public:
@@ -817,6 +825,12 @@ class XmlDoc {
 
 	bool hashNoSplit ( class HashTableX *tt ) ;
 	char *hashAll ( class HashTableX *table ) ;
+
+	// . run a cpu heavy stage in a PARSE_THREAD
+	// . returns false if it should be done right here instead
+	bool launchStage  ( char stage ) ;
+	void stageStart_r ( ) ;
+	void stopStage    ( ) ;
 	int32_t getBoostFromSiteNumInlinks ( int32_t inlinks ) ;
 	bool hashSpiderReply (class SpiderReply *reply ,class HashTableX *tt) ;
 	bool hashMetaTags ( class HashTableX *table ) ;
@@ -1115,6 +1129,9 @@ class XmlDoc {
 	class UdpSlot *m_injectionSlot;
 
 	// . same thing, a little more complicated
+	// . the parsing buffers of the classes below come from this
+	// . reset() frees it all at once
+	Arena      m_arena;
 	// . these classes are only set on demand
 	Xml        m_xml;
 	Links      m_links;
@@ -2102,6 +2119,16 @@ class XmlDoc {
 	RdbList m_storeList;
 	Msg1    m_msg1;
 	bool    m_allHashed;
+
+	// . the stage out in a PARSE_THREAD if m_stageThreadOut is true
+	// . XDS_PARSE sets m_xml, m_words, m_bits, m_phrases and m_pos
+	// . m_stageState is the thread's state, reset() detaches us from it
+	bool       m_stageThreadOut;
+	class StageState *m_stageState;
+	char       m_stage;
+	bool       m_parseStageDone;
+	// posdb term table for getMetaList(), a member so it uses m_arena
+	HashTableX m_tt1;
 	bool checkCachedb ( );
 	bool storeScoredInsertableTermsIntoCachedb ( ) ;
 	bool storeRelatedQueriesIntoCachedb ( ) ;
@@ -259,13 +259,15 @@ int32_t XmlNode::set ( char *node , bool pureXml , int32_t version ) {
 		m_node       = node;
 		m_hasBackTag = false;
 		m_hash       = 0;
-		int32_t i = 0;
+		char *p = node;
 		//char inCDATA = 0;
-		// inc i as int32_t as it's NOT the beginning of a tag
-		while ( node[i] && 
-			(node[i] != '<' || ! isTagStart ( node+i)))//,versin)))
-			i++;
-		m_nodeLen = i;
+		// . inc p as int32_t as it's NOT the beginning of a tag
+		// . strchrnul() looks for the '<' a vector at a time
+		for ( ; ; p++ ) {
+			p = strchrnul ( p , '<' );
+			if ( ! *p || isTagStart ( p ) ) break;
+		}
+		m_nodeLen = p - node;
 		m_pairTagNum = -1;
 		return m_nodeLen;
 	}
@@ -452,6 +452,32 @@ inline bool is_alnum_utf8 ( unsigned char *src ) {
 	return ucIsAlnum ( x );
 }
 
+// . skip over a run of printable ascii punct, but stop on a '<'
+// . for the word loops in Words.cpp so they do not utf8 decode and
+//   quickpoll every char of the runs that are plain ascii
+inline char *skipAsciiPunct ( char *p ) {
+	while ( is_ascii(*p) && ! is_alnum_a(*p) && *p != '<' ) p++;
+	return p;
+}
+
+// skip over a run of ascii alnum chars
+inline char *skipAsciiAlnum ( char *p ) {
+	while ( is_ascii(*p) && is_alnum_a(*p) ) p++;
+	return p;
+}
+
+// same as above but for ranges that are not \0 terminated at "pend"
+inline char *skipAsciiPunct ( char *p , char *pend ) {
+	while ( p < pend && is_ascii(*p) && ! is_alnum_a(*p) && *p != '<' )
+		p++;
+	return p;
+}
+
+inline char *skipAsciiAlnum ( char *p , char *pend ) {
+	while ( p < pend && is_ascii(*p) && is_alnum_a(*p) ) p++;
+	return p;
+}
+
 inline bool is_alpha_utf8 ( char *src ) {
 	// if in ascii do it quickly
 	if ( is_ascii3(*src) ) return is_alpha_a ( *src );
@@ -278,6 +278,8 @@ bool bucketstest ( char *dbname ) ;
 bool hashtest    ( ) ;
 // how fast to parse the content of this docId?
 bool parseTest ( char *coll , int64_t docId , char *query );
+// how fast to parse the content of the first maxDocs title recs?
+bool parseCorpusTest ( char *coll , int32_t maxDocs );
 //bool carveTest ( uint32_t radius, char *fname, char* query );
 bool summaryTest1   ( char *rec, int32_t listSize, char *coll , int64_t docId ,
 		      char *query );
@@ -818,6 +820,10 @@ int main2 ( int argc , char *argv[] ) {
 
 			"parsetest <docIdToTest> [coll] [query]\n\t"
 			"parser speed tests\n\n"
+
+			"parsecorpustest [coll] [maxDocs]\n\t"
+			"Xml::set() and Words::set() speed over the "
+			"title recs\n\n"
 			*/
 
 			"thrutest [dir] [fileSize]\n\tdisk sequential "
@@ -1043,8 +1049,6 @@ int main2 ( int argc , char *argv[] ) {
 		SafeBuf sb2;
 		sb2.brify2 ( sb.getBufStart() , 60 , "\n\t" , false );
 		fprintf(stdout,"%s",sb2.getBufStart());
-		// disable printing of used memory
-		g_mem.m_used = 0;
 		return 0;
 	}
 
@@ -1294,6 +1298,16 @@ int main2 ( int argc , char *argv[] ) {
 		parseTest( coll, docid, query );
 		return 0;
 	}
+	if ( strcmp ( cmd , "parsecorpustest"  ) == 0 ) {
+		if ( ! hashinit() ) {
+			log("db: Failed to init hashtable." ); return 1; }
+		char   *coll    = "";
+		int32_t maxDocs = 1000;
+		if ( cmdarg+2 <= argc ) coll    = argv[cmdarg+1];
+		if ( cmdarg+3 <= argc ) maxDocs = atol(argv[cmdarg+2]);
+		parseCorpusTest ( coll , maxDocs );
+		return 0;
+	}
 
 	/*
         if ( strcmp ( cmd , "carvetest"  ) == 0 ) {
@@ -4003,6 +4017,10 @@ int main2 ( int argc , char *argv[] ) {
 	json.test();
 	json.reset();
 
+	// . build the tables the parse stage uses before the spider can
+	//   parse docs in PARSE_THREADs. if it fails they are not threaded.
+	initParseTables();
+
 	// . start the spiderloop
 	// . comment out when testing SpiderCache
 	g_spiderLoop.startLoop();
@@ -5964,6 +5982,7 @@ bool registerMsgHandlers2(){
 
 	//if(! g_udpServer.registerHandler(0x10,handleRequest10)) return false;
 	if ( ! g_udpServer.registerHandler(0xc1,handleRequestc1)) return false;
+	if ( ! Msg39::initResultsCache() ) return false;
 	if ( ! g_udpServer.registerHandler(0x39,handleRequest39)) return false;
 	if ( ! g_udpServer.registerHandler(0x2c,handleRequest2c)) return false;
 	if ( ! g_udpServer.registerHandler(0x12,handleRequest12)) return false;
@@ -12868,6 +12887,126 @@ bool parseTest ( char *coll , int64_t docId , char *query ) {
 	return true;
 }	
 
+// . time Xml::set() and Words::set() over the content of the first
+//   "maxDocs" title recs so one odd doc does not skew it like parsetest
+// . the content is parsed as many times as it is indexed and summarized
+bool parseCorpusTest ( char *coll , int32_t maxDocs ) {
+	g_conf.m_maxMem = 2000000000LL; // 2G
+	if (!ucInit(g_hostdb.m_dir, true)) 
+		return log("Unicode initialization failed!");
+	g_titledb.init ();
+	g_titledb.getRdb()->addRdbBase1 ( coll );
+	CollectionRec *cr = g_collectiondb.getRec(coll);
+	if ( ! cr ) return log("build: parsecorpustest: no coll %s",coll);
+	log(LOG_INIT,"build: Testing parse speed of %"INT32" title recs.",
+	    maxDocs);
+	g_threads.disableThreads();
+	key_t startKey;
+	key_t endKey;
+	startKey.setMin();
+	endKey.setMax();
+	// a niceness of 0 tells it to block until it gets results!!
+	Msg5 msg5;
+	Msg5 msg5b;
+	RdbList list;
+	XmlDoc *xd;
+	try { xd = new (XmlDoc); }
+	catch ( ... ) {
+		return log("build: parsecorpustest: could not alloc xmldoc");
+	}
+	mnew ( xd , sizeof(XmlDoc) , "ptxd" );
+	int32_t numDocs  = 0;
+	int64_t numBytes = 0;
+	int64_t numNodes = 0;
+	int64_t numWords = 0;
+	int64_t xmlTime  = 0;
+	int64_t wordTime = 0;
+	Xml   xml;
+	Words words;
+
+ loop:
+	if ( ! msg5.getList ( RDB_TITLEDB    ,
+			      cr->m_collnum  ,
+			      &list          ,
+			      startKey       ,
+			      endKey         ,
+			      1024*1024      , // min rec sizes
+			      true           , // include tree?
+			      false          , // add to cache?
+			      0              , // max cache age
+			      0              , // startFileNum
+			      -1             , // m_numFiles   
+			      NULL           , // state 
+			      NULL           , // callback
+			      0              , // niceness
+			      false          , // do error correction?
+			      NULL           , // cache key ptr
+			      0              , // retry num
+			      -1             , // maxRetries
+			      true           , // compensate for merge
+			      -1LL           , // sync point
+			      &msg5b         ))
+		return log(LOG_LOGIC,"build: getList did not block.");
+
+	for ( list.resetListPtr() ; 
+	      ! list.isExhausted() && numDocs < maxDocs ;
+	      list.skipCurrentRecord() ) {
+		key_t k = list.getCurrentKey();
+		// skip deletes
+		if ( (k.n0 & 0x01) == 0 ) continue;
+		xd->reset();
+		if ( ! xd->set2 ( list.getCurrentRec() ,
+				  list.getCurrentRecSize() ,
+				  coll , NULL , 0 ) )
+			continue;
+		char   *content    = xd->ptr_utf8Content;
+		int32_t contentLen = xd->size_utf8Content - 1;
+		if ( ! content || contentLen <= 0 ) continue;
+		int64_t t = gettimeofdayInMicroseconds();
+		if ( ! xml.set ( content , contentLen , 
+				 false, 0, false, xd->m_version ,
+				 true , // setparents
+				 0 , // niceness 
+				 xd->m_contentType ) )
+			return log("build: parsecorpustest: xml set: %s",
+				   mstrerror(g_errno));
+		int64_t e = gettimeofdayInMicroseconds();
+		xmlTime += e - t;
+		if ( ! words.set ( &xml , true , 0 ) )
+			return log("build: parsecorpustest: words set: %s",
+				   mstrerror(g_errno));
+		t = gettimeofdayInMicroseconds();
+		wordTime += t - e;
+		numDocs++;
+		numBytes += contentLen;
+		numNodes += xml.getNumNodes();
+		numWords += words.getNumWords();
+	}
+
+	// get the next list unless we are done
+	if ( numDocs < maxDocs && ! list.isEmpty() ) {
+		startKey = *(key_t *)list.getLastKey();
+		startKey += (uint32_t) 1;
+		// watch out for wrap around
+		if ( startKey >= *(key_t *)list.getLastKey() ) goto loop;
+	}
+
+	mdelete ( xd , sizeof(XmlDoc) , "ptxd" );
+	delete ( xd );
+
+	if ( numDocs <= 0 ) return log("build: parsecorpustest: no docs.");
+	log("build: Parsed %"INT32" docs, %"INT64" bytes, %"INT64" nodes, "
+	    "%"INT64" words.", numDocs,numBytes,numNodes,numWords);
+	log("build: Xml::set() took %.3f ms a doc, %.3f bytes/usec.",
+	    (double)xmlTime/1000.0/numDocs,
+	    (double)numBytes/(xmlTime?xmlTime:1));
+	log("build: Words::set(xml,computeIds=true) took %.3f ms a doc, "
+	    "%.3f bytes/usec.",
+	    (double)wordTime/1000.0/numDocs,
+	    (double)numBytes/(wordTime?wordTime:1));
+	return true;
+}
+
 /*
 bool carveTest ( uint32_t radius, char *fname, char* query ) {
 	Query q;
@@ -16579,7 +16718,7 @@ bool memTest() {
 	fprintf(stderr, "memtest: Was able to allocate %"INT64" bytes of a "
 		"total of "
 	    "%"INT64" bytes of memory attempted.\n",
-	    g_mem.m_used,g_conf.m_maxMem);
+	    g_mem.getUsedMem(),g_conf.m_maxMem);
 
 	return true;
 